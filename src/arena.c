@@ -0,0 +1,187 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE   4096
+#define ARENA_ALIGN        ((size_t)8)  /* pointers, 64-bit ints, regex_t */
+#define ARENA_ROUND(n)     (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena_block {
+    struct arena_block   *next;
+    size_t                size;     /* usable bytes after the header */
+    size_t                used;
+    max_align_t           data[];
+};
+
+struct arena_cleanup {
+    struct arena_cleanup       *next;
+    pa_policy_arena_cleanup_cb  cb;
+    void                       *data;
+};
+
+struct pa_policy_arena {
+    char                 *name;
+    struct arena_block   *blocks;   /* the current block is the first */
+    struct arena_cleanup *cleanups;
+    size_t                size;     /* bytes held in blocks */
+    size_t                used;     /* bytes handed out */
+};
+
+/* all arenas together, for reporting the memory taken by the rules */
+static size_t arena_total;
+static size_t arena_peak;
+
+static struct arena_block *block_new(struct pa_policy_arena *, size_t);
+
+
+struct pa_policy_arena *pa_policy_arena_new(const char *name)
+{
+    struct pa_policy_arena *arena;
+
+    pa_assert(name);
+
+    arena = pa_xnew0(struct pa_policy_arena, 1);
+    arena->name = pa_xstrdup(name);
+
+    return arena;
+}
+
+void pa_policy_arena_free(struct pa_policy_arena *arena)
+{
+    struct arena_cleanup *c;
+    struct arena_block   *b;
+    struct arena_block   *next;
+
+    if (!arena)
+        return;
+
+    /* the records are in the arena themselves, so run them all first */
+    for (c = arena->cleanups;  c;  c = c->next)
+        c->cb(c->data);
+
+    for (b = arena->blocks;  b;  b = next) {
+        next = b->next;
+        pa_xfree(b);
+    }
+
+    pa_log_debug("released %s arena (%zu bytes used of %zu)",
+                 arena->name, arena->used, arena->size);
+
+    arena_total -= arena->size;
+
+    pa_xfree(arena->name);
+    pa_xfree(arena);
+}
+
+void *pa_policy_arena_alloc(struct pa_policy_arena *arena, size_t size)
+{
+    struct arena_block *b;
+    void               *p;
+
+    pa_assert(arena);
+
+    size = ARENA_ROUND(size ? size : 1);
+
+    if (!(b = arena->blocks) || b->size - b->used < size) {
+        if (size > ARENA_BLOCK_SIZE / 4) {
+            /* a block of its own, so the current one is not wasted */
+            b = block_new(arena, size);
+
+            if (arena->blocks) {
+                b->next = arena->blocks->next;
+                arena->blocks->next = b;
+            }
+            else
+                arena->blocks = b;
+        }
+        else {
+            b = block_new(arena, ARENA_BLOCK_SIZE);
+            b->next = arena->blocks;
+            arena->blocks = b;
+        }
+    }
+
+    p = (char *)b->data + b->used;
+    b->used += size;
+    arena->used += size;
+
+    return memset(p, 0, size);
+}
+
+char *pa_policy_arena_strdup(struct pa_policy_arena *arena, const char *s)
+{
+    size_t len;
+
+    if (!s)
+        return NULL;
+
+    len = strlen(s) + 1;
+
+    return memcpy(pa_policy_arena_alloc(arena, len), s, len);
+}
+
+void pa_policy_arena_cleanup(struct pa_policy_arena *arena,
+                             pa_policy_arena_cleanup_cb cb, void *data)
+{
+    struct arena_cleanup *c;
+
+    pa_assert(arena);
+    pa_assert(cb);
+
+    c = pa_policy_arena_xnew0(arena, struct arena_cleanup, 1);
+    c->cb   = cb;
+    c->data = data;
+    c->next = arena->cleanups;
+
+    arena->cleanups = c;
+}
+
+size_t pa_policy_arena_size(struct pa_policy_arena *arena)
+{
+    return arena ? arena->size : 0;
+}
+
+void pa_policy_arena_log_usage(void)
+{
+    pa_log_info("policy rules take %zu bytes in arenas (peak %zu bytes)",
+                arena_total, arena_peak);
+}
+
+
+static struct arena_block *block_new(struct pa_policy_arena *arena,
+                                     size_t size)
+{
+    struct arena_block *b;
+
+    b = pa_xmalloc(sizeof(*b) + size);
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+
+    arena->size += size;
+    arena_total += size;
+
+    if (arena_total > arena_peak)
+        arena_peak = arena_total;
+
+    return b;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
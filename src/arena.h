@@ -0,0 +1,44 @@
+#ifndef foopolicyarenafoo
+#define foopolicyarenafoo
+
+#include <stddef.h>
+
+/*
+ * Arena for data that lives as long as the rule set it belongs to: the
+ * match objects, strings and definition arrays built from the config.
+ * Allocations are carved in order from large blocks, so definitions that
+ * are evaluated together sit next to each other, and the whole rule set
+ * is released at once. Nothing can be freed individually; a replaced
+ * definition just stays in the arena until the arena is released.
+ *
+ * Resources that are not memory of the arena (compiled regexps,
+ * proplists, runtime strings on the heap) are released by the cleanup
+ * callbacks registered on the arena, in the reverse order of
+ * registration, before the blocks are freed.
+ */
+
+struct pa_policy_arena;
+
+typedef void (*pa_policy_arena_cleanup_cb)(void *);
+
+#define pa_policy_arena_xnew0(a, type, n) \
+    ((type *) pa_policy_arena_alloc((a), sizeof(type) * (n)))
+
+struct pa_policy_arena *pa_policy_arena_new(const char *);
+void   pa_policy_arena_free(struct pa_policy_arena *);
+void  *pa_policy_arena_alloc(struct pa_policy_arena *, size_t);
+char  *pa_policy_arena_strdup(struct pa_policy_arena *, const char *);
+void   pa_policy_arena_cleanup(struct pa_policy_arena *,
+                               pa_policy_arena_cleanup_cb, void *);
+size_t pa_policy_arena_size(struct pa_policy_arena *);
+void   pa_policy_arena_log_usage(void);
+
+#endif /* foopolicyarenafoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -10,7 +10,11 @@
 #include "classify.h"
 #include "context.h"
 #include "policy.h"
+#include "route-plan.h"
+#include "trace.h"
 #include "log.h"
+#include "stats.h"
+#include "probes.h"
 
 
 /* hooks */
@@ -102,13 +106,9 @@ pa_hashmap *pa_card_ext_get_profiles(struct pa_card *card)
 
 int pa_card_ext_set_profile(struct userdata *u, char *type)
 {    
-    void            *state = NULL;
-    pa_idxset       *idxset;
+    struct pa_route_plan *plan;
     struct pa_card  *card;
     struct pa_classify_card_data *data;
-    struct pa_classify_card_data *datas[PA_POLICY_CARD_MAX_DEFS] = { NULL, NULL };
-    struct pa_card  *cards[PA_POLICY_CARD_MAX_DEFS] = { NULL, NULL };
-    int              priority;
     const char      *pn;
     const char      *override_pn;
     const char      *cn;
@@ -119,27 +119,15 @@ int pa_card_ext_set_profile(struct userdata *u, char *type)
 
     pa_assert(u);
     pa_assert(u->core);
-    pa_assert_se((idxset = u->core->cards));
 
     sts = 0;
+    if (!(plan = pa_policy_route_plan_get(u, type)))
+        return 0;
 
-    while ((card = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
-        if (pa_classify_is_card_typeof(u, card, type, &data, &priority)) {
-            if (priority == 0) {
-                datas[0] = data;
-                cards[0] = card;
-            }
-            if (priority == 1) {
-                datas[1] = data;
-                cards[1] = card;
-            }
-        }
-    }
+    for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && plan->card_data[i]; i++) {
 
-    for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && datas[i]; i++) {
-
-        data = datas[i];
-        card = cards[i];
+        data = plan->card_data[i];
+        card = plan->cards[i];
 
         ap = card->active_profile;
         pn = data->profile;
@@ -153,6 +141,8 @@ int pa_card_ext_set_profile(struct userdata *u, char *type)
         cn = pa_card_ext_get_name(card);
 
         if (new_profile && (!ap || ap != new_profile)) {
+            PA_POLICY_PROBE3(card_set_profile, card->index, cn, pn);
+
             if (pa_card_set_profile(card, new_profile, false) < 0) {
                 sts = -1;
                 pa_log("failed to set card '%s' profile to '%s'", cn, pn);
@@ -170,8 +160,11 @@ static pa_hook_result_t card_put(void *hook_data, void *call_data,
 {
     struct pa_card  *card = (struct pa_card *)call_data;
     struct userdata *u    = (struct userdata *)slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_new_card(u, card);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_card_put, start);
 
     return PA_HOOK_OK;
 }
@@ -182,8 +175,11 @@ static pa_hook_result_t card_unlink(void *hook_data, void *call_data,
 {
     struct pa_card  *card = (struct pa_card *)call_data;
     struct userdata *u    = (struct userdata *)slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_removed_card(u, card);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_card_unlink, start);
 
     return PA_HOOK_OK;
 }
@@ -193,8 +189,11 @@ static pa_hook_result_t card_avail(void *hook_data, void *call_data,
 {
     pa_card_profile *cp = (pa_card_profile *) call_data;
     struct userdata *u  = (struct userdata *) slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_card_profile_available_changed(u, cp->card);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_card_profile_available, start);
 
     return PA_HOOK_OK;
 }
@@ -204,8 +203,11 @@ static pa_hook_result_t card_profile_changed(void *hook_data, void *call_data,
 {
     pa_card         *card = call_data;
     struct userdata *u    = slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_card_profile_changed(u, card);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_card_profile_changed, start);
 
     return PA_HOOK_OK;
 }
@@ -222,9 +224,11 @@ static void handle_new_card(struct userdata *u, struct pa_card *card)
         name = pa_card_ext_get_name(card);
         idx  = card->index;
 
+        pa_policy_trace_event(u, pa_policy_trace_card_put, name);
         pa_policy_context_register(u, pa_policy_object_card, name, card);
+        pa_policy_route_plan_add_card(u, card);
 
-        if (pa_policy_log_level_debug()) {
+        if (pa_policy_log_enabled(u, pa_policy_log_device)) {
             pa_classify_card(u, card, 0,0, false, &r);
             buf = pa_policy_log_concat(r->types, r->count);
 
@@ -260,9 +264,11 @@ static void handle_removed_card(struct userdata *u, struct pa_card *card)
         name = pa_card_ext_get_name(card);
         idx  = card->index;
 
+        pa_policy_trace_event(u, pa_policy_trace_card_unlink, name);
         pa_policy_context_unregister(u, pa_policy_object_card, name, card, idx);
+        pa_policy_route_plan_remove_card(u, card);
 
-        if (pa_policy_log_level_debug()) {
+        if (pa_policy_log_enabled(u, pa_policy_log_device)) {
             pa_classify_card(u, card, 0, 0, false, &r);
             buf = pa_policy_log_concat(r->types, r->count);
             pa_log_debug("remove card '%s' (idx=%d%s%s)",
@@ -297,7 +303,7 @@ static void handle_card_profile_changed(struct userdata *u, pa_card *card)
     p = card->active_profile;
 
     if (r->count > 0) {
-        if (pa_policy_log_level_debug()) {
+        if (pa_policy_log_enabled(u, pa_policy_log_device)) {
             char *buf;
             buf = pa_policy_log_concat(r->types, r->count);
             pa_log_debug("card profile changed: type=\"%s\", profile=\"%s\"", buf, p->name);
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <time.h>
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -13,6 +14,7 @@
 #include <pulsecore/core.h>
 #include <pulsecore/hook-list.h>
 #include <pulsecore/core-error.h>
+#include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 
 #include "classify.h"
@@ -26,7 +28,37 @@
 #include "variable.h"
 #include "context.h"
 #include "match.h"
-
+#include "arena.h"
+#include "intern.h"
+#include "module-pool.h"
+#include "log.h"
+#include "stats.h"
+#include "probes.h"
+
+#define BITS_WORD(n)    ((n) / 32)
+#define BITS_MASK(n)    (1U << ((n) % 32))
+#define BITS_WORDS(n)   (((n) + 31) / 32)
+#define BITS_TEST(b, n) ((b)->bits[BITS_WORD(n)] & BITS_MASK(n))
+
+#define DEFS_MIN        8       /* definitions in the first array */
+#define DEVICES_SIZE(n) (sizeof(struct pa_classify_device) + \
+                         sizeof(struct pa_classify_device_def) * ((n) - 1))
+#define CARDS_SIZE(n)   (sizeof(struct pa_classify_card) + \
+                         sizeof(struct pa_classify_card_def) * ((n) - 1))
+
+struct match_bits {
+    uint32_t  index;            /* index of the object, to detect reuse */
+    uint32_t  bits[1];          /* bit per definition that matched */
+};
+
+struct pa_classify_stream_diff {        /* old vs. reloaded stream defs */
+    struct pa_policy_arena        *arena;   /* keeps the old defs */
+    struct pa_classify_stream_def *defs;
+    bool                           prepared;
+    bool                           all;     /* defs reordered, check all */
+    pa_hashmap                    *twins;   /* new def -> identical old def */
+    pa_idxset                     *changed; /* defs only in one of the sets */
+};
 
 
 static const char *find_group_for_client(struct userdata *, struct pa_client *,
@@ -37,20 +69,21 @@ static char *arg_dump(int, char **, char *, size_t);
 
 static void app_id_free(pa_classify_app_id *app);
 static void app_id_map_free_all(pa_hashmap *app_id_map);
-static void app_id_map_insert(pa_hashmap *app_id_map, const char *app_id,
-                              const char *prop, enum pa_classify_method method,
+static void app_id_map_insert(struct userdata *u, pa_hashmap *app_id_map,
+                              const char *app_id, const char *prop,
+                              enum pa_classify_method method,
                               const char *arg, const char *group);
 static void app_id_map_remove(pa_hashmap *app_id_map, const char *app_id,
                               const char *prop, enum pa_classify_method method,
                               const char *arg);
-static const char *app_id_get_group(pa_hashmap *map, const char *app_id,
+static const char *app_id_get_group(struct userdata *u, pa_hashmap *map,
+                                    const char *app_id,
                                     pa_proplist *proplist);
 static pa_classify_app_id *app_id_map_find(pa_hashmap *app_id_map, const char *app_id,
                                            const char *prop, enum pa_classify_method method,
                                            const char *arg);
 
-static void streams_free(struct pa_classify_stream_def *);
-static void streams_add(struct userdata *u, struct pa_classify_stream_def **, const char *,
+static void streams_add(struct userdata *u, struct pa_classify_stream *, const char *,
                         enum pa_classify_method, const char *, const char *,
                         const char *, uid_t, const char *, const char *, uint32_t,
                         const char *);
@@ -60,38 +93,71 @@ static struct pa_classify_stream_def
             *streams_find(struct userdata *u, struct pa_classify_stream_def **, pa_proplist *,
                           const char *, const char *, uid_t, const char *,
                           struct pa_classify_stream_def **);
+static bool stream_def_may_match(struct userdata *, struct pa_classify_stream_def *,
+                                 pa_proplist *, const char *, uid_t, const char *);
+static char *stream_def_key(struct pa_classify_stream_def *);
+static void stream_diff_prepare(struct pa_classify_stream_diff *,
+                                struct pa_classify_stream_def *);
 
-static void device_def_free(struct pa_classify_device_def *d);
-static void devices_free(struct pa_classify_device *);
+static struct pa_classify_device *devices_new(struct pa_policy_arena *);
 static void devices_add(struct userdata *u, struct pa_classify_device **p_devices, const char *type,
                         enum pa_policy_object_type obj_type, const char *prop,
                         enum pa_classify_method method, const char *arg,
                         pa_idxset *ports, const char *module, const char *module_args,
                         uint32_t flags, uint32_t port_change_delay);
-static int devices_classify(struct pa_classify_device *devices, const void *object,
+static int devices_classify(struct pa_classify_device *devices,
+                            const struct match_bits *,
                             uint32_t flag_mask, uint32_t flag_value,
                             struct pa_classify_result **result);
-static int devices_is_typeof(struct pa_classify_device_def *defs, const void *object,
+static int devices_is_typeof(struct pa_classify_device_def *defs,
+                             const struct match_bits *,
                              const char *type, struct pa_classify_device_data **data);
 
-static void card_def_free(struct pa_classify_card_def *d);
-static void cards_free(struct pa_classify_card *);
+static struct pa_classify_card *cards_new(struct pa_policy_arena *);
 static void cards_add(struct userdata *u, struct pa_classify_card **, const char *,
                       enum pa_classify_method[PA_POLICY_CARD_MAX_DEFS], char **, char **,
                       uint32_t[PA_POLICY_CARD_MAX_DEFS]);
-static int  cards_classify(struct pa_classify_card *, pa_card *, pa_hashmap *card_profiles,
-                           uint32_t,uint32_t, bool reclassify, struct pa_classify_result **result);
-static int card_is_typeof(struct pa_classify_card_def *, pa_card *card,
+static int  cards_classify(struct pa_classify_card *, const struct match_bits *,
+                           pa_hashmap *card_profiles, uint32_t,uint32_t,
+                           bool reclassify, struct pa_classify_result **result);
+static int card_is_typeof(struct pa_classify_card_def *, const struct match_bits *,
                           const char *, struct pa_classify_card_data **, int *priority);
 
-static int port_device_is_typeof(struct pa_classify_device_def *,
+static void cache_init(struct userdata *, struct pa_classify_cache *,
+                       pa_core_hook_t, pa_core_hook_t);
+static void cache_done(struct pa_classify_cache *);
+static void cache_flush(struct pa_classify_cache *);
+static pa_hook_result_t cache_forget(void *, void *, void *);
+static const struct match_bits *device_bits(struct userdata *,
+                                            struct pa_classify_cache *,
+                                            struct pa_classify_device *,
+                                            const void *, uint32_t);
+static const struct match_bits *card_bits(struct userdata *,
+                                          struct pa_classify_cache *,
+                                          struct pa_classify_card *, pa_card *);
+
+static int port_device_is_typeof(struct userdata *,
+                                 struct pa_classify_device_def *,
                                  enum pa_policy_object_type obj_type,
                                  void *obj,
                                  const char *,
                                  struct pa_classify_device_data **);
+static bool device_hidden(struct userdata *, const void *);
+
+static void *defs_grow(struct pa_policy_arena *, const void *, size_t, size_t);
+static void match_prop_append(pa_strbuf *, pa_policy_match_object *,
+                              enum pa_policy_object_type, pa_proplist *);
+
+static void classify_update_module_defer(struct userdata *, uint32_t,
+                                         struct pa_classify_device_data *);
+static void classify_pending_clear(struct pa_classify_module *);
+static void module_loads_cb(pa_mainloop_api *, pa_defer_event *, void *);
 
 static pa_hook_result_t module_unlink_hook_cb(pa_core *c, pa_module *m, struct pa_classify *cl);
 
+static uint64_t timing_start(struct userdata *, struct pa_classify *);
+static void timing_stop(struct pa_classify *, enum pa_classify_op, uint64_t);
+
 
 static struct pa_classify_result *classify_result_malloc(uint32_t type_count)
 {
@@ -110,6 +176,12 @@ static void classify_result_append(struct pa_classify_result **r, const char *ty
     (*r)->count++;
 }
 
+/* the devices of the modules in the module pool have no type */
+static bool device_hidden(struct userdata *u, const void *device)
+{
+    return u->modpool && pa_policy_module_pool_hides(u->modpool, device);
+}
+
 static void unload_module(pa_module *m)
 {
     if (m) {
@@ -127,13 +199,27 @@ struct pa_classify *pa_classify_new(struct userdata *u)
 
     cl = pa_xnew0(struct pa_classify, 1);
 
-    cl->sinks   = pa_xnew0(struct pa_classify_device, 1);
-    cl->sources = pa_xnew0(struct pa_classify_device, 1);
-    cl->cards   = pa_xnew0(struct pa_classify_card, 1);
+    cl->stream_arena = pa_policy_arena_new("stream");
+    cl->device_arena = pa_policy_arena_new("device");
+    cl->card_arena   = pa_policy_arena_new("card");
+
+    cl->sinks   = devices_new(cl->device_arena);
+    cl->sources = devices_new(cl->device_arena);
+    cl->cards   = cards_new(cl->card_arena);
     cl->streams.app_id_map = pa_hashmap_new_full(pa_idxset_string_hash_func,
                                                  pa_idxset_string_compare_func,
                                                  pa_xfree,
                                                  NULL);
+    cl->streams.sname_map = pa_hashmap_new(pa_idxset_string_hash_func,
+                                           pa_idxset_string_compare_func);
+    cl->streams.dflt_group = pa_policy_intern(PA_POLICY_DEFAULT_GROUP_NAME);
+
+    cache_init(u, &cl->sink_cache, PA_CORE_HOOK_SINK_PROPLIST_CHANGED,
+               PA_CORE_HOOK_SINK_UNLINK_POST);
+    cache_init(u, &cl->source_cache, PA_CORE_HOOK_SOURCE_PROPLIST_CHANGED,
+               PA_CORE_HOOK_SOURCE_UNLINK_POST);
+    cache_init(u, &cl->card_cache, PA_CORE_HOOK_CARD_PROPLIST_CHANGED,
+               PA_CORE_HOOK_CARD_UNLINK);
 
     return cl;
 }
@@ -144,21 +230,213 @@ void pa_classify_free(struct userdata *u)
     uint32_t i;
 
     if (cl) {
+        pa_classify_log_timing(u);
         app_id_map_free_all(cl->streams.app_id_map);
-        streams_free(cl->streams.defs);
-        devices_free(cl->sinks);
-        devices_free(cl->sources);
-        cards_free(cl->cards);
+        pa_hashmap_free(cl->streams.sname_map);
+        pa_xfree(cl->streams.active_sname);
+        cache_done(&cl->sink_cache);
+        cache_done(&cl->source_cache);
+        cache_done(&cl->card_cache);
+        pa_policy_arena_free(cl->stream_arena);
+        pa_policy_arena_free(cl->device_arena);
+        pa_policy_arena_free(cl->card_arena);
         if (cl->module_unlink_hook_slot)
             pa_hook_slot_free(cl->module_unlink_hook_slot);
 
-        for (i = 0; i < PA_POLICY_MODULE_COUNT; i++)
+        if (cl->load_event)
+            u->core->mainloop->defer_free(cl->load_event);
+
+        for (i = 0; i < PA_POLICY_MODULE_COUNT; i++) {
             unload_module(cl->module[i].module);
+            pa_xfree(cl->module[i].module_name);
+            pa_xfree(cl->module[i].module_args);
+            pa_xfree(cl->pending[i].module_name);
+            pa_xfree(cl->pending[i].module_args);
+        }
 
         pa_xfree(cl);
     }
 }
 
+void pa_classify_enable_timing(struct userdata *u)
+{
+    pa_assert(u);
+    pa_assert(u->classify);
+
+    u->classify->timing = true;
+}
+
+void pa_classify_log_timing(struct userdata *u)
+{
+    static const char *names[pa_classify_op_max] = {
+        "stream", "sink", "source", "card"
+    };
+
+    struct pa_classify_op_stats *st;
+    int i;
+
+    pa_assert(u);
+    pa_assert(u->classify);
+
+    if (!u->classify->timing)
+        return;
+
+    for (i = 0;  i < pa_classify_op_max;  i++) {
+        st = u->classify->stats + i;
+
+        if (st->calls) {
+            pa_log_info("classify %s: %llu calls, %llu ns/op", names[i],
+                        (unsigned long long)st->calls,
+                        (unsigned long long)(st->nsec / st->calls));
+        }
+    }
+}
+
+struct pa_classify_stream_diff *pa_classify_reset_streams(struct userdata *u)
+{
+    struct pa_classify *cl;
+    struct pa_classify_stream_diff *diff;
+
+    pa_assert(u);
+    pa_assert_se((cl = u->classify));
+
+    /* The app-id registrations come from D-Bus, not from the config, and
+     * the active routing sink is kept so that the new definitions get
+     * their active state in streams_add(). The old definitions stay in
+     * their arena until the reloaded ones are compared to them. */
+    diff = pa_xnew0(struct pa_classify_stream_diff, 1);
+    diff->arena = cl->stream_arena;
+    diff->defs  = cl->streams.defs;
+
+    pa_hashmap_remove_all(cl->streams.sname_map);
+    cl->streams.defs = NULL;
+
+    cl->stream_arena = pa_policy_arena_new("stream");
+
+    return diff;
+}
+
+void pa_classify_stream_diff_free(struct pa_classify_stream_diff *diff)
+{
+    if (diff) {
+        if (diff->twins)
+            pa_hashmap_free(diff->twins);
+        if (diff->changed)
+            pa_idxset_free(diff->changed, NULL);
+
+        pa_policy_arena_free(diff->arena);
+        pa_xfree(diff);
+    }
+}
+
+bool pa_classify_stream_diff_check(struct userdata *u,
+                                   struct pa_classify_stream_diff *diff,
+                                   struct pa_client *client,
+                                   pa_proplist *proplist,
+                                   const char **old_group,
+                                   const char **new_group)
+{
+    struct pa_classify *cl;
+    struct pa_classify_stream_def *d;
+    struct pa_classify_stream_def *old_def;
+    struct pa_classify_stream_def *new_def;
+    const char *clnam = "";
+    uid_t       uid   = (uid_t) -1;
+    const char *exe   = "";
+    uint32_t    idx;
+    bool        affected;
+
+    pa_assert(u);
+    pa_assert_se((cl = u->classify));
+    pa_assert(diff);
+    pa_assert(proplist);
+    pa_assert(old_group);
+    pa_assert(new_group);
+
+    if (!diff->prepared)
+        stream_diff_prepare(diff, cl->streams.defs);
+
+    if (!diff->all && pa_idxset_isempty(diff->changed))
+        return false;
+
+    /* same client data as find_group_for_client() uses */
+    if (client == NULL) {
+        if (!(exe = pa_proplist_gets(proplist, PA_PROP_APPLICATION_PROCESS_BINARY)))
+            exe = "";
+    }
+    else {
+        clnam = pa_client_ext_name(client);
+        uid   = pa_client_ext_uid(client);
+        exe   = pa_client_ext_exe(client);
+    }
+
+    /* With the order of the unchanged definitions kept, the first match
+     * can only differ for a stream that some changed definition matches. */
+    if (!diff->all) {
+        affected = false;
+
+        PA_IDXSET_FOREACH(d, diff->changed, idx) {
+            if (stream_def_may_match(u, d, proplist, clnam, uid, exe)) {
+                affected = true;
+                break;
+            }
+        }
+
+        if (!affected)
+            return false;
+    }
+
+    /* the app-id registrations take precedence over the definitions */
+    if (client && app_id_get_group(u, cl->streams.app_id_map,
+                                   pa_client_ext_app_id(client), proplist))
+        return false;
+
+    old_def = streams_find(u, &diff->defs, proplist, clnam, NULL, uid, exe, NULL);
+    new_def = streams_find(u, &cl->streams.defs, proplist, clnam, NULL, uid, exe, NULL);
+
+    if (new_def && old_def && pa_hashmap_get(diff->twins, new_def) == old_def)
+        return false;
+
+    if (!new_def && !old_def)
+        return false;
+
+    *old_group = old_def ? old_def->group : cl->streams.dflt_group;
+    *new_group = new_def ? new_def->group : cl->streams.dflt_group;
+
+    return true;
+}
+
+void pa_classify_reset_devices(struct userdata *u)
+{
+    struct pa_classify *cl;
+
+    pa_assert(u);
+    pa_assert_se((cl = u->classify));
+
+    cache_flush(&cl->sink_cache);
+    cache_flush(&cl->source_cache);
+
+    pa_policy_arena_free(cl->device_arena);
+    cl->device_arena = pa_policy_arena_new("device");
+
+    cl->sinks   = devices_new(cl->device_arena);
+    cl->sources = devices_new(cl->device_arena);
+}
+
+void pa_classify_reset_cards(struct userdata *u)
+{
+    struct pa_classify *cl;
+
+    pa_assert(u);
+    pa_assert_se((cl = u->classify));
+
+    cache_flush(&cl->card_cache);
+
+    pa_policy_arena_free(cl->card_arena);
+    cl->card_arena = pa_policy_arena_new("card");
+    cl->cards = cards_new(cl->card_arena);
+}
+
 void pa_classify_add_sink(struct userdata *u, const char *type, const char *prop,
                           enum pa_classify_method method, const char *arg,
                           pa_idxset *ports,
@@ -176,6 +454,7 @@ void pa_classify_add_sink(struct userdata *u, const char *type, const char *prop
 
     devices_add(u, &classify->sinks, type, pa_policy_object_sink, prop, method, arg, ports,
                 module, module_args, flags, port_change_delay);
+    cache_flush(&classify->sink_cache);
 }
 
 void pa_classify_add_source(struct userdata *u, const char *type, const char *prop,
@@ -195,6 +474,7 @@ void pa_classify_add_source(struct userdata *u, const char *type, const char *pr
 
     devices_add(u, &classify->sources, type, pa_policy_object_source, prop, method, arg, ports,
                 module, module_args, flags, 0);
+    cache_flush(&classify->source_cache);
 }
 
 void pa_classify_add_card(struct userdata *u, char *type,
@@ -210,6 +490,7 @@ void pa_classify_add_card(struct userdata *u, char *type,
     pa_assert(arg[0]);
 
     cards_add(u, &classify->cards, type, method, arg, profiles, flags);
+    cache_flush(&classify->card_cache);
 }
 
 
@@ -243,30 +524,54 @@ void pa_classify_add_stream(struct userdata *u, const char *prop,
                 pa_log("can't find group '%s' for stream", grnam);
             }
             else {
+                pa_xfree(group->portname);
                 group->portname = pa_xstrdup(port);
                 pa_log_debug("set portname '%s' for group '%s'", port, grnam);
             }
         }
 
-        streams_add(u, &classify->streams.defs, prop,method,arg,
+        streams_add(u, &classify->streams, prop,method,arg,
                     clnam, sname, uid, exe, grnam, flags, set_properties);
     }
 }
 
 void pa_classify_update_stream_route(struct userdata *u, const char *sname)
 {
+    struct pa_classify_stream *streams;
     struct pa_classify_stream_def *stream;
 
     pa_assert(u);
     pa_assert(u->classify);
 
-    for (stream = u->classify->streams.defs;  stream;  stream = stream->next) {
-        if (stream->sname) {
-            if (pa_streq(stream->sname, sname))
-                stream->sact = 1;
-            else
-                stream->sact = 0;
-            pa_log_debug("stream group %s changes to %s state", stream->group, stream->sact ? "active" : "inactive");
+    streams = &u->classify->streams;
+
+    /* Only the stream definitions of the previously and the newly
+     * active sink need to be touched. */
+    if (pa_safe_streq(streams->active_sname, sname))
+        return;
+
+    if (streams->active_sname) {
+        stream = pa_hashmap_get(streams->sname_map, streams->active_sname);
+
+        for ( ;  stream;  stream = stream->sname_next) {
+            stream->sact = 0;
+            pa_policy_log_debug(u, pa_policy_log_classify,
+                                "stream group %s changes to inactive state",
+                                stream->group);
+        }
+    }
+
+    pa_xfree(streams->active_sname);
+    streams->active_sname = pa_xstrdup(sname);
+
+    if (sname) {
+        stream = pa_hashmap_get(streams->sname_map, sname);
+
+        for ( ;  stream;  stream = stream->sname_next) {
+            stream->sact = 1;
+            pa_policy_log_debug(u, pa_policy_log_classify,
+                                "stream group %s changes to active state",
+                                stream->group);
         }
     }
 }
@@ -281,7 +586,7 @@ void pa_classify_register_app_id(struct userdata *u, const char *app_id, const c
     pa_assert_se((classify = u->classify));
 
     if (app_id && group) {
-        app_id_map_insert(classify->streams.app_id_map, app_id,
+        app_id_map_insert(u, classify->streams.app_id_map, app_id,
                           prop, method, arg, group);
     }
 }
@@ -331,6 +636,17 @@ const char *pa_classify_sink_input_by_data(struct userdata *u,
     return group;
 }
 
+const char *pa_classify_sink_input_by_proplist(struct userdata *u,
+                                               struct pa_client *client,
+                                               pa_proplist *proplist,
+                                               uint32_t *flags)
+{
+    pa_assert(u);
+    pa_assert(proplist);
+
+    return find_group_for_client(u, client, proplist, flags);
+}
+
 const char *pa_classify_source_output(struct userdata *u,
                                       struct pa_source_output *sout)
 {
@@ -368,6 +684,8 @@ int pa_classify_sink(struct userdata *u, struct pa_sink *sink,
 {
     struct pa_classify *classify;
     struct pa_classify_device *devices;
+    uint64_t start;
+    int ret;
 
     pa_assert(u);
     pa_assert_se((classify = u->classify));
@@ -375,8 +693,19 @@ int pa_classify_sink(struct userdata *u, struct pa_sink *sink,
     pa_assert_se((devices = classify->sinks));
     pa_assert(result);
 
-    return devices_classify(devices, sink,
-                            flag_mask, flag_value, result);
+    if (device_hidden(u, sink)) {
+        *result = classify_result_malloc(0);
+        return 0;
+    }
+
+    start = timing_start(u, classify);
+    ret = devices_classify(devices,
+                           device_bits(u, &classify->sink_cache, devices,
+                                       sink, sink->index),
+                           flag_mask, flag_value, result);
+    timing_stop(classify, pa_classify_op_sink, start);
+
+    return ret;
 }
 
 int pa_classify_source(struct userdata *u, struct pa_source *source,
@@ -385,6 +714,8 @@ int pa_classify_source(struct userdata *u, struct pa_source *source,
 {
     struct pa_classify *classify;
     struct pa_classify_device *devices;
+    uint64_t start;
+    int ret;
 
     pa_assert(u);
     pa_assert_se((classify = u->classify));
@@ -392,8 +723,19 @@ int pa_classify_source(struct userdata *u, struct pa_source *source,
     pa_assert_se((devices = classify->sources));
     pa_assert(result);
 
-    return devices_classify(devices, source,
-                            flag_mask, flag_value, result);
+    if (device_hidden(u, source)) {
+        *result = classify_result_malloc(0);
+        return 0;
+    }
+
+    start = timing_start(u, classify);
+    ret = devices_classify(devices,
+                           device_bits(u, &classify->source_cache, devices,
+                                       source, source->index),
+                           flag_mask, flag_value, result);
+    timing_stop(classify, pa_classify_op_source, start);
+
+    return ret;
 }
 
 int pa_classify_card(struct userdata *u, struct pa_card *card,
@@ -403,6 +745,8 @@ int pa_classify_card(struct userdata *u, struct pa_card *card,
     struct pa_classify *classify;
     struct pa_classify_card *cards;
     pa_hashmap *profs;
+    uint64_t start;
+    int ret;
 
     pa_assert(u);
     pa_assert(result);
@@ -410,9 +754,13 @@ int pa_classify_card(struct userdata *u, struct pa_card *card,
     pa_assert(classify->cards);
     pa_assert_se((cards = classify->cards));
 
+    start = timing_start(u, classify);
     profs = pa_card_ext_get_profiles(card);
+    ret = cards_classify(cards, card_bits(u, &classify->card_cache, cards, card),
+                         profs, flag_mask,flag_value, reclassify, result);
+    timing_stop(classify, pa_classify_op_card, start);
 
-    return cards_classify(cards, card, profs, flag_mask,flag_value, reclassify, result);
+    return ret;
 }
 
 int pa_classify_card_all_types(struct userdata *u,
@@ -483,6 +831,38 @@ int pa_classify_source_all_types(struct userdata *u,
     return devices_all_types(devices, result);
 }
 
+/* true if any sink, source or card definition has the type */
+bool pa_classify_has_type(struct userdata *u, const char *type)
+{
+    struct pa_classify *classify;
+    struct pa_classify_device_def *d;
+    struct pa_classify_card_def *c;
+
+    pa_assert(u);
+    pa_assert_se((classify = u->classify));
+
+    /* the types of the definitions are interned */
+    if (!type || !(type = pa_policy_intern_lookup(type)))
+        return false;
+
+    for (d = classify->sinks->defs;  d->type;  d++) {
+        if (d->type == type)
+            return true;
+    }
+
+    for (d = classify->sources->defs;  d->type;  d++) {
+        if (d->type == type)
+            return true;
+    }
+
+    for (c = classify->cards->defs;  c->type;  c++) {
+        if (c->type == type)
+            return true;
+    }
+
+    return false;
+}
+
 int pa_classify_is_sink_typeof(struct userdata *u, struct pa_sink *sink,
                                const char *type,
                                struct pa_classify_device_data **d)
@@ -495,10 +875,13 @@ int pa_classify_is_sink_typeof(struct userdata *u, struct pa_sink *sink,
     pa_assert(classify->sinks);
     pa_assert_se((defs = classify->sinks->defs));
 
-    if (!sink || !type)
+    if (!sink || !type || device_hidden(u, sink))
         return false;
 
-    return devices_is_typeof(defs, sink, type, d);
+    return devices_is_typeof(defs,
+                             device_bits(u, &classify->sink_cache, classify->sinks,
+                                         sink, sink->index),
+                             type, d);
 }
 
 
@@ -514,10 +897,13 @@ int pa_classify_is_source_typeof(struct userdata *u, struct pa_source *source,
     pa_assert(classify->sources);
     pa_assert_se((defs = classify->sources->defs));
 
-    if (!source || !type)
+    if (!source || !type || device_hidden(u, source))
         return false;
 
-    return devices_is_typeof(defs, source, type, d);
+    return devices_is_typeof(defs,
+                             device_bits(u, &classify->source_cache, classify->sources,
+                                         source, source->index),
+                             type, d);
 }
 
 
@@ -535,7 +921,8 @@ int pa_classify_is_card_typeof(struct userdata *u, struct pa_card *card,
     if (!card || !type)
         return false;
 
-    return card_is_typeof(defs, card, type, d, priority);
+    return card_is_typeof(defs, card_bits(u, &classify->card_cache, classify->cards, card),
+                          type, d, priority);
 }
 
 
@@ -551,10 +938,10 @@ int pa_classify_is_port_sink_typeof(struct userdata *u, struct pa_sink *sink,
     pa_assert(classify->sinks);
     pa_assert_se((defs = classify->sinks->defs));
 
-    if (!sink || !type)
+    if (!sink || !type || device_hidden(u, sink))
         return false;
 
-    return port_device_is_typeof(defs, pa_policy_object_sink, sink, type, d);
+    return port_device_is_typeof(u, defs, pa_policy_object_sink, sink, type, d);
 }
 
 
@@ -571,48 +958,112 @@ int pa_classify_is_port_source_typeof(struct userdata *u,
     pa_assert(classify->sources);
     pa_assert_se((defs = classify->sources->defs));
 
-    if (!source || !type)
+    if (!source || !type || device_hidden(u, source))
         return false;
 
-    return port_device_is_typeof(defs, pa_policy_object_source, source, type, d);
+    return port_device_is_typeof(u, defs, pa_policy_object_source, source, type, d);
+}
+
+/*
+ * The values of the properties the definitions match objects of the
+ * given type on. A proplist change that leaves these as they were can't
+ * change how the object is classified.
+ */
+char *pa_classify_match_props(struct userdata *u,
+                              enum pa_policy_object_type obj_type,
+                              pa_proplist *proplist)
+{
+    struct pa_classify            *classify;
+    struct pa_classify_device     *devices[2];
+    struct pa_classify_device_def *d;
+    struct pa_classify_card_def   *c;
+    pa_strbuf                     *buf;
+    uint32_t                       i;
+    int                            j;
+
+    pa_assert(u);
+    pa_assert_se((classify = u->classify));
+    pa_assert(proplist);
+
+    buf = pa_strbuf_new();
+
+    if (obj_type == pa_policy_object_card) {
+        for (c = classify->cards->defs;  c->type;  c++) {
+            for (j = 0;  j < PA_POLICY_CARD_MAX_DEFS && c->data[j].profile;  j++)
+                match_prop_append(buf, c->data[j].card_match, obj_type, proplist);
+        }
+    }
+    else {
+        /* the ports of a sink definition may match sources and vice versa */
+        devices[0] = classify->sinks;
+        devices[1] = classify->sources;
+
+        for (j = 0;  j < 2;  j++) {
+            for (d = devices[j]->defs;  d->type;  d++) {
+                match_prop_append(buf, d->dev_match, obj_type, proplist);
+
+                for (i = 0;  i < d->data.nport;  i++) {
+                    match_prop_append(buf, d->data.ports[i].device_match,
+                                      obj_type, proplist);
+                }
+            }
+        }
+    }
+
+    return pa_strbuf_to_string_free(buf);
 }
 
 
 static int classify_update_module_load(struct userdata *u,
                                        uint32_t dir,
                                        struct pa_classify_module *m,
-                                       struct pa_classify_device_data *devdata) {
+                                       const char *name,
+                                       const char *args,
+                                       uint32_t flags) {
+    pa_usec_t start;
+
     pa_assert(u);
     pa_assert(m);
-    pa_assert(devdata);
+    pa_assert(name);
     pa_assert(!m->module);
 
     pa_log_debug("Load module for %s: %s %s", dir == PA_POLICY_MODULE_FOR_SINK ? "sink" : "source",
-                                              devdata->module,
-                                              devdata->module_args ? devdata->module_args : "");
+                                              name, args ? args : "");
 
+    start = pa_rtclock_now();
+
+    if (u->modpool)
+        m->module = pa_policy_module_pool_take(u->modpool, name,
+                                               args, &m->load_time);
+
+    if (!m->module) {
 #if PULSEAUDIO_VERSION >= 12
-    int r;
-    if ((r = pa_module_load(&m->module,
-                            u->core,
-                            devdata->module,
-                            devdata->module_args)) < 0) {
-        pa_log("Failed to load %s: %s (%d)", devdata->module, pa_cstrerror(r), -r);
-        return -1;
-    }
+        int r;
+        if ((r = pa_module_load(&m->module,
+                                u->core,
+                                name,
+                                args)) < 0) {
+            pa_log("Failed to load %s: %s (%d)", name, pa_cstrerror(r), -r);
+            return -1;
+        }
 #else
-    m->module = pa_module_load(u->core,
-                               devdata->module,
-                               devdata->module_args);
-    if (!m->module) {
-        pa_log("Failed to load %s", devdata->module);
-        return -1;
-    }
+        m->module = pa_module_load(u->core,
+                                   name,
+                                   args);
+        if (!m->module) {
+            pa_log("Failed to load %s", name);
+            return -1;
+        }
 #endif
+        m->load_time = pa_rtclock_now() - start;
+    }
 
-    m->module_name = devdata->module;
-    m->module_args = devdata->module_args;
-    m->flags = devdata->flags;
+    PA_POLICY_PROBE3(module_load, dir, m->module->index, name);
+
+    /* copies, as the device definitions may be replaced on config reload */
+    m->module_name = pa_xstrdup(name);
+    m->module_args = pa_xstrdup(args);
+    m->flags = flags;
 
     return 0;
 }
@@ -630,11 +1081,18 @@ static void classify_update_module_unload(struct userdata *u,
                  dir == PA_POLICY_MODULE_FOR_SINK ? "sink" : "source",
                  m->module_name);
 
-    if (m->flags & PA_POLICY_MODULE_UNLOAD_IMMEDIATELY)
+    PA_POLICY_PROBE3(module_unload, dir, m->module->index, m->module_name);
+
+    if (u->modpool && pa_policy_module_pool_park(u->modpool, m->module, m->module_name,
+                                                 m->module_args, m->load_time))
+        ;                       /* kept loaded for the next route needing it */
+    else if (m->flags & PA_POLICY_MODULE_UNLOAD_IMMEDIATELY)
         unload_module(m->module);
     else
         pa_module_unload_request(m->module, true);
 
+    pa_xfree(m->module_name);
+    pa_xfree(m->module_args);
     m->module_name = NULL;
     m->module_args = NULL;
     m->module = NULL;
@@ -658,13 +1116,140 @@ int pa_classify_update_module(struct userdata *u,
         !pa_safe_streq(m->module_args, devdata->module_args))
         classify_update_module_unload(u, dir, m);
 
-    if (devdata->module && !m->module)
-        ret = classify_update_module_load(u, dir, m, devdata);
+    if (devdata->module && !m->module) {
+        if (u->classify->defer_loads)
+            classify_update_module_defer(u, dir, devdata);
+        else
+            ret = classify_update_module_load(u, dir, m, devdata->module,
+                                              devdata->module_args, devdata->flags);
+    }
+    else if (u->classify->defer_loads) {
+        /* the last one wins, also when it needs no load at all */
+        classify_pending_clear(&u->classify->pending[dir]);
+    }
 
     return ret;
 }
 
 
+void pa_classify_defer_module_loads(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->classify);
+
+    /* the loads of the previous route are not left behind the new one */
+    pa_classify_flush_module_loads(u);
+
+    u->classify->defer_loads = true;
+}
+
+
+void pa_classify_flush_module_loads(struct userdata *u) {
+    struct pa_classify *cl;
+
+    pa_assert(u);
+    pa_assert_se((cl = u->classify));
+
+    if (cl->load_event && cl->loads_done)
+        module_loads_cb(u->core->mainloop, cl->load_event, u);
+}
+
+
+bool pa_classify_run_module_loads(struct userdata *u, pa_classify_loads_done_cb cb) {
+    pa_mainloop_api *api;
+    struct pa_classify *cl;
+    uint32_t i;
+
+    pa_assert(u);
+    pa_assert(cb);
+    pa_assert_se((cl = u->classify));
+    pa_assert_se((api = u->core->mainloop));
+
+    cl->defer_loads = false;
+
+    for (i = 0; i < PA_POLICY_MODULE_COUNT; i++) {
+        if (cl->pending[i].module_name)
+            break;
+    }
+
+    if (i == PA_POLICY_MODULE_COUNT)
+        return false;
+
+    cl->loads_done = cb;
+
+    if (!cl->load_event)
+        cl->load_event = api->defer_new(api, module_loads_cb, u);
+    else
+        api->defer_enable(cl->load_event, 1);
+
+    return true;
+}
+
+
+static void classify_update_module_defer(struct userdata *u,
+                                         uint32_t dir,
+                                         struct pa_classify_device_data *devdata) {
+    struct pa_classify_module *p;
+
+    p = &u->classify->pending[dir];
+
+    pa_log_debug("Defer loading module for %s: %s %s",
+                 dir == PA_POLICY_MODULE_FOR_SINK ? "sink" : "source",
+                 devdata->module, devdata->module_args ? devdata->module_args : "");
+
+    /* the last one wins, as it would when loading right away */
+    pa_xfree(p->module_name);
+    pa_xfree(p->module_args);
+    p->module_name = pa_xstrdup(devdata->module);
+    p->module_args = pa_xstrdup(devdata->module_args);
+    p->flags = devdata->flags;
+}
+
+
+static void classify_pending_clear(struct pa_classify_module *p) {
+    pa_xfree(p->module_name);
+    pa_xfree(p->module_args);
+    p->module_name = NULL;
+    p->module_args = NULL;
+}
+
+
+static void module_loads_cb(pa_mainloop_api *api, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+    struct pa_classify *cl;
+    struct pa_classify_module *p;
+    struct pa_classify_module *m;
+    pa_classify_loads_done_cb cb;
+    bool success = true;
+    uint32_t i;
+
+    pa_assert(u);
+    pa_assert_se((cl = u->classify));
+    pa_assert(cl->load_event == e);
+
+    api->defer_enable(e, 0);
+
+    for (i = 0; i < PA_POLICY_MODULE_COUNT; i++) {
+        p = &cl->pending[i];
+        m = &cl->module[i];
+
+        if (!p->module_name)
+            continue;
+
+        /* a route in between may have loaded it already */
+        if (!m->module && classify_update_module_load(u, i, m, p->module_name,
+                                                      p->module_args, p->flags) < 0)
+            success = false;
+
+        classify_pending_clear(p);
+    }
+
+    if ((cb = cl->loads_done)) {
+        cl->loads_done = NULL;
+        cb(u, success);
+    }
+}
+
+
 void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *type) {
     struct pa_classify_device_def *defs;
     struct pa_classify_device_def *d;
@@ -679,11 +1264,11 @@ void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *ty
 
     m = &u->classify->module[dir];
 
-    if (!m->module)
+    if (!m->module || !(type = pa_policy_intern_lookup(type)))
         return;
 
     for (d = defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
+        if (type == d->type) {
             new_def = d;
             break;
         }
@@ -693,7 +1278,7 @@ void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *ty
         return;
 
     for (d = defs;  d->type;  d++) {
-        if (!pa_streq(type, d->type)) {
+        if (type != d->type) {
             if (d->data.module) {
                 if (pa_safe_streq(m->module_name, new_def->data.module) &&
                     pa_safe_streq(m->module_args, new_def->data.module_args)) {
@@ -709,6 +1294,40 @@ void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *ty
 }
 
 
+void pa_classify_preload_modules(struct userdata *u) {
+    struct pa_classify_device *devices[PA_POLICY_MODULE_COUNT];
+    struct pa_classify_device_def *d;
+    struct pa_classify_module *m;
+    uint32_t dir;
+
+    pa_assert(u);
+    pa_assert(u->classify);
+
+    if (!u->modpool)
+        return;
+
+    devices[PA_POLICY_MODULE_FOR_SINK]   = u->classify->sinks;
+    devices[PA_POLICY_MODULE_FOR_SOURCE] = u->classify->sources;
+
+    /* in the order of the definitions, until the pool is full */
+    for (dir = 0; dir < PA_POLICY_MODULE_COUNT; dir++) {
+        m = &u->classify->module[dir];
+
+        for (d = devices[dir]->defs;  d->type;  d++) {
+            if (!d->data.module)
+                continue;
+
+            if (m->module && pa_safe_streq(m->module_name, d->data.module) &&
+                pa_safe_streq(m->module_args, d->data.module_args))
+                continue;       /* in use */
+
+            pa_policy_module_pool_warm(u->modpool, d->data.module,
+                                       d->data.module_args);
+        }
+    }
+}
+
+
 static pa_hook_result_t module_unlink_hook_cb(pa_core *c, pa_module *m, struct pa_classify *cl) {
     uint32_t i;
 
@@ -722,6 +1341,8 @@ static pa_hook_result_t module_unlink_hook_cb(pa_core *c, pa_module *m, struct p
                          i == PA_POLICY_MODULE_FOR_SINK ? "sink" : "source",
                          m->name);
             cl->module[i].module = NULL;
+            pa_xfree(cl->module[i].module_name);
+            pa_xfree(cl->module[i].module_args);
             cl->module[i].module_name = NULL;
             cl->module[i].module_args = NULL;
             break;
@@ -746,10 +1367,15 @@ static const char *find_group_for_client(struct userdata  *u,
     const char *exe     = "";           /* client's binary path */
     const char *group   = NULL;
     uint32_t    flags   = 0;
+    uint64_t    start;
 
     assert(u);
     pa_assert_se((classify = u->classify));
 
+    start = timing_start(u, classify);
+
+    PA_POLICY_PROBE1(classify_begin, client ? client->index : PA_IDXSET_INVALID);
+
     app_id_map = classify->streams.app_id_map;
     defs = &classify->streams.defs;
 
@@ -765,7 +1391,7 @@ static const char *find_group_for_client(struct userdata  *u,
     } else {
         app_id = pa_client_ext_app_id(client);
 
-        if (!(group = app_id_get_group(app_id_map, app_id, proplist))) {
+        if (!(group = app_id_get_group(u, app_id_map, app_id, proplist))) {
 
             clnam = pa_client_ext_name(client);
             uid   = pa_client_ext_uid(client);
@@ -776,7 +1402,12 @@ static const char *find_group_for_client(struct userdata  *u,
     }
 
     if (group == NULL)
-        group = PA_POLICY_DEFAULT_GROUP_NAME;
+        group = classify->streams.dflt_group;
+
+    timing_stop(classify, pa_classify_op_stream, start);
+
+    PA_POLICY_PROBE3(classify_end, client ? client->index : PA_IDXSET_INVALID,
+                     group, flags);
 
     pa_log_debug("%s (%s|%s|%d|%s) => %s,0x%x", __FUNCTION__,
                  clnam ? clnam : "<null>", app_id ? app_id : "<null>", uid,
@@ -817,7 +1448,6 @@ static char *arg_dump(int argc, char **argv, char *buf, size_t len)
 static void app_id_free(pa_classify_app_id *app)
 {
     if (app) {
-        pa_xfree(app->group);
         pa_xfree(app);
     }
 }
@@ -832,32 +1462,41 @@ static void app_id_map_free_all(pa_hashmap *app_id_map)
     }
 }
 
-static void app_id_map_insert(pa_hashmap *app_id_map, const char *app_id,
-                              const char *prop, enum pa_classify_method method,
+static void app_id_map_insert(struct userdata *u, pa_hashmap *app_id_map,
+                              const char *app_id, const char *prop,
+                              enum pa_classify_method method,
                               const char *arg, const char *group)
 {
     pa_classify_app_id *app;
+    const char *gname;
     char *tmp = NULL;
 
     pa_assert(app_id_map);
     pa_assert(group);
 
+    /* the group comes from D-Bus; don't let it grow the intern pool */
+    if (!(gname = pa_policy_intern_lookup(group))) {
+        pa_log("app_id %s: unknown group '%s'", app_id, group);
+        return;
+    }
+
     if ((app = app_id_map_find(app_id_map, app_id, prop, method, arg))) {
-        if (app->match)
+        if (app->match && pa_policy_log_enabled(u, pa_policy_log_classify))
             tmp = pa_policy_match_def(app->match);
 
-        pa_log_debug("app_id group changed (%s|%s) %s -> %s", app_id, tmp ? tmp : "",
-                                                              app->group, group);
+        pa_policy_log_debug(u, pa_policy_log_classify,
+                            "app_id group changed (%s|%s) %s -> %s",
+                            app_id, tmp ? tmp : "", app->group, gname);
 
-        pa_xfree(app->group);
-        app->group = pa_xstrdup(group);
+        app->group = gname;
     } else {
         app = pa_xnew0(pa_classify_app_id, 1);
 
-        app->group = pa_xstrdup(group);
+        app->group = gname;
 
         if (prop) {
-            app->match = pa_policy_match_property_new(pa_policy_object_proplist,
+            app->match = pa_policy_match_property_new(NULL,
+                                                      pa_policy_object_proplist,
                                                       prop,
                                                       method,
                                                       arg);
@@ -865,14 +1504,14 @@ static void app_id_map_insert(pa_hashmap *app_id_map, const char *app_id,
                 pa_log("failed to create match object for app_id %s group %s", app_id, app->group);
         }
 
-        if (app->match)
+        if (app->match && pa_policy_log_enabled(u, pa_policy_log_classify))
             tmp = pa_policy_match_def(app->match);
 
         pa_hashmap_put(app_id_map, pa_xstrdup(app_id), app);
 
-        pa_log_debug("app_id added (%s|%s) => %s", app_id,
-                                                   tmp ? tmp : "",
-                                                   app->group);
+        pa_policy_log_debug(u, pa_policy_log_classify,
+                            "app_id added (%s|%s) => %s",
+                            app_id, tmp ? tmp : "", app->group);
     }
 
     pa_xfree(tmp);
@@ -890,7 +1529,8 @@ static void app_id_map_remove(pa_hashmap *app_id_map, const char *app_id,
     }
 }
 
-static const char *app_id_get_group(pa_hashmap *map, const char *app_id,
+static const char *app_id_get_group(struct userdata *u, pa_hashmap *map,
+                                    const char *app_id,
                                     pa_proplist *proplist)
 {
 
@@ -903,7 +1543,7 @@ static const char *app_id_get_group(pa_hashmap *map, const char *app_id,
         if ((app = pa_hashmap_get(map, app_id))) {
             if (!app->match)
                 group = app->group;
-            else if (pa_policy_match(app->match, proplist))
+            else if (pa_policy_match(u, app->match, proplist))
                 group = app->group;
         }
     }
@@ -933,39 +1573,25 @@ static pa_classify_app_id *app_id_map_find(pa_hashmap *app_id_map, const char *a
     return NULL;
 }
 
-static void streams_free(struct pa_classify_stream_def *defs)
-{
-    struct pa_classify_stream_def *stream;
-    struct pa_classify_stream_def *next;
-
-    for (stream = defs;  stream;  stream = next) {
-        next = stream->next;
-
-        pa_policy_match_free(stream->stream_match);
-        pa_xfree(stream->exe);
-        pa_xfree(stream->clnam);
-        pa_xfree(stream->sname);
-        pa_xfree(stream->group);
-        if (stream->properties)
-            pa_proplist_free(stream->properties);
-
-        pa_xfree(stream);
-    }
-}
-
-static void streams_add(struct userdata *u, struct pa_classify_stream_def **defs, const char *prop,
+static void streams_add(struct userdata *u, struct pa_classify_stream *streams, const char *prop,
                         enum pa_classify_method method, const char *arg, const char *clnam,
                         const char *sname, uid_t uid, const char *exe, const char *group, uint32_t flags,
                         const char *set_properties)
 {
+    struct pa_policy_arena *arena;
+    struct pa_classify_stream_def **defs;
     struct pa_classify_stream_def *d;
     struct pa_classify_stream_def *prev;
+    struct pa_classify_stream_def *head;
     pa_proplist *proplist = NULL;
     char        *method_def = NULL;
 
-    pa_assert(defs);
+    pa_assert(streams);
     pa_assert(group);
 
+    arena = u->classify->stream_arena;
+    defs = &streams->defs;
+
     proplist = pa_proplist_new();
 
     if (prop && arg && (method == pa_method_equals)) {
@@ -974,40 +1600,55 @@ static void streams_add(struct userdata *u, struct pa_classify_stream_def **defs
 
     if ((d = streams_find(u, defs, proplist, clnam, sname, uid, exe, &prev)) != NULL) {
         pa_log_info("redefinition of stream");
-        pa_xfree(d->group);
     }
     else {
-        d = pa_xnew0(struct pa_classify_stream_def, 1);
+        d = pa_policy_arena_xnew0(arena, struct pa_classify_stream_def, 1);
 
         if (prop && arg) {
-            d->stream_match = pa_policy_match_property_new(pa_policy_object_proplist,
+            d->stream_match = pa_policy_match_property_new(arena,
+                                                           pa_policy_object_proplist,
                                                            prop,
                                                            method,
                                                            arg);
             if (!d->stream_match) {
                 pa_log("%s: invalid stream definition [%s:%s]", __FUNCTION__, prop, arg);
-                pa_xfree(d);
+                pa_proplist_free(proplist);
                 return;
             }
 
-            method_def = pa_policy_match_def(d->stream_match);
+            if (pa_policy_log_enabled(u, pa_policy_log_classify))
+                method_def = pa_policy_match_def(d->stream_match);
         }
 
         d->uid          = uid;
-        d->exe          = exe   ? pa_xstrdup(exe)   : NULL;
-        d->clnam        = clnam ? pa_xstrdup(clnam) : NULL;
-        d->sname        = sname ? pa_xstrdup(sname) : NULL;
-        d->sact         = sname ? 0 : -1;
+        d->exe          = pa_policy_arena_strdup(arena, exe);
+        d->clnam        = pa_policy_arena_strdup(arena, clnam);
+        d->sname        = pa_policy_arena_strdup(arena, sname);
+        d->sact         = sname ? pa_safe_streq(sname, streams->active_sname) : -1;
         /* Stream action, identified streams' proplists are merged with what's defined here. */
         d->properties   = set_properties ? pa_proplist_from_string(set_properties) : NULL;
 
+        if (d->properties)
+            pa_policy_arena_cleanup(arena, (pa_policy_arena_cleanup_cb) pa_proplist_free,
+                                    d->properties);
+
         prev->next = d;
 
-        pa_log_debug("stream added (%d|%s|%s|%s|%d)", uid, exe?exe:"<null>",
-                     clnam?clnam:"<null>", method_def, d->sact);
+        if (d->sname) {
+            if ((head = pa_hashmap_get(streams->sname_map, d->sname))) {
+                d->sname_next = head->sname_next;
+                head->sname_next = d;
+            }
+            else
+                pa_hashmap_put(streams->sname_map, d->sname, d);
+        }
+
+        pa_policy_log_debug(u, pa_policy_log_classify,
+                            "stream added (%d|%s|%s|%s|%d)", uid, exe?exe:"<null>",
+                            clnam?clnam:"<null>", method_def, d->sact);
     }
 
-    d->group = pa_xstrdup(group);
+    d->group = pa_policy_intern(group);
     d->flags = flags;
 
     pa_proplist_free(proplist);
@@ -1067,7 +1708,7 @@ streams_find(struct userdata *u, struct pa_classify_stream_def **defs, pa_propli
              const char *clnam, const char *sname, uid_t uid, const char *exe,
              struct pa_classify_stream_def **prev_ret)
 {
-#define PROPERTY_MATCH     (!d->stream_match || pa_policy_match(d->stream_match, proplist))
+#define PROPERTY_MATCH     (!d->stream_match || pa_policy_match(u, d->stream_match, proplist))
 #define STRING_MATCH_OF(m) (!d->m || (m && d->m && !strcmp(m, d->m)))
 #define ID_MATCH_OF(m)     (d->m == -1 || m == d->m)
 
@@ -1109,41 +1750,112 @@ streams_find(struct userdata *u, struct pa_classify_stream_def **defs, pa_propli
 #undef ID_MATCH_OF
 }
 
-static void classify_port_entry_free(void *data) {
-    struct pa_classify_port_entry *port = data;
-
-    pa_assert(port);
+static bool stream_def_may_match(struct userdata *u,
+                                 struct pa_classify_stream_def *d,
+                                 pa_proplist *proplist, const char *clnam,
+                                 uid_t uid, const char *exe)
+{
+    /* as streams_find() but without the routing state of the moment */
+    return (!d->stream_match || pa_policy_match(u, d->stream_match, proplist)) &&
+           (!d->clnam || (clnam && pa_streq(clnam, d->clnam))) &&
+           (d->uid == (uid_t) -1 || uid == d->uid) &&
+           (!d->exe || (exe && pa_streq(exe, d->exe)));
+}
 
-    pa_policy_match_free(port->device_match);
-    pa_xfree(port->port_name);
-    pa_xfree(port);
+static char *stream_def_key(struct pa_classify_stream_def *d)
+{
+    char *match = d->stream_match ? pa_policy_match_def(d->stream_match) : NULL;
+    char *props = d->properties ? pa_proplist_to_string(d->properties) : NULL;
+    char *key;
+
+    key = pa_sprintf_malloc("%d|%s|%s|%s|%d|%s|0x%x|%s|%s", (int) d->uid,
+                            pa_strnull(d->exe), pa_strnull(d->clnam),
+                            pa_strnull(d->sname), (int) d->sact, d->group,
+                            d->flags, pa_strnull(match), pa_strnull(props));
+    pa_xfree(match);
+    pa_xfree(props);
+
+    return key;
 }
 
-static void device_def_free(struct pa_classify_device_def *d)
+static void stream_diff_prepare(struct pa_classify_stream_diff *diff,
+                                struct pa_classify_stream_def *defs)
 {
-    pa_assert(d);
+    struct stream_def_pos {
+        struct pa_classify_stream_def *def;
+        unsigned                       pos;
+    } *entries, *e;
+    struct pa_classify_stream_def *d;
+    pa_hashmap *keys;
+    char       *key;
+    unsigned    n;
+    unsigned    last = 0;
 
-    pa_xfree(d->type);
+    diff->twins   = pa_hashmap_new(pa_idxset_trivial_hash_func,
+                                   pa_idxset_trivial_compare_func);
+    diff->changed = pa_idxset_new(pa_idxset_trivial_hash_func,
+                                  pa_idxset_trivial_compare_func);
+    keys = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                               pa_idxset_string_compare_func, pa_xfree, NULL);
 
-    if (d->data.ports)
-        pa_idxset_free(d->data.ports, classify_port_entry_free);
+    for (d = defs, n = 0;  d;  d = d->next)
+        n++;
 
-    pa_policy_match_free(d->dev_match);
+    entries = pa_xnew(struct stream_def_pos, n ? n : 1);
 
-    pa_xfree(d->data.module);
-        pa_xfree(d->data.module_args);
+    /* key of each reloaded def with its position, to check the order */
+    for (d = defs, n = 0;  d;  d = d->next, n++) {
+        e = entries + n;
+        e->def = d;
+        e->pos = n;
+
+        key = stream_def_key(d);
+
+        if (pa_hashmap_put(keys, key, e) < 0)
+            pa_xfree(key);      /* a duplicate, left without a twin */
+    }
+
+    for (d = diff->defs;  d;  d = d->next) {
+        key = stream_def_key(d);
+        e   = pa_hashmap_remove(keys, key);
+        pa_xfree(key);
+
+        if (!e) {
+            pa_idxset_put(diff->changed, d, NULL);
+            continue;
+        }
+
+        if (e->pos < last)
+            diff->all = true;
+        last = e->pos;
+
+        pa_hashmap_put(diff->twins, e->def, d);
+    }
+
+    /* the reloaded defs that had no old counterpart */
+    for (d = defs;  d;  d = d->next) {
+        if (!pa_hashmap_get(diff->twins, d))
+            pa_idxset_put(diff->changed, d, NULL);
+    }
+
+    pa_hashmap_free(keys);
+    pa_xfree(entries);
+
+    diff->prepared = true;
+
+    pa_log_debug("stream definitions: %u changed%s",
+                 pa_idxset_size(diff->changed),
+                 diff->all ? ", order changed" : "");
 }
 
-static void devices_free(struct pa_classify_device *devices)
+static struct pa_classify_device *devices_new(struct pa_policy_arena *arena)
 {
-    struct pa_classify_device_def *d;
+    struct pa_classify_device *devs;
 
-    if (devices) {
-        for (d = devices->defs;  d->type;  d++)
-            device_def_free(d);
+    devs = pa_policy_arena_alloc(arena, DEVICES_SIZE(DEFS_MIN));
+    devs->nalloc = DEFS_MIN;
 
-        pa_xfree(devices);
-    }
+    return devs;
 }
 
 static void devices_add(struct userdata *u, struct pa_classify_device **p_devices, const char *type,
@@ -1152,9 +1864,10 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
                         pa_idxset *ports, const char *module, const char *module_args,
                         uint32_t flags, uint32_t port_change_delay)
 {
+    struct pa_policy_arena *arena;
     struct pa_classify_device *devs;
     struct pa_classify_device_def *d;
-    size_t newsize;
+    int nalloc;
     char *ports_string = NULL; /* Just for log output. */
     pa_strbuf *buf; /* For building ports_string. */
     bool replace = false;
@@ -1162,6 +1875,8 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
     pa_assert(p_devices);
     pa_assert_se((devs = *p_devices));
 
+    arena = u->classify->device_arena;
+
     /* update variables */
     pa_policy_var_update(u, type);
     pa_policy_var_update(u, prop);
@@ -1169,24 +1884,33 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
     pa_policy_var_update(u, module);
     pa_policy_var_update(u, module_args);
 
+    type = pa_policy_intern(type);
+
     for (d = devs->defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
+        if (type == d->type) {
             replace = true;
             break;
         }
     }
 
     if (replace && d) {
-        device_def_free(d);
+        pa_log_warn("%s type '%s' redefined, dropping the earlier definition",
+                    pa_policy_object_type_str(obj_type), type);
+        /* the earlier one stays in the arena until the devices are reset */
         memset(d, 0, sizeof(*d));
     } else {
-        newsize = sizeof(*devs) + sizeof(devs->defs[0]) * (devs->ndef + 1);
-        devs = *p_devices = pa_xrealloc(devs, newsize);
+        /* keep the definitions contiguous, with room for the terminator */
+        if (devs->ndef + 1 >= devs->nalloc) {
+            nalloc = devs->nalloc * 2;
+            devs = *p_devices = defs_grow(arena, devs, DEVICES_SIZE(devs->nalloc),
+                                          DEVICES_SIZE(nalloc));
+            devs->nalloc = nalloc;
+        }
         d = devs->defs + devs->ndef;
-        memset(d+1, 0, sizeof(devs->defs[0]));
     }
 
-    d->dev_match = pa_policy_match_new(obj_type,
+    d->dev_match = pa_policy_match_new(arena,
+                                       obj_type,
                                        pa_streq(prop, "(name)") ? pa_object_name : pa_object_property,
                                        prop,
                                        method,
@@ -1198,7 +1922,7 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
         return;
     }
 
-    d->type = pa_xstrdup(type);
+    d->type = type;
 
     buf = pa_strbuf_new();
 
@@ -1209,23 +1933,24 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
         uint32_t idx;
         bool first = true;
 
-        /* Copy the ports idxset to d->data.ports. */
+        /* Copy the ports idxset to the d->data.ports array. */
 
-        d->data.ports = pa_idxset_new(NULL, NULL);
+        d->data.ports = pa_policy_arena_xnew0(arena, struct pa_classify_port_entry,
+                                              pa_idxset_size(ports));
 
         PA_IDXSET_FOREACH(port_config, ports, idx) {
-            port = pa_xnew0(struct pa_classify_port_entry, 1);
+            port = d->data.ports + d->data.nport++;
 
-            port->port_name = pa_xstrdup(pa_policy_var(u, port_config->port_name));
-            port->device_match = pa_policy_match_new(obj_type,
+            port->port_name = pa_policy_arena_strdup(arena,
+                                                     pa_policy_var(u, port_config->port_name));
+            port->device_match = pa_policy_match_new(arena,
+                                                     obj_type,
                                                      pa_streq(port_config->prop, "(name)") ?
                                                         pa_object_name : pa_object_property,
                                                      pa_policy_var(u, port_config->prop),
                                                      port_config->method,
                                                      pa_policy_var(u, port_config->arg));
 
-            pa_idxset_put(d->data.ports, port, NULL);
-
             if (!first)
                 pa_strbuf_putc(buf, ',');
             first = false;
@@ -1236,8 +1961,8 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
         }
     }
 
-    d->data.module = module ? pa_xstrdup(module) : NULL;
-    d->data.module_args = module_args ? pa_xstrdup(module_args) : NULL;
+    d->data.module = pa_policy_arena_strdup(arena, module);
+    d->data.module_args = pa_policy_arena_strdup(arena, module_args);
 
     if (d->data.module && !u->classify->module_unlink_hook_slot)
         u->classify->module_unlink_hook_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_MODULE_UNLINK],
@@ -1248,7 +1973,8 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
     d->data.flags = flags;
     d->data.port_change_delay = port_change_delay * PA_USEC_PER_MSEC;
 
-    devs->ndef++;
+    if (!replace)
+        devs->ndef++;
 
 #if (PULSEAUDIO_VERSION >= 8)
     ports_string = pa_strbuf_to_string_free(buf);
@@ -1263,18 +1989,20 @@ static void devices_add(struct userdata *u, struct pa_classify_device **p_device
     pa_xfree(ports_string);
 }
 
-static int devices_classify(struct pa_classify_device *devices, const void *object,
+static int devices_classify(struct pa_classify_device *devices,
+                            const struct match_bits *mb,
                             uint32_t flag_mask, uint32_t flag_value,
                             struct pa_classify_result **result)
 {
     struct pa_classify_device_def *d;
 
+    pa_assert(mb);
     pa_assert(result);
 
     *result = classify_result_malloc(devices->ndef);
 
     for (d = devices->defs;  d->type;  d++) {
-        if (pa_policy_match(d->dev_match, object)) {
+        if (BITS_TEST(mb, d - devices->defs)) {
             if ((d->data.flags & flag_mask) == flag_value) {
                 pa_assert((*result)->count < devices->ndef);
                 classify_result_append(result, d->type);
@@ -1285,14 +2013,18 @@ static int devices_classify(struct pa_classify_device *devices, const void *obje
     return (*result)->count;
 }
 
-static int devices_is_typeof(struct pa_classify_device_def *defs, const void *object,
+static int devices_is_typeof(struct pa_classify_device_def *defs,
+                             const struct match_bits *mb,
                              const char *type, struct pa_classify_device_data **data)
 {
     struct pa_classify_device_def *d;
 
+    if (!(type = pa_policy_intern_lookup(type)))
+        return false;
+
     for (d = defs;  d->type;  d++) {
-        if (!strcmp(type, d->type)) {
-            if (pa_policy_match(d->dev_match, object)) {
+        if (type == d->type) {
+            if (BITS_TEST(mb, d - defs)) {
                 if (data != NULL)
                     *data = &d->data;
 
@@ -1304,88 +2036,83 @@ static int devices_is_typeof(struct pa_classify_device_def *defs, const void *ob
     return false;
 }
 
-static void card_def_free(struct pa_classify_card_def *d)
+static struct pa_classify_card *cards_new(struct pa_policy_arena *arena)
 {
-    int i;
-
-    pa_assert(d);
-
-    pa_xfree(d->type);
-
-    for (i = 0; i < PA_POLICY_CARD_MAX_DEFS; i++) {
-        pa_xfree(d->data[i].profile);
-        pa_policy_match_free(d->data[i].card_match);
-    }
-}
-
-static void cards_free(struct pa_classify_card *cards)
-{
-    struct pa_classify_card_def *d;
+    struct pa_classify_card *cards;
 
-    if (cards) {
-        for (d = cards->defs;  d->type;  d++)
-            card_def_free(d);
+    cards = pa_policy_arena_alloc(arena, CARDS_SIZE(DEFS_MIN));
+    cards->nalloc = DEFS_MIN;
 
-        pa_xfree(cards);
-    }
+    return cards;
 }
 
 static void cards_add(struct userdata *u, struct pa_classify_card **p_cards,
                       const char *type, enum pa_classify_method method[PA_POLICY_CARD_MAX_DEFS],
                       char **arg, char **profiles, uint32_t flags[PA_POLICY_CARD_MAX_DEFS])
 {
+    struct pa_policy_arena *arena;
     struct pa_classify_card *cards;
     struct pa_classify_card_def *d;
     struct pa_classify_card_data *data;
-    size_t newsize;
     const char *arg_str;
+    int nalloc;
     int i;
     bool replace = false;
 
     pa_assert(p_cards);
     pa_assert_se((cards = *p_cards));
 
+    arena = u->classify->card_arena;
+
     /* update variable */
     pa_policy_var_update(u, type);
 
+    type = pa_policy_intern(type);
+
     for (d = cards->defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
+        if (type == d->type) {
             replace = true;
             break;
         }
     }
 
     if (replace && d) {
-        card_def_free(d);
+        /* the earlier one stays in the arena until the cards are reset */
         memset(d, 0, sizeof(*d));
     } else {
-        newsize = sizeof(*cards) + sizeof(cards->defs[0]) * (cards->ndef + 1);
-        cards = *p_cards = pa_xrealloc(cards, newsize);
+        /* keep the definitions contiguous, with room for the terminator */
+        if (cards->ndef + 1 >= cards->nalloc) {
+            nalloc = cards->nalloc * 2;
+            cards = *p_cards = defs_grow(arena, cards, CARDS_SIZE(cards->nalloc),
+                                         CARDS_SIZE(nalloc));
+            cards->nalloc = nalloc;
+        }
         d = cards->defs + cards->ndef;
-        memset(d+1, 0, sizeof(cards->defs[0]));
     }
 
-    d->type    = pa_xstrdup(type);
+    d->type    = type;
 
     for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && profiles[i]; i++) {
 
         data = &d->data[i];
 
-        data->profile = profiles[i] ? pa_xstrdup(pa_policy_var(u, profiles[i])) : NULL;
+        data->profile = pa_policy_arena_strdup(arena, pa_policy_var(u, profiles[i]));
         data->flags   = flags[i];
         arg_str = pa_policy_var(u, arg[i]);
 
         if (method[i] == pa_method_true)
             goto fail;
 
-        data->card_match = pa_policy_match_name_new(pa_policy_object_card,
+        data->card_match = pa_policy_match_name_new(arena,
+                                                    pa_policy_object_card,
                                                     method[i],
                                                     arg_str);
         if (!data->card_match)
             goto fail;
     }
 
-    cards->ndef++;
+    if (!replace)
+        cards->ndef++;
 
     pa_log_info("card '%s' %s (%s|%s|%s|0x%04x)", type, replace ? "updated" : "added",
                 pa_match_method_str(method[0]), pa_policy_var(u, arg[0]),
@@ -1403,7 +2130,7 @@ fail:
 }
 
 static int cards_classify(struct pa_classify_card *cards,
-                          pa_card *card, pa_hashmap *card_profiles,
+                          const struct match_bits *mb, pa_hashmap *card_profiles,
                           uint32_t flag_mask, uint32_t flag_value,
                           bool reclassify, struct pa_classify_result **result)
 {
@@ -1426,7 +2153,7 @@ static int cards_classify(struct pa_classify_card *cards,
 
             data = &d->data[i];
 
-            if (pa_policy_match(data->card_match, card)) {
+            if (BITS_TEST(mb, (d - cards->defs) * PA_POLICY_CARD_MAX_DEFS + i)) {
                 supports_profile = false;
 
                 if (data->profile == NULL)
@@ -1450,17 +2177,21 @@ static int cards_classify(struct pa_classify_card *cards,
     return (*result)->count;
 }
 
-static int card_is_typeof(struct pa_classify_card_def *defs, pa_card *card,
+static int card_is_typeof(struct pa_classify_card_def *defs,
+                          const struct match_bits *mb,
                           const char *type, struct pa_classify_card_data **data, int *priority)
 {
     struct pa_classify_card_def *d;
     int i;
 
+    if (!(type = pa_policy_intern_lookup(type)))
+        return false;
+
     for (d = defs;  d->type;  d++) {
-        if (!strcmp(type, d->type)) {
+        if (type == d->type) {
 
             for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && d->data[i].profile; i++) {
-                if (pa_policy_match(d->data[i].card_match, card)) {
+                if (BITS_TEST(mb, (d - defs) * PA_POLICY_CARD_MAX_DEFS + i)) {
                     if (data != NULL)
                         *data = &d->data[i];
                     if (priority != NULL)
@@ -1475,7 +2206,8 @@ static int card_is_typeof(struct pa_classify_card_def *defs, pa_card *card,
     return false;
 }
 
-static int port_device_is_typeof(struct pa_classify_device_def *defs,
+static int port_device_is_typeof(struct userdata *u,
+                                 struct pa_classify_device_def *defs,
                                  enum pa_policy_object_type obj_type,
                                  void *obj,
                                  const char *type,
@@ -1483,9 +2215,12 @@ static int port_device_is_typeof(struct pa_classify_device_def *defs,
 {
     struct pa_classify_device_def *d;
 
+    if (!(type = pa_policy_intern_lookup(type)))
+        return false;
+
     for (d = defs;  d->type;  d++) {
-        if (pa_streq(type, d->type)) {
-            if (d->data.ports && pa_classify_get_port_entry(&d->data, obj_type, obj)) {
+        if (type == d->type) {
+            if (d->data.ports && pa_classify_get_port_entry(u, &d->data, obj_type, obj)) {
                 if (data)
                     *data = &d->data;
 
@@ -1497,25 +2232,204 @@ static int port_device_is_typeof(struct pa_classify_device_def *defs,
     return false;
 }
 
-struct pa_classify_port_entry *pa_classify_get_port_entry(struct pa_classify_device_data *data,
+struct pa_classify_port_entry *pa_classify_get_port_entry(struct userdata *u,
+                                                          struct pa_classify_device_data *data,
                                                           enum pa_policy_object_type obj_type,
                                                           void *obj)
 {
     struct pa_classify_port_entry *port;
-    uint32_t idx;
+    uint32_t i;
 
     pa_assert(data);
     pa_assert(obj);
     pa_assert(obj_type == pa_policy_object_sink || obj_type == pa_policy_object_source);
 
-    PA_IDXSET_FOREACH(port, data->ports, idx) {
-        if (pa_policy_match_type(port->device_match, obj_type, obj))
+    for (i = 0;  i < data->nport;  i++) {
+        port = data->ports + i;
+
+        if (pa_policy_match_type(u, port->device_match, obj_type, obj))
             return port;
     }
 
     return NULL;
 }
 
+static void match_prop_append(pa_strbuf *buf, pa_policy_match_object *match,
+                              enum pa_policy_object_type obj_type,
+                              pa_proplist *proplist)
+{
+    const char *value;
+
+    if (match && match->type == obj_type && match->target == pa_object_property) {
+        value = pa_proplist_gets(proplist, match->target_def);
+
+        /* an unset property differs from an empty one */
+        pa_strbuf_printf(buf, "%s%c%s\n", match->target_def,
+                         value ? '=' : '!', value ? value : "");
+    }
+}
+
+static void *defs_grow(struct pa_policy_arena *arena, const void *defs,
+                       size_t size, size_t newsize)
+{
+    /* the old array stays in the arena; the waste is at most the size of
+     * the final array, as the arrays double */
+    return memcpy(pa_policy_arena_alloc(arena, newsize), defs, size);
+}
+
+static void cache_init(struct userdata *u, struct pa_classify_cache *cache,
+                       pa_core_hook_t proplist, pa_core_hook_t unlink)
+{
+    pa_hook *hooks = u->core->hooks;
+
+    cache->objects  = pa_hashmap_new_full(pa_idxset_trivial_hash_func,
+                                          pa_idxset_trivial_compare_func,
+                                          NULL, pa_xfree);
+
+    /* early, so that everybody else reclassifies with the new properties */
+    cache->proplist = pa_hook_connect(hooks + proplist, PA_HOOK_EARLY,
+                                      cache_forget, cache);
+
+    /* after the card, sink and source handlers that still classify it */
+    cache->unlink   = pa_hook_connect(hooks + unlink, PA_HOOK_LATE + 10,
+                                      cache_forget, cache);
+}
+
+static void cache_done(struct pa_classify_cache *cache)
+{
+    if (cache->proplist)
+        pa_hook_slot_free(cache->proplist);
+    if (cache->unlink)
+        pa_hook_slot_free(cache->unlink);
+    if (cache->objects)
+        pa_hashmap_free(cache->objects);
+}
+
+static void cache_flush(struct pa_classify_cache *cache)
+{
+    pa_hashmap_remove_all(cache->objects);
+}
+
+static pa_hook_result_t cache_forget(void *hook_data, void *call_data,
+                                     void *slot_data)
+{
+    struct pa_classify_cache *cache = slot_data;
+
+    pa_hashmap_remove_and_free(cache->objects, call_data);
+
+    return PA_HOOK_OK;
+}
+
+static struct match_bits *cache_lookup(struct pa_classify_cache *cache,
+                                       const void *object, uint32_t index)
+{
+    struct match_bits *mb;
+
+    /* an object at the address of a gone one has a different index */
+    if ((mb = pa_hashmap_get(cache->objects, object)) && mb->index != index) {
+        pa_hashmap_remove_and_free(cache->objects, object);
+        mb = NULL;
+    }
+
+    return mb;
+}
+
+static struct match_bits *cache_insert(struct pa_classify_cache *cache,
+                                       const void *object, uint32_t index,
+                                       uint32_t nbit)
+{
+    struct match_bits *mb;
+
+    mb = pa_xmalloc0(sizeof(*mb) + sizeof(uint32_t) *
+                     (BITS_WORDS(nbit) > 0 ? BITS_WORDS(nbit) - 1 : 0));
+    mb->index = index;
+
+    pa_hashmap_put(cache->objects, (void *)object, mb);
+
+    return mb;
+}
+
+static const struct match_bits *device_bits(struct userdata *u,
+                                            struct pa_classify_cache *cache,
+                                            struct pa_classify_device *devices,
+                                            const void *object, uint32_t index)
+{
+    struct pa_classify_device_def *d;
+    struct match_bits             *mb;
+    uint32_t                       n;
+
+    if ((mb = cache_lookup(cache, object, index)))
+        return mb;
+
+    mb = cache_insert(cache, object, index, devices->ndef);
+
+    for (d = devices->defs;  d->type;  d++) {
+        n = d - devices->defs;
+
+        if (pa_policy_match(u, d->dev_match, object))
+            mb->bits[BITS_WORD(n)] |= BITS_MASK(n);
+    }
+
+    return mb;
+}
+
+static const struct match_bits *card_bits(struct userdata *u,
+                                          struct pa_classify_cache *cache,
+                                          struct pa_classify_card *cards,
+                                          pa_card *card)
+{
+    struct pa_classify_card_def *d;
+    struct match_bits           *mb;
+    uint32_t                     n;
+    int                          i;
+
+    if ((mb = cache_lookup(cache, card, card->index)))
+        return mb;
+
+    mb = cache_insert(cache, card, card->index,
+                      cards->ndef * PA_POLICY_CARD_MAX_DEFS);
+
+    for (d = cards->defs;  d->type;  d++) {
+        for (i = 0; i < PA_POLICY_CARD_MAX_DEFS && d->data[i].profile; i++) {
+            n = (d - cards->defs) * PA_POLICY_CARD_MAX_DEFS + i;
+
+            if (pa_policy_match(u, d->data[i].card_match, card))
+                mb->bits[BITS_WORD(n)] |= BITS_MASK(n);
+        }
+    }
+
+    return mb;
+}
+
+static uint64_t timing_start(struct userdata *u, struct pa_classify *cl)
+{
+    struct timespec ts;
+
+    pa_policy_stats_count(u, pa_policy_stat_classify);
+
+    if (!cl->timing)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void timing_stop(struct pa_classify *cl, enum pa_classify_op op,
+                        uint64_t start)
+{
+    struct timespec ts;
+
+    if (!cl->timing)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    cl->stats[op].calls++;
+    cl->stats[op].nsec += (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec - start;
+}
+
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -35,17 +35,21 @@
 
 struct pa_sink;
 struct pa_source;
+struct pa_policy_arena;
 struct pa_sink_input;
 struct pa_sink_input_new_data;
 struct pa_card;
+struct pa_client;
+struct pa_classify_stream_diff;         /* old vs. reloaded stream defs */
 
 typedef struct pa_classify_app_id {
     pa_policy_match_object      *match;
-    char                        *group;
+    const char                  *group;
 } pa_classify_app_id;
 
 struct pa_classify_stream_def {
     struct pa_classify_stream_def *next;
+    struct pa_classify_stream_def *sname_next; /* defs with the same sname */
                                           /* for stream classification */
     pa_policy_match_object        *stream_match;
     uid_t                          uid;   /* user id, if any */
@@ -53,7 +57,7 @@ struct pa_classify_stream_def {
     char                          *clnam; /* client name, if any */
     char                          *sname; /* active routing sink name, if any */
     uid_t                          sact;  /* routing sink active */
-    char                          *group; /* policy group name */
+    const char                    *group; /* policy group name, interned */
     uint32_t                       flags; /* PA_POLICY_LOCAL_ROUTE |
                                              PA_POLICY_LOCAL_MUTE   */
     pa_proplist                   *properties;
@@ -62,6 +66,9 @@ struct pa_classify_stream_def {
 struct pa_classify_stream {
     pa_hashmap                    *app_id_map;
     struct pa_classify_stream_def *defs;
+    pa_hashmap                    *sname_map;    /* sname -> def chain */
+    char                          *active_sname; /* last routed sink type */
+    const char                    *dflt_group;   /* interned default group */
 };
 
 struct pa_classify_port_config_entry {
@@ -77,9 +84,10 @@ struct pa_classify_port_entry {
 };
 
 struct pa_classify_device_data {
-    pa_idxset  *ports; /* Contains pa_classify_port_entry structs. If
-                        * the device type doesn't require setting any ports,
-                        * this is NULL. */
+    struct pa_classify_port_entry *ports; /* If the device type doesn't
+                                           * require setting any ports,
+                                           * this is NULL. */
+    uint32_t    nport;
     char       *module;     /* If module is defined for device when device
                              * is activated that module is loaded. */
     char       *module_args;
@@ -88,7 +96,7 @@ struct pa_classify_device_data {
 };
 
 struct pa_classify_device_def {
-    char                            *type;  /* device type, e.g. ihf */
+    const char                      *type;  /* device type, e.g. ihf */
                                             /* for classification */
     pa_policy_match_object          *dev_match;
     struct pa_classify_device_data   data;  /* data associated with device */
@@ -96,6 +104,7 @@ struct pa_classify_device_def {
 
 struct pa_classify_device {
     int                              ndef;
+    int                              nalloc;  /* incl. the terminating def */
     struct pa_classify_device_def    defs[1];
 };
 
@@ -106,29 +115,70 @@ struct pa_classify_card_data {
 };
 
 struct pa_classify_card_def {
-    char                        *type;    /* handled device name, e.g ihf */
+    const char                  *type;    /* handled device name, e.g ihf */
     struct pa_classify_card_data data[2]; /* data associated with device 'type' */
 };
 
 struct pa_classify_card {
     int                          ndef;
+    int                          nalloc;  /* incl. the terminating def */
     struct pa_classify_card_def  defs[1];
 };
 
+typedef void (*pa_classify_loads_done_cb)(struct userdata *, bool);
+
 struct pa_classify_module {
-    const char                  *module_name;
-    const char                  *module_args;
+    char                        *module_name;
+    char                        *module_args;
     pa_module                   *module;
     uint32_t                     flags;
+    pa_usec_t                    load_time;  /* what loading it took */
+};
+
+enum pa_classify_op {
+    pa_classify_op_stream = 0,
+    pa_classify_op_sink,
+    pa_classify_op_source,
+    pa_classify_op_card,
+    pa_classify_op_max
+};
+
+struct pa_classify_op_stats {
+    uint64_t                     calls;
+    uint64_t                     nsec;     /* total time spent */
+};
+
+/* Match results of the device or card definitions per object. The bits
+ * are computed on first use and dropped when the proplist of the object
+ * changes, when it goes away or when the definitions change. */
+struct pa_classify_cache {
+    pa_hashmap                  *objects;  /* object -> match bits */
+    pa_hook_slot                *proplist;
+    pa_hook_slot                *unlink;
 };
 
+/* The definitions of streams, devices and cards, including their match
+ * objects and strings, live in an arena per kind that is replaced as a
+ * whole when the definitions of that kind are reloaded. */
 struct pa_classify {
+    struct pa_policy_arena      *stream_arena;
+    struct pa_policy_arena      *device_arena;
+    struct pa_policy_arena      *card_arena;
     struct pa_classify_stream    streams;
     struct pa_classify_device   *sinks;
     struct pa_classify_device   *sources;
     struct pa_classify_card     *cards;
     struct pa_classify_module    module[PA_POLICY_MODULE_COUNT];
+    struct pa_classify_module    pending[PA_POLICY_MODULE_COUNT]; /* deferred loads */
+    bool                         defer_loads;
+    pa_defer_event              *load_event;
+    pa_classify_loads_done_cb    loads_done;
     pa_hook_slot                *module_unlink_hook_slot;
+    struct pa_classify_cache     sink_cache;
+    struct pa_classify_cache     source_cache;
+    struct pa_classify_cache     card_cache;
+    bool                         timing;   /* collect the op stats */
+    struct pa_classify_op_stats  stats[pa_classify_op_max];
 };
 
 struct pa_classify_result {
@@ -138,6 +188,16 @@ struct pa_classify_result {
 
 struct pa_classify *pa_classify_new(struct userdata *);
 void  pa_classify_free(struct userdata *u);
+void  pa_classify_enable_timing(struct userdata *);
+void  pa_classify_log_timing(struct userdata *);
+struct pa_classify_stream_diff *pa_classify_reset_streams(struct userdata *);
+void  pa_classify_stream_diff_free(struct pa_classify_stream_diff *);
+bool  pa_classify_stream_diff_check(struct userdata *,
+                                    struct pa_classify_stream_diff *,
+                                    struct pa_client *, pa_proplist *,
+                                    const char **, const char **);
+void  pa_classify_reset_devices(struct userdata *);
+void  pa_classify_reset_cards(struct userdata *);
 void  pa_classify_add_sink(struct userdata *, const char *, const char *,
                            enum pa_classify_method, const char *, pa_idxset *,
                            const char *module, const char *module_args,
@@ -169,6 +229,11 @@ const char *pa_classify_sink_input(struct userdata *u, struct pa_sink_input *sin
 const char *pa_classify_sink_input_by_data(struct userdata *u,
                                            struct pa_sink_input_new_data *sinp,
                                            uint32_t *flags);
+/* classifies against the given proplist, which may get modified */
+const char *pa_classify_sink_input_by_proplist(struct userdata *u,
+                                               struct pa_client *client,
+                                               pa_proplist *proplist,
+                                               uint32_t *flags);
 const char *pa_classify_source_output(struct userdata *u, struct pa_source_output *sout);
 const char *pa_classify_source_output_by_data(struct userdata *u,
                                         struct pa_source_output_new_data *data);
@@ -187,6 +252,7 @@ int   pa_classify_sink_all_types(struct userdata *u,
 int   pa_classify_source_all_types(struct userdata *u,
                                    struct pa_classify_result **result);
 
+bool  pa_classify_has_type(struct userdata *, const char *);
 int   pa_classify_is_sink_typeof(struct userdata *, struct pa_sink *,
                                  const char *,
                                  struct pa_classify_device_data **);
@@ -205,12 +271,19 @@ int pa_classify_is_port_sink_typeof(struct userdata *, struct pa_sink *,
 int pa_classify_is_port_source_typeof(struct userdata *, struct pa_source *,
                                       const char *,
                                       struct pa_classify_device_data **);
-struct pa_classify_port_entry *pa_classify_get_port_entry(struct pa_classify_device_data *,
+struct pa_classify_port_entry *pa_classify_get_port_entry(struct userdata *,
+                                                          struct pa_classify_device_data *,
                                                           enum pa_policy_object_type,
                                                           void *);
+char *pa_classify_match_props(struct userdata *, enum pa_policy_object_type,
+                              pa_proplist *);
 
 int pa_classify_update_module(struct userdata *u, uint32_t dir, struct pa_classify_device_data *device);
 void pa_classify_update_modules(struct userdata *u, uint32_t dir, const char *type);
+void pa_classify_preload_modules(struct userdata *u);
+void pa_classify_defer_module_loads(struct userdata *u);
+void pa_classify_flush_module_loads(struct userdata *u);
+bool pa_classify_run_module_loads(struct userdata *u, pa_classify_loads_done_cb cb);
 
 #endif
 
@@ -13,6 +13,7 @@
 
 #include "userdata.h"
 #include "client-ext.h"
+#include "log.h"
 
 static void handle_client_events(pa_core *, pa_subscription_event_type_t,
 				 uint32_t, void *);
@@ -249,13 +250,14 @@ static void handle_new_or_modified_client(struct userdata  *u,
     uint32_t idx = client->index;
     char     buf[1024];
 
-    pa_log_debug("new/modified client (idx=%d) %s", idx,
-                 client_ext_dump(client, buf, sizeof(buf)));
+    pa_policy_log_debug(u, pa_policy_log_client,
+                        "new/modified client (idx=%d) %s", idx,
+                        client_ext_dump(client, buf, sizeof(buf)));
 }
 
 static void handle_removed_client(struct userdata *u, uint32_t idx)
 {
-    pa_log_debug("client removed (idx=%d)", idx);
+    pa_policy_log_debug(u, pa_policy_log_client, "client removed (idx=%d)", idx);
 }
 
 
@@ -0,0 +1,350 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "config-cache.h"
+
+#define CACHE_MAGIC     "PAPC"
+#define CACHE_VERSION   2
+#define CACHE_LINE_MAX  512     /* same as the line buffer of the parser */
+
+struct cache_header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t ninput;
+    uint32_t nline;
+    uint32_t size;              /* size of the whole image */
+};
+
+struct cache_input {            /* followed by the path incl. '\0' */
+    uint64_t size;
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+    uint32_t pathlen;
+};
+
+struct cache_line {             /* followed by the line incl. '\0' */
+    uint32_t file;              /* index of the input file */
+    int32_t  lineno;
+    uint32_t len;
+};
+
+struct pa_policy_config_cache {
+    char     *path;
+    bool      valid;            /* false if some input could not be stat'ed */
+    uint32_t  ninput;
+    uint32_t  nline;
+    char     *inputs;           /* serialized cache_input records */
+    size_t    inputlen;
+    char     *lines;            /* serialized cache_line records */
+    size_t    linelen;
+    size_t    linealloc;
+};
+
+static void append(char **buf, size_t *len, size_t *alloc,
+                   const void *data, size_t size);
+static int  input_stat(const char *, struct cache_input *);
+static int  inputs_match(const char *, size_t *, size_t,
+                         char **, unsigned);
+
+
+struct pa_policy_config_cache *pa_policy_config_cache_new(const char *path,
+                                                          char **inputs,
+                                                          unsigned ninput)
+{
+    struct pa_policy_config_cache *cache;
+    struct cache_input             in;
+    size_t                         alloc = 0;
+    unsigned                       i;
+
+    pa_assert(path);
+    pa_assert(inputs || !ninput);
+
+    cache = pa_xnew0(struct pa_policy_config_cache, 1);
+    cache->path   = pa_xstrdup(path);
+    cache->valid  = true;
+    cache->ninput = ninput;
+
+    for (i = 0;  i < ninput;  i++) {
+        if (input_stat(inputs[i], &in) < 0) {
+            cache->valid = false;
+            break;
+        }
+
+        append(&cache->inputs, &cache->inputlen, &alloc, &in, sizeof(in));
+        append(&cache->inputs, &cache->inputlen, &alloc,
+               inputs[i], in.pathlen);
+    }
+
+    return cache;
+}
+
+void pa_policy_config_cache_free(struct pa_policy_config_cache *cache)
+{
+    if (cache) {
+        pa_xfree(cache->path);
+        pa_xfree(cache->inputs);
+        pa_xfree(cache->lines);
+        pa_xfree(cache);
+    }
+}
+
+void pa_policy_config_cache_record(struct pa_policy_config_cache *cache,
+                                   unsigned file, int lineno, const char *line)
+{
+    struct cache_line rec;
+
+    pa_assert(cache);
+    pa_assert(line);
+
+    rec.file   = file;
+    rec.lineno = lineno;
+    rec.len    = strlen(line) + 1;
+
+    if (rec.len > CACHE_LINE_MAX) {
+        cache->valid = false;
+        return;
+    }
+
+    append(&cache->lines, &cache->linelen, &cache->linealloc, &rec, sizeof(rec));
+    append(&cache->lines, &cache->linelen, &cache->linealloc, line, rec.len);
+    cache->nline++;
+}
+
+int pa_policy_config_cache_save(struct pa_policy_config_cache *cache)
+{
+    struct cache_header hdr;
+    char               *tmp;
+    FILE               *f;
+    int                 ret = -1;
+
+    pa_assert(cache);
+
+    if (!cache->valid)
+        return -1;
+
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CACHE_VERSION;
+    hdr.ninput  = cache->ninput;
+    hdr.nline   = cache->nline;
+    hdr.size    = sizeof(hdr) + cache->inputlen + cache->linelen;
+
+    /* write a temporary file and rename it, so readers never see half of it */
+    tmp = pa_sprintf_malloc("%s.tmp", cache->path);
+
+    if ((f = fopen(tmp, "w")) == NULL) {
+        pa_log("can't create policy cache '%s': %s", tmp, strerror(errno));
+        goto out;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        (cache->inputlen && fwrite(cache->inputs, cache->inputlen, 1, f) != 1) ||
+        (cache->linelen  && fwrite(cache->lines,  cache->linelen,  1, f) != 1))
+    {
+        pa_log("can't write policy cache '%s': %s", tmp, strerror(errno));
+        fclose(f);
+        unlink(tmp);
+        goto out;
+    }
+
+    if (fclose(f) != 0 || rename(tmp, cache->path) < 0) {
+        pa_log("can't save policy cache '%s': %s", cache->path, strerror(errno));
+        unlink(tmp);
+        goto out;
+    }
+
+    pa_log_info("policy cache '%s' saved (%u lines, %u bytes)",
+                cache->path, hdr.nline, hdr.size);
+    ret = 0;
+
+ out:
+    pa_xfree(tmp);
+    return ret;
+}
+
+int pa_policy_config_cache_replay(const char *path, char **inputs,
+                                  unsigned ninput,
+                                  pa_policy_config_cache_line_cb cb,
+                                  void *data)
+{
+    struct cache_header hdr;
+    struct cache_line   rec;
+    struct stat         st;
+    const char         *image = MAP_FAILED;
+    char                line[CACHE_LINE_MAX];
+    size_t              size = 0;
+    size_t              offs;
+    size_t              lines;
+    uint32_t            i;
+    int                 fd;
+    int                 ret = 0;
+
+    pa_assert(path);
+    pa_assert(cb);
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        if (errno != ENOENT)
+            pa_log_info("can't open policy cache '%s': %s", path, strerror(errno));
+        return 0;
+    }
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr))
+        goto out;
+
+    size  = st.st_size;
+    image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (image == MAP_FAILED)
+        goto out;
+
+    memcpy(&hdr, image, sizeof(hdr));
+
+    if (memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic)) ||
+        hdr.version != CACHE_VERSION || hdr.size != size ||
+        hdr.ninput != ninput)
+    {
+        pa_log_info("policy cache '%s' is of a different version", path);
+        goto out;
+    }
+
+    offs = sizeof(hdr);
+
+    if (!inputs_match(image, &offs, size, inputs, ninput)) {
+        pa_log_info("policy cache '%s' is stale", path);
+        goto out;
+    }
+
+    /* check all records before replaying anything, as replay can't be undone */
+    for (lines = offs, i = 0;  i < hdr.nline;  i++) {
+        if (size - lines < sizeof(rec))
+            goto corrupt;
+
+        memcpy(&rec, image + lines, sizeof(rec));
+        lines += sizeof(rec);
+
+        if (rec.file >= ninput || rec.len == 0 || rec.len > CACHE_LINE_MAX ||
+            size - lines < rec.len ||
+            image[lines + rec.len - 1] != '\0')
+            goto corrupt;
+
+        lines += rec.len;
+    }
+
+    if (lines != size)
+        goto corrupt;
+
+    for (i = 0;  i < hdr.nline;  i++) {
+        memcpy(&rec, image + offs, sizeof(rec));
+        offs += sizeof(rec);
+
+        /* the parser modifies the line in place */
+        memcpy(line, image + offs, rec.len);
+        offs += rec.len;
+
+        cb(data, rec.file, rec.lineno, line);
+    }
+
+    ret = 1;
+    goto out;
+
+ corrupt:
+    pa_log("policy cache '%s' is corrupted", path);
+
+ out:
+    if (image != MAP_FAILED)
+        munmap((void *)image, size);
+
+    close(fd);
+
+    return ret;
+}
+
+
+static void append(char **buf, size_t *len, size_t *alloc,
+                   const void *data, size_t size)
+{
+    if (*len + size > *alloc) {
+        *alloc = (*alloc ? *alloc * 2 : 4096);
+
+        if (*alloc < *len + size)
+            *alloc = *len + size;
+
+        *buf = pa_xrealloc(*buf, *alloc);
+    }
+
+    memcpy(*buf + *len, data, size);
+    *len += size;
+}
+
+static int input_stat(const char *path, struct cache_input *in)
+{
+    struct stat st;
+
+    if (stat(path, &st) < 0)
+        return -1;
+
+    memset(in, 0, sizeof(*in));
+    in->size       = st.st_size;
+    in->mtime_sec  = st.st_mtim.tv_sec;
+    in->mtime_nsec = st.st_mtim.tv_nsec;
+    in->pathlen    = strlen(path) + 1;
+
+    return 0;
+}
+
+static int inputs_match(const char *image, size_t *offs, size_t size,
+                        char **inputs, unsigned ninput)
+{
+    struct cache_input cached;
+    struct cache_input current;
+    unsigned           i;
+
+    for (i = 0;  i < ninput;  i++) {
+        if (size - *offs < sizeof(cached))
+            return false;
+
+        memcpy(&cached, image + *offs, sizeof(cached));
+        *offs += sizeof(cached);
+
+        if (input_stat(inputs[i], &current) < 0)
+            return false;
+
+        if (cached.pathlen != current.pathlen ||
+            size - *offs < cached.pathlen ||
+            memcmp(image + *offs, inputs[i], cached.pathlen))
+            return false;
+
+        *offs += cached.pathlen;
+
+        if (cached.size       != current.size      ||
+            cached.mtime_sec  != current.mtime_sec ||
+            cached.mtime_nsec != current.mtime_nsec)
+            return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
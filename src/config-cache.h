@@ -0,0 +1,41 @@
+#ifndef fooconfigcachefoo
+#define fooconfigcachefoo
+
+/*
+ * Binary cache of the policy configuration. The image holds the
+ * significant, already preprocessed lines of every config file together
+ * with the path, size and modification time of each input file. As long
+ * as none of the inputs changed the lines are replayed from the image
+ * instead of being read and preprocessed from the text files.
+ *
+ * The cache saves the file reading and the preprocessing only. The
+ * replayed lines still go through the section parsers, and the groups,
+ * devices, streams and context rules are built from them as before. The
+ * built definitions are not stored, as they hold compiled regular
+ * expressions and pointers into the intern pool, neither of which can
+ * be mapped back from a file.
+ */
+
+struct pa_policy_config_cache;
+
+typedef void (*pa_policy_config_cache_line_cb)(void *, unsigned, int, char *);
+
+struct pa_policy_config_cache *pa_policy_config_cache_new(const char *,
+                                                          char **, unsigned);
+void pa_policy_config_cache_free(struct pa_policy_config_cache *);
+void pa_policy_config_cache_record(struct pa_policy_config_cache *,
+                                   unsigned, int, const char *);
+int  pa_policy_config_cache_save(struct pa_policy_config_cache *);
+
+int  pa_policy_config_cache_replay(const char *, char **, unsigned,
+                                   pa_policy_config_cache_line_cb, void *);
+
+#endif /* fooconfigcachefoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -21,11 +21,18 @@
 #include <config.h>
 #endif
 
+#include <pulse/rtclock.h>
+
+#include <pulsecore/atomic.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/dynarray.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/log.h>
+#include <pulsecore/strbuf.h>
+#include <pulsecore/thread.h>
 
 #include "config-file.h"
+#include "config-cache.h"
 #include "policy-group.h"
 #include "classify.h"
 #include "context.h"
@@ -40,6 +47,10 @@
 
 #define DEFAULT_PORT_CHANGE_DELAY_MS (200)
 
+#define PARSE_WORKER_MAX           4
+
+#define BUFSIZE                    512
+
 #define DEV_PORT_SEPARATOR         "->"
 #define DEV_PORT_SEPARATOR_LEN     (2)
 
@@ -116,6 +127,10 @@ struct groupdef {
     pa_proplist             *properties;
     char                    *flags;
     int                      flags_lineno;
+    char                    *media_hysteresis;
+    int                      media_hysteresis_lineno;
+    char                    *uncork_grace;
+    int                      uncork_grace_lineno;
 };
 
 struct devicedef {
@@ -196,12 +211,65 @@ struct sections {
 };
 
 
-static int parse_line(struct userdata *u, int lineno, char *buf, struct sections *sections, int *success);
+struct deferred {               /* left for the main thread by a worker */
+    int    lineno;
+    char  *line;                /* line preceding the first section header */
+    char  *var;                 /* or a variable definition */
+    char  *value;
+};
+
+struct config_line {
+    int                  lineno;
+    char                *text;      /* preprocessed */
+};
+
+struct config_file {            /* one input file of the config snapshot */
+    char                *path;
+    off_t                size;      /* -1 if the file could not be stat'ed */
+    struct timespec      mtime;
+    struct config_line  *lines;
+    unsigned             nline;
+    unsigned             aline;
+    int                  origin;    /* file the lines were taken from or -1 */
+};
+
+struct pa_policy_config {       /* the loaded config, kept for reloading */
+    char                *cfgfile;
+    char                *cfgdir;
+    struct config_file  *files;
+    unsigned             nfile;
+    struct config_file  *pending;   /* scanned, not yet committed */
+    unsigned             npending;
+};
+
+struct parser {
+    struct userdata               *u;
+    struct sections               *sections;
+    struct pa_policy_config_cache *cache;   /* records the lines if set */
+    struct pa_policy_config       *config;  /* keeps the lines if set */
+    unsigned                       file;    /* index of the current file */
+    bool                           worker;  /* runs on a worker thread */
+    struct deferred               *deferred;
+    unsigned                       ndeferred;
+    int                            success;
+};
+
+struct parse_job {              /* config files shared by the workers */
+    char          **files;
+    struct parser  *parsers;    /* one for each file */
+    unsigned        count;
+    pa_atomic_t     next;       /* index of the next file to parse */
+};
+
+static int parse_line(struct parser *, int lineno, char *buf);
+static void parse_cached_line(void *, unsigned, int, char *);
+static void parse_definition(void *, int, char *);
 static int preprocess_buffer(int, char *, char *);
 
 static int section_header(int, char *, enum section_type *);
 static int section_open(struct userdata *, enum section_type,struct section *);
 static int section_close(struct userdata *, struct section *);
+static void section_free(struct section *);
 static int section_close_all(struct userdata *u, struct sections *sections);
 
 static int groupdef_parse(int, char *, struct groupdef *);
@@ -235,101 +303,636 @@ const char *policy_file_path(const char *file, char *buf, size_t len);
 
 static char **split_strv(const char *s, const char *delimiter);
 
-static int policy_parse_config_file(struct userdata *u, const char *cfgfile, struct sections *sections);
-static int policy_parse_files_in_configdir(struct userdata *u, const char *cfgdir, struct sections *sections);
-
-int pa_policy_parse_config_files(struct userdata *u, const char *cfgfile, const char *cfgdir)
+static int config_files_collect(const char *cfgfile, const char *cfgdir,
+                                char ***ret_files, unsigned *ret_count);
+static void config_file_parse(struct parser *, const char *);
+static void config_files_parse_parallel(struct parser *, char **, unsigned);
+static void defer(struct parser *, int, const char *, char *, char *);
+
+static void config_file_init(struct config_file *, char *);
+static void config_file_done(struct config_file *);
+static void config_file_add_line(struct config_file *, int, const char *);
+static void config_file_read(struct config_file *);
+static uint32_t section_flag(enum section_type);
+static void config_signatures(struct config_file *, unsigned, char **);
+static void config_files_free(struct config_file *, unsigned);
+
+int pa_policy_parse_config_files(struct userdata *u, const char *cfgfile,
+                                 const char *cfgdir, const char *cachefile,
+                                 bool keep)
 {
-    struct sections sections;
-    int             ret;
+    struct sections          sections;
+    struct parser            parser;
+    struct pa_policy_config *config = NULL;
+    char                   **files;
+    unsigned                 count;
+    unsigned                 i;
+    pa_usec_t                start;
+    bool                     cached = false;
+    int                      ret;
+
+    start = pa_rtclock_now();
 
     memset(&sections, 0, sizeof(sections));
     PA_LLIST_HEAD_INIT(struct section, sections.sec);
 
-    ret = policy_parse_config_file(u, cfgfile, &sections);
-    if (ret)
-        ret = policy_parse_files_in_configdir(u, cfgdir, &sections);
+    memset(&parser, 0, sizeof(parser));
+    parser.u        = u;
+    parser.sections = &sections;
+    parser.success  = true;     /* assume successful operation */
+
+    if (!config_files_collect(cfgfile, cfgdir, &files, &count))
+        return 0;
+
+    if (keep) {
+        config = pa_xnew0(struct pa_policy_config, 1);
+        config->cfgfile = pa_xstrdup(cfgfile);
+        config->cfgdir  = pa_xstrdup(cfgdir);
+        config->files   = pa_xnew0(struct config_file, count);
+        config->nfile   = count;
+
+        for (i = 0;  i < count;  i++)
+            config_file_init(config->files + i, pa_xstrdup(files[i]));
+
+        parser.config = config;
+    }
+
+    if (cachefile && pa_policy_config_cache_replay(cachefile, files, count,
+                                                   parse_cached_line, &parser) > 0)
+        cached = true;
+    else {
+        if (cachefile) {
+            /* the cache records lines in file order, so go sequentially */
+            parser.cache = pa_policy_config_cache_new(cachefile, files, count);
+
+            for (i = 0;  i < count;  i++) {
+                parser.file = i;
+                config_file_parse(&parser, files[i]);
+            }
+        }
+        else
+            config_files_parse_parallel(&parser, files, count);
+    }
+
+    ret = parser.success;
+
     if (ret)
         ret = section_close_all(u, &sections);
-    if (ret)
-        pa_log_debug("all configs parsed");
+
+    if (parser.cache) {
+        /* don't cache a configuration that does not load */
+        if (ret)
+            pa_policy_config_cache_save(parser.cache);
+
+        pa_policy_config_cache_free(parser.cache);
+    }
+
+    if (ret) {
+        pa_log_info("%u config file(s) loaded %s in %llu usec", count,
+                    cached ? "from cache" : "from text",
+                    (unsigned long long)(pa_rtclock_now() - start));
+    }
+
+    if (ret && config) {
+        pa_policy_config_free(u->config);
+        u->config = config;
+    }
+    else
+        pa_policy_config_free(config);
+
+    for (i = 0;  i < count;  i++)
+        pa_xfree(files[i]);
+
+    pa_xfree(files);
 
     return ret;
 }
 
-int policy_parse_config_file(struct userdata *u, const char *cfgfile, struct sections *sections)
+void pa_policy_config_free(struct pa_policy_config *config)
 {
-#define BUFSIZE 512
-#define CONFIG_OVERRIDE_SUFFIX ".override"
+    unsigned i;
 
-    FILE              *f;
-    char               cfgpath[PATH_MAX - sizeof(CONFIG_OVERRIDE_SUFFIX)];
-    char               ovrpath[PATH_MAX];
-    char              *path;
-    char               buf[BUFSIZE];
-    int                lineno;
-    int                success;
+    if (config) {
+        pa_policy_config_discard(config);
+
+        for (i = 0;  i < config->nfile;  i++)
+            config_file_done(config->files + i);
+
+        pa_xfree(config->files);
+        pa_xfree(config->cfgfile);
+        pa_xfree(config->cfgdir);
+        pa_xfree(config);
+    }
+}
+
+void pa_policy_config_get_paths(struct pa_policy_config *config,
+                                const char **cfgfile, const char **cfgdir)
+{
+    pa_assert(config);
+    pa_assert(cfgfile);
+    pa_assert(cfgdir);
+
+    *cfgfile = config->nfile > 0 ? config->files[0].path : NULL;
+    *cfgdir  = config->cfgdir ? config->cfgdir : DEFAULT_CONFIG_DIRECTORY;
+}
+
+int pa_policy_config_scan(struct userdata *u, uint32_t *changed)
+{
+    struct pa_policy_config *config;
+    struct config_file      *files;
+    struct config_file      *old;
+    char                    *before[section_max];
+    char                    *after[section_max];
+    char                   **paths;
+    unsigned                 count;
+    unsigned                 i, j;
+    int                      nread = 0;
 
     pa_assert(u);
+    pa_assert(changed);
+    pa_assert_se((config = u->config));
 
-    if (!cfgfile)
-        cfgfile = DEFAULT_CONFIG_FILE;
+    *changed = 0;
+
+    /* a scan not committed or discarded yet is superseded */
+    pa_policy_config_discard(config);
+
+    if (!config_files_collect(config->cfgfile, config->cfgdir, &paths, &count))
+        return -1;
+
+    config_signatures(config->files, config->nfile, before);
+
+    files = pa_xnew0(struct config_file, count);
+
+    for (i = 0;  i < count;  i++) {
+        config_file_init(files + i, paths[i]);
+
+        for (old = NULL, j = 0;  j < config->nfile;  j++) {
+            if (pa_streq(config->files[j].path, files[i].path)) {
+                old = config->files + j;
+                break;
+            }
+        }
+
+        if (old && old->size >= 0 && old->size == files[i].size &&
+            old->mtime.tv_sec  == files[i].mtime.tv_sec &&
+            old->mtime.tv_nsec == files[i].mtime.tv_nsec)
+        {
+            /* unchanged, reuse the lines read last time */
+            files[i].lines  = old->lines;
+            files[i].nline  = old->nline;
+            files[i].aline  = old->aline;
+            files[i].origin = j;
+            old->lines = NULL;
+            old->nline = old->aline = 0;
+        }
+        else {
+            config_file_read(files + i);
+            nread++;
+        }
+    }
+
+    pa_xfree(paths);
+
+    config->pending  = files;
+    config->npending = count;
+
+    config_signatures(files, count, after);
+
+    for (i = 0;  i < section_max;  i++) {
+        if (strcmp(before[i], after[i]))
+            *changed |= section_flag(i);
+
+        pa_xfree(before[i]);
+        pa_xfree(after[i]);
+    }
+
+    return nread;
+}
+
+/* takes the scanned files into use as the config snapshot */
+void pa_policy_config_commit(struct pa_policy_config *config)
+{
+    pa_assert(config);
+
+    if (config->pending) {
+        config_files_free(config->files, config->nfile);
+
+        config->files    = config->pending;
+        config->nfile    = config->npending;
+        config->pending  = NULL;
+        config->npending = 0;
+    }
+}
+
+/* drops the scanned files, keeping the snapshot as it was */
+void pa_policy_config_discard(struct pa_policy_config *config)
+{
+    struct config_file *file;
+    struct config_file *old;
+    unsigned            i;
+
+    pa_assert(config);
+
+    if (config->pending) {
+        for (i = 0;  i < config->npending;  i++) {
+            file = config->pending + i;
+
+            if (file->origin >= 0) {
+                old = config->files + file->origin;
+                old->lines = file->lines;
+                old->nline = file->nline;
+                old->aline = file->aline;
+                file->lines = NULL;
+                file->nline = file->aline = 0;
+            }
+        }
+
+        config_files_free(config->pending, config->npending);
+
+        config->pending  = NULL;
+        config->npending = 0;
+    }
+}
+
+int pa_policy_config_apply(struct userdata *u, uint32_t types)
+{
+    struct pa_policy_config *config;
+    struct config_file      *file;
+    struct sections          sections;
+    struct section          *section, *tmp, *reverse;
+    struct parser            parser;
+    char                     line[BUFSIZE];
+    unsigned                 i, j;
+    int                      ret;
+
+    pa_assert(u);
+    pa_assert_se((config = u->config));
+
+    PA_LLIST_HEAD_INIT(struct section, sections.sec);
+
+    memset(&parser, 0, sizeof(parser));
+    parser.u        = u;
+    parser.sections = &sections;
+    parser.success  = true;
 
-    policy_file_path(cfgfile, cfgpath, sizeof(cfgpath));
-    snprintf(ovrpath, PATH_MAX, "%s" CONFIG_OVERRIDE_SUFFIX, cfgpath);
+    for (i = 0;  i < config->nfile;  i++) {
+        file = config->files + i;
 
-    if ((f = fopen(ovrpath,"r")) != NULL)
-        path = ovrpath;
-    else if ((f = fopen(cfgpath, "r")) != NULL)
-        path = cfgpath;
+        for (j = 0;  j < file->nline;  j++) {
+            pa_strlcpy(line, file->lines[j].text, sizeof(line));
+            parse_definition(&parser, file->lines[j].lineno, line);
+        }
+    }
+
+    ret = parser.success;
+
+    PA_LLIST_HEAD_INIT(struct section, reverse);
+
+    PA_LLIST_FOREACH_SAFE(section, tmp, sections.sec) {
+        PA_LLIST_REMOVE(struct section, sections.sec, section);
+        PA_LLIST_PREPEND(struct section, reverse, section);
+    }
+
+    /* only the requested kind of sections are taken into use */
+    PA_LLIST_FOREACH_SAFE(section, tmp, reverse) {
+        if (section_flag(section->type) & types) {
+            if (!section_close(u, section))
+                ret = 0;
+        }
+        else
+            section_free(section);
+
+        pa_xfree(section);
+    }
+
+    return ret;
+}
+
+static void config_file_init(struct config_file *file, char *path)
+{
+    struct stat st;
+
+    memset(file, 0, sizeof(*file));
+    file->path   = path;
+    file->origin = -1;
+
+    if (stat(path, &st) < 0)
+        file->size = -1;
     else {
-        pa_log("Can't open config file '%s': %s", cfgpath, strerror(errno));
-        return 0;
+        file->size  = st.st_size;
+        file->mtime = st.st_mtim;
+    }
+}
+
+static void config_file_done(struct config_file *file)
+{
+    unsigned i;
+
+    for (i = 0;  i < file->nline;  i++)
+        pa_xfree(file->lines[i].text);
+
+    pa_xfree(file->lines);
+    pa_xfree(file->path);
+}
+
+static void config_file_add_line(struct config_file *file, int lineno,
+                                 const char *text)
+{
+    if (file->nline >= file->aline) {
+        file->aline = file->aline ? file->aline * 2 : 32;
+        file->lines = pa_xrenew(struct config_line, file->lines, file->aline);
+    }
+
+    file->lines[file->nline].lineno = lineno;
+    file->lines[file->nline].text   = pa_xstrdup(text);
+    file->nline++;
+}
+
+static void config_file_read(struct config_file *file)
+{
+    FILE *f;
+    char  buf[BUFSIZE];
+    char  line[BUFSIZE];
+    int   lineno;
+
+    pa_log_info("reading config file '%s'", file->path);
+
+    if ((f = fopen(file->path, "r")) == NULL) {
+        pa_log("Can't open config file '%s': %s", file->path, strerror(errno));
+        return;
+    }
+
+    for (lineno = 1;  fgets(buf, BUFSIZE, f) != NULL;  lineno++) {
+        if (preprocess_buffer(lineno, buf, line) < 0)
+            break;
+
+        if (*line != '\0')
+            config_file_add_line(file, lineno, line);
     }
 
+    fclose(f);
+}
+
+static uint32_t section_flag(enum section_type type)
+{
+    switch (type) {
+    case section_group:     return PA_POLICY_CONFIG_GROUP;
+    case section_device:    return PA_POLICY_CONFIG_DEVICE;
+    case section_card:      return PA_POLICY_CONFIG_CARD;
+    case section_stream:    return PA_POLICY_CONFIG_STREAM;
+    case section_context:   return PA_POLICY_CONFIG_CONTEXT;
+    case section_activity:  return PA_POLICY_CONFIG_ACTIVITY;
+    case section_variable:  return PA_POLICY_CONFIG_VARIABLE;
+    default:                return 0;
+    }
+}
+
+/* Concatenate the lines of each kind of section in parse order, so that
+ * two configs can be compared section kind by section kind. */
+static void config_files_free(struct config_file *files, unsigned nfile)
+{
+    unsigned i;
+
+    for (i = 0;  i < nfile;  i++)
+        config_file_done(files + i);
+
+    pa_xfree(files);
+}
+
+static void config_signatures(struct config_file *files, unsigned nfile,
+                              char **sigs)
+{
+    pa_strbuf           *bufs[section_max];
+    struct config_file  *file;
+    struct config_line  *line;
+    enum section_type    type = section_unknown;
+    enum section_type    newtype;
+    unsigned             i, j;
+
+    for (i = 0;  i < section_max;  i++)
+        bufs[i] = pa_strbuf_new();
+
+    for (i = 0;  i < nfile;  i++) {
+        file = files + i;
+
+        for (j = 0;  j < file->nline;  j++) {
+            line = file->lines + j;
+
+            /* lines before the first header continue the previous section */
+            if (line->text[0] == '[' &&
+                section_header(line->lineno, line->text, &newtype))
+                type = newtype;
+
+            pa_strbuf_puts(bufs[type], line->text);
+            pa_strbuf_putc(bufs[type], '\n');
+        }
+    }
+
+    for (i = 0;  i < section_max;  i++)
+        sigs[i] = pa_strbuf_to_string_free(bufs[i]);
+}
+
+static void config_file_parse(struct parser *parser, const char *path)
+{
+    FILE *f;
+    char  buf[BUFSIZE];
+    int   lineno;
+
     pa_log_info("parsing config file '%s'", path);
 
-    success = true;                    /* assume successful operation */
+    if ((f = fopen(path, "r")) == NULL) {
+        pa_log("Can't open config file '%s': %s", path, strerror(errno));
+        return;
+    }
 
     for (errno = 0, lineno = 1;  fgets(buf, BUFSIZE, f) != NULL;  lineno++) {
-        if (!parse_line(u, lineno, buf, sections, &success))
+        if (!parse_line(parser, lineno, buf))
             break;
     }
 
     if (fclose(f) != 0) {
         pa_log("Can't close config file '%s': %s", path, strerror(errno));
     }
+}
+
+static void parse_worker(void *data)
+{
+    struct parse_job *job = data;
+    unsigned          i;
+
+    while ((i = (unsigned)pa_atomic_inc(&job->next)) < job->count)
+        config_file_parse(job->parsers + i, job->files[i]);
+}
+
+/* Lex and parse the files on worker threads, each into a section list of
+ * its own. The lists are then merged on the main thread in file order,
+ * which gives the same result as parsing the files one after another. */
+static void config_files_parse_parallel(struct parser *parser, char **files,
+                                        unsigned count)
+{
+    struct parse_job  job;
+    struct parser    *fp;
+    struct sections  *fsections;
+    struct sections   ordered;
+    struct section   *section;
+    struct deferred  *d;
+    pa_thread       **threads;
+    unsigned          nworker;
+    unsigned          i, j;
+    int               ncpu;
+
+    ncpu = pa_ncpus();
+    nworker = PA_MIN(count, ncpu > 0 ? (unsigned)ncpu : 1);
+    nworker = PA_MIN(nworker, PARSE_WORKER_MAX);
+
+    if (nworker < 2) {
+        for (i = 0;  i < count;  i++) {
+            parser->file = i;
+            config_file_parse(parser, files[i]);
+        }
+        return;
+    }
+
+    job.files   = files;
+    job.count   = count;
+    job.parsers = pa_xnew0(struct parser, count);
+    fsections   = pa_xnew0(struct sections, count);
+    pa_atomic_store(&job.next, 0);
+
+    for (i = 0;  i < count;  i++) {
+        fp = job.parsers + i;
+        PA_LLIST_HEAD_INIT(struct section, fsections[i].sec);
+        fp->sections = fsections + i;
+        fp->config   = parser->config;  /* each worker keeps its own file */
+        fp->file     = i;
+        fp->worker   = true;
+        fp->success  = true;
+    }
+
+    /* the main thread does its share of the work as well */
+    threads = pa_xnew0(pa_thread *, nworker - 1);
+
+    for (i = 0;  i < nworker - 1;  i++)
+        threads[i] = pa_thread_new("policy-config", parse_worker, &job);
+
+    parse_worker(&job);
+
+    for (i = 0;  i < nworker - 1;  i++) {
+        if (threads[i])
+            pa_thread_free(threads[i]);
+    }
+
+    pa_xfree(threads);
+
+    pa_log_debug("%u config files parsed by %u threads", count, nworker);
+
+    for (i = 0;  i < count;  i++) {
+        fp = job.parsers + i;
+
+        for (j = 0;  j < fp->ndeferred;  j++) {
+            d = fp->deferred + j;
+
+            if (d->line) {
+                parse_definition(parser, d->lineno, d->line);
+                pa_xfree(d->line);
+            }
+            else {
+                pa_policy_var_add(parser->u, d->var, d->value);
+                pa_xfree(d->var);
+                pa_xfree(d->value);
+            }
+        }
+
+        /* the per file lists are in reverse order just like the merged one */
+        PA_LLIST_HEAD_INIT(struct section, ordered.sec);
+
+        while ((section = fp->sections->sec)) {
+            PA_LLIST_REMOVE(struct section, fp->sections->sec, section);
+            PA_LLIST_PREPEND(struct section, ordered.sec, section);
+        }
+
+        while ((section = ordered.sec)) {
+            PA_LLIST_REMOVE(struct section, ordered.sec, section);
+            PA_LLIST_PREPEND(struct section, parser->sections->sec, section);
+        }
+
+        if (!fp->success)
+            parser->success = 0;
+
+        pa_xfree(fp->deferred);
+    }
 
-    return success;
+    pa_xfree(fsections);
+    pa_xfree(job.parsers);
 }
 
-int policy_parse_files_in_configdir(struct userdata *u, const char *cfgdir, struct sections *sections)
+static void defer(struct parser *parser, int lineno, const char *line,
+                  char *var, char *value)
 {
-#define BUFSIZE 512
+    struct deferred *d;
+
+    parser->deferred = pa_xrenew(struct deferred, parser->deferred,
+                                 parser->ndeferred + 1);
+
+    d = parser->deferred + parser->ndeferred++;
+    d->lineno = lineno;
+    d->line   = pa_xstrdup(line);
+    d->var    = var;
+    d->value  = value;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Collect the config files in the order they are to be parsed: the main
+ * file (or its override) first, followed by the files of the config
+ * directory in alphabetical order. */
+static int config_files_collect(const char *cfgfile, const char *cfgdir,
+                                char ***ret_files, unsigned *ret_count)
+{
+#define CONFIG_OVERRIDE_SUFFIX ".override"
 
     pa_dynarray       *files = NULL;
     DIR               *d;
-    FILE              *f;
     struct dirent     *e;
     const char        *p;
     char              *q;
     int                l;
+    char               mainpath[PATH_MAX - sizeof(CONFIG_OVERRIDE_SUFFIX)];
+    char               ovrpath[PATH_MAX];
     char               cfgpath[PATH_MAX];
     char             **overrides;
     unsigned           noverride;
-    char               buf[BUFSIZE];
-    int                lineno;
-    unsigned           i, j;
-    int                success;
+    char             **sorted_files;
+    unsigned           count;
+    unsigned           i;
 
-    pa_assert(u);
+    if (!cfgfile)
+        cfgfile = DEFAULT_CONFIG_FILE;
+
+    policy_file_path(cfgfile, mainpath, sizeof(mainpath));
+    snprintf(ovrpath, PATH_MAX, "%s" CONFIG_OVERRIDE_SUFFIX, mainpath);
+
+    if (access(ovrpath, R_OK) == 0)
+        p = ovrpath;
+    else if (access(mainpath, R_OK) == 0)
+        p = mainpath;
+    else {
+        pa_log("Can't open config file '%s': %s", mainpath, strerror(errno));
+        return 0;
+    }
+
+    files = pa_dynarray_new(NULL);
+    pa_dynarray_append(files, pa_xstrdup(p));
 
     if (!cfgdir)
         cfgdir = DEFAULT_CONFIG_DIRECTORY;
 
     pa_log_info("policy config directory is '%s'", cfgdir);
 
-    success = 1;
     overrides = NULL;
     noverride = 0;
 
@@ -352,8 +955,6 @@ int policy_parse_files_in_configdir(struct userdata *u, const char *cfgdir, stru
     if ((d = opendir(cfgdir)) == NULL)
         pa_log_info("Can't find config directory '%s'", cfgdir);
     else {
-        files = pa_dynarray_new(NULL);
-
         for (p = cfgdir, q = cfgpath;  (q-cfgpath < PATH_MAX) && *p;   p++,q++)
             *q = *p;
         if (q == cfgpath || q[-1] != '/')
@@ -388,64 +989,62 @@ int policy_parse_files_in_configdir(struct userdata *u, const char *cfgdir, stru
 
     } /* if opendir() */
 
-    /* read config files in descending order */
-    if (files) {
-        char **sorted_files;
-        unsigned count;
+    count = pa_dynarray_size(files);
+    sorted_files = pa_xnew(char *, count);
 
-        errno = 0;
+    for (i = 0; i < count; i++)
+        sorted_files[i] = pa_dynarray_get(files, i);
+    pa_dynarray_free(files);
 
-        count = pa_dynarray_size(files);
-        sorted_files = pa_xnew(char *, count);
+    /* sort the config directory files, leaving the main file first */
+    if (count > 2)
+        qsort(sorted_files + 1, count - 1, sizeof(char *), compare_paths);
 
-        for (i = 0; i < count; i++)
-            sorted_files[i] = pa_dynarray_get(files, i);
-        pa_dynarray_free(files);
+    for (i = 0; i < noverride; i++)
+        pa_xfree(overrides[i]);
 
-        for (i = 0; i < count; i++) {
-            for (j = 0; j < count; j++) {
-                if (strcmp(sorted_files[i], sorted_files[j]) < 0) {
-                    char *tmp = sorted_files[i];
-                    sorted_files[i] = sorted_files[j];
-                    sorted_files[j] = tmp;
-                }
-            }
-        }
+    pa_xfree(overrides);
 
-        for (i = 0; i < count; i++) {
-            pa_log_info("parsing config file '%s'", sorted_files[i]);
+    *ret_files = sorted_files;
+    *ret_count = count;
 
-            if ((f = fopen(sorted_files[i], "r")) == NULL) {
-                pa_log("Can't open config file '%s': %s",
-                        sorted_files[i], strerror(errno));
-                continue;
-            }
+    return 1;
+}
 
-            for (errno = 0, lineno = 1;  fgets(buf, BUFSIZE, f);   lineno++) {
-                if (!parse_line(u, lineno, buf, sections, &success))
-                    break;
-            }
+static int parse_line(struct parser *parser, int lineno, char *buf) {
+    char line[BUFSIZE];
 
-            if (fclose(f) != 0) {
-                pa_log("Can't close config file '%s': %s",
-                        sorted_files[i], strerror(errno));
-            }
+    if (preprocess_buffer(lineno, buf, line) < 0)
+        return 0;
 
-            pa_xfree(sorted_files[i]);
-        }
+    if (*line == '\0')
+        return 1;
 
-        pa_xfree(sorted_files);
-    }
+    if (parser->cache)
+        pa_policy_config_cache_record(parser->cache, parser->file, lineno, line);
 
-    for (i = 0; i < noverride; i++)
-        pa_xfree(overrides[i]);
+    if (parser->config)
+        config_file_add_line(parser->config->files + parser->file, lineno, line);
 
-    pa_xfree(overrides);
+    parse_definition(parser, lineno, line);
 
-    return success;
+    return 1;
 }
 
-static int parse_line(struct userdata *u, int lineno, char *buf, struct sections *sections, int *success) {
+static void parse_cached_line(void *data, unsigned file, int lineno, char *line) {
+    struct parser *parser = data;
+
+    if (parser->config)
+        config_file_add_line(parser->config->files + file, lineno, line);
+
+    parse_definition(parser, lineno, line);
+}
+
+static void parse_definition(void *data, int lineno, char *line) {
+    struct parser      *parser = data;
+    struct userdata    *u = parser->u;
+    struct sections    *sections = parser->sections;
+    int                *success = &parser->success;
     struct section     *section;
     enum section_type   newsect;
     struct groupdef    *grdef;
@@ -454,13 +1053,6 @@ static int parse_line(struct userdata *u, int lineno, char *buf, struct sections
     struct streamdef   *strdef;
     struct contextdef  *ctxdef;
     struct activitydef *actdef;
-    char                line[BUFSIZE];
-
-    if (preprocess_buffer(lineno, buf, line) < 0)
-        return 0;
-
-    if (*line == '\0')
-        return 1;
 
     if (section_header(lineno, line, &newsect)) {
         section = pa_xnew0(struct section, 1);
@@ -472,6 +1064,10 @@ static int parse_line(struct userdata *u, int lineno, char *buf, struct sections
         if (section_open(u, newsect, section) < 0)
             *success = 0;
     }
+    else if (!sections->sec && parser->worker) {
+        /* belongs to the last section of the previous file */
+        defer(parser, lineno, line, NULL, NULL);
+    }
     else {
         pa_assert_se((section = sections->sec));
 
@@ -531,6 +1127,10 @@ static int parse_line(struct userdata *u, int lineno, char *buf, struct sections
 
             if (variabledef_parse(lineno, line, &var, &value) < 0)
                 *success = 0;
+            else if (parser->worker) {
+                /* variables are only added on the main thread */
+                defer(parser, lineno, NULL, var, value);
+            }
             else {
                 pa_policy_var_add(u, var, value);
                 pa_xfree(var);
@@ -545,8 +1145,6 @@ static int parse_line(struct userdata *u, int lineno, char *buf, struct sections
 
         }
     }
-
-    return 1;
 }
 
 static int preprocess_buffer(int lineno, char *inbuf, char *outbuf)
@@ -755,6 +1353,8 @@ static void section_free(struct section *sec) {
             pa_xfree(sec->def.group->source_prop);
             pa_xfree(sec->def.group->source_arg);
             pa_xfree(sec->def.group->flags);
+            pa_xfree(sec->def.group->media_hysteresis);
+            pa_xfree(sec->def.group->uncork_grace);
             pa_xfree(sec->def.group);
             break;
 
@@ -830,6 +1430,7 @@ static void section_free(struct section *sec) {
 static int section_close(struct userdata *u, struct section *sec)
 {
     struct groupdef   *grdef;
+    struct pa_policy_group *group;
     struct devicedef  *devdef;
     struct carddef    *carddef;
     struct streamdef  *strdef;
@@ -841,6 +1442,7 @@ static int section_close(struct userdata *u, struct section *sec)
     struct delprop    *delprop;
     struct setdef     *setdef;
     uint32_t           delay = DEFAULT_PORT_CHANGE_DELAY_MS;
+    uint32_t           grace;
     uint32_t           card_flags[2] = { 0, 0};
     uint32_t           flags = 0;
     int                status = 0;
@@ -857,13 +1459,25 @@ static int section_close(struct userdata *u, struct section *sec)
 
             flags_parse(u, grdef->flags_lineno, grdef->flags, section_group, &flags);
 
+            delay = 0;
+            delay_parse(u, grdef->media_hysteresis_lineno,
+                        grdef->media_hysteresis, &delay);
+
+            grace = 0;
+            delay_parse(u, grdef->uncork_grace_lineno,
+                        grdef->uncork_grace, &grace);
+
             /* Transfer ownership of grdef->properties */
-            pa_policy_group_new(u, grdef->name,   grdef->sink,
-                                   grdef->sink_method, grdef->sink_arg, grdef->sink_prop,
-                                   grdef->source,
-                                   grdef->source_method, grdef->source_arg, grdef->source_prop,
-                                   grdef->properties,
-                                   flags);
+            group = pa_policy_group_new(u, grdef->name,   grdef->sink,
+                                        grdef->sink_method, grdef->sink_arg, grdef->sink_prop,
+                                        grdef->source,
+                                        grdef->source_method, grdef->source_arg, grdef->source_prop,
+                                        grdef->properties,
+                                        flags);
+            if (group) {
+                group->media_hysteresis = delay;
+                group->uncork_grace = grace;
+            }
             break;
 
         case section_device:
@@ -1146,6 +1760,14 @@ static int groupdef_parse(int lineno, char *line, struct groupdef *grdef)
             grdef->flags = pa_xstrdup(line+6);
             grdef->flags_lineno = lineno;
         }
+        else if (!strncmp(line, "media_hysteresis=", 17)) {
+            grdef->media_hysteresis = pa_xstrdup(line+17);
+            grdef->media_hysteresis_lineno = lineno;
+        }
+        else if (!strncmp(line, "uncork_grace=", 13)) {
+            grdef->uncork_grace = pa_xstrdup(line+13);
+            grdef->uncork_grace_lineno = lineno;
+        }
         else {
             if ((end = strchr(line, '=')) == NULL) {
                 pa_log("invalid definition '%s' in line %d", line, lineno);
@@ -2198,6 +2820,8 @@ static int flags_parse(struct userdata  *u,
             flags |= PA_POLICY_GROUP_FLAG_CORK_STREAM;
         else if (group && !strcmp(flagname, "mute_by_route"))
             flags |= PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE;
+        else if (group && !strcmp(flagname, "mute_by_factor"))
+            flags |= PA_POLICY_GROUP_FLAG_MUTE_BY_FACTOR;
         else if (group && !strcmp(flagname, "media_notify"))
             flags |= PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY;
         else if (group && !strcmp(flagname, "dynamic_sink"))
@@ -2259,7 +2883,10 @@ static char **split_strv(const char *s, const char *delimiter) {
 
 const char *policy_file_path(const char *file, char *buf, size_t len)
 {
-    snprintf(buf, len, "%s/%s", PA_DEFAULT_CONFIG_DIR, file);
+    if (file[0] == '/')
+        snprintf(buf, len, "%s", file);
+    else
+        snprintf(buf, len, "%s/%s", PA_DEFAULT_CONFIG_DIR, file);
 
     return buf;
 }
@@ -1,9 +1,32 @@
 #ifndef fooconfigfilefoo
 #define fooconfigfilefoo
 
+#include <stdint.h>
+
 #include "userdata.h"
 
-int pa_policy_parse_config_files(struct userdata *u, const char *cfgfile, const char *cfgdir);
+/* kinds of config sections, for pa_policy_config_scan() and _apply() */
+#define PA_POLICY_CONFIG_GROUP     (1U << 0)
+#define PA_POLICY_CONFIG_DEVICE    (1U << 1)
+#define PA_POLICY_CONFIG_CARD      (1U << 2)
+#define PA_POLICY_CONFIG_STREAM    (1U << 3)
+#define PA_POLICY_CONFIG_CONTEXT   (1U << 4)
+#define PA_POLICY_CONFIG_ACTIVITY  (1U << 5)
+#define PA_POLICY_CONFIG_VARIABLE  (1U << 6)
+
+struct pa_policy_config;
+
+int pa_policy_parse_config_files(struct userdata *u, const char *cfgfile,
+                                 const char *cfgdir, const char *cachefile,
+                                 bool keep);
+
+void pa_policy_config_free(struct pa_policy_config *);
+void pa_policy_config_get_paths(struct pa_policy_config *,
+                                const char **, const char **);
+int  pa_policy_config_scan(struct userdata *, uint32_t *);
+void pa_policy_config_commit(struct pa_policy_config *);
+void pa_policy_config_discard(struct pa_policy_config *);
+int  pa_policy_config_apply(struct userdata *, uint32_t);
 
 #endif
 
@@ -13,30 +13,28 @@
 #include "source-output-ext.h"
 #include "variable.h"
 #include "match.h"
+#include "forward.h"
+#include "arena.h"
+#include "probes.h"
 
 static struct pa_policy_context_variable
             *add_variable(struct pa_policy_context *, const char *);
-static void delete_variable(struct pa_policy_context *,
-                            struct pa_policy_context_variable *);
 
 static struct pa_policy_context_rule
-            *add_rule(struct pa_policy_context_rule **,
+            *add_rule(struct pa_policy_arena *,
+                      struct pa_policy_context_rule **,
                       enum pa_classify_method, const char *);
-static void  delete_rule(struct pa_policy_context_rule **,
-                         struct pa_policy_context_rule  *);
 
 static void  append_action(union pa_policy_context_action **,
                            union pa_policy_context_action *);
-static void  delete_action(union pa_policy_context_action **,
-                           union pa_policy_context_action *);
+static void  free_string(void *);
 static int perform_action(struct userdata *, union pa_policy_context_action *,
                           char *);
 
 static int   value_setup(struct userdata *u, union pa_policy_value *,
                          enum pa_policy_value_type, va_list);
-static void  value_cleanup(union pa_policy_value *);
 
-static void register_object(struct pa_policy_object *,
+static void register_object(struct userdata *, struct pa_policy_object *,
                             enum pa_policy_object_type,
                             const char *, void *, int);
 static void unregister_object(struct pa_policy_object *,
@@ -56,8 +54,7 @@ static unsigned long object_index(enum pa_policy_object_type, void *);
 /* activities */
 static struct pa_policy_activity_variable
             *get_activity_variable(struct userdata *u, struct pa_policy_context *, const char *);
-static void delete_activity(struct pa_policy_context *,
-                            struct pa_policy_activity_variable *);
+static void release_activity(void *);
 static void apply_activity(struct userdata *u, struct pa_policy_activity_variable *var);
 
 struct pa_policy_context *pa_policy_context_new(struct userdata *u)
@@ -65,6 +62,7 @@ struct pa_policy_context *pa_policy_context_new(struct userdata *u)
     struct pa_policy_context *ctx;
 
     ctx = pa_xmalloc0(sizeof(*ctx));
+    ctx->arena = pa_policy_arena_new("context");
 
     return ctx;
 }
@@ -72,18 +70,14 @@ struct pa_policy_context *pa_policy_context_new(struct userdata *u)
 void pa_policy_context_free(struct pa_policy_context *ctx)
 {
     if (ctx != NULL) {
-
-        while (ctx->variables != NULL)
-            delete_variable(ctx, ctx->variables);
-
-        while (ctx->activities != NULL)
-            delete_activity(ctx, ctx->activities);
-
+        /* the variables, rules and actions all live in the arena */
+        pa_policy_arena_free(ctx->arena);
         pa_xfree(ctx);
     }
 }
 
-static void register_rule(struct pa_policy_context_rule *rule,
+static void register_rule(struct userdata *u,
+                          struct pa_policy_context_rule *rule,
                           enum pa_policy_object_type type,
                           const char *name, void *ptr) {
     union  pa_policy_context_action    *actn;
@@ -119,7 +113,7 @@ static void register_rule(struct pa_policy_context_rule *rule,
             continue;
         } /* switch */
 
-        register_object(object, type, name, ptr, lineno);
+        register_object(u, object, type, name, ptr, lineno);
 
     }  /* for actn */
 }
@@ -133,7 +127,7 @@ void pa_policy_context_register(struct userdata *u,
 
     for (var = u->context->variables;   var != NULL;   var = var->next) {
         for (rule = var->rules;   rule != NULL;   rule = rule->next)
-            register_rule(rule, what, name, ptr);
+            register_rule(u, rule, what, name, ptr);
     }  /*  for var */
 }
 
@@ -208,7 +202,7 @@ pa_policy_context_add_property_rule(struct userdata *u, const char *varname,
     pa_policy_var_update(u, arg);
 
     variable = add_variable(u->context, varname);
-    rule     = add_rule(&variable->rules, method, arg);
+    rule     = add_rule(u->context->arena, &variable->rules, method, arg);
 
     return rule;
 }
@@ -232,18 +226,20 @@ pa_policy_context_add_property_action(struct userdata *u,
     pa_policy_var_update(u, obj_name);
     pa_policy_var_update(u, prop_name);
 
-    action  = pa_xmalloc0(sizeof(*action));
+    action  = pa_policy_arena_xnew0(u->context->arena,
+                                    union pa_policy_context_action, 1);
     setprop = &action->setprop;
 
     setprop->type   = pa_policy_set_property;
     setprop->lineno = lineno;
 
     setprop->object.type = obj_type;
-    setprop->object.match = pa_policy_match_name_new(obj_type,
+    setprop->object.match = pa_policy_match_name_new(u->context->arena,
+                                                     obj_type,
                                                      obj_classify,
                                                      obj_name);
 
-    setprop->property = pa_xstrdup(prop_name);
+    setprop->property = pa_policy_arena_strdup(u->context->arena, prop_name);
 
     va_start(value_arg, value_type);
     value_setup(u, &setprop->value, value_type, value_arg);
@@ -268,16 +264,18 @@ pa_policy_context_delete_property_action(struct userdata *u,
     pa_policy_var_update(u, obj_name);
     pa_policy_var_update(u, prop_name);
 
-    action  = pa_xmalloc0(sizeof(*action));
+    action  = pa_policy_arena_xnew0(u->context->arena,
+                                    union pa_policy_context_action, 1);
     delprop = &action->delprop; 
 
     delprop->type   = pa_policy_delete_property;
     delprop->lineno = lineno;
 
     delprop->object.type = obj_type;
-    delprop->object.match = pa_policy_match_string_new(obj_classify, obj_name);
+    delprop->object.match = pa_policy_match_string_new(u->context->arena,
+                                                       obj_classify, obj_name);
 
-    delprop->property = pa_xstrdup(prop_name);
+    delprop->property = pa_policy_arena_strdup(u->context->arena, prop_name);
 
     append_action(&rule->actions, action);
 }
@@ -295,7 +293,8 @@ pa_policy_context_set_default_action(struct pa_policy_context_rule *rule,
     /* update variables */
     pa_policy_var_update(u, activity_group);
 
-    action = pa_xmalloc0(sizeof(*action));
+    action = pa_policy_arena_xnew0(u->context->arena,
+                                   union pa_policy_context_action, 1);
     setdef = &action->setdef;
 
     setdef->type   = pa_policy_set_default;
@@ -326,16 +325,21 @@ pa_policy_context_override_action(struct userdata               *u,
     pa_policy_var_update(u, obj_name);
     pa_policy_var_update(u, profile_name);
 
-    action  = pa_xmalloc0(sizeof(*action));
+    action  = pa_policy_arena_xnew0(u->context->arena,
+                                    union pa_policy_context_action, 1);
     overr = &action->overr;
 
     overr->type   = pa_policy_override;
     overr->lineno = lineno;
 
     overr->object.type = obj_type;
-    overr->object.match = pa_policy_match_string_new(obj_classify, obj_name);
+    overr->object.match = pa_policy_match_string_new(u->context->arena,
+                                                     obj_classify, obj_name);
 
-    overr->profile = pa_xstrdup(profile_name);
+    overr->profile = pa_policy_arena_strdup(u->context->arena, profile_name);
+
+    /* the original profile is runtime state on the heap */
+    pa_policy_arena_cleanup(u->context->arena, free_string, &overr->orig_profile);
 
     va_start(value_arg, value_type);
     value_setup(u, &overr->value, value_type, value_arg);
@@ -343,10 +347,11 @@ pa_policy_context_override_action(struct userdata               *u,
 
     /* Store the value for the rule but set the method as true so
      * that the value is always handled. */
-    overr->active_val = pa_xstrdup(pa_policy_match_arg(rule->match));
+    overr->active_val = pa_policy_arena_strdup(u->context->arena,
+                                               pa_policy_match_arg(rule->match));
     if (rule->match)
         pa_policy_match_free(rule->match);
-    rule->match = pa_policy_match_string_new(pa_method_true, "");
+    rule->match = pa_policy_match_string_new(u->context->arena, pa_method_true, "");
 
     append_action(&rule->actions, action);
     append_action(&u->context->overrides, action);
@@ -409,7 +414,7 @@ int pa_policy_context_variable_changed(struct userdata *u, const char *name,
                 var->value = pa_xstrdup(value);
 
                 for (rule = var->rules;  rule != NULL;  rule = rule->next) {
-                    if (pa_policy_match(rule->match, value)) {
+                    if (pa_policy_match(u, rule->match, value)) {
                         for (actn = rule->actions; actn; actn = actn->any.next)
                         {
                             if (u->context->variable_change_count == PA_POLICY_CONTEXT_MAX_CHANGES) {
@@ -440,6 +445,8 @@ void pa_policy_context_variable_commit(struct userdata *u)
     pa_assert(u);
     pa_assert(u->context);
 
+    PA_POLICY_PROBE1(context_commit_begin, u->context->variable_change_count);
+
     while (u->context->variable_change_count) {
         u->context->variable_change_count--;
 
@@ -450,6 +457,8 @@ void pa_policy_context_variable_commit(struct userdata *u)
             pa_log("Failed to perform action for value %s", value);
         pa_xfree(value);
     }
+
+    PA_POLICY_PROBE(context_commit_end);
 }
 
 static
@@ -471,11 +480,14 @@ struct pa_policy_context_variable *add_variable(struct pa_policy_context *ctx,
         }
     }
 
-    var = pa_xmalloc0(sizeof(*var));
+    var = pa_policy_arena_xnew0(ctx->arena, struct pa_policy_context_variable, 1);
 
-    var->name  = pa_xstrdup(name);
+    var->name  = pa_policy_arena_strdup(ctx->arena, name);
     var->value = pa_xstrdup("");
 
+    /* the value changes at runtime, so it is on the heap */
+    pa_policy_arena_cleanup(ctx->arena, free_string, &var->value);
+
     last->next = var;
 
     pa_log_debug("created context variable '%s'", var->name);
@@ -483,74 +495,18 @@ struct pa_policy_context_variable *add_variable(struct pa_policy_context *ctx,
     return var;
 }
 
-static void delete_activity(struct pa_policy_context           *ctx,
-                            struct pa_policy_activity_variable *variable)
-{
-    struct pa_policy_activity_variable *last;
-
-    for (last = (struct pa_policy_activity_variable *)&ctx->activities;
-         last->next != NULL;
-         last = last->next) {
-
-        if (last->next == variable) {
-            last->next = variable->next;
-
-            pa_xfree(variable->device);
-
-            while (variable->active_rules != NULL)
-                delete_rule(&variable->active_rules, variable->active_rules);
-            while (variable->inactive_rules != NULL)
-                delete_rule(&variable->inactive_rules, variable->inactive_rules);
-
-            pa_xfree(variable);
-            return;
-        }
-    }
-
-    pa_log("%s(): confused with data structures: can't find activity variable",
-           __FUNCTION__);
-}
-
-static void delete_variable(struct pa_policy_context          *ctx,
-                            struct pa_policy_context_variable *variable)
-{
-    struct pa_policy_context_variable *last;
-    
-    for (last = (struct pa_policy_context_variable *)&ctx->variables;
-         last->next != NULL;
-         last = last->next)
-    {
-        if (last->next == variable) {
-            last->next = variable->next;
-
-#if 0
-            pa_log_debug("delete context variable '%s'", variable->name);
-#endif
-
-            pa_xfree(variable->name);
-
-            while (variable->rules != NULL)
-                delete_rule(&variable->rules, variable->rules);
-
-            pa_xfree(variable);
-
-            return;
-        }
-    }
-
-    pa_log("%s(): confused with data structures: can't find variable",
-           __FUNCTION__);
-}
-
 static struct pa_policy_context_rule *
-add_rule(struct pa_policy_context_rule    **rules,
+add_rule(struct pa_policy_arena            *arena,
+         struct pa_policy_context_rule    **rules,
          enum pa_classify_method            method,
          const char                        *arg)
 {
-    struct pa_policy_context_rule *rule = pa_xmalloc0(sizeof(*rule));
+    struct pa_policy_context_rule *rule;
     struct pa_policy_context_rule *last;
 
-    if (!(rule->match = pa_policy_match_string_new(method, arg))) {
+    rule = pa_policy_arena_xnew0(arena, struct pa_policy_context_rule, 1);
+
+    if (!(rule->match = pa_policy_match_string_new(arena, method, arg))) {
         pa_log("%s: invalid rule definition (method %s)",
                __FUNCTION__, pa_match_method_str(method));
         return NULL;
@@ -566,34 +522,6 @@ add_rule(struct pa_policy_context_rule    **rules,
     return rule;
 }
 
-static void delete_rule(struct pa_policy_context_rule **rules,
-                        struct pa_policy_context_rule  *rule)
-{
-    struct pa_policy_context_rule *last;
-
-    for (last = (struct pa_policy_context_rule *)rules;
-         last->next != NULL;
-         last = last->next)
-    {
-        if (last->next == rule) {
-            last->next = rule->next;
-
-            pa_policy_match_free(rule->match);
-
-            while (rule->actions != NULL)
-                delete_action(&rule->actions, rule->actions);
-
-            pa_xfree(rule);
-
-            return;
-        }
-    } 
-
-    pa_log("%s(): confused with data structures: can't find rule",
-           __FUNCTION__);
-}
-
-
 static void append_action(union pa_policy_context_action **actions,
                           union pa_policy_context_action  *action)
 {
@@ -607,58 +535,12 @@ static void append_action(union pa_policy_context_action **actions,
     last->any.next = action;
 }
 
-static void delete_action(union pa_policy_context_action **actions,
-                          union pa_policy_context_action  *action)
+static void free_string(void *data)
 {
-    union pa_policy_context_action *last;
-    struct pa_policy_set_property  *setprop;
-    struct pa_policy_override      *overr;
-
-    for (last = (union pa_policy_context_action *)actions;
-         last->any.next != NULL;
-         last = last->any.next)
-    {
-        if (last->any.next == action) {
-            last->any.next = action->any.next;
-
-            switch (action->any.type) {
-
-            case pa_policy_set_property:
-                setprop = &action->setprop;
-
-                pa_policy_match_free(setprop->object.match);
-                pa_xfree(setprop->property);
-                value_cleanup(&setprop->value);
-
-                break;
-
-            case pa_policy_set_default:
-                /* no-op */
-                break;
-
-            case pa_policy_override:
-                overr = &action->overr;
-                pa_policy_match_free(overr->object.match);
-                pa_xfree(overr->profile);
-                pa_xfree(overr->orig_profile);
-                pa_xfree(overr->active_val);
-                value_cleanup(&overr->value);
-                break;
-
-            default:
-                pa_log("%s(): confused with data structure: invalid action "
-                       "type %d", __FUNCTION__, action->any.type);
-                return;         /* better to leak than corrupt :) */
-            }
-
-            pa_xfree(action);
-
-            return;
-        }
-    }
+    char **string = data;
 
-    pa_log("%s(): confused with data structures: can't find action",
-           __FUNCTION__);
+    pa_xfree(*string);
+    *string = NULL;
 }
 
 static int perform_action(struct userdata                *u,
@@ -794,7 +676,7 @@ static int perform_action(struct userdata                *u,
                 }
 
                 /* Forward shared strings */
-                pa_shared_data_sets(u->shared, setprop->property, prop_value);
+                pa_policy_forward_sets(u, setprop->property, prop_value);
             }
         }
         break;
@@ -856,7 +738,8 @@ static int value_setup(struct userdata           *u,
         string   = va_arg(arg, char *);
 
         constant->type   = pa_policy_value_constant;
-        constant->string = pa_xstrdup(pa_policy_var(u, string));
+        constant->string = pa_policy_arena_strdup(u->context->arena,
+                                                  pa_policy_var(u, string));
 
         break;
 
@@ -878,26 +761,14 @@ static int value_setup(struct userdata           *u,
     return success;
 }
 
-static void value_cleanup(union pa_policy_value *value)
-{
-    switch (value->type) {
-
-    case pa_policy_value_constant:
-        pa_xfree(value->constant.string);
-        break;
-
-    default:
-        break;
-    }
-}
-
-static void register_object(struct pa_policy_object *object,
+static void register_object(struct userdata *u,
+                            struct pa_policy_object *object,
                             enum pa_policy_object_type type,
                             const char *name, void *ptr, int lineno)
 {
     const char    *type_str;
 
-    if (pa_policy_match_type(object->match, type, ptr)) {
+    if (pa_policy_match_type(u, object->match, type, ptr)) {
 
         type_str = pa_policy_object_type_str(type);
 
@@ -1184,12 +1055,14 @@ struct pa_policy_activity_variable *get_activity_variable(struct userdata *u, st
         }
     }
 
-    var = pa_xmalloc0(sizeof(*var));
+    var = pa_policy_arena_xnew0(ctx->arena, struct pa_policy_activity_variable, 1);
 
-    var->device = pa_xstrdup(device);
+    var->device = pa_policy_arena_strdup(ctx->arena, device);
     var->userdata = u;
     var->default_state = -1;
 
+    pa_policy_arena_cleanup(ctx->arena, release_activity, var);
+
     last->next = var;
 
     pa_log_debug("created context activity variable '%s'", var->device);
@@ -1215,7 +1088,7 @@ pa_policy_activity_add_active_rule(struct userdata *u, const char *device,
     pa_policy_var_update(u, sink_name);
 
     pa_assert_se((variable = get_activity_variable(u, u->context, device)));
-    rule = add_rule(&variable->active_rules, method, sink_name);
+    rule = add_rule(u->context->arena, &variable->active_rules, method, sink_name);
 
     return rule;
 }
@@ -1228,7 +1101,7 @@ pa_policy_activity_add_inactive_rule(struct userdata *u, const char *device,
     struct pa_policy_context_rule      *rule;
 
     pa_assert_se((variable = get_activity_variable(u, u->context, device)));
-    rule = add_rule(&variable->inactive_rules, method, sink_name);
+    rule = add_rule(u->context->arena, &variable->inactive_rules, method, sink_name);
 
     return rule;
 }
@@ -1251,7 +1124,7 @@ static int perform_activity_action(pa_sink *sink, struct pa_policy_activity_vari
     }
 
     for ( ;  rule != NULL;  rule = rule->next) {
-        if (pa_policy_match(rule->match, sink->name)) {
+        if (pa_policy_match(var->userdata, rule->match, sink->name)) {
 
             if (force_state == -1 && var->sink_opened != -1 && var->sink_opened == is_opened) {
                 pa_log_debug("Already executed actions for state change, skip.");
@@ -1313,6 +1186,14 @@ static void enable_activity(struct userdata *u, struct pa_policy_activity_variab
     apply_activity(u, var);
 }
 
+static void release_activity(void *data)
+{
+    struct pa_policy_activity_variable *var = data;
+
+    if (var->sink_state_changed_hook_slot)
+        pa_hook_slot_free(var->sink_state_changed_hook_slot);
+}
+
 static void disable_activity(struct userdata *u, struct pa_policy_activity_variable *var) {
     pa_assert(u);
     pa_assert(var);
@@ -1352,9 +1233,9 @@ void pa_policy_activity_register(struct userdata *u,
 
     for (var = u->context->activities;   var != NULL;   var = var->next) {
         for (rule = var->active_rules;   rule != NULL;   rule = rule->next)
-            register_rule(rule, type, name, ptr);
+            register_rule(u, rule, type, name, ptr);
         for (rule = var->inactive_rules;   rule != NULL;   rule = rule->next)
-            register_rule(rule, type, name, ptr);
+            register_rule(u, rule, type, name, ptr);
     }  /*  for var */
 }
 
@@ -6,6 +6,8 @@
 
 #define PA_POLICY_CONTEXT_MAX_CHANGES (16)
 
+struct pa_policy_arena;
+
 enum pa_policy_action_type {
     pa_policy_action_unknown = 0,
     pa_policy_action_min = pa_policy_action_unknown,
@@ -131,6 +133,7 @@ struct pa_policy_activity_variable {
 };
 
 struct pa_policy_context {
+    struct pa_policy_arena             *arena;  /* variables, rules, actions */
     struct pa_policy_context_variable  *variables;
     struct pa_policy_activity_variable *activities;
     struct variable_change {
@@ -6,6 +6,7 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <pulse/rtclock.h>
 #include <pulsecore/dbus-shared.h>
 #include <pulsecore/core-util.h>
 #include <meego/shared-data.h>
@@ -21,6 +22,11 @@
 #include "card-ext.h"
 #include "sink-input-ext.h"
 #include "policy.h"
+#include "trace.h"
+#include "sockif.h"
+#include "log.h"
+#include "stats.h"
+#include "probes.h"
 
 #define ADMIN_DBUS_MANAGER          "org.freedesktop.DBus"
 #define ADMIN_DBUS_PATH             "/org/freedesktop/DBus"
@@ -39,13 +45,12 @@
 #define POLICY_STREAM_INFO          "stream_info"
 #define POLICY_ACTIONS              "audio_actions"
 #define POLICY_STATUS               "status"
+#define POLICY_GET_STATS            "get_stats"
+#define POLICY_RESET_STATS          "reset_stats"
 
-#define PROP_ROUTE_SINK_TARGET      "policy.sink_route.target"
-#define PROP_ROUTE_SINK_MODE        "policy.sink_route.mode"
-#define PROP_ROUTE_SINK_HWID        "policy.sink_route.hwid"
-#define PROP_ROUTE_SOURCE_TARGET    "policy.source_route.target"
-#define PROP_ROUTE_SOURCE_MODE      "policy.source_route.mode"
-#define PROP_ROUTE_SOURCE_HWID      "policy.source_route.hwid"
+/* txid, { action name : [ [ (argument name, value) ] ] } */
+#define POLICY_ACTIONS_SIGNATURE    "ua{saa(sv)}"
+#define POLICY_ACTION_PREFIX        "com.nokia.policy."
 
 #define POLICY_DBUS_INFO            "info"
 #define POLICY_DBUS_MEDIA           "media"
@@ -59,17 +64,6 @@
 #define POLICY_DBUS_CARD_PROFILE    "profile_changed"
 
 
-#define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
-
-#define MAX_ROUTING_DECISIONS 2
-
-struct routing_decision {      /* temporary storage for routing decision information */
-    enum pa_policy_route_class class;
-    char *target;
-    char *mode;
-    char *hwid;
-};
-
 struct pa_policy_dbusif {
     pa_dbus_connection *conn;
     DBusPendingCall    *pending_pdp_state;
@@ -78,22 +72,33 @@ struct pa_policy_dbusif {
     char               *mypath;  /* my signal path */
     char               *pdpath;  /* policy daemon's signal path */
     char               *pdnam;   /* policy daemon's D-Bus name */
+    char               *pdowner; /* its unique name while it is up */
     char               *admrule; /* match rule to catch name changes */
     char               *actrule; /* match rule to catch action signals */
     char               *strrule; /* match rule to catch stream info signals */
     bool                regist;  /* wheter or not registered to policy daemon*/
-    bool                route_sources_first;
+    enum pa_policy_route_order route_order; /* order of routing decisions */
+    struct replay      *replay;  /* trace being replayed, if any */
+    bool                replaying; /* handling a replayed message */
+    pa_hashmap         *states;  /* device type -> state, not sent yet */
+    pa_defer_event     *state_defer; /* sends the queued states */
+    bool                loading; /* module loads of a route still to run */
+    bool                status_pending; /* status waits for the loads */
+    uint32_t            status_txid;
+    uint32_t            status;
+    struct pa_policy_route_decision *retry; /* attach again once loaded */
+    int                 nretry;
 };
 
-struct actdsc {                 /* action descriptor */
-    const char         *name;
-    int               (*parser)(struct userdata *u, DBusMessageIter *iter);
-};
-
-struct argdsc {                 /* argument descriptor for actions */
-    const char         *name;
-    int                 offs;
-    int                 type;
+struct replay {                 /* replay of a recorded policy trace */
+    struct pa_policy_trace_record *records;
+    unsigned            nrecord;
+    unsigned            next;    /* next record to replay */
+    pa_usec_t           start;
+    pa_time_event      *timer;
+    unsigned            nmsg;    /* messages handled */
+    pa_usec_t           total;   /* time spent handling them */
+    pa_usec_t           max;
 };
 
 struct argrt {                  /* audio_route arguments */
@@ -101,6 +106,7 @@ struct argrt {                  /* audio_route arguments */
     char               *device;
     char               *mode;
     char               *hwid;
+    char               *group;   /* optional, all groups if not given */
 };
 
 struct argvol {                 /* volume_limit arguments */
@@ -123,17 +129,47 @@ struct argctx {                 /* context arguments */
     char               *value;
 };
 
-static int action_parser(DBusMessageIter *, struct argdsc *, void *, int);
+union actargs {                 /* arguments of any command */
+    struct argrt        rt;
+    struct argvol       vol;
+    struct argcork      cork;
+    struct argmute      mute;
+    struct argctx       ctx;
+};
+
+struct actdsc {                 /* action descriptor */
+    const char         *name;
+    int               (*parser)(struct userdata *u, DBusMessageIter *iter);
+    /* decodes one command into its typed arguments */
+    bool              (*decode)(DBusMessageIter *iter, union actargs *args);
+};
+
+static const struct actdsc *action_lookup(const char *);
+static bool command_begin(DBusMessageIter *, DBusMessageIter *);
+static bool command_arg(DBusMessageIter *, const char **, DBusMessageIter *);
+static bool arg_get(DBusMessageIter *, const char *, const char *, int, void *);
+static bool route_decode(DBusMessageIter *, union actargs *);
+static bool volume_decode(DBusMessageIter *, union actargs *);
+static bool cork_decode(DBusMessageIter *, union actargs *);
+static bool mute_decode(DBusMessageIter *, union actargs *);
+static bool context_decode(DBusMessageIter *, union actargs *);
 static int audio_route_parser(struct userdata *, DBusMessageIter *);
 static int volume_limit_parser(struct userdata *, DBusMessageIter *);
 static int audio_cork_parser(struct userdata *, DBusMessageIter *);
 static int audio_mute_parser(struct userdata *, DBusMessageIter *);
 static int context_parser(struct userdata *, DBusMessageIter *);
+static void route_retry_save(struct pa_policy_dbusif *,
+                             const struct pa_policy_route_decision *, int);
+static void route_retry_free(struct pa_policy_dbusif *);
+static bool route_attach(struct userdata *, int,
+                         const struct pa_policy_route_decision *, int);
 
 static DBusHandlerResult filter(DBusConnection *, DBusMessage *, void *);
 static void handle_admin_message(struct userdata *, DBusMessage *);
+static void trace_message(struct userdata *, DBusMessage *);
 static void handle_info_message(struct userdata *, DBusMessage *);
 static void handle_action_message(struct userdata *, DBusMessage *);
+static void handle_stats_message(struct userdata *, DBusMessage *);
 static void getnameowner_cb(DBusPendingCall *, void *);
 static void pdp_get_state(struct pa_policy_dbusif *, struct userdata *);
 static void pdp_get_state_cancel(struct pa_policy_dbusif *);
@@ -142,6 +178,12 @@ static int  pdp_register_ep(struct pa_policy_dbusif *, struct userdata *);
 static void pdp_register_ep_cancel(struct pa_policy_dbusif *);
 static int  signal_status(struct userdata *, uint32_t, uint32_t);
 static void pa_policy_free_dbusif(struct pa_policy_dbusif *,struct userdata *);
+static void replay_cb(pa_mainloop_api *, pa_time_event *,
+                      const struct timeval *, void *);
+static void replay_free(struct userdata *, struct replay *);
+static void send_device_state(struct userdata *, const char *,
+                              const struct pa_classify_result *);
+static void device_state_flush_cb(pa_mainloop_api *, pa_defer_event *, void *);
 
 
 
@@ -150,7 +192,7 @@ struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *u,
                                                const char      *mypath,
                                                const char      *pdpath,
                                                const char      *pdnam,
-                                               bool             route_sources_first)
+                                               enum pa_policy_route_order route_order)
 {
     pa_module               *m = u->module;
     struct pa_policy_dbusif *dbusif = NULL;
@@ -162,7 +204,7 @@ struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *u,
 
     dbusif = pa_xnew0(struct pa_policy_dbusif, 1);
 
-    dbusif->route_sources_first = route_sources_first;
+    dbusif->route_order = route_order;
 
     dbus_error_init(&error);
     dbusif->conn = pa_dbus_bus_get(m->core, DBUS_BUS_SYSTEM, &error);
@@ -266,6 +308,15 @@ static void pa_policy_free_dbusif(struct pa_policy_dbusif *dbusif,
 
     pdp_get_state_cancel(dbusif);
     pdp_register_ep_cancel(dbusif);
+    replay_free(u, dbusif->replay);
+
+    if (u && dbusif->state_defer)
+        u->core->mainloop->defer_free(dbusif->state_defer);
+
+    if (dbusif->states)
+        pa_hashmap_free(dbusif->states);
+
+    route_retry_free(dbusif);
 
     if (dbusif->conn) {
         dbusconn = pa_dbus_connection_get(dbusif->conn);
@@ -284,6 +335,7 @@ static void pa_policy_free_dbusif(struct pa_policy_dbusif *dbusif,
     pa_xfree(dbusif->mypath);
     pa_xfree(dbusif->pdpath);
     pa_xfree(dbusif->pdnam);
+    pa_xfree(dbusif->pdowner);
     pa_xfree(dbusif->admrule);
     pa_xfree(dbusif->actrule);
     pa_xfree(dbusif->strrule);
@@ -297,8 +349,107 @@ void pa_policy_dbusif_done(struct userdata *u)
     }
 }
 
+int pa_policy_dbusif_replay(struct userdata *u, const char *path)
+{
+    struct pa_policy_dbusif *dbusif;
+    struct replay           *replay;
+
+    pa_assert(u);
+    pa_assert(path);
+    pa_assert_se((dbusif = u->dbusif));
+    pa_assert(!dbusif->replay);
+
+    replay = pa_xnew0(struct replay, 1);
+
+    if (pa_policy_trace_load(path, &replay->records, &replay->nrecord) < 0) {
+        pa_xfree(replay);
+        return -1;
+    }
+
+    pa_log_info("replaying %u records of policy trace '%s'",
+                replay->nrecord, path);
+
+    replay->start = pa_rtclock_now();
+    replay->timer = pa_core_rttime_new(u->core, replay->start, replay_cb, u);
+    dbusif->replay = replay;
+
+    return 0;
+}
+
+/* Device states are queued and sent once the current mainloop iteration
+ * is over, so that a burst of hotplug events or a full resync ends up
+ * as at most one signal per state, with only the last state of each
+ * device type. */
 void pa_policy_dbusif_send_device_state(struct userdata *u, const char *state,
                                         const struct pa_classify_result *list)
+{
+    struct pa_policy_dbusif *dbusif = u->dbusif;
+    pa_mainloop_api         *api    = u->core->mainloop;
+    uint32_t                 i;
+
+    if (!dbusif->regist)
+        return;
+
+    if (!list || list->count == 0)
+        return;
+
+    if (!dbusif->states) {
+        dbusif->states = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                             pa_idxset_string_compare_func,
+                                             pa_xfree, pa_xfree);
+    }
+
+    for (i = 0;  i < list->count;  i++) {
+        pa_hashmap_remove_and_free(dbusif->states, list->types[i]);
+        pa_hashmap_put(dbusif->states, pa_xstrdup(list->types[i]),
+                       pa_xstrdup(state));
+    }
+
+    if (!dbusif->state_defer)
+        dbusif->state_defer = api->defer_new(api, device_state_flush_cb, u);
+    else
+        api->defer_enable(dbusif->state_defer, 1);
+}
+
+static void device_state_flush_cb(pa_mainloop_api *api, pa_defer_event *e,
+                                  void *userdata)
+{
+    static const char *states[] = { PA_POLICY_DISCONNECTED, PA_POLICY_CONNECTED };
+
+    struct userdata           *u = userdata;
+    struct pa_policy_dbusif   *dbusif;
+    struct pa_classify_result *list;
+    void                      *it;
+    const char                *type;
+    const char                *state;
+    unsigned                   i;
+
+    pa_assert(u);
+    pa_assert_se((dbusif = u->dbusif));
+    pa_assert(dbusif->state_defer == e);
+
+    api->defer_enable(e, 0);
+
+    list = pa_xmalloc(sizeof(*list) + sizeof(char *) * pa_hashmap_size(dbusif->states));
+
+    /* disconnections first, as in a full resync */
+    for (i = 0;  i < PA_ELEMENTSOF(states);  i++) {
+        list->count = 0;
+
+        PA_HASHMAP_FOREACH_KV(type, state, dbusif->states, it) {
+            if (pa_streq(state, states[i]))
+                list->types[list->count++] = type;
+        }
+
+        send_device_state(u, states[i], list);
+    }
+
+    pa_xfree(list);
+    pa_hashmap_remove_all(dbusif->states);
+}
+
+static void send_device_state(struct userdata *u, const char *state,
+                              const struct pa_classify_result *list)
 {
     const char              *path = POLICY_DBUS_STATE_PATH;
 
@@ -340,6 +491,7 @@ void pa_policy_dbusif_send_device_state(struct userdata *u, const char *state,
 
     dbus_message_iter_close_container(&mit, &dit);
 
+    pa_policy_stats_count(u, pa_policy_stat_dbus_out);
     sts = dbus_connection_send(conn, msg, NULL);
 
     if (!sts) {
@@ -399,6 +551,7 @@ void pa_policy_dbusif_send_card_profile_changed(struct userdata *u, const struct
 
     dbus_message_iter_close_container(&mit, &dit);
 
+    pa_policy_stats_count(u, pa_policy_stat_dbus_out);
     sts = dbus_connection_send(conn, msg, NULL);
 
     if (!sts)
@@ -438,6 +591,8 @@ void pa_policy_dbusif_send_media_status(struct userdata *u, const char *media,
         if (!success)
             pa_log("Can't build D-Bus info message");
         else {
+            pa_policy_stats_count(u, pa_policy_stat_dbus_out);
+
             if (!dbus_connection_send(conn, msg, NULL)) {
                 pa_log("Can't send info message: out of memory");
             }
@@ -460,12 +615,24 @@ static DBusHandlerResult filter(DBusConnection *conn, DBusMessage *msg,
     }
 
 
+    if (dbus_message_is_method_call(msg, u->dbusif->ifnam, POLICY_GET_STATS) ||
+        dbus_message_is_method_call(msg, u->dbusif->ifnam, POLICY_RESET_STATS))
+    {
+        pa_policy_stats_count(u, pa_policy_stat_dbus_in);
+        handle_stats_message(u, msg);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
     if (dbus_message_is_signal(msg, POLICY_DBUS_INTERFACE,POLICY_STREAM_INFO)){
+        pa_policy_stats_count(u, pa_policy_stat_dbus_in);
+        trace_message(u, msg);
         handle_info_message(u, msg);
         return DBUS_HANDLER_RESULT_HANDLED;
     }
 
     if (dbus_message_is_signal(msg, POLICY_DBUS_INTERFACE, POLICY_ACTIONS)) {
+        pa_policy_stats_count(u, pa_policy_stat_dbus_in);
+        trace_message(u, msg);
         handle_action_message(u, msg);
         return DBUS_HANDLER_RESULT_HANDLED;
     }
@@ -473,6 +640,134 @@ static DBusHandlerResult filter(DBusConnection *conn, DBusMessage *msg,
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+static void trace_message(struct userdata *u, DBusMessage *msg)
+{
+    char *buf;
+    int   len;
+
+    if (!u->trace)
+        return;
+
+    if (!dbus_message_marshal(msg, &buf, &len)) {
+        pa_log("failed to marshal policy message for the trace");
+        return;
+    }
+
+    pa_policy_trace_write(u->trace, pa_policy_trace_message, buf, len);
+    dbus_free(buf);
+}
+
+static void replay_message(struct userdata *u, struct replay *replay,
+                           struct pa_policy_trace_record *rec)
+{
+    DBusMessage *msg = NULL;
+    DBusError    error;
+    uint32_t     txid;
+    pa_usec_t    start;
+    pa_usec_t    spent;
+
+    if (rec->type == pa_policy_trace_message) {
+        dbus_error_init(&error);
+
+        if (!(msg = dbus_message_demarshal(rec->data, rec->len, &error))) {
+            pa_log("invalid message in policy trace: %s", error.message);
+            dbus_error_free(&error);
+            return;
+        }
+    }
+
+    start = pa_rtclock_now();
+    u->dbusif->replaying = true;
+
+    if (!msg) {
+        if (pa_policy_sockif_process_frame(u, (const uint8_t *)rec->data,
+                                           rec->len, &txid) < 0)
+            pa_log("invalid socket frame in policy trace");
+    }
+    else if (dbus_message_is_signal(msg, POLICY_DBUS_INTERFACE, POLICY_STREAM_INFO))
+        handle_info_message(u, msg);
+    else if (dbus_message_is_signal(msg, POLICY_DBUS_INTERFACE, POLICY_ACTIONS))
+        handle_action_message(u, msg);
+
+    u->dbusif->replaying = false;
+    spent = pa_rtclock_now() - start;
+
+    replay->nmsg++;
+    replay->total += spent;
+
+    if (spent > replay->max)
+        replay->max = spent;
+
+    if (msg)
+        dbus_message_unref(msg);
+}
+
+static void replay_cb(pa_mainloop_api *api, pa_time_event *e,
+                      const struct timeval *t, void *userdata)
+{
+    static const char *events[] = {
+        [pa_policy_trace_sink_put]    = "sink appeared",
+        [pa_policy_trace_sink_unlink] = "sink removed",
+        [pa_policy_trace_card_put]    = "card appeared",
+        [pa_policy_trace_card_unlink] = "card removed",
+    };
+
+    struct userdata               *u = userdata;
+    struct replay                 *replay;
+    struct pa_policy_trace_record *rec;
+    pa_usec_t                      now;
+
+    pa_assert(u);
+    pa_assert(u->dbusif);
+    pa_assert_se((replay = u->dbusif->replay));
+    pa_assert(replay->timer == e);
+
+    now = pa_rtclock_now();
+
+    /* keep the recorded pace, but catch up if we fell behind */
+    while (replay->next < replay->nrecord) {
+        rec = replay->records + replay->next;
+
+        if (replay->start + rec->time > now)
+            break;
+
+        replay->next++;
+
+        if (rec->type == pa_policy_trace_message ||
+            rec->type == pa_policy_trace_frame)
+            replay_message(u, replay, rec);
+        else if (rec->type < PA_ELEMENTSOF(events) && events[rec->type]) {
+            /* devices can't be made up; just mark where they changed */
+            pa_log_info("trace: %s: %s", events[rec->type], rec->data);
+        }
+    }
+
+    if (replay->next < replay->nrecord) {
+        pa_core_rttime_restart(u->core, replay->timer,
+                               replay->start + replay->records[replay->next].time);
+        return;
+    }
+
+    pa_log_info("policy trace replayed: %u messages, %llu usec/message, "
+                "max %llu usec", replay->nmsg,
+                (unsigned long long)(replay->nmsg ? replay->total / replay->nmsg : 0),
+                (unsigned long long)replay->max);
+
+    replay_free(u, replay);
+    u->dbusif->replay = NULL;
+}
+
+static void replay_free(struct userdata *u, struct replay *replay)
+{
+    if (replay) {
+        if (replay->timer)
+            u->core->mainloop->time_free(replay->timer);
+
+        pa_policy_trace_records_free(replay->records, replay->nrecord);
+        pa_xfree(replay);
+    }
+}
+
 static void handle_admin_message(struct userdata *u, DBusMessage *msg)
 {
     struct pa_policy_dbusif *dbusif;
@@ -499,6 +794,9 @@ static void handle_admin_message(struct userdata *u, DBusMessage *msg)
         return;
     }
 
+    pa_xfree(dbusif->pdowner);
+    dbusif->pdowner = (after && *after) ? pa_xstrdup(after) : NULL;
+
     if (after && *after) {
         pa_log_debug("policy decision point is up");
         pdp_get_state_cancel(dbusif);
@@ -592,16 +890,106 @@ static void handle_info_message(struct userdata *u, DBusMessage *msg)
 
 static void handle_action_message(struct userdata *u, DBusMessage *msg)
 {
-    static struct actdsc actions[] = {
-        { "com.nokia.policy.audio_route" , audio_route_parser  },
-        { "com.nokia.policy.volume_limit", volume_limit_parser },
-        { "com.nokia.policy.audio_cork"  , audio_cork_parser   },
-        { "com.nokia.policy.audio_mute"  , audio_mute_parser   },
-        { "com.nokia.policy.context"     , context_parser      },
-        {               NULL             , NULL                }
-    };
+    dbus_uint32_t txid;
+    int           success;
+
+    success = pa_policy_dbusif_process_actions(u, msg, &txid);
+
+    /* the transactions of a replayed trace were answered when recorded;
+     * a status now would confirm them to the running policy daemon */
+    if (success >= 0 && !u->dbusif->replaying) {
+        if (u->dbusif->loading) {
+            /* sent when the modules of the route are loaded */
+            u->dbusif->status_pending = true;
+            u->dbusif->status_txid    = txid;
+            u->dbusif->status         = success;
+        }
+        else
+            signal_status(u, txid, success);
+    }
+}
 
-    struct actdsc   *act;
+/* get_stats replies a(stttatt): name, calls, total and max usec, the
+ * duration histogram and the gauge value of every entry; reset_stats
+ * clears the counters and is accepted only from the policy daemon. */
+static void handle_stats_message(struct userdata *u, DBusMessage *msg)
+{
+    DBusConnection                    *conn = pa_dbus_connection_get(u->dbusif->conn);
+    const struct pa_policy_stat_value *v;
+    DBusMessage                       *reply;
+    DBusMessageIter                    mit;
+    DBusMessageIter                    ait;
+    DBusMessageIter                    sit;
+    DBusMessageIter                    hit;
+    const char                        *name;
+    dbus_uint64_t                      val;
+    const char                        *sender;
+    unsigned                           i, j;
+
+    if (dbus_message_has_member(msg, POLICY_RESET_STATS)) {
+        sender = dbus_message_get_sender(msg);
+
+        if (!u->dbusif->pdowner || !sender || strcmp(sender, u->dbusif->pdowner)) {
+            pa_log("%s refused from %s", POLICY_RESET_STATS,
+                   sender ? sender : "unknown sender");
+            reply = dbus_message_new_error(msg, DBUS_ERROR_ACCESS_DENIED,
+                                           "only the policy daemon may reset");
+        }
+        else {
+            pa_policy_stats_reset(u);
+            reply = dbus_message_new_method_return(msg);
+        }
+    }
+    else {
+        if (!(reply = dbus_message_new_method_return(msg)))
+            return;
+
+        dbus_message_iter_init_append(reply, &mit);
+        dbus_message_iter_open_container(&mit, DBUS_TYPE_ARRAY, "(stttatt)", &ait);
+
+        for (i = 0;  i < pa_policy_stat_max;  i++) {
+            name = pa_policy_stats_name(i);
+            v    = pa_policy_stats_value(u, i);
+
+            dbus_message_iter_open_container(&ait, DBUS_TYPE_STRUCT, NULL, &sit);
+            dbus_message_iter_append_basic(&sit, DBUS_TYPE_STRING, &name);
+            val = v->calls;
+            dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64, &val);
+            val = v->total;
+            dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64, &val);
+            val = v->max;
+            dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64, &val);
+
+            dbus_message_iter_open_container(&sit, DBUS_TYPE_ARRAY, "t", &hit);
+            for (j = 0;  j < PA_POLICY_STATS_BUCKETS;  j++) {
+                val = v->hist[j];
+                dbus_message_iter_append_basic(&hit, DBUS_TYPE_UINT64, &val);
+            }
+            dbus_message_iter_close_container(&sit, &hit);
+
+            val = v->value;
+            dbus_message_iter_append_basic(&sit, DBUS_TYPE_UINT64, &val);
+
+            dbus_message_iter_close_container(&ait, &sit);
+        }
+
+        dbus_message_iter_close_container(&mit, &ait);
+    }
+
+    if (reply) {
+        pa_policy_stats_count(u, pa_policy_stat_dbus_out);
+
+        if (!dbus_connection_send(conn, reply, NULL))
+            pa_log("Failed to reply to %s", dbus_message_get_member(msg));
+
+        dbus_message_unref(reply);
+    }
+}
+
+int pa_policy_dbusif_process_actions(struct userdata *u, DBusMessage *msg,
+                                     uint32_t *txid_ret)
+{
+    const struct actdsc *act;
     dbus_uint32_t    txid;
     char            *actname;
     DBusMessageIter  msgit;
@@ -612,125 +1000,426 @@ static void handle_action_message(struct userdata *u, DBusMessage *msg)
 
     pa_log_debug("got policy actions");
 
-    dbus_message_iter_init(msg, &msgit);
-
-    if (dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_UINT32)
-        return;
+    if (!dbus_message_iter_init(msg, &msgit) ||
+        dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_UINT32)
+        return -1;
 
     dbus_message_iter_get_basic(&msgit, (void *)&txid);
+    *txid_ret = txid;
 
     pa_log_debug("got actions (txid:%d)", txid);
 
-    if (!dbus_message_iter_next(&msgit) ||
-        dbus_message_iter_get_arg_type(&msgit) != DBUS_TYPE_ARRAY) {
+    /* With the signature checked once up front the structure of the
+     * message needs no checking while it is walked through. */
+    if (!dbus_message_has_signature(msg, POLICY_ACTIONS_SIGNATURE)) {
+        pa_log("policy actions with invalid signature '%s'",
+               dbus_message_get_signature(msg));
         success = false;
-        goto send_signal;
+        goto done;
     }
 
+    dbus_message_iter_next(&msgit);
     dbus_message_iter_recurse(&msgit, &arrit);
 
+    if (dbus_message_iter_get_arg_type(&arrit) == DBUS_TYPE_INVALID) {
+        success = false;
+        goto done;
+    }
+
+    pa_policy_dbusif_actions_begin(u);
+
     do {
-        if (dbus_message_iter_get_arg_type(&arrit) != DBUS_TYPE_DICT_ENTRY) {
+        dbus_message_iter_recurse(&arrit, &entit);
+        dbus_message_iter_get_basic(&entit, (void *)&actname);
+        dbus_message_iter_next(&entit);
+        dbus_message_iter_recurse(&entit, &actit);
+
+        if (dbus_message_iter_get_arg_type(&actit) == DBUS_TYPE_INVALID) {
             success = false;
             continue;
         }
 
+        if ((act = action_lookup(actname)) != NULL)
+            success &= act->parser(u, &actit);
+
+    } while (dbus_message_iter_next(&arrit));
+
+    pa_policy_dbusif_actions_end(u);
+
+ done:
+    return success;
+}
+
+int pa_policy_dbusif_decode_actions(DBusMessage *msg)
+{
+    const struct actdsc *act;
+    char                *actname;
+    DBusMessageIter      msgit;
+    DBusMessageIter      arrit;
+    DBusMessageIter      entit;
+    DBusMessageIter      actit;
+    int                  ncmd = 0;
+    union actargs        args;
+
+    if (!dbus_message_has_signature(msg, POLICY_ACTIONS_SIGNATURE) ||
+        !dbus_message_iter_init(msg, &msgit))
+        return -1;
+
+    dbus_message_iter_next(&msgit);
+    dbus_message_iter_recurse(&msgit, &arrit);
+
+    while (dbus_message_iter_get_arg_type(&arrit) != DBUS_TYPE_INVALID) {
         dbus_message_iter_recurse(&arrit, &entit);
+        dbus_message_iter_get_basic(&entit, (void *)&actname);
+        dbus_message_iter_next(&entit);
+        dbus_message_iter_recurse(&entit, &actit);
 
-        do {
-            if (dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_STRING) {
-                success = false;
-                continue;
-            }
-            
-            dbus_message_iter_get_basic(&entit, (void *)&actname);
-            
-            if (!dbus_message_iter_next(&entit) ||
-                dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_ARRAY) {
-                success = false;
-                continue;
-            }
-            
-            dbus_message_iter_recurse(&entit, &actit);
-            
-            if (dbus_message_iter_get_arg_type(&actit) != DBUS_TYPE_ARRAY) {
-                success = false;
-                continue;
-            }
-            
-            for (act = actions;   act->name != NULL;   act++) {
-                if (!strcmp(actname, act->name))
-                    break;
-            }
-                                    
-            if (act->parser != NULL)
-                success &= act->parser(u, &actit);
+        if ((act = action_lookup(actname)) != NULL &&
+            dbus_message_iter_get_arg_type(&actit) != DBUS_TYPE_INVALID)
+        {
+            do {
+                if (!act->decode(&actit, &args))
+                    return -1;
 
-        } while (dbus_message_iter_next(&entit));
+                ncmd++;
+            } while (dbus_message_iter_next(&actit));
+        }
 
-    } while (dbus_message_iter_next(&arrit));
+        dbus_message_iter_next(&arrit);
+    }
+
+    return ncmd;
+}
+
+void pa_policy_dbusif_actions_begin(struct userdata *u)
+{
+    /* a status held back for the module loads goes out before the next
+     * transaction, which could otherwise overwrite it */
+    if (u->dbusif->loading)
+        pa_classify_flush_module_loads(u);
+
+    /* cork changes take effect once the whole message is parsed */
+    pa_policy_group_cork_begin(u);
+}
 
+void pa_policy_dbusif_actions_end(struct userdata *u)
+{
+    pa_policy_group_cork_commit(u);
     pa_policy_context_variable_commit(u);
+}
+
+/* The action names differ at fixed positions after the common prefix,
+ * so they can be told apart without comparing against every entry. */
+static const struct actdsc *action_lookup(const char *name)
+{
+    static const struct actdsc actions[] = {
+        { "com.nokia.policy.audio_route" , audio_route_parser , route_decode   },
+        { "com.nokia.policy.volume_limit", volume_limit_parser, volume_decode  },
+        { "com.nokia.policy.audio_cork"  , audio_cork_parser  , cork_decode    },
+        { "com.nokia.policy.audio_mute"  , audio_mute_parser  , mute_decode    },
+        { "com.nokia.policy.context"     , context_parser     , context_decode },
+    };
+
+    const struct actdsc *act = NULL;
+    const char          *suffix;
+
+    if (strncmp(name, POLICY_ACTION_PREFIX, sizeof(POLICY_ACTION_PREFIX) - 1))
+        return NULL;
+
+    suffix = name + sizeof(POLICY_ACTION_PREFIX) - 1;
+
+    switch (suffix[0]) {
+    case 'a':
+        if (strncmp(suffix, "audio_", 6))
+            return NULL;
+
+        switch (suffix[6]) {
+        case 'r':   act = actions + 0;   break;
+        case 'c':   act = actions + 2;   break;
+        case 'm':   act = actions + 3;   break;
+        default:                         return NULL;
+        }
+        break;
+
+    case 'v':   act = actions + 1;   break;
+    case 'c':   act = actions + 4;   break;
+    default:                         return NULL;
+    }
+
+    return strcmp(name, act->name) ? NULL : act;
+}
+
+/* The message signature has been checked already, so a command is an
+ * array of (sv) and only the types of the values need checking. */
+static bool command_begin(DBusMessageIter *actit, DBusMessageIter *cmdit)
+{
+    dbus_message_iter_recurse(actit, cmdit);
+
+    return dbus_message_iter_get_arg_type(cmdit) == DBUS_TYPE_STRUCT;
+}
+
+static bool command_arg(DBusMessageIter *cmdit, const char **name,
+                        DBusMessageIter *valit)
+{
+    DBusMessageIter argit;
+
+    if (dbus_message_iter_get_arg_type(cmdit) != DBUS_TYPE_STRUCT)
+        return false;
 
- send_signal:
-    signal_status(u, txid, success);
+    dbus_message_iter_recurse(cmdit, &argit);
+    dbus_message_iter_get_basic(&argit, (void *)name);
+    dbus_message_iter_next(&argit);
+    dbus_message_iter_recurse(&argit, valit);
+    dbus_message_iter_next(cmdit);
+
+    return true;
 }
 
-static int action_parser(DBusMessageIter *actit, struct argdsc *descs,
-                         void *args, int len)
+/* Takes the value if the argument is the expected one; an unknown
+ * argument is skipped, one of the wrong type fails the command. */
+static bool arg_get(DBusMessageIter *valit, const char *name,
+                    const char *expected, int type, void *value)
 {
+    if (strcmp(name, expected))
+        return true;
+
+    if (dbus_message_iter_get_arg_type(valit) != type)
+        return false;
+
+    dbus_message_iter_get_basic(valit, value);
+
+    return true;
+}
+
+/* The decoders tell the arguments apart by their first letter, as the
+ * action names are by action_lookup(), and fill in the typed arguments
+ * in one pass over the command. */
+static bool route_decode(DBusMessageIter *actit, union actargs *args)
+{
+    struct argrt    *rt = &args->rt;
     DBusMessageIter  cmdit;
-    DBusMessageIter  argit;
     DBusMessageIter  valit;
-    struct argdsc   *desc;
-    char            *argname;
-    void            *argval;
-    
-    dbus_message_iter_recurse(actit, &cmdit);
+    const char      *name;
+    bool             ok = true;
+
+    memset(rt, 0, sizeof(*rt));
+
+    if (!command_begin(actit, &cmdit))
+        return false;
+
+    while (ok && command_arg(&cmdit, &name, &valit)) {
+        switch (name[0]) {
+        case 't': ok = arg_get(&valit, name, "type"  , DBUS_TYPE_STRING, &rt->type);   break;
+        case 'd': ok = arg_get(&valit, name, "device", DBUS_TYPE_STRING, &rt->device); break;
+        case 'm': ok = arg_get(&valit, name, "mode"  , DBUS_TYPE_STRING, &rt->mode);   break;
+        case 'h': ok = arg_get(&valit, name, "hwid"  , DBUS_TYPE_STRING, &rt->hwid);   break;
+        case 'g': ok = arg_get(&valit, name, "group" , DBUS_TYPE_STRING, &rt->group);  break;
+        default:                                                                       break;
+        }
+    }
 
-    memset(args, 0, len);
+    return ok;
+}
 
-    do {
-        if (dbus_message_iter_get_arg_type(&cmdit) != DBUS_TYPE_STRUCT)
-            return false;
+static bool volume_decode(DBusMessageIter *actit, union actargs *args)
+{
+    struct argvol   *vol = &args->vol;
+    DBusMessageIter  cmdit;
+    DBusMessageIter  valit;
+    const char      *name;
+    bool             ok = true;
 
-        dbus_message_iter_recurse(&cmdit, &argit);
+    memset(vol, 0, sizeof(*vol));
 
-        if (dbus_message_iter_get_arg_type(&argit) != DBUS_TYPE_STRING)
-            return false;
+    if (!command_begin(actit, &cmdit))
+        return false;
+
+    while (ok && command_arg(&cmdit, &name, &valit)) {
+        switch (name[0]) {
+        case 'g': ok = arg_get(&valit, name, "group", DBUS_TYPE_STRING, &vol->group); break;
+        case 'l': ok = arg_get(&valit, name, "limit", DBUS_TYPE_INT32 , &vol->limit); break;
+        default:                                                                      break;
+        }
+    }
 
-        dbus_message_iter_get_basic(&argit, (void *)&argname);
+    return ok;
+}
 
-        if (!dbus_message_iter_next(&argit))
-            return false;
+static bool cork_decode(DBusMessageIter *actit, union actargs *args)
+{
+    struct argcork  *cork = &args->cork;
+    DBusMessageIter  cmdit;
+    DBusMessageIter  valit;
+    const char      *name;
+    bool             ok = true;
 
-        if (dbus_message_iter_get_arg_type(&argit) != DBUS_TYPE_VARIANT)
-            return false;
+    memset(cork, 0, sizeof(*cork));
 
-        dbus_message_iter_recurse(&argit, &valit);
+    if (!command_begin(actit, &cmdit))
+        return false;
 
-        for (desc = descs;  desc->name != NULL;  desc++) {
-            if (!strcmp(argname, desc->name)) {
-                if (desc->offs + (int)sizeof(char *) > len) {
-                    pa_log("%s(): desc offset %d is out of range %d",
-                           __FUNCTION__, desc->offs, len);
-                    return false;
-                }
-                else {
-                    if (dbus_message_iter_get_arg_type(&valit) != desc->type)
-                        return false;
+    while (ok && command_arg(&cmdit, &name, &valit)) {
+        switch (name[0]) {
+        case 'g': ok = arg_get(&valit, name, "group", DBUS_TYPE_STRING, &cork->group); break;
+        case 'c': ok = arg_get(&valit, name, "cork" , DBUS_TYPE_STRING, &cork->cork);  break;
+        default:                                                                       break;
+        }
+    }
 
-                    argval = (char *)args + desc->offs;
+    return ok;
+}
 
-                    dbus_message_iter_get_basic(&valit, argval);
-                }
-                break;
-            }
+static bool mute_decode(DBusMessageIter *actit, union actargs *args)
+{
+    struct argmute  *mute = &args->mute;
+    DBusMessageIter  cmdit;
+    DBusMessageIter  valit;
+    const char      *name;
+    bool             ok = true;
+
+    memset(mute, 0, sizeof(*mute));
+
+    if (!command_begin(actit, &cmdit))
+        return false;
+
+    while (ok && command_arg(&cmdit, &name, &valit)) {
+        switch (name[0]) {
+        case 'd': ok = arg_get(&valit, name, "device", DBUS_TYPE_STRING, &mute->device); break;
+        case 'm': ok = arg_get(&valit, name, "mute"  , DBUS_TYPE_STRING, &mute->mute);   break;
+        default:                                                                         break;
         }
+    }
 
-    } while (dbus_message_iter_next(&cmdit));
+    return ok;
+}
 
-    return true;
+static bool context_decode(DBusMessageIter *actit, union actargs *args)
+{
+    struct argctx   *ctx = &args->ctx;
+    DBusMessageIter  cmdit;
+    DBusMessageIter  valit;
+    const char      *name;
+    bool             ok = true;
+
+    memset(ctx, 0, sizeof(*ctx));
+
+    if (!command_begin(actit, &cmdit))
+        return false;
+
+    while (ok && command_arg(&cmdit, &name, &valit)) {
+        switch (name[0]) {
+        case 'v':
+            if (name[1] == 'a' && name[2] == 'r')
+                ok = arg_get(&valit, name, "variable", DBUS_TYPE_STRING, &ctx->variable);
+            else
+                ok = arg_get(&valit, name, "value", DBUS_TYPE_STRING, &ctx->value);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return ok;
+}
+
+static void route_modules_loaded_cb(struct userdata *u, bool success)
+{
+    struct pa_policy_dbusif *dbusif = u->dbusif;
+
+    dbusif->loading = false;
+
+    if (!success)
+        pa_log_error("can't load the modules of the route");
+
+    /* the groups whose target came with the modules go there now */
+    if (dbusif->retry) {
+        if (success) {
+            pa_log_debug("attaching the groups again after the module loads");
+            success = route_attach(u, pa_policy_group_start_move_all(u),
+                                   dbusif->retry, dbusif->nretry);
+        }
+
+        route_retry_free(dbusif);
+    }
+
+    if (dbusif->status_pending) {
+        dbusif->status_pending = false;
+        signal_status(u, dbusif->status_txid, dbusif->status && success);
+    }
+}
+
+/* The strings of the decisions belong to the D-Bus message. */
+static void route_retry_save(struct pa_policy_dbusif *dbusif,
+                             const struct pa_policy_route_decision *decisions,
+                             int num_decisions)
+{
+    struct pa_policy_route_decision *d;
+    int i;
+
+    route_retry_free(dbusif);
+
+    dbusif->retry  = pa_xnew0(struct pa_policy_route_decision, num_decisions);
+    dbusif->nretry = num_decisions;
+
+    for (i = 0; i < num_decisions; i++) {
+        d = dbusif->retry + i;
+
+        d->class  = decisions[i].class;
+        d->group  = pa_xstrdup(decisions[i].group);
+        d->target = pa_xstrdup(decisions[i].target);
+        d->mode   = pa_xstrdup(decisions[i].mode);
+        d->hwid   = pa_xstrdup(decisions[i].hwid);
+    }
+}
+
+static void route_retry_free(struct pa_policy_dbusif *dbusif)
+{
+    struct pa_policy_route_decision *d;
+    int i;
+
+    for (i = 0; i < dbusif->nretry; i++) {
+        d = dbusif->retry + i;
+
+        pa_xfree((char *)d->group);
+        pa_xfree((char *)d->target);
+        pa_xfree((char *)d->mode);
+        pa_xfree((char *)d->hwid);
+    }
+
+    pa_xfree(dbusif->retry);
+
+    dbusif->retry  = NULL;
+    dbusif->nretry = 0;
+}
+
+/* Attach every group once to its new position, or re-attach it where
+ * it was if no decision concerns it. */
+static bool route_attach(struct userdata *u, int num_moving,
+                         const struct pa_policy_route_decision *decisions,
+                         int num_decisions)
+{
+    int num_attached;
+    bool result = true;
+
+    if ((num_attached = pa_policy_group_move_all_to(u, decisions, num_decisions)) < 0) {
+        result = false;
+        pa_log_error("Failed to route groups according to %d decisions", num_decisions);
+    }
+    else
+        pa_log_debug("Attached %d of %d groups.", num_attached, num_moving);
+
+    /* Test that no moving groups exist */
+    if (num_attached != num_moving) {
+        pa_log_error("Got %d routing decisions. %d groups were left incomplete.",
+                     num_decisions, num_moving - (num_attached < 0 ? 0 : num_attached));
+
+        pa_policy_group_assert_moving(u);
+        result = false;
+    }
+
+    PA_POLICY_PROBE3(route_attached, num_attached, num_moving, result);
+
+    return result;
 }
 
 static void port_changes_done_cb(struct userdata *u)
@@ -739,201 +1428,252 @@ static void port_changes_done_cb(struct userdata *u)
                                           PA_SAILFISHOS_MEDIA_VOLUME_CHANGE_DONE);
 }
 
-static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
+static const char *route_prop_name(const struct pa_policy_route_decision *d,
+                                   const char *what, char *buf, size_t len)
 {
-    static struct argdsc descs[] = {
-        {"type"  , STRUCT_OFFSET(struct argrt, type)  , DBUS_TYPE_STRING },
-        {"device", STRUCT_OFFSET(struct argrt, device), DBUS_TYPE_STRING },
-        {"mode"  , STRUCT_OFFSET(struct argrt, mode),   DBUS_TYPE_STRING },
-        {"hwid"  , STRUCT_OFFSET(struct argrt, hwid),   DBUS_TYPE_STRING },
-        {  NULL  ,            0                       , DBUS_TYPE_INVALID}
-    };
+    const char *cls = (d->class == pa_policy_route_to_sink) ? "sink":"source";
 
-    struct argrt args;
-    pa_proplist *p = NULL;
-    struct routing_decision decisions[MAX_ROUTING_DECISIONS];
+    /* group specific routes are remembered separately from the generic one */
+    if (d->group)
+        snprintf(buf, len, "policy.%s_route.%s.%s", cls, d->group, what);
+    else
+        snprintf(buf, len, "policy.%s_route.%s", cls, what);
+
+    return buf;
+}
+
+static bool route_decision_changed(pa_proplist *p,
+                                   const struct pa_policy_route_decision *d)
+{
+    char name[256];
+
+    return
+      !pa_streq(pa_strempty(pa_proplist_gets(p, route_prop_name(d, "target", name, sizeof(name)))), d->target) ||
+      !pa_streq(pa_strempty(pa_proplist_gets(p, route_prop_name(d, "mode",   name, sizeof(name)))), d->mode)   ||
+      !pa_streq(pa_strempty(pa_proplist_gets(p, route_prop_name(d, "hwid",   name, sizeof(name)))), d->hwid);
+}
+
+static int route_order_rank(enum pa_policy_route_order order,
+                            enum pa_policy_route_class class)
+{
+    switch (order) {
+    case pa_policy_route_order_sinks_first:
+        return class == pa_policy_route_to_sink ? 0 : 1;
+    case pa_policy_route_order_sources_first:
+        return class == pa_policy_route_to_source ? 0 : 1;
+    default:
+        return 0;
+    }
+}
+
+static void route_order_sort(enum pa_policy_route_order order,
+                             struct pa_policy_route_decision *decisions,
+                             int num_decisions)
+{
+    struct pa_policy_route_decision tmp;
+    int i, j;
+
+    /* stable insertion sort, the decision lists are short */
+    for (i = 1;  i < num_decisions;  i++) {
+        tmp = decisions[i];
+
+        for (j = i;  j > 0;  j--) {
+            if (route_order_rank(order, decisions[j-1].class) <=
+                route_order_rank(order, tmp.class))
+                break;
+
+            decisions[j] = decisions[j-1];
+        }
+
+        decisions[j] = tmp;
+    }
+}
+
+static int audio_route_parser(struct userdata *u, DBusMessageIter *actit)
+{
+    union actargs args;
+    struct pa_policy_route_decision *decisions = NULL;
+    struct pa_policy_route_decision *d;
     int num_decisions = 0;
-    int num_decisions_done = 0;
-    int i = 0;
-    int num_moving = 0;
-    bool result = true;
-    bool route_changed = false;
-    bool sink_route_changed = false;
+    int max_decisions = 0;
+    bool result;
+
+    PA_POLICY_PROBE(route_parse_begin);
 
     /* Parse message. It's safe to bail out here, because we're not moving any streams yet. */
     do {
-        i = num_decisions;
-        num_decisions++;
-
-        if (num_decisions > MAX_ROUTING_DECISIONS) {
-            pa_log_error("Too many routing decisions (max %d)", MAX_ROUTING_DECISIONS);
-            return false;
+        if (num_decisions >= max_decisions) {
+            max_decisions = max_decisions ? max_decisions * 2 : 4;
+            decisions = pa_xrenew(struct pa_policy_route_decision, decisions, max_decisions);
         }
 
-        if (!action_parser(actit, descs, &args, sizeof(args)))
-            return false;
+        d = decisions + num_decisions;
 
-        if (args.type == NULL || args.device == NULL)
-            return false;
+        if (!route_decode(actit, &args))
+            goto parse_error;
+
+        if (args.rt.type == NULL || args.rt.device == NULL)
+            goto parse_error;
 
-        if (!strcmp(args.type, "sink"))
-            decisions[i].class = pa_policy_route_to_sink;
-        else if (!strcmp(args.type, "source"))
-            decisions[i].class = pa_policy_route_to_source;
+        if (!strcmp(args.rt.type, "sink"))
+            d->class = pa_policy_route_to_sink;
+        else if (!strcmp(args.rt.type, "source"))
+            d->class = pa_policy_route_to_source;
         else
-            return false;
+            goto parse_error;
 
-        decisions[i].target = args.device;
-        decisions[i].mode   = (args.mode && strcmp(args.mode, "na")) ? args.mode : "";
-        decisions[i].hwid   = (args.hwid && strcmp(args.hwid, "na")) ? args.hwid : "";
+        num_decisions++;
 
-        pa_log_debug("route %s to %s (%s|%s)", args.type, decisions[i].target,
-                                                          decisions[i].mode,
-                                                          decisions[i].hwid);
+        d->group  = (args.rt.group && args.rt.group[0]) ? args.rt.group : NULL;
+        d->target = args.rt.device;
+        d->mode   = (args.rt.mode && strcmp(args.rt.mode, "na")) ? args.rt.mode : "";
+        d->hwid   = (args.rt.hwid && strcmp(args.rt.hwid, "na")) ? args.rt.hwid : "";
 
-        p = u->module->proplist;
+    } while (dbus_message_iter_next(actit));
 
-        if (decisions[i].class == pa_policy_route_to_sink) {
-            if (!pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SINK_TARGET)), decisions[i].target) ||
-                !pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SINK_MODE  )), decisions[i].mode)   ||
-                !pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SINK_HWID  )), decisions[i].hwid)) {
+    result = pa_policy_dbusif_route(u, decisions, num_decisions);
 
-                sink_route_changed = route_changed = true;
-                pa_sink_ext_pending_start(u);
-                pa_log_debug("Sink route has changed");
+    pa_xfree(decisions);
 
-                pa_shared_data_inc_integer(u->shared, PA_SAILFISHOS_MEDIA_VOLUME_SYNC,
-                                                      PA_SAILFISHOS_MEDIA_VOLUME_CHANGING);
-            }
-        } else {
-            if (!pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SOURCE_TARGET)), decisions[i].target) ||
-                !pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SOURCE_MODE  )), decisions[i].mode)   ||
-                !pa_streq(pa_strempty(pa_proplist_gets(p, PROP_ROUTE_SOURCE_HWID  )), decisions[i].hwid)) {
+    return result;
+
+ parse_error:
+    pa_xfree(decisions);
+    return false;
+}
+
+int pa_policy_dbusif_route(struct userdata *u,
+                           struct pa_policy_route_decision *decisions,
+                           int num_decisions)
+{
+    struct pa_policy_route_decision *d;
+    pa_proplist *p = NULL;
+    char name[256];
+    int i = 0;
+    int num_moving = 0;
+    bool attached;
+    bool result = true;
+    bool route_changed = false;
+    bool sink_route_changed = false;
+
+    for (i = 0; i < num_decisions; i++) {
+        d = decisions + i;
+
+        pa_log_debug("route %s%s%s to %s (%s|%s)",
+                     d->class == pa_policy_route_to_sink ? "sink" : "source",
+                     d->group ? " of " : "", d->group ? d->group : "",
+                     d->target, d->mode, d->hwid);
+
+        if (route_decision_changed(u->module->proplist, d)) {
+            route_changed = true;
 
-                route_changed = true;
+            if (d->class == pa_policy_route_to_sink) {
+                sink_route_changed = true;
+                pa_log_debug("Sink route has changed");
+            } else
                 pa_log_debug("Source route has changed");
-            }
         }
+    }
 
-    } while (dbus_message_iter_next(actit));
+    PA_POLICY_PROBE2(route_parse_end, num_decisions, route_changed);
 
     if (!route_changed) {
         pa_log_debug("New audio route is identical to the current one. No need to move streams.");
         return true;
     }
 
+    if (sink_route_changed) {
+        pa_sink_ext_pending_start(u);
+        pa_shared_data_inc_integer(u->shared, PA_SAILFISHOS_MEDIA_VOLUME_SYNC,
+                                              PA_SAILFISHOS_MEDIA_VOLUME_CHANGING);
+    }
+
+    /* Device modules are loaded once the groups are attached again, so
+     * that a slow load doesn't keep the streams detached. */
+    pa_classify_defer_module_loads(u);
+
+    /* Streams to be corked are corked before they are moved. */
+    pa_policy_group_cork_flush(u);
+
     /* Detach groups. */
     num_moving = pa_policy_group_start_move_all(u);
     pa_log_debug("Policy groups moving: %d", num_moving);
 
-    if (u->dbusif->route_sources_first) {
-        /* Following works only if MAX_ROUTING_DECISIONS is 2, so make sure this is
-         * caught if the value ever changes. */
-        pa_assert_se(MAX_ROUTING_DECISIONS == 2);
-        if (num_decisions > 1 && decisions[0].class != pa_policy_route_to_source) {
-            struct routing_decision tmp = decisions[0];
-            decisions[0] = decisions[1];
-            decisions[1] = tmp;
-        }
-    }
+    PA_POLICY_PROBE1(route_detached, num_moving);
+
+    route_order_sort(u->dbusif->route_order, decisions, num_decisions);
 
     /* Set profiles and ports while the groups are detached. */
     for (i = 0; i < num_decisions; i++) {
+        d = decisions + i;
         p = pa_proplist_new();
 
-        if (decisions[i].class == pa_policy_route_to_sink) {
-            pa_proplist_sets(p, PROP_ROUTE_SINK_TARGET, decisions[i].target);
-            pa_proplist_sets(p, PROP_ROUTE_SINK_MODE,   decisions[i].mode);
-            pa_proplist_sets(p, PROP_ROUTE_SINK_HWID,   decisions[i].hwid);
-        } else {
-            pa_proplist_sets(p, PROP_ROUTE_SOURCE_TARGET, decisions[i].target);
-            pa_proplist_sets(p, PROP_ROUTE_SOURCE_MODE,   decisions[i].mode);
-            pa_proplist_sets(p, PROP_ROUTE_SOURCE_HWID,   decisions[i].hwid);
-        }
+        pa_proplist_sets(p, route_prop_name(d, "target", name, sizeof(name)), d->target);
+        pa_proplist_sets(p, route_prop_name(d, "mode",   name, sizeof(name)), d->mode);
+        pa_proplist_sets(p, route_prop_name(d, "hwid",   name, sizeof(name)), d->hwid);
 
         pa_module_update_proplist(u->module, PA_UPDATE_REPLACE, p);
         pa_proplist_free(p);
 
-        if (pa_card_ext_set_profile(u, decisions[i].target) < 0 ||
-              (decisions[i].class == pa_policy_route_to_sink &&
-                 pa_sink_ext_set_ports(u, decisions[i].target) < 0) ||
-              (decisions[i].class == pa_policy_route_to_source &&
-                 pa_source_ext_set_ports(u, decisions[i].target) < 0))
+        if (pa_card_ext_set_profile(u, d->target) < 0 ||
+              (d->class == pa_policy_route_to_sink &&
+                 pa_sink_ext_set_ports(u, d->target) < 0) ||
+              (d->class == pa_policy_route_to_source &&
+                 pa_source_ext_set_ports(u, d->target) < 0))
         {
             result = false; /* Continue anyway to avoid leaving streams detached. */
             pa_log_error("can't set profiles/ports to %s %s",
-                         (decisions[i].class == pa_policy_route_to_sink ? "sink" : "source"),
-                          decisions[i].target);
+                         (d->class == pa_policy_route_to_sink ? "sink" : "source"),
+                          d->target);
         }
 
-        if (decisions[i].class == pa_policy_route_to_sink) {
-            if (pa_policy_activity_device_changed(u, decisions[i].target) < 0)
-                pa_log("Failed to update activity for %s", decisions[i].target);
+        if (d->class == pa_policy_route_to_sink) {
+            if (pa_policy_activity_device_changed(u, d->target) < 0)
+                pa_log("Failed to update activity for %s", d->target);
         }
     }
 
-    /* Attach groups to their new positions and re-attach those that were not moved. */
-    for (i = 0; i < num_decisions; i++) {
-        int num_moved;
-
-        if ((num_moved = pa_policy_group_move_to(u, NULL, decisions[i].class,
-                                                 decisions[i].target,
-                                                 decisions[i].mode,
-                                                 decisions[i].hwid)) < 0) {
-            result = false;
-            pa_log_error("Failed to move group %s %s %s", decisions[i].target,
-                                                          decisions[i].mode,
-                                                          decisions[i].hwid);
-        } else {
-            pa_log_debug("Moved %d %s groups to %s.",
-                         num_moved,
-                         decisions[i].class == pa_policy_route_to_sink ? "sink" : "source",
-                         decisions[i].target);
-            if (num_moving == num_moved)
-                num_decisions_done++;
-        }
-    }
+    PA_POLICY_PROBE1(route_devices_set, num_decisions);
 
-    /* Test that no moving groups exist */
-    if (num_decisions != num_decisions_done) {
-        pa_log_error("Got %d routing decisions. %d decisions were incomplete.",
-                     num_decisions, num_decisions - num_decisions_done);
-
-        pa_policy_group_assert_moving(u);
-        result = false;
-    }
+    attached = route_attach(u, num_moving, decisions, num_decisions);
 
     if (sink_route_changed)
         pa_sink_ext_pending_run(u, port_changes_done_cb);
 
-    return result;
+    if (pa_classify_run_module_loads(u, route_modules_loaded_cb)) {
+        u->dbusif->loading = true;
+
+        /* A target may be a device of the modules still to load. The
+         * groups stayed where they were and are attached again once the
+         * modules are there; that attach decides the status. */
+        if (!attached) {
+            route_retry_save(u->dbusif, decisions, num_decisions);
+            return result;
+        }
+    }
+
+    return result && attached;
 }
 
 static int volume_limit_parser(struct userdata *u, DBusMessageIter *actit)
 {
-    static struct argdsc descs[] = {
-        {"group", STRUCT_OFFSET(struct argvol, group), DBUS_TYPE_STRING },
-        {"limit", STRUCT_OFFSET(struct argvol, limit), DBUS_TYPE_INT32  },
-        {  NULL ,            0                       , DBUS_TYPE_INVALID}
-    };
-
-    struct argvol  args;
+    union actargs  args;
     int            success = true;
 
     do {
-        if (!action_parser(actit, descs, &args, sizeof(args))) {
+        if (!volume_decode(actit, &args)) {
             success = false;
             break;
         }
 
-        if (args.group == NULL || args.limit < 0 || args.limit > 100) {
+        if (args.vol.group == NULL || args.vol.limit < 0 || args.vol.limit > 100) {
             success = false;
             break;
         }
 
-        pa_log_debug("volume limit (%s|%d)", args.group, args.limit); 
+        pa_log_debug("volume limit (%s|%d)", args.vol.group, args.vol.limit); 
 
-        pa_policy_group_volume_limit(u, args.group, (uint32_t)args.limit);
+        pa_policy_group_volume_limit(u, args.vol.group, (uint32_t)args.vol.limit);
 
     } while (dbus_message_iter_next(actit));
 
@@ -944,28 +1684,22 @@ static int volume_limit_parser(struct userdata *u, DBusMessageIter *actit)
 
 static int audio_cork_parser(struct userdata *u, DBusMessageIter *actit)
 {
-    static struct argdsc descs[] = {
-        {"group", STRUCT_OFFSET(struct argcork, group), DBUS_TYPE_STRING },
-        {"cork" , STRUCT_OFFSET(struct argcork, cork) , DBUS_TYPE_STRING },
-        { NULL  ,            0                        , DBUS_TYPE_INVALID}
-    };
-    
-    struct argcork  args;
+    union actargs  args;
     char           *grp;
     int             val;
     
     do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
+        if (!cork_decode(actit, &args))
             return false;
 
-        if (args.group == NULL || args.cork == NULL)
+        if (args.cork.group == NULL || args.cork.cork == NULL)
             return false;
 
-        grp = args.group;
+        grp = args.cork.group;
 
-        if (!strcmp(args.cork, "corked"))
+        if (!strcmp(args.cork.cork, "corked"))
             val = 1;
-        else if (!strcmp(args.cork, "uncorked"))
+        else if (!strcmp(args.cork.cork, "uncorked"))
             val = 0;
         else
             return false;
@@ -980,28 +1714,22 @@ static int audio_cork_parser(struct userdata *u, DBusMessageIter *actit)
 
 static int audio_mute_parser(struct userdata *u, DBusMessageIter *actit)
 {
-    static struct argdsc descs[] = {
-        {"device", STRUCT_OFFSET(struct argmute, device), DBUS_TYPE_STRING },
-        {"mute"  , STRUCT_OFFSET(struct argmute, mute)  , DBUS_TYPE_STRING },
-        { NULL   ,            0                         , DBUS_TYPE_INVALID}
-    };
-    
-    struct argmute  args;
+    union actargs  args;
     char           *device;
     int             val;
     
     do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
+        if (!mute_decode(actit, &args))
             return false;
 
-        if (args.device == NULL || args.mute == NULL)
+        if (args.mute.device == NULL || args.mute.mute == NULL)
             return false;
 
-        device = args.device;
+        device = args.mute.device;
 
-        if (!strcmp(args.mute, "muted"))
+        if (!strcmp(args.mute.mute, "muted"))
             val = 1;
-        else if (!strcmp(args.mute, "unmuted"))
+        else if (!strcmp(args.mute.mute, "unmuted"))
             val = 0;
         else
             return false;
@@ -1016,24 +1744,18 @@ static int audio_mute_parser(struct userdata *u, DBusMessageIter *actit)
 
 static int context_parser(struct userdata *u, DBusMessageIter *actit)
 {
-    static struct argdsc descs[] = {
-        {"variable", STRUCT_OFFSET(struct argctx,variable), DBUS_TYPE_STRING },
-        {"value"   , STRUCT_OFFSET(struct argctx,value)   , DBUS_TYPE_STRING },
-        {  NULL    ,            0                         , DBUS_TYPE_INVALID}
-    };
-    
-    struct argctx   args;
+    union actargs  args;
     
     do {
-        if (!action_parser(actit, descs, &args, sizeof(args)))
+        if (!context_decode(actit, &args))
             return false;
 
-        if (args.variable == NULL || args.value == NULL)
+        if (args.ctx.variable == NULL || args.ctx.value == NULL)
             return false;
 
-        pa_log_debug("context (%s|%s)", args.variable, args.value);
+        pa_log_debug("context (%s|%s)", args.ctx.variable, args.ctx.value);
 
-        pa_policy_context_variable_changed(u, args.variable, args.value);
+        pa_policy_context_variable_changed(u, args.ctx.variable, args.ctx.value);
 
     } while (dbus_message_iter_next(actit));
     
@@ -1045,6 +1767,7 @@ static void getnameowner_cb(DBusPendingCall *pend, void *data)
     struct userdata         *u = data;
     DBusMessage             *reply;
     DBusError                error;
+    const char              *owner;
 
     pa_assert(u);
     pa_assert(u->dbusif);
@@ -1065,6 +1788,13 @@ static void getnameowner_cb(DBusPendingCall *pend, void *data)
         dbus_error_free(&error);
     } else {
         pa_log_info("pdp is available");
+
+        if (dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &owner,
+                                  DBUS_TYPE_INVALID)) {
+            pa_xfree(u->dbusif->pdowner);
+            u->dbusif->pdowner = pa_xstrdup(owner);
+        }
+
         if (!u->dbusif->regist)
             pdp_register_ep(u->dbusif, u);
     }
@@ -1098,6 +1828,8 @@ static void pdp_get_state(struct pa_policy_dbusif *dbusif, struct userdata *u)
         goto done;
     }
 
+    pa_policy_stats_count(u, pa_policy_stat_dbus_out);
+
     if (!(success = dbus_connection_send_with_reply(conn, msg, &pend, DBUS_TIMEOUT_USE_DEFAULT))) {
         pa_log("Failed to send message to get pdp state");
         goto done;
@@ -1206,6 +1938,7 @@ static int pdp_register_ep(struct pa_policy_dbusif *dbusif, struct userdata *u)
     }
 
 
+    pa_policy_stats_count(u, pa_policy_stat_dbus_out);
     success = dbus_connection_send_with_reply(conn, msg, &pend, 10000);
     if (!success) {
         pa_log("Failed to register");
@@ -1278,6 +2011,7 @@ static int signal_status(struct userdata *u, uint32_t txid, uint32_t status)
         goto fail;
     }
 
+    pa_policy_stats_count(u, pa_policy_stat_dbus_out);
     ret = dbus_connection_send(conn, msg, NULL);
 
     if (!ret) {
@@ -1,15 +1,41 @@
 #ifndef foodbusiffoo
 #define foodbusiffoo
 
+#include <stdint.h>
+#include <dbus/dbus.h>
+
 #include "userdata.h"
 #include "classify.h"
 
 struct pa_policy_dbusif;
+struct pa_policy_route_decision;
+
+enum pa_policy_route_order {    /* how audio_route decisions are applied */
+    pa_policy_route_order_as_is = 0,
+    pa_policy_route_order_sinks_first,
+    pa_policy_route_order_sources_first,
+};
 
 struct pa_policy_dbusif *pa_policy_dbusif_init(struct userdata *, const char *,
                                                const char *, const char *,
-                                               const char *, bool);
+                                               const char *,
+                                               enum pa_policy_route_order);
 void pa_policy_dbusif_done(struct userdata *);
+int  pa_policy_dbusif_replay(struct userdata *, const char *);
+/* Executes an audio_actions message. Returns the status to report for
+ * the transaction, or -1 if the message carries no transaction id. */
+int  pa_policy_dbusif_process_actions(struct userdata *, DBusMessage *,
+                                      uint32_t *);
+/* Walks through the commands of an audio_actions message without
+ * executing them. Returns the number of commands or -1 if the message
+ * is not valid. */
+int  pa_policy_dbusif_decode_actions(DBusMessage *);
+/* The actions of a transaction are executed between begin and end,
+ * whichever interface they came from. */
+void pa_policy_dbusif_actions_begin(struct userdata *);
+void pa_policy_dbusif_actions_end(struct userdata *);
+int  pa_policy_dbusif_route(struct userdata *,
+                            struct pa_policy_route_decision *, int);
 void pa_policy_dbusif_send_device_state(struct userdata *u, const char *state,
                                         const struct pa_classify_result *list);
 void pa_policy_dbusif_send_media_status(struct userdata *, const char *,
@@ -0,0 +1,55 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+#include <meego/shared-data.h>
+
+#include "forward.h"
+#include "stats.h"
+
+
+void pa_policy_forward_sets(struct userdata *u, const char *key,
+                            const char *value)
+{
+    const char *last;
+
+    pa_assert(u);
+    pa_assert(u->shared);
+    pa_assert(key);
+    pa_assert(value);
+
+    /* compared with what is stored, as other modules write the keys, too */
+    if ((last = pa_shared_data_gets(u->shared, key)) && pa_streq(last, value)) {
+        pa_policy_stats_count(u, pa_policy_stat_shared_suppressed);
+        return;
+    }
+
+    pa_policy_stats_count(u, pa_policy_stat_shared_written);
+
+    pa_shared_data_sets(u->shared, key, value);
+}
+
+void pa_policy_forward_sets_always(struct userdata *u, const char *key,
+                                   const char *value)
+{
+    pa_assert(u);
+    pa_assert(u->shared);
+    pa_assert(key);
+    pa_assert(value);
+
+    /* listeners rely on being notified even if the value is the same */
+    pa_policy_stats_count(u, pa_policy_stat_shared_written);
+
+    pa_shared_data_sets_always(u->shared, key, value);
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
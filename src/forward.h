@@ -0,0 +1,26 @@
+#ifndef fooforwardfoo
+#define fooforwardfoo
+
+#include "userdata.h"
+
+/*
+ * Filter in front of pa_shared_data. Writes of a value that is identical
+ * to the one currently stored for the key are dropped, so that the
+ * listeners of the shared data are not woken up needlessly. The passed
+ * and the dropped writes are counted as 'shared.written' and
+ * 'shared.suppressed' in the module statistics.
+ */
+
+void pa_policy_forward_sets(struct userdata *, const char *, const char *);
+void pa_policy_forward_sets_always(struct userdata *, const char *,
+                                   const char *);
+
+#endif /* fooforwardfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,82 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/macro.h>
+
+#include "intern.h"
+
+/* shared by the module instances, like the statistics */
+static pa_hashmap *strings;     /* string -> the same string */
+static unsigned    users;
+static size_t      size;        /* bytes of the strings */
+
+
+void pa_policy_intern_init(void)
+{
+    if (users++ == 0) {
+        strings = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                      pa_idxset_string_compare_func,
+                                      NULL, pa_xfree);
+    }
+}
+
+void pa_policy_intern_done(void)
+{
+    pa_assert(users > 0);
+
+    if (--users == 0) {
+        pa_hashmap_free(strings);
+        strings = NULL;
+        size = 0;
+    }
+}
+
+const char *pa_policy_intern(const char *s)
+{
+    char *str;
+
+    pa_assert(strings);
+
+    if (!s)
+        return NULL;
+
+    if (!(str = pa_hashmap_get(strings, s))) {
+        str = pa_xstrdup(s);
+        pa_hashmap_put(strings, str, str);
+        size += strlen(str) + 1;
+    }
+
+    return str;
+}
+
+const char *pa_policy_intern_lookup(const char *s)
+{
+    pa_assert(strings);
+
+    return s ? pa_hashmap_get(strings, s) : NULL;
+}
+
+unsigned pa_policy_intern_count(void)
+{
+    return strings ? pa_hashmap_size(strings) : 0;
+}
+
+size_t pa_policy_intern_size(void)
+{
+    return size;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
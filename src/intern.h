@@ -0,0 +1,35 @@
+#ifndef foopolicyinternfoo
+#define foopolicyinternfoo
+
+#include <stddef.h>
+
+/*
+ * Pool of the names the module passes around: group names and device
+ * and card types, all of them coming from the configuration. Names that
+ * change at run time, like the sink a group is routed to, must not go
+ * into the pool as it never shrinks. Every name is stored once and the pool hands out the canonical pointer, so names
+ * from the pool can be compared by their pointers. A name that is not
+ * in the pool can't be the name of anything known to the module, which
+ * pa_policy_intern_lookup() tells without adding it.
+ *
+ * The strings stay until the last module instance is unloaded.
+ */
+
+void        pa_policy_intern_init(void);
+void        pa_policy_intern_done(void);
+
+const char *pa_policy_intern(const char *);
+const char *pa_policy_intern_lookup(const char *);
+
+unsigned    pa_policy_intern_count(void);
+size_t      pa_policy_intern_size(void);
+
+#endif /* foopolicyinternfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,303 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "lint.h"
+#include "classify.h"
+#include "match.h"
+#include "policy-group.h"
+
+#define REGEX_META "\\.[]()*+?{}|^$"
+
+struct lint_cost {
+    unsigned matchers;          /* evaluated in the worst case */
+    unsigned regexes;           /* of which are regular expressions */
+};
+
+static int  lint_streams(struct userdata *, struct lint_cost *);
+static int  lint_devices(struct pa_classify_device *, const char *,
+                         struct lint_cost *);
+static int  lint_cards(struct pa_classify_card *, struct lint_cost *);
+static int  lint_regex(pa_policy_match_object *, const char *, const char *);
+static bool stream_def_covers(struct userdata *, struct pa_classify_stream_def *,
+                              struct pa_classify_stream_def *);
+static bool match_covers(pa_policy_match_object *, pa_policy_match_object *);
+static bool match_same(pa_policy_match_object *, pa_policy_match_object *);
+static bool card_def_same(struct pa_classify_card_def *,
+                          struct pa_classify_card_def *);
+static void cost_add(struct lint_cost *, pa_policy_match_object *);
+
+
+int pa_policy_lint(struct userdata *u)
+{
+    struct pa_classify *cl;
+    struct lint_cost    streams, sinks, sources, cards;
+    int                 nwarn = 0;
+
+    pa_assert(u);
+    pa_assert_se((cl = u->classify));
+
+    memset(&streams, 0, sizeof(streams));
+    memset(&sinks,   0, sizeof(sinks));
+    memset(&sources, 0, sizeof(sources));
+    memset(&cards,   0, sizeof(cards));
+
+    nwarn += lint_streams(u, &streams);
+    nwarn += lint_devices(cl->sinks,   "sink",   &sinks);
+    nwarn += lint_devices(cl->sources, "source", &sources);
+    nwarn += lint_cards(cl->cards, &cards);
+
+    pa_log_info("policy lint: %d warning(s)", nwarn);
+    pa_log_info("policy lint: classification evaluates at most %u (%u regex) "
+                "matchers per stream, %u (%u) per sink, %u (%u) per source "
+                "and %u (%u) per card",
+                streams.matchers, streams.regexes, sinks.matchers, sinks.regexes,
+                sources.matchers, sources.regexes, cards.matchers, cards.regexes);
+
+    return nwarn;
+}
+
+
+static int lint_streams(struct userdata *u, struct lint_cost *cost)
+{
+    struct pa_classify_stream_def *d;
+    struct pa_classify_stream_def *e;
+    unsigned                       i, j;
+    char                          *def;
+    int                            nwarn = 0;
+
+    for (d = u->classify->streams.defs, i = 1;  d;  d = d->next, i++) {
+        /* the search stops at the first rule that matches */
+        cost_add(cost, d->stream_match);
+
+        if (d->stream_match)
+            nwarn += lint_regex(d->stream_match, "stream", d->group);
+
+        for (e = u->classify->streams.defs, j = 1;  e != d;  e = e->next, j++) {
+            if (stream_def_covers(u, e, d)) {
+                def = d->stream_match ? pa_policy_match_def(d->stream_match) : NULL;
+                pa_log_warn("policy lint: stream rule #%u (%s => %s) is shadowed "
+                            "by rule #%u (=> %s) and never matches",
+                            i, def ? def : "any", d->group, j, e->group);
+                pa_xfree(def);
+                nwarn++;
+                break;
+            }
+        }
+    }
+
+    return nwarn;
+}
+
+static int lint_devices(struct pa_classify_device *devices, const char *what,
+                        struct lint_cost *cost)
+{
+    struct pa_classify_device_def *d;
+    struct pa_classify_device_def *e;
+    uint32_t                       i;
+    int                            nwarn = 0;
+
+    if (!devices)
+        return 0;
+
+    /* all definitions are evaluated, as a device may have many types */
+    for (d = devices->defs;  d->type;  d++) {
+        cost_add(cost, d->dev_match);
+        nwarn += lint_regex(d->dev_match, what, d->type);
+
+        for (i = 0;  i < d->data.nport;  i++)
+            nwarn += lint_regex(d->data.ports[i].device_match, what, d->type);
+
+        for (e = devices->defs;  e != d;  e++) {
+            if (pa_streq(e->type, d->type) && match_same(e->dev_match, d->dev_match)) {
+                pa_log_warn("policy lint: %s type '%s' is defined twice for "
+                            "the same devices (definitions #%u and #%u)", what,
+                            d->type, (unsigned)(e - devices->defs) + 1,
+                            (unsigned)(d - devices->defs) + 1);
+                nwarn++;
+                break;
+            }
+        }
+    }
+
+    return nwarn;
+}
+
+static int lint_cards(struct pa_classify_card *cards, struct lint_cost *cost)
+{
+    struct pa_classify_card_def *d;
+    struct pa_classify_card_def *e;
+    int                          i;
+    int                          nwarn = 0;
+
+    if (!cards)
+        return 0;
+
+    for (d = cards->defs;  d->type;  d++) {
+        for (i = 0;  i < PA_POLICY_CARD_MAX_DEFS && d->data[i].profile;  i++) {
+            cost_add(cost, d->data[i].card_match);
+            nwarn += lint_regex(d->data[i].card_match, "card", d->type);
+        }
+
+        for (e = cards->defs;  e != d;  e++) {
+            if (card_def_same(e, d)) {
+                pa_log_warn("policy lint: card type '%s' is defined twice for "
+                            "the same cards (definitions #%u and #%u)", d->type,
+                            (unsigned)(e - cards->defs) + 1,
+                            (unsigned)(d - cards->defs) + 1);
+                nwarn++;
+                break;
+            }
+        }
+    }
+
+    return nwarn;
+}
+
+/* Suggest equals or startswith for an anchored regex without any
+ * special characters, e.g. '^foo$' or '^foo'. */
+static int lint_regex(pa_policy_match_object *obj, const char *what,
+                      const char *name)
+{
+    const char *arg;
+    const char *p;
+    char       *literal;
+    char       *q;
+    bool        anchored_end = false;
+
+    if (!obj || pa_policy_match_method(obj) != pa_method_matches)
+        return 0;
+
+    if (!(arg = pa_policy_match_arg(obj)) || arg[0] != '^')
+        return 0;
+
+    literal = q = pa_xmalloc(strlen(arg));
+
+    for (p = arg + 1;  *p;  p++) {
+        if (*p == '\\' && p[1] && strchr(REGEX_META, p[1]))
+            *q++ = *++p;
+        else if (*p == '$' && !p[1])
+            anchored_end = true;
+        else if (strchr(REGEX_META, *p)) {
+            pa_xfree(literal);
+            return 0;
+        }
+        else
+            *q++ = *p;
+    }
+
+    *q = '\0';
+
+    pa_log_warn("policy lint: %s '%s': regex '%s' could be %s:%s", what, name,
+                arg, anchored_end ? "equals" : "startswith", literal);
+
+    pa_xfree(literal);
+
+    return 1;
+}
+
+/* true if every stream matched by 'later' is matched by 'earlier' first */
+static bool stream_def_covers(struct userdata *u,
+                              struct pa_classify_stream_def *earlier,
+                              struct pa_classify_stream_def *later)
+{
+    struct pa_policy_group *group;
+
+    /* rules bound to a routing sink or a dynamic group sink are not
+     * always active, so they can't hide anything for sure */
+    if (earlier->sname)
+        return false;
+
+    if (!(group = pa_policy_group_find(u, earlier->group)) ||
+        (group->flags & PA_POLICY_GROUP_FLAG_DYNAMIC_SINK))
+        return false;
+
+    if (earlier->uid != (uid_t)-1 && earlier->uid != later->uid)
+        return false;
+
+    if (earlier->exe && !pa_safe_streq(earlier->exe, later->exe))
+        return false;
+
+    if (earlier->clnam && !pa_safe_streq(earlier->clnam, later->clnam))
+        return false;
+
+    return match_covers(earlier->stream_match, later->stream_match);
+}
+
+static bool match_covers(pa_policy_match_object *a, pa_policy_match_object *b)
+{
+    if (!a)
+        return true;
+
+    if (!b || a->target != b->target || !pa_safe_streq(a->target_def, b->target_def))
+        return false;
+
+    switch (a->method) {
+    case pa_method_true:
+        return true;
+
+    case pa_method_equals:
+    case pa_method_matches:
+        return b->method == a->method && pa_safe_streq(a->arg_def, b->arg_def);
+
+    case pa_method_startswith:
+        return (b->method == pa_method_equals || b->method == pa_method_startswith) &&
+               a->arg_def && b->arg_def && pa_startswith(b->arg_def, a->arg_def);
+
+    default:
+        return false;
+    }
+}
+
+static bool match_same(pa_policy_match_object *a, pa_policy_match_object *b)
+{
+    if (!a || !b)
+        return a == b;
+
+    return a->type == b->type && a->target == b->target &&
+           a->method == b->method && pa_safe_streq(a->target_def, b->target_def) &&
+           pa_safe_streq(a->arg_def, b->arg_def);
+}
+
+static bool card_def_same(struct pa_classify_card_def *a,
+                          struct pa_classify_card_def *b)
+{
+    int i;
+
+    if (!pa_streq(a->type, b->type))
+        return false;
+
+    for (i = 0;  i < PA_POLICY_CARD_MAX_DEFS;  i++) {
+        if (!pa_safe_streq(a->data[i].profile, b->data[i].profile) ||
+            !match_same(a->data[i].card_match, b->data[i].card_match))
+            return false;
+    }
+
+    return true;
+}
+
+static void cost_add(struct lint_cost *cost, pa_policy_match_object *obj)
+{
+    if (obj) {
+        cost->matchers++;
+
+        if (obj->method == pa_method_matches)
+            cost->regexes++;
+    }
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,24 @@
+#ifndef foolintfoo
+#define foolintfoo
+
+#include "userdata.h"
+
+/*
+ * Sanity checks of the loaded policy configuration: stream rules that
+ * can never match, device and card types defined twice for the same
+ * objects, regular expressions that could be plain string comparisons
+ * and a rough cost of classifying one object. Returns the number of
+ * warnings logged.
+ */
+
+int pa_policy_lint(struct userdata *);
+
+#endif /* foolintfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -2,9 +2,21 @@
 #include <config.h>
 #endif
 
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/strbuf.h>
+
+#if (PULSEAUDIO_VERSION >= 15)
+#include <pulse/def.h>
+#include <pulsecore/json.h>
+#include <pulsecore/message-handler.h>
+#endif
+
 #include "log.h"
+#include "userdata.h"
+
+#define LOG_OBJECT_PATH "/modules/policy-enforcement/log"
 
 #ifndef ENV_LOG_LEVEL
 #define ENV_LOG_LEVEL "PULSE_LOG"
@@ -12,6 +24,17 @@
 
 static pa_log_level_t log_level = PA_LOG_ERROR;
 
+static const char *category_names[pa_policy_log_category_max] = {
+    [pa_policy_log_classify] = "classify",
+    [pa_policy_log_client]   = "client",
+    [pa_policy_log_device]   = "device",
+};
+
+#if (PULSEAUDIO_VERSION >= 15)
+static int message_cb(const char *, const char *, const pa_json_object *,
+                      char **, void *);
+#endif
+
 void pa_policy_log_init(bool debug)
 {
     const char *e;
@@ -41,6 +64,88 @@ bool pa_policy_log_level_debug()
         return false;
 }
 
+/*
+ * all categories are on at debug level, so that nothing gets lost.
+ * The debug level comes from debug=true or from PULSE_LOG=4 in the
+ * environment. pulsecore has no getter for the daemon's own log level,
+ * so running the daemon with -vvvv or log-level=debug in daemon.conf
+ * leaves the categories off unless debug_categories says otherwise.
+ */
+uint32_t pa_policy_log_default_categories(void)
+{
+    return (log_level == PA_LOG_DEBUG) ? PA_POLICY_LOG_ALL : 0;
+}
+
+/* comma separated list of category names, 'all' or 'none' */
+int pa_policy_log_parse_categories(const char *list, uint32_t *mask_ret)
+{
+    const char *state = NULL;
+    char       *name;
+    uint32_t    mask = 0;
+    int         i;
+    int         ret = 0;
+
+    pa_assert(list);
+    pa_assert(mask_ret);
+
+    while ((name = pa_split(list, ",", &state))) {
+        if (pa_streq(name, "all"))
+            mask = PA_POLICY_LOG_ALL;
+        else if (!pa_streq(name, "none")) {
+            for (i = 0;  i < pa_policy_log_category_max;  i++) {
+                if (pa_streq(name, category_names[i]))
+                    break;
+            }
+
+            if (i < pa_policy_log_category_max)
+                mask |= 1U << i;
+            else {
+                pa_log("unknown debug category '%s'", name);
+                ret = -1;
+            }
+        }
+
+        pa_xfree(name);
+    }
+
+    if (ret == 0)
+        *mask_ret = mask;
+
+    return ret;
+}
+
+int pa_policy_log_set_categories(struct userdata *u, const char *list)
+{
+    pa_assert(u);
+
+    if (pa_policy_log_parse_categories(list, &u->logcats) < 0)
+        return -1;
+
+    pa_log_info("debug categories set to '%s'", list);
+
+    return 0;
+}
+
+void pa_policy_log_handler_register(struct userdata *u)
+{
+    pa_assert(u);
+
+#if (PULSEAUDIO_VERSION >= 15)
+    pa_message_handler_register(u->core, LOG_OBJECT_PATH,
+                                "Policy enforcement debug logging",
+                                message_cb, u);
+#endif
+}
+
+void pa_policy_log_handler_unregister(struct userdata *u)
+{
+    pa_assert(u);
+
+#if (PULSEAUDIO_VERSION >= 15)
+    pa_message_handler_unregister(u->core, LOG_OBJECT_PATH);
+#endif
+}
+
 char *pa_policy_log_concat(const char **str, int count)
 {
     pa_strbuf *buf;
@@ -56,3 +161,31 @@ char *pa_policy_log_concat(const char **str, int count)
 
     return pa_strbuf_to_string_free(buf);
 }
+
+#if (PULSEAUDIO_VERSION >= 15)
+/*
+ * 'set-debug-categories' takes the categories as a string parameter,
+ * e.g. pactl send-message /modules/policy-enforcement/log
+ * set-debug-categories '"classify,device"'.
+ */
+static int message_cb(const char *path, const char *message,
+                      const pa_json_object *parameters, char **response,
+                      void *userdata)
+{
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+    pa_assert(message);
+
+    if (!pa_streq(message, "set-debug-categories"))
+        return -PA_ERR_NOTIMPLEMENTED;
+
+    if (!parameters || pa_json_object_get_type(parameters) != PA_JSON_TYPE_STRING)
+        return -PA_ERR_INVALID;
+
+    if (pa_policy_log_set_categories(u, pa_json_object_get_string(parameters)) < 0)
+        return -PA_ERR_INVALID;
+
+    return PA_OK;
+}
+#endif
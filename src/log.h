@@ -1,11 +1,47 @@
 #ifndef foopolicylogfoo
 #define foopolicylogfoo
 
+#include <stdint.h>
+
 #include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+/*
+ * Debug messages of the hot paths are grouped into categories that can
+ * be switched on and off at runtime, with the debug_categories module
+ * argument or the 'set-debug-categories' message of the module object.
+ * pa_policy_log_debug() tests the category before any of its arguments
+ * are evaluated, so building the message costs nothing while the
+ * category is off.
+ */
+enum pa_policy_log_category {
+    pa_policy_log_classify = 0,   /* stream and device classification */
+    pa_policy_log_client,         /* client events */
+    pa_policy_log_device,         /* cards, sinks and sources */
+    pa_policy_log_category_max
+};
+
+#define PA_POLICY_LOG_ALL   ((1U << pa_policy_log_category_max) - 1)
+
+#define pa_policy_log_enabled(u, cat) \
+    PA_UNLIKELY((u)->logcats & (1U << (cat)))
+
+#define pa_policy_log_debug(u, cat, ...)        \
+    do {                                        \
+        if (pa_policy_log_enabled(u, cat))      \
+            pa_log_debug(__VA_ARGS__);          \
+    } while (0)
+
+struct userdata;
 
 void pa_policy_log_init(bool debug);
 pa_log_level_t pa_policy_log_level();
 bool pa_policy_log_level_debug();
+uint32_t pa_policy_log_default_categories(void);
+int pa_policy_log_parse_categories(const char *, uint32_t *);
+int pa_policy_log_set_categories(struct userdata *, const char *);
+void pa_policy_log_handler_register(struct userdata *);
+void pa_policy_log_handler_unregister(struct userdata *);
 char *pa_policy_log_concat(const char **str, int count);
 
 #endif
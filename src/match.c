@@ -15,6 +15,8 @@
 #include <pulsecore/hook-list.h>
 
 #include "match.h"
+#include "arena.h"
+#include "stats.h"
 
 /* #define DEBUG_MATCH 1 */
 
@@ -60,13 +62,36 @@ static const char *policy_object_target_str(enum pa_policy_object_target target)
     return NULL;
 }
 
-pa_policy_match_object *policy_match_new(enum pa_classify_method method,
+static char *match_strdup(struct pa_policy_arena *arena, const char *s)
+{
+    if (arena)
+        return pa_policy_arena_strdup(arena, s);
+
+    return s ? pa_xstrdup(s) : NULL;
+}
+
+static void match_release(void *data)
+{
+    pa_policy_match_object *obj = data;
+
+    if (obj->method == pa_method_matches)
+        regfree(&obj->arg.rexp);
+}
+
+pa_policy_match_object *policy_match_new(struct pa_policy_arena *arena,
+                                         enum pa_classify_method method,
                                          const char *string)
 {
     pa_policy_match_object *obj = NULL;
 
-    obj = pa_xnew0(pa_policy_match_object, 1);
-    obj->arg_def = string ? pa_xstrdup(string) : NULL;
+    if (arena) {
+        obj = pa_policy_arena_xnew0(arena, pa_policy_match_object, 1);
+        obj->in_arena = true;
+    }
+    else
+        obj = pa_xnew0(pa_policy_match_object, 1);
+
+    obj->arg_def = match_strdup(arena, string);
 
     switch (method) {
         case pa_method_equals:
@@ -85,6 +110,8 @@ pa_policy_match_object *policy_match_new(enum pa_classify_method method,
                 pa_log("failed to compile regex from '%s'", obj->arg_def);
                 goto fail;
             }
+            if (arena)
+                pa_policy_arena_cleanup(arena, match_release, obj);
             break;
 
         case pa_method_true:
@@ -107,12 +134,13 @@ fail:
     return NULL;
 }
 
-pa_policy_match_object *pa_policy_match_string_new(enum pa_classify_method method,
+pa_policy_match_object *pa_policy_match_string_new(struct pa_policy_arena *arena,
+                                                   enum pa_classify_method method,
                                                    const char *string)
 {
     pa_policy_match_object *obj = NULL;
 
-    if (!(obj = policy_match_new(method, string)))
+    if (!(obj = policy_match_new(arena, method, string)))
         return NULL;
 
     obj->target = pa_object_string;
@@ -126,13 +154,14 @@ pa_policy_match_object *pa_policy_match_string_new(enum pa_classify_method metho
     return obj;
 }
 
-pa_policy_match_object *pa_policy_match_name_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_name_new(struct pa_policy_arena *arena,
+                                                 enum pa_policy_object_type type,
                                                  enum pa_classify_method method,
                                                  const char *string)
 {
     pa_policy_match_object *obj = NULL;
 
-    if (!(obj = policy_match_new(method, string)))
+    if (!(obj = policy_match_new(arena, method, string)))
         return NULL;
 
     obj->type   = type;
@@ -147,7 +176,8 @@ pa_policy_match_object *pa_policy_match_name_new(enum pa_policy_object_type type
     return obj;
 }
 
-pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_property_new(struct pa_policy_arena *arena,
+                                                     enum pa_policy_object_type type,
                                                      const char *property_name,
                                                      enum pa_classify_method method,
                                                      const char *string)
@@ -156,12 +186,12 @@ pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type
 
     pa_assert(property_name);
 
-    if (!(obj = policy_match_new(method, string)))
+    if (!(obj = policy_match_new(arena, method, string)))
         return NULL;
 
     obj->type       = type;
     obj->target     = pa_object_property;
-    obj->target_def = pa_xstrdup(property_name);
+    obj->target_def = match_strdup(arena, property_name);
     obj->method     = method;
 
 #ifdef DEBUG_MATCH
@@ -174,7 +204,8 @@ pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type
     return obj;
 }
 
-pa_policy_match_object *pa_policy_match_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_new(struct pa_policy_arena *arena,
+                                            enum pa_policy_object_type type,
                                             enum pa_policy_object_target target,
                                             const char *target_def,
                                             enum pa_classify_method method,
@@ -190,12 +221,12 @@ pa_policy_match_object *pa_policy_match_new(enum pa_policy_object_type type,
         goto fail;
     }
 
-    if (!(obj = policy_match_new(method, arg)))
+    if (!(obj = policy_match_new(arena, method, arg)))
         goto fail;
 
     obj->type           = type;
     obj->target         = target;
-    obj->target_def     = pa_xstrdup(target_def);
+    obj->target_def     = match_strdup(arena, target_def);
     obj->method         = method;
 
 #ifdef DEBUG_MATCH
@@ -221,6 +252,13 @@ void pa_policy_match_free(pa_policy_match_object *obj)
     if (obj->method == pa_method_matches)
         regfree(&obj->arg.rexp);
 
+    if (obj->in_arena) {
+        /* the memory goes with the arena; keep its cleanup from
+         * releasing the regexp again */
+        obj->method = pa_method_unknown;
+        return;
+    }
+
     pa_xfree(obj->arg_def);
     pa_xfree(obj->target_def);
     pa_xfree(obj);
@@ -324,7 +362,7 @@ static bool policy_match(pa_policy_match_object *obj, const void *target, const
     return match;
 }
 
-bool pa_policy_match_type(pa_policy_match_object *obj,
+bool pa_policy_match_type(struct userdata *u, pa_policy_match_object *obj,
                           enum pa_policy_object_type expected_type,
                           const void *target)
 {
@@ -340,16 +378,19 @@ bool pa_policy_match_type(pa_policy_match_object *obj,
     if (obj->type != expected_type)
         return false;
 
-    return pa_policy_match(obj, target);
+    return pa_policy_match(u, obj, target);
 }
 
-bool pa_policy_match(pa_policy_match_object *obj, const void *target)
+bool pa_policy_match(struct userdata *u, pa_policy_match_object *obj,
+                     const void *target)
 {
     const char *to_check = NULL;
 
     pa_assert(obj);
     pa_assert(obj->func);
 
+    pa_policy_stats_count(u, pa_policy_stat_match);
+
     if (!target)
         return false;
 
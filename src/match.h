@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <regex.h>
 
+struct userdata;
+
 enum pa_policy_object_type {
     pa_policy_object_unknown = 0,
     pa_policy_object_min = pa_policy_object_unknown,
@@ -52,27 +54,37 @@ struct pa_policy_match_object {
     int                           (*func)(const char *, union pa_classify_arg *);
     union pa_classify_arg           arg;
     char                           *arg_def;
+    bool                            in_arena;   /* released with the arena */
 };
 
 typedef struct pa_policy_match_object pa_policy_match_object;
 
-pa_policy_match_object *pa_policy_match_string_new(enum pa_classify_method method,
+struct pa_policy_arena;
+
+/* The match objects are allocated from the arena if one is given and
+ * from the heap otherwise. */
+pa_policy_match_object *pa_policy_match_string_new(struct pa_policy_arena *arena,
+                                                   enum pa_classify_method method,
                                                    const char *string);
-pa_policy_match_object *pa_policy_match_name_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_name_new(struct pa_policy_arena *arena,
+                                                 enum pa_policy_object_type type,
                                                  enum pa_classify_method method,
                                                  const char *arg);
-pa_policy_match_object *pa_policy_match_property_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_property_new(struct pa_policy_arena *arena,
+                                                     enum pa_policy_object_type type,
                                                      const char *property_name,
                                                      enum pa_classify_method method,
                                                      const char *arg);
-pa_policy_match_object *pa_policy_match_new(enum pa_policy_object_type type,
+pa_policy_match_object *pa_policy_match_new(struct pa_policy_arena *arena,
+                                            enum pa_policy_object_type type,
                                             enum pa_policy_object_target target,
                                             const char *target_def,
                                             enum pa_classify_method method,
                                             const char *arg);
 void pa_policy_match_free(pa_policy_match_object *obj);
-bool pa_policy_match(pa_policy_match_object *obj, const void *target);
-bool pa_policy_match_type(pa_policy_match_object *obj,
+bool pa_policy_match(struct userdata *u, pa_policy_match_object *obj,
+                     const void *target);
+bool pa_policy_match_type(struct userdata *u, pa_policy_match_object *obj,
                           enum pa_policy_object_type expected_type,
                           const void *target);
 
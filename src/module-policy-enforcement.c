@@ -44,6 +44,15 @@
 #include "module-ext.h"
 #include "dbusif.h"
 #include "variable.h"
+#include "route-plan.h"
+#include "reload.h"
+#include "lint.h"
+#include "trace.h"
+#include "sockif.h"
+#include "stats.h"
+#include "arena.h"
+#include "intern.h"
+#include "module-pool.h"
 
 PA_MODULE_AUTHOR("Janos Kovacs");
 PA_MODULE_DESCRIPTION("Policy enforcement module");
@@ -59,8 +68,20 @@ PA_MODULE_USAGE(
     "null_source=<name of the null source> "
     "othermedia_preemption=<on|off> "
     "route_sources_first=<true|false> Default false "
+    "route_order=<as-is|sinks-first|sources-first> Default as-is "
     "configdir=<configuration directory> "
-    "debug=<true|false> Default false"
+    "config_cache=<preprocessed configuration cache file> "
+    "watch_config=<true|false> Default false "
+    "config_lint=<true|false> Default false "
+    "classify_stats=<true|false> Default false "
+    "trace_file=<file to record the policy input to> "
+    "trace_replay=<recorded policy trace to replay> "
+    "policy_socket=<unix socket path for policy actions> "
+    "module_pool=<number of device modules kept loaded> Default 0 "
+    "module_preload=<true|false> Default false "
+    "debug=<true|false> Default false "
+    "debug_categories=<all|none|comma separated list of classify,client,device> "
+    "Default all with debug=true or PULSE_LOG=4, otherwise none"
 );
 
 static const char* const valid_modargs[] = {
@@ -73,8 +94,19 @@ static const char* const valid_modargs[] = {
     "null_source_name",
     "othermedia_preemption",
     "route_sources_first",
+    "route_order",
     "configdir",
+    "config_cache",
+    "watch_config",
+    "config_lint",
+    "classify_stats",
+    "trace_file",
+    "trace_replay",
+    "policy_socket",
+    "module_pool",
+    "module_preload",
     "debug",
+    "debug_categories",
     NULL
 };
 
@@ -91,8 +123,21 @@ int pa__init(pa_module *m) {
     const char      *nsource;
     const char      *preempt;
     bool             route_sources_first = false;
+    const char      *rorder;
+    enum pa_policy_route_order route_order;
     const char      *cfgdir;
+    const char      *cfgcache;
+    bool             watch_config = false;
+    bool             config_lint = false;
+    bool             classify_stats = false;
+    const char      *tracefile;
+    const char      *replayfile;
+    const char      *sockpath;
+    uint32_t         module_pool = 0;
+    bool             module_preload = false;
     bool             debug = false;
+    const char      *dbgcats;
+    uint32_t         logcats;
     
     pa_assert(m);
     
@@ -110,23 +155,86 @@ int pa__init(pa_module *m) {
     nsource = pa_modargs_get_value(ma, "null_source_name", NULL);
     preempt = pa_modargs_get_value(ma, "othermedia_preemption", NULL);
     cfgdir  = pa_modargs_get_value(ma, "configdir", NULL);
+    cfgcache= pa_modargs_get_value(ma, "config_cache", NULL);
+    tracefile = pa_modargs_get_value(ma, "trace_file", NULL);
+    replayfile = pa_modargs_get_value(ma, "trace_replay", NULL);
+    sockpath = pa_modargs_get_value(ma, "policy_socket", NULL);
+    dbgcats = pa_modargs_get_value(ma, "debug_categories", NULL);
 
     if (pa_modargs_get_value_boolean(ma, "route_sources_first", &route_sources_first) < 0) {
         pa_log("Failed to parse \"route_sources_first\" parameter.");
         goto fail;
     }
 
+    rorder = pa_modargs_get_value(ma, "route_order", NULL);
+
+    if (rorder == NULL)
+        route_order = route_sources_first ? pa_policy_route_order_sources_first
+                                          : pa_policy_route_order_as_is;
+    else if (pa_streq(rorder, "as-is"))
+        route_order = pa_policy_route_order_as_is;
+    else if (pa_streq(rorder, "sinks-first"))
+        route_order = pa_policy_route_order_sinks_first;
+    else if (pa_streq(rorder, "sources-first"))
+        route_order = pa_policy_route_order_sources_first;
+    else {
+        pa_log("Invalid \"route_order\" parameter '%s'.", rorder);
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "watch_config", &watch_config) < 0) {
+        pa_log("Failed to parse \"watch_config\" parameter.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "config_lint", &config_lint) < 0) {
+        pa_log("Failed to parse \"config_lint\" parameter.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "classify_stats", &classify_stats) < 0) {
+        pa_log("Failed to parse \"classify_stats\" parameter.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "module_pool", &module_pool) < 0) {
+        pa_log("Failed to parse \"module_pool\" parameter.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "module_preload", &module_preload) < 0) {
+        pa_log("Failed to parse \"module_preload\" parameter.");
+        goto fail;
+    }
+
     if (pa_modargs_get_value_boolean(ma, "debug", &debug) < 0) {
         pa_log("Failed to parse \"debug\" parameter.");
         goto fail;
     }
 
     pa_policy_log_init(debug);
+    logcats = pa_policy_log_default_categories();
+
+    if (dbgcats && pa_policy_log_parse_categories(dbgcats, &logcats) < 0) {
+        pa_log("Invalid \"debug_categories\" parameter '%s'.", dbgcats);
+        goto fail;
+    }
 
     u = pa_xnew0(struct userdata, 1);
     m->userdata = u;
+
+    pa_policy_intern_init();
+
     u->core     = m->core;
     u->module   = m;
+    u->logcats  = logcats;
+    u->stats    = pa_policy_stats_new(u);
+
+    pa_policy_log_handler_register(u);
+
+    if (tracefile && !(u->trace = pa_policy_trace_open(tracefile)))
+        goto fail;
+
     u->nullsink = pa_sink_ext_init_null_sink(nsnam);
     u->nullsource= pa_source_ext_init_null_source(nsource);
     u->hsnk     = pa_index_hash_init(8);
@@ -141,10 +249,13 @@ int pa__init(pa_module *m) {
     u->groups   = pa_policy_groupset_new(u);
     u->classify = pa_classify_new(u);
     u->context  = pa_policy_context_new(u);
-    u->dbusif   = pa_policy_dbusif_init(u, ifnam, mypath, pdpath, pdnam, route_sources_first);
+    u->dbusif   = pa_policy_dbusif_init(u, ifnam, mypath, pdpath, pdnam, route_order);
     u->vars     = pa_policy_var_init();
-    u->sinkext  = pa_sink_ext_new();
+    u->sinkext  = pa_sink_ext_new(u);
     u->shared   = pa_shared_data_get(u->core);
+    u->plans    = pa_policy_route_plans_new(u);
+    u->modpool  = module_pool ? pa_policy_module_pool_new(u, module_pool,
+                                                          module_preload) : NULL;
 
     if (u->scl == NULL      || u->ssnk == NULL     || u->ssrc == NULL ||
         u->ssi == NULL      || u->sso == NULL      || u->scrd == NULL ||
@@ -155,9 +266,19 @@ int pa__init(pa_module *m) {
 
     pa_policy_groupset_update_default_sink(u, PA_IDXSET_INVALID);
 
-    if (!pa_policy_parse_config_files(u, cfgfile, cfgdir))
+    if (classify_stats)
+        pa_classify_enable_timing(u);
+
+    if (!pa_policy_parse_config_files(u, cfgfile, cfgdir, cfgcache, watch_config))
         goto fail;
 
+    pa_policy_arena_log_usage();
+
+    if (config_lint)
+        pa_policy_lint(u);
+
+    pa_classify_preload_modules(u);
+
     if (pa_policy_group_find(u, PA_POLICY_DEFAULT_GROUP_NAME) == NULL) {
         pa_log_debug("default group '%s' not defined, generating default group.", PA_POLICY_DEFAULT_GROUP_NAME);
         pa_policy_groupset_create_default_group(u, preempt);
@@ -172,9 +293,24 @@ int pa__init(pa_module *m) {
     pa_source_output_ext_discover(u);
     pa_card_ext_discover(u);
     pa_module_ext_discover(u);
-    /* variables are not used after initialization */
-    pa_policy_var_done(u->vars);
-    u->vars = NULL;
+
+    if (watch_config)
+        u->reload = pa_policy_reload_new(u);
+
+    if (replayfile && pa_policy_dbusif_replay(u, replayfile) < 0)
+        goto fail;
+
+    if (sockpath && !(u->sockif = pa_policy_sockif_new(u, sockpath)))
+        goto fail;
+
+    /* variables are not used after initialization, unless the
+     * config gets reloaded */
+    if (!u->reload) {
+        pa_policy_var_done(u->vars);
+        u->vars = NULL;
+        pa_policy_config_free(u->config);
+        u->config = NULL;
+    }
 
     pa_modargs_free(ma);
     
@@ -198,8 +334,14 @@ void pa__done(pa_module *m) {
     if (!(u = m->userdata))
         return;
     
+    pa_policy_reload_free(u->reload);
+    pa_policy_config_free(u->config);
+    pa_policy_sockif_free(u->sockif);
     pa_policy_dbusif_done(u);
     pa_policy_var_done(u->vars);
+    pa_policy_trace_close(u->trace);
+    pa_policy_stats_free(u->stats);
+    pa_policy_log_handler_unregister(u);
 
     pa_sink_ext_free(u->sinkext);
     pa_client_ext_subscription_free(u->scl);
@@ -210,8 +352,10 @@ void pa__done(pa_module *m) {
     pa_card_ext_subscription_free(u->scrd);
     pa_module_ext_subscription_free(u->smod);
 
+    pa_policy_route_plans_free(u->plans);
     pa_policy_groupset_free(u->groups);
     pa_classify_free(u);
+    pa_policy_module_pool_free(u->modpool);
     pa_policy_context_free(u->context);
     pa_index_hash_free(u->hsnk);
     pa_index_hash_free(u->hsi);
@@ -219,6 +363,7 @@ void pa__done(pa_module *m) {
     pa_source_ext_null_source_free(u->nullsource);
     pa_shared_data_unref(u->shared);
 
+    pa_policy_intern_done();
     
     pa_xfree(u);
 }
@@ -0,0 +1,558 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/module.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/source.h>
+#include <pulsecore/source-output.h>
+
+#include "module-pool.h"
+#include "policy-group.h"
+#include "sink-ext.h"
+#include "source-ext.h"
+#include "sink-input-ext.h"
+#include "source-output-ext.h"
+#include "stats.h"
+
+struct pool_entry {
+    PA_LLIST_FIELDS(struct pool_entry);
+    char                     *name;
+    char                     *args;
+    pa_module                *module;
+    pa_usec_t                 load_time;  /* what loading it took */
+    pa_usec_t                 parked;     /* when it was last in use */
+    pa_idxset                *suspended;  /* devices suspended by the pool */
+    bool                      dropped;    /* unload requested */
+};
+
+struct pa_policy_module_pool {
+    struct userdata          *userdata;
+    uint32_t                  max;        /* max number of parked modules */
+    uint32_t                  count;      /* not counting the dropped ones */
+    bool                      preload;
+    bool                      warming;    /* preloading a module */
+    pa_idxset                *hidden;     /* sinks and sources of the pool */
+    pa_hook_slot             *unlink;
+    pa_hook_slot             *sink_put;
+    pa_hook_slot             *source_put;
+    pa_hook_slot             *sink_unlink;
+    pa_hook_slot             *source_unlink;
+    PA_LLIST_HEAD(struct pool_entry, entries);  /* most recently used first */
+};
+
+static struct pool_entry *entry_new(struct pa_policy_module_pool *,
+                                    const char *, const char *,
+                                    pa_module *, pa_usec_t);
+static struct pool_entry *entry_find(struct pa_policy_module_pool *,
+                                     const char *, const char *);
+static void entry_free(struct pa_policy_module_pool *, struct pool_entry *);
+static void suspend_module(pa_core *, struct pool_entry *);
+static void resume_module(pa_core *, struct pool_entry *);
+static void hide_module(struct pa_policy_module_pool *, pa_module *);
+static void show_module(struct pa_policy_module_pool *, pa_module *);
+static void move_streams_off(struct userdata *, pa_module *);
+static pa_module *load_module(pa_core *, const char *, const char *);
+static void unload_module(pa_core *, pa_module *);
+static pa_hook_result_t module_unlink(pa_core *, pa_module *,
+                                      struct pa_policy_module_pool *);
+static pa_hook_result_t device_put(pa_core *, void *,
+                                   struct pa_policy_module_pool *);
+static pa_hook_result_t device_unlink(pa_core *, void *,
+                                      struct pa_policy_module_pool *);
+
+
+struct pa_policy_module_pool *pa_policy_module_pool_new(struct userdata *u,
+                                                        uint32_t max,
+                                                        bool preload)
+{
+    struct pa_policy_module_pool *pool;
+    pa_hook                      *hooks;
+
+    pa_assert(u);
+    pa_assert(u->core);
+
+    hooks = u->core->hooks;
+
+    pool = pa_xnew0(struct pa_policy_module_pool, 1);
+    pool->userdata = u;
+    pool->max      = max;
+    pool->preload  = preload;
+    pool->hidden   = pa_idxset_new(NULL, NULL);
+
+    /* modules may go away behind our back, e.g. when their card does */
+    pool->unlink = pa_hook_connect(hooks + PA_CORE_HOOK_MODULE_UNLINK,
+                                   PA_HOOK_NORMAL,
+                                   (pa_hook_cb_t) module_unlink, pool);
+
+    /* hide the devices of a preloaded module before anyone sees them */
+    pool->sink_put = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_PUT,
+                                     PA_HOOK_EARLY,
+                                     (pa_hook_cb_t) device_put, pool);
+    pool->source_put = pa_hook_connect(hooks + PA_CORE_HOOK_SOURCE_PUT,
+                                       PA_HOOK_EARLY,
+                                       (pa_hook_cb_t) device_put, pool);
+
+    /* after sink-ext and source-ext skipped them as hidden */
+    pool->sink_unlink = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_UNLINK_POST,
+                                        PA_HOOK_LATE + 10,
+                                        (pa_hook_cb_t) device_unlink, pool);
+    pool->source_unlink = pa_hook_connect(hooks + PA_CORE_HOOK_SOURCE_UNLINK_POST,
+                                          PA_HOOK_LATE + 10,
+                                          (pa_hook_cb_t) device_unlink, pool);
+
+    pa_log_info("module pool of %u module(s)%s", max,
+                preload ? ", preloaded" : "");
+
+    return pool;
+}
+
+void pa_policy_module_pool_free(struct pa_policy_module_pool *pool)
+{
+    struct pool_entry *e;
+    pa_module         *module;
+
+    if (pool) {
+        if (pool->unlink)
+            pa_hook_slot_free(pool->unlink);
+        if (pool->sink_put)
+            pa_hook_slot_free(pool->sink_put);
+        if (pool->source_put)
+            pa_hook_slot_free(pool->source_put);
+        if (pool->sink_unlink)
+            pa_hook_slot_free(pool->sink_unlink);
+        if (pool->source_unlink)
+            pa_hook_slot_free(pool->source_unlink);
+
+        while ((e = pool->entries) != NULL) {
+            module = e->module;
+            entry_free(pool, e);
+            unload_module(pool->userdata->core, module);
+        }
+
+        pa_idxset_free(pool->hidden, NULL);
+        pa_xfree(pool);
+    }
+}
+
+bool pa_policy_module_pool_hides(struct pa_policy_module_pool *pool,
+                                 const void *device)
+{
+    pa_assert(pool);
+
+    return device && pa_idxset_get_by_data(pool->hidden, device, NULL);
+}
+
+pa_module *pa_policy_module_pool_take(struct pa_policy_module_pool *pool,
+                                      const char *name, const char *args,
+                                      pa_usec_t *load_time)
+{
+    struct pool_entry *e;
+    pa_module         *module;
+
+    pa_assert(pool);
+    pa_assert(name);
+
+    if (!(e = entry_find(pool, name, args)))
+        return NULL;
+
+    module = e->module;
+
+    if (load_time)
+        *load_time = e->load_time;
+
+    /* the saved time is what loading it would have taken */
+    pa_policy_stats_add(pool->userdata, pa_policy_stat_module_pool, e->load_time);
+
+    pa_log_debug("module %s (%u) taken from the pool, %llu usec saved",
+                 name, module->index, (unsigned long long)e->load_time);
+
+    resume_module(pool->userdata->core, e);
+    entry_free(pool, e);
+    show_module(pool, module);
+
+    return module;
+}
+
+bool pa_policy_module_pool_park(struct pa_policy_module_pool *pool,
+                                pa_module *module, const char *name,
+                                const char *args, pa_usec_t load_time)
+{
+    struct pool_entry *e;
+    struct pool_entry *lru;
+
+    pa_assert(pool);
+    pa_assert(module);
+    pa_assert(name);
+
+    if (!pool->max)
+        return false;
+
+    if (pool->count >= pool->max) {
+        for (lru = NULL, e = pool->entries;  e;  e = e->next) {
+            if (!e->dropped)
+                lru = e;
+        }
+
+        pa_assert(lru);
+
+        pa_log_debug("module %s (%u) dropped from the pool, unused for "
+                     "%llu usec", lru->name, lru->module->index,
+                     (unsigned long long)(pa_rtclock_now() - lru->parked));
+
+        /* its devices stay hidden until the module is gone */
+        lru->dropped = true;
+        pool->count--;
+        pa_module_unload_request(lru->module, true);
+    }
+
+    move_streams_off(pool->userdata, module);
+    hide_module(pool, module);
+
+    e = entry_new(pool, name, args, module, load_time);
+    suspend_module(pool->userdata->core, e);
+
+    /* it was in use until now, so it is the last one to go */
+    PA_LLIST_PREPEND(struct pool_entry, pool->entries, e);
+
+    pa_log_debug("module %s (%u) parked in the pool", name, module->index);
+
+    return true;
+}
+
+void pa_policy_module_pool_warm(struct pa_policy_module_pool *pool,
+                                const char *name, const char *args)
+{
+    struct pool_entry *e;
+    struct pool_entry *last;
+    pa_module         *module;
+    pa_usec_t          start;
+
+    pa_assert(pool);
+    pa_assert(name);
+
+    if (!pool->preload || pool->count >= pool->max || entry_find(pool, name, args))
+        return;
+
+    start = pa_rtclock_now();
+
+    pool->warming = true;
+    module = load_module(pool->userdata->core, name, args);
+    pool->warming = false;
+
+    if (!module) {
+        pa_log("failed to preload module %s", name);
+        return;
+    }
+
+    /* e.g. module-switch-on-connect may have moved streams already */
+    move_streams_off(pool->userdata, module);
+
+    e = entry_new(pool, name, args, module, pa_rtclock_now() - start);
+    suspend_module(pool->userdata->core, e);
+
+    /* not used yet, so the first one to go */
+    for (last = pool->entries;  last && last->next;  last = last->next)
+        ;
+
+    PA_LLIST_INSERT_AFTER(struct pool_entry, pool->entries, last, e);
+
+    pa_log_debug("module %s (%u) preloaded in %llu usec", name,
+                 module->index, (unsigned long long)e->load_time);
+}
+
+
+/* the caller links the entry */
+static struct pool_entry *entry_new(struct pa_policy_module_pool *pool,
+                                    const char *name, const char *args,
+                                    pa_module *module, pa_usec_t load_time)
+{
+    struct pool_entry *e;
+
+    e = pa_xnew0(struct pool_entry, 1);
+    e->name      = pa_xstrdup(name);
+    e->args      = pa_xstrdup(args);
+    e->module    = module;
+    e->load_time = load_time;
+    e->parked    = pa_rtclock_now();
+    e->suspended = pa_idxset_new(NULL, NULL);
+
+    pool->count++;
+
+    return e;
+}
+
+static struct pool_entry *entry_find(struct pa_policy_module_pool *pool,
+                                     const char *name, const char *args)
+{
+    struct pool_entry *e;
+
+    PA_LLIST_FOREACH(e, pool->entries) {
+        if (!e->dropped && pa_streq(e->name, name) && pa_safe_streq(e->args, args))
+            return e;
+    }
+
+    return NULL;
+}
+
+static void entry_free(struct pa_policy_module_pool *pool,
+                       struct pool_entry *e)
+{
+    PA_LLIST_REMOVE(struct pool_entry, pool->entries, e);
+
+    if (!e->dropped) {
+        pa_assert(pool->count > 0);
+        pool->count--;
+    }
+
+    pa_idxset_free(e->suspended, NULL);
+    pa_xfree(e->name);
+    pa_xfree(e->args);
+    pa_xfree(e);
+}
+
+/* Devices that are suspended internally already are left alone, so that
+ * resuming does not clear a suspend someone else holds. */
+static void suspend_module(pa_core *core, struct pool_entry *e)
+{
+    pa_sink   *sink;
+    pa_source *source;
+    uint32_t   idx;
+
+    PA_IDXSET_FOREACH(sink, core->sinks, idx) {
+        if (sink->module == e->module &&
+            !(sink->suspend_cause & PA_SUSPEND_INTERNAL))
+        {
+            pa_sink_suspend(sink, true, PA_SUSPEND_INTERNAL);
+            pa_idxset_put(e->suspended, sink, NULL);
+        }
+    }
+
+    /* the monitor sources follow their sinks */
+    PA_IDXSET_FOREACH(source, core->sources, idx) {
+        if (source->module == e->module && !source->monitor_of &&
+            !(source->suspend_cause & PA_SUSPEND_INTERNAL))
+        {
+            pa_source_suspend(source, true, PA_SUSPEND_INTERNAL);
+            pa_idxset_put(e->suspended, source, NULL);
+        }
+    }
+}
+
+static void resume_module(pa_core *core, struct pool_entry *e)
+{
+    pa_sink   *sink;
+    pa_source *source;
+    uint32_t   idx;
+
+    PA_IDXSET_FOREACH(sink, core->sinks, idx) {
+        if (pa_idxset_remove_by_data(e->suspended, sink, NULL))
+            pa_sink_suspend(sink, false, PA_SUSPEND_INTERNAL);
+    }
+
+    PA_IDXSET_FOREACH(source, core->sources, idx) {
+        if (pa_idxset_remove_by_data(e->suspended, source, NULL))
+            pa_source_suspend(source, false, PA_SUSPEND_INTERNAL);
+    }
+}
+
+/* A pooled device is as good as unlinked for the policy: it has no type,
+ * is no route target and is not told to the policy daemon. */
+static void hide_module(struct pa_policy_module_pool *pool, pa_module *module)
+{
+    struct userdata *u = pool->userdata;
+    pa_sink         *sink;
+    pa_source       *source;
+    uint32_t         idx;
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
+        if (sink->module == module && !pa_policy_module_pool_hides(pool, sink) &&
+            PA_SINK_IS_LINKED(sink->state))
+        {
+            pa_sink_ext_hide(u, sink);
+            pa_idxset_put(pool->hidden, sink, NULL);
+
+            /* the core may still have it as its default */
+            pa_policy_groupset_update_default_sink(u, sink->index);
+        }
+    }
+
+    PA_IDXSET_FOREACH(source, u->core->sources, idx) {
+        if (source->module == module && !pa_policy_module_pool_hides(pool, source) &&
+            PA_SOURCE_IS_LINKED(source->state))
+        {
+            pa_source_ext_hide(u, source);
+            pa_idxset_put(pool->hidden, source, NULL);
+        }
+    }
+}
+
+static void show_module(struct pa_policy_module_pool *pool, pa_module *module)
+{
+    struct userdata *u = pool->userdata;
+    pa_sink         *sink;
+    pa_source       *source;
+    uint32_t         idx;
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
+        if (sink->module == module && pa_idxset_remove_by_data(pool->hidden, sink, NULL))
+            pa_sink_ext_show(u, sink);
+    }
+
+    PA_IDXSET_FOREACH(source, u->core->sources, idx) {
+        if (source->module == module && pa_idxset_remove_by_data(pool->hidden, source, NULL))
+            pa_source_ext_show(u, source);
+    }
+}
+
+/* Move the streams to where their group would have them or else to the
+ * default device. Streams that have nowhere else to go are muted on the
+ * null sink or source rather than left on a suspended device. */
+static void move_streams_off(struct userdata *u, pa_module *module)
+{
+    struct pa_policy_group *group;
+    pa_sink                *sink;
+    pa_sink                *target;
+    pa_sink_input          *sinp;
+    pa_source              *source;
+    pa_source              *starget;
+    pa_source_output       *sout;
+    pa_idxset              *streams;
+    const char             *name;
+    uint32_t                idx, i;
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
+        if (sink->module != module || pa_idxset_isempty(sink->inputs))
+            continue;
+
+        /* moving takes the streams off the idxset being walked */
+        streams = pa_idxset_copy(sink->inputs, NULL);
+
+        PA_IDXSET_FOREACH(sinp, streams, i) {
+            name   = pa_sink_input_ext_get_policy_group(sinp);
+            group  = name ? pa_policy_group_find(u, name) : NULL;
+            target = group ? group->sink : NULL;
+
+            if (!target || target->module == module)
+                target = pa_namereg_get(u->core, NULL, PA_NAMEREG_SINK);
+            if (!target || target->module == module ||
+                pa_policy_module_pool_hides(u->modpool, target))
+                target = u->nullsink->sink;
+
+            if (target && target != sinp->sink &&
+                pa_sink_input_move_to(sinp, target, false) < 0)
+                pa_log("failed to move sink input %u off a pooled sink",
+                       sinp->index);
+        }
+
+        pa_idxset_free(streams, NULL);
+    }
+
+    PA_IDXSET_FOREACH(source, u->core->sources, idx) {
+        if (source->module != module || pa_idxset_isempty(source->outputs))
+            continue;
+
+        streams = pa_idxset_copy(source->outputs, NULL);
+
+        PA_IDXSET_FOREACH(sout, streams, i) {
+            name    = pa_source_output_ext_get_policy_group(sout);
+            group   = name ? pa_policy_group_find(u, name) : NULL;
+            starget = group ? group->source : NULL;
+
+            if (!starget || starget->module == module)
+                starget = pa_namereg_get(u->core, NULL, PA_NAMEREG_SOURCE);
+            if (!starget || starget->module == module ||
+                pa_policy_module_pool_hides(u->modpool, starget))
+                starget = u->nullsource->source;
+
+            if (starget && starget != sout->source &&
+                pa_source_output_move_to(sout, starget, false) < 0)
+                pa_log("failed to move source output %u off a pooled source",
+                       sout->index);
+        }
+
+        pa_idxset_free(streams, NULL);
+    }
+}
+
+static pa_module *load_module(pa_core *core, const char *name,
+                              const char *args)
+{
+    pa_module *module;
+
+#if PULSEAUDIO_VERSION >= 12
+    if (pa_module_load(&module, core, name, args) < 0)
+        module = NULL;
+#else
+    module = pa_module_load(core, name, args);
+#endif
+
+    return module;
+}
+
+static void unload_module(pa_core *core, pa_module *module)
+{
+#if (PULSEAUDIO_VERSION >= 8)
+    pa_module_unload(module, true);
+#else
+    pa_module_unload(core, module, true);
+#endif
+}
+
+static pa_hook_result_t module_unlink(pa_core *core, pa_module *module,
+                                      struct pa_policy_module_pool *pool)
+{
+    struct pool_entry *e;
+
+    pa_assert(module);
+    pa_assert(pool);
+
+    PA_LLIST_FOREACH(e, pool->entries) {
+        if (e->module == module) {
+            pa_log_debug("pooled module %s (%u) unloading",
+                         e->name, module->index);
+            entry_free(pool, e);
+            break;
+        }
+    }
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t device_put(pa_core *core, void *device,
+                                   struct pa_policy_module_pool *pool)
+{
+    pa_assert(pool);
+
+    if (pool->warming)
+        pa_idxset_put(pool->hidden, device, NULL);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t device_unlink(pa_core *core, void *device,
+                                      struct pa_policy_module_pool *pool)
+{
+    pa_assert(pool);
+
+    pa_idxset_remove_by_data(pool->hidden, device, NULL);
+
+    return PA_HOOK_OK;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,57 @@
+#ifndef foopolicymodulepoolfoo
+#define foopolicymodulepoolfoo
+
+#include <stdbool.h>
+
+#include <pulse/sample.h>
+
+#include "userdata.h"
+
+/*
+ * Warm pool of the modules of the device definitions (module=,
+ * module_args=). Instead of being unloaded when a route no longer needs
+ * it, a module is parked in the pool with its sinks and sources
+ * suspended, and a route switch needing the same module and arguments
+ * takes it back from the pool instead of loading it again. The pool can
+ * also be filled up in advance with the modules of the configured
+ * devices, if asked to preload. When the pool is full the least recently
+ * used module is unloaded. A module taken from the pool leaves it and is
+ * parked again at the head once its route is done with it, so the pool
+ * is kept in order of use without reordering entries in place.
+ *
+ * The pool is capped by the number of modules, not by memory: the pool
+ * can't tell what a module holds, and while parked its devices are
+ * suspended and keep neither the hardware nor stream buffers open.
+ *
+ * The streams are moved off the devices of a module before it is parked.
+ * While in the pool the devices are hidden: the policy takes them for
+ * unlinked, so they have no type, are no route targets and are not
+ * reported to the policy daemon.
+ */
+
+struct pa_module;
+
+struct pa_policy_module_pool *pa_policy_module_pool_new(struct userdata *,
+                                                        uint32_t, bool);
+void pa_policy_module_pool_free(struct pa_policy_module_pool *);
+
+struct pa_module *pa_policy_module_pool_take(struct pa_policy_module_pool *,
+                                             const char *, const char *,
+                                             pa_usec_t *);
+bool pa_policy_module_pool_park(struct pa_policy_module_pool *,
+                                struct pa_module *, const char *,
+                                const char *, pa_usec_t);
+void pa_policy_module_pool_warm(struct pa_policy_module_pool *,
+                                const char *, const char *);
+bool pa_policy_module_pool_hides(struct pa_policy_module_pool *,
+                                 const void *);
+
+#endif /* foopolicymodulepoolfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -2,6 +2,7 @@
 #include <config.h>
 #endif
 
+#include <pulse/rtclock.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
 #include <pulse/volume.h>
@@ -16,6 +17,12 @@
 #include "variable.h"
 #include "context.h"
 #include "match.h"
+#include "forward.h"
+#include "route-plan.h"
+#include "stats.h"
+#include "probes.h"
+#include "intern.h"
+#include "module-pool.h"
 
 #define MUTE   1
 #define UNMUTE 0
@@ -30,6 +37,7 @@ struct target {
     };
     const char                 *mode;
     const char                 *hwid;
+    const char                 *group;  /* interned, NULL if no such group */
 };
 
 
@@ -45,12 +53,39 @@ static uint32_t          defsinkidx = PA_IDXSET_INVALID;
 static uint32_t          defsrcidx  = PA_IDXSET_INVALID;
 static pa_volume_t       dbtbl[300];
 
-static int move_group(struct pa_policy_group *, struct target *);
+static const char *media_names[pa_policy_media_max] = {
+    [pa_policy_media_playback]  = "audio_playback",
+    [pa_policy_media_recording] = "audio_recording",
+};
+
+static int move_group(struct userdata *, struct pa_policy_group *,
+                      struct target *);
+static int move_sink_input(struct userdata *, struct pa_sink_input *,
+                           struct pa_sink *);
+static int move_source_output(struct userdata *, struct pa_source_output *,
+                              struct pa_source *);
 static int volset_group(struct userdata *, struct pa_policy_group *,
                         pa_volume_t);
 static int mute_group_by_route(struct userdata *u, struct pa_policy_group *, int);
+static int mute_sources_by_route(struct userdata *u, struct pa_policy_group *, int);
+static int mute_group_by_factor(struct userdata *u, struct pa_policy_group *, int);
+static bool group_mute_factor(struct userdata *, struct pa_policy_group *,
+                              struct pa_sink_input *, uint32_t);
 static int mute_group_locally(struct userdata *, struct pa_policy_group *,int);
 static int cork_group(struct userdata *u, struct pa_policy_group *, int);
+static int cork_schedule(struct userdata *, struct pa_policy_group *, int);
+static void cork_queue(struct userdata *, struct pa_policy_group *, int);
+static void cork_apply_queued(struct userdata *, bool);
+static void uncork_cb(pa_mainloop_api *, pa_time_event *,
+                      const struct timeval *, void *);
+static void cork_cancel(struct pa_policy_group *);
+static void media_notify(struct userdata *, struct pa_policy_group *,
+                         enum pa_policy_media, int);
+static void media_send(struct userdata *, struct pa_policy_group *,
+                       enum pa_policy_media, int);
+static void media_notify_cb(pa_mainloop_api *, pa_time_event *,
+                            const struct timeval *, void *);
+static void media_notify_cancel(struct pa_policy_group *);
 
 static struct pa_policy_group *group_scan(struct pa_policy_groupset *,
                                           struct cursor *);
@@ -59,6 +94,12 @@ static struct pa_policy_group *find_group_by_name(struct pa_policy_groupset *,
 
 static struct pa_sink   *find_sink_by_type(struct userdata *, const char *);
 static struct pa_source *find_source_by_type(struct userdata *, const char *);
+static void resolve_target(struct userdata *, enum pa_policy_route_class,
+                           const char *, const char *, const char *,
+                           struct target *);
+static void broadcast_sink_route(struct userdata *, const char *,
+                                 struct target *);
+static void update_sink_mode(struct pa_sink *, const char *, const char *);
 
 static uint32_t hash_value(const char *);
 
@@ -89,8 +130,18 @@ struct pa_policy_groupset *pa_policy_groupset_new(struct userdata *u)
 
 void pa_policy_groupset_free(struct pa_policy_groupset *gset)
 {
+    struct pa_policy_group *group;
+    int                     i;
+
     pa_assert(gset);
 
+    for (i = 0;  i < PA_POLICY_GROUP_HASH_DIM;  i++) {
+        for (group = gset->hash_tbl[i];  group;  group = group->next) {
+            media_notify_cancel(group);
+            cork_cancel(group);
+        }
+    }
+
     pa_xfree(gset);
 }
 
@@ -134,6 +185,10 @@ void pa_policy_groupset_update_default_sink(struct userdata *u, uint32_t idx)
     if (defsink == NULL) {
         defsink = pa_namereg_get(u->core, NULL, PA_NAMEREG_SINK);
 
+        /* the core does not know that the pooled sinks are off limits */
+        if (defsink && u->modpool && pa_policy_module_pool_hides(u->modpool, defsink))
+            defsink = NULL;
+
         if (defsink != NULL) {
             defsinkname = pa_sink_ext_get_name(defsink);
             defsinkidx  = defsink->index;
@@ -181,7 +236,7 @@ static void policy_groupset_register_sink(struct userdata *u,
 
         for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
             for (group = gset->hash_tbl[i];    group;    group = group->next) {
-                if (pa_policy_group_sink(group, sink) &&
+                if (pa_policy_group_sink(u, group, sink) &&
                     group->sink != sink) {
                     pa_log_debug("  set sink '%s' as default for group '%s'",
                                  sinkname, group->name);
@@ -259,7 +314,7 @@ static void policy_groupset_register_source(struct userdata *u,
 
         for (i = 0;   i < PA_POLICY_GROUP_HASH_DIM;   i++) {
             for (group = gset->hash_tbl[i];    group;    group = group->next) {
-                if (pa_policy_group_source(group, source) &&
+                if (pa_policy_group_source(u, group, source) &&
                     group->source != source) {
                     pa_log_debug("  set source '%s' as default for group '%s'",
                                  srcname, group->name);
@@ -375,6 +430,7 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
     struct pa_policy_group      *group;
     uint32_t                     idx;
     enum pa_policy_object_target obj_target;
+    int                          i;
 
     pa_assert(u);
     pa_assert_se((gset = u->groups));
@@ -393,7 +449,8 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
         obj_target = pa_safe_streq(sink_prop, "(name)") ? pa_object_name : pa_object_property;
         if (obj_target == pa_object_name)
             sink_prop = NULL;
-        group->sink_match = pa_policy_match_new(pa_policy_object_sink,
+        group->sink_match = pa_policy_match_new(NULL,
+                                                pa_policy_object_sink,
                                                 obj_target,
                                                 pa_policy_var(u, sink_prop),
                                                 sink_method,
@@ -409,7 +466,8 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
         obj_target = pa_safe_streq(source_prop, "(name)") ? pa_object_name : pa_object_property;
         if (obj_target == pa_object_name)
             source_prop = NULL;
-        group->src_match = pa_policy_match_new(pa_policy_object_source,
+        group->src_match = pa_policy_match_new(NULL,
+                                               pa_policy_object_source,
                                                obj_target,
                                                pa_policy_var(u, source_prop),
                                                source_method,
@@ -423,7 +481,7 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
 
     group->next     = gset->hash_tbl[idx];
     group->flags    = flags;
-    group->name     = pa_xstrdup(name);
+    group->name     = pa_policy_intern(name);
     group->limit    = PA_VOLUME_NORM;
 
     group->sinkname = sinkname ? pa_xstrdup(sinkname) : NULL;
@@ -435,6 +493,14 @@ struct pa_policy_group *pa_policy_group_new(struct userdata *u, const char *name
     group->srcidx   = srcname  ? PA_IDXSET_INVALID : defsrcidx;
     group->properties = properties;
 
+    for (i = 0;  i < pa_policy_media_max;  i++) {
+        group->media[i].userdata = u;
+        group->media[i].group    = group;
+    }
+
+    group->cork.userdata = u;
+    group->cork.group    = group;
+
     gset->hash_tbl[idx] = group;
 
     pa_log_info("created group (%s|%d|%s|0x%04x)", group->name,
@@ -461,7 +527,7 @@ void pa_policy_group_free(struct pa_policy_groupset *gset, const char *name)
     struct pa_source_output      *sout;
     struct pa_source_output_list *sol;
     struct pa_source_output_list *nxtso;
-    char                         *dnam;
+    const char                   *dnam;
     uint32_t                      idx;
 
     pa_assert(gset);
@@ -520,7 +586,9 @@ void pa_policy_group_free(struct pa_policy_groupset *gset, const char *name)
                     }
                 } /* if group->soutls */
 
-                pa_xfree(group->name);
+                media_notify_cancel(group);
+                cork_cancel(group);
+
                 pa_xfree(group->sinkname);
                 pa_xfree(group->portname);
                 pa_policy_match_free(group->sink_match);
@@ -556,7 +624,6 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
                                        struct pa_sink_input *si,
                                        uint32_t              flags)
 {
-    static const char *media        = "audio_playback";
     static uint32_t    route_flags  = PA_POLICY_GROUP_FLAG_SET_SINK |
                                       PA_POLICY_GROUP_FLAG_ROUTE_AUDIO;
     static uint32_t    setsink_flag = PA_POLICY_GROUP_FLAG_SET_SINK;
@@ -604,7 +671,7 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
                 pa_log_debug("move sink input '%s' to sink '%s'",
                              sinp_name, ns->name);
 
-                pa_sink_input_move_to(si, ns->sink, true);
+                move_sink_input(u, si, ns->sink);
             }
             else if (group->flags & route_flags) {
                 static_route = ((group->flags & route_flags) == setsink_flag);
@@ -612,7 +679,7 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
                 pa_log_debug("move stream '%s'/'%s' to sink '%s'",
                              group->name, sinp_name, sink_name);
 
-                pa_sink_input_move_to(si, group->sink, true);
+                move_sink_input(u, si, group->sink);
 
                 if (local_route && group->portname && static_route) {
                     pa_sink_ext_override_port(u, group->sink, group->portname);
@@ -640,17 +707,19 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
             }
         }
 
+        /* also takes the factor off a stream coming from a muted group */
+        pa_sink_input_ext_set_mute_factor(u, si, group_mute_factor(u, group, si, flags));
+
         group->sinpcnt++;
 
         if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
             group->sinpcnt == 1)
         {
-            pa_log_debug("media notification: group '%s' media '%s' "
-                         "state 'active'", group->name, media);
-
-            pa_policy_dbusif_send_media_status(u, media, group->name, 1);
+            media_notify(u, group, pa_policy_media_playback, 1);
         }
 
+        PA_POLICY_PROBE2(group_insert_sink_input, si->index, group->name);
+
         pa_log_debug("sink input '%s' added to group '%s'",
                      pa_sink_input_ext_get_name(si), group->name);
     }
@@ -659,7 +728,6 @@ void pa_policy_group_insert_sink_input(struct userdata      *u,
 
 void pa_policy_group_remove_sink_input(struct userdata *u, uint32_t idx)
 {
-    static const char         *media = "audio_playback";
     struct pa_policy_group    *group;
     struct pa_sink_input_list *prev;
     struct pa_sink_input_list *sl;
@@ -688,16 +756,15 @@ void pa_policy_group_remove_sink_input(struct userdata *u, uint32_t idx)
                 {
                     group->sinpcnt = 0;
 
-                    pa_log_debug("media notification: group '%s' media '%s' "
-                                 "state 'inactive'", group->name, media);
-
-                    pa_policy_dbusif_send_media_status(u, media,group->name,0);
+                    media_notify(u, group, pa_policy_media_playback, 0);
                 }
 
                 prev->next = sl->next;
 
                 pa_xfree(sl);
 
+                PA_POLICY_PROBE2(group_remove_sink_input, idx, group->name);
+
                 pa_log_debug("sink input (idx=%d) removed from group '%s'",
                              idx, group->name);
 
@@ -713,7 +780,6 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
                                           const char              *name,
                                           struct pa_source_output *so)
 {
-    static const char  *media       = "audio_recording";
 #if 0
     static uint32_t     route_flags = PA_POLICY_GROUP_FLAG_SET_SOURCE |
                                       PA_POLICY_GROUP_FLAG_ROUTE_AUDIO;
@@ -752,7 +818,7 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
             pa_log_debug("move source output '%s' to source '%s'",
                          sout_name, ns->name);
 
-            pa_source_output_move_to(so, ns->source, true);
+            move_source_output(u, so, ns->source);
         } else if (group->source != NULL) {
             sout_name = pa_source_output_ext_get_name(so);
             src_name  = pa_source_ext_get_name(group->source);
@@ -761,7 +827,7 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
                 pa_log_debug("move source output '%s' to source '%s'",
                              sout_name, src_name);
 
-                pa_source_output_move_to(so, group->source, true);
+                move_source_output(u, so, group->source);
             }
         }
 
@@ -770,12 +836,11 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
         if ((group->flags & PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY) &&
             group->soutcnt == 1)
         {
-            pa_log_debug("media notification: group '%s' media '%s' "
-                         "state 'active'", group->name, media);
-            
-            pa_policy_dbusif_send_media_status(u, media, group->name, 1);
+            media_notify(u, group, pa_policy_media_recording, 1);
         }
 
+        PA_POLICY_PROBE2(group_insert_source_output, so->index, group->name);
+
         pa_log_debug("source output '%s' added to group '%s'",
                      pa_source_output_ext_get_name(so), group->name);
     }
@@ -784,8 +849,6 @@ void pa_policy_group_insert_source_output(struct userdata         *u,
 
 void pa_policy_group_remove_source_output(struct userdata *u, uint32_t idx)
 {
-    static const char  *media       = "audio_recording";
-
     struct pa_policy_group       *group;
     struct pa_source_output_list *prev;
     struct pa_source_output_list *sl;
@@ -813,16 +876,15 @@ void pa_policy_group_remove_source_output(struct userdata *u, uint32_t idx)
                 {
                     group->soutcnt = 0;
 
-                    pa_log_debug("media notification: group '%s' media '%s' "
-                                 "state 'inactive'", group->name, media);
-
-                    pa_policy_dbusif_send_media_status(u, media,group->name,0);
+                    media_notify(u, group, pa_policy_media_recording, 0);
                 }
 
                 prev->next = sl->next;
 
                 pa_xfree(sl);
 
+                PA_POLICY_PROBE2(group_remove_source_output, idx, group->name);
+
                 pa_log_debug("source output (idx=%d) removed from group '%s'",
                              idx, group->name);
 
@@ -839,8 +901,6 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
                             enum pa_policy_route_class class, const char *type,
                             const char *mode, const char *hwid)
 {
-    static pa_subscription_event_type_t sinkev = PA_SUBSCRIPTION_EVENT_SINK |
-                                                 PA_SUBSCRIPTION_EVENT_CHANGE;
     struct pa_policy_group   *grp;
     struct target             target;
     bool                 target_is_sink = false;
@@ -849,28 +909,8 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
 
     pa_assert(u);
 
-    target.class = class;
-    target.mode  = mode ? mode : "";
-    target.hwid  = hwid ? hwid : "";
-    target.any   = NULL;
-
-    switch (class) {
-        
-    case pa_policy_route_to_sink:
-        target.sink = find_sink_by_type(u, type);
-        target_is_sink = true;
-        break;
-
-    case pa_policy_route_to_source:
-        target.source = find_source_by_type(u, type);
-        target_is_sink = false;
-        break;
-
-    default:
-        target.any = NULL;
-        break;
-    }
-
+    resolve_target(u, class, type, mode, hwid, &target);
+    target_is_sink = (class == pa_policy_route_to_sink);
 
     if (target.any == NULL) {
         pa_log("pa_policy_group_move_to(): could not find %s for type %s name %s",
@@ -881,7 +921,7 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
                 if (!(grp->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO))
                     ret = 0;
                 else
-                    ret = move_group(grp, &target) == 0 ? 1 : -1;
+                    ret = move_group(u, grp, &target) == 0 ? 1 : -1;
             }
         }
         else {                  /* move all groups */
@@ -889,7 +929,7 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
 
            while ((grp = group_scan(u->groups, &cursor)) != NULL) {
                 if ((grp->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO)) {
-                    if (move_group(grp, &target) < 0)
+                    if (move_group(u, grp, &target) < 0)
                         ret = -1;
                     else
                         ret++;
@@ -898,26 +938,186 @@ int pa_policy_group_move_to(struct userdata *u, const char *name,
         }
     }
 
-    /* For sink target update audio mode and accessory hwid always and
-     * fire hook. */
-    if (target_is_sink && target.sink) {
-        pa_log_info("Broadcast mode '%s' to sink '%s'", target.mode, target.sink->name);
-        pa_proplist_sets(target.sink->proplist, PA_PROP_MAEMO_AUDIO_MODE    , target.mode);
-        pa_proplist_sets(target.sink->proplist, PA_PROP_MAEMO_ACCESSORY_HWID, target.hwid);
+    if (target_is_sink && target.sink)
+        broadcast_sink_route(u, type, &target);
+
+    return ret;
+}
+
+int pa_policy_group_move_all_to(struct userdata *u,
+                                const struct pa_policy_route_decision *decisions,
+                                int count)
+{
+    static const enum pa_policy_route_class classes[] = {
+        pa_policy_route_to_sink,
+        pa_policy_route_to_source
+    };
+
+    const struct pa_policy_route_decision *d;
+    struct pa_policy_group *grp;
+    struct target          *targets;
+    struct target           current;
+    struct target          *t;
+    struct cursor           cursor = { .idx = 0, .grp = NULL, };
+    int                     generic;
+    int                     specific;
+    int                     attached = 0;
+    int                     ret = 0;
+    unsigned                c;
+    int                     i;
+
+    pa_assert(u);
+    pa_assert(decisions || count == 0);
+
+    targets = pa_xnew0(struct target, count > 0 ? count : 1);
 
-        pa_subscription_post(target.sink->core, sinkev, target.sink->index);
-        pa_hook_fire(&target.sink->core->hooks[PA_CORE_HOOK_SINK_PROPLIST_CHANGED], target.sink);
+    for (i = 0;  i < count;  i++) {
+        d = decisions + i;
 
-        /* Forward shared info. First HWID then MODE, so that when checking MODE value HWID already
-         * is stored. */
-        pa_shared_data_sets(u->shared, PA_PROP_MAEMO_ACCESSORY_HWID, target.hwid);
-        pa_shared_data_sets_always(u->shared, PA_PROP_MAEMO_AUDIO_MODE, target.mode);
+        resolve_target(u, d->class, d->target, d->mode, d->hwid, targets + i);
 
-        /* Update active sink for streams */
-        pa_classify_update_stream_route(u, type);
+        /* an unknown group is not in the pool and matches no group */
+        targets[i].group = pa_policy_intern_lookup(d->group);
+
+        if (targets[i].any == NULL) {
+            pa_log("could not find %s for type %s name %s",
+                   d->class == pa_policy_route_to_sink ? "sink" : "source",
+                   d->target, d->group ? d->group : "<all>");
+            ret = -1;
+        }
     }
 
-    return ret;
+    while ((grp = group_scan(u->groups, &cursor)) != NULL) {
+        if (!(grp->flags & PA_POLICY_GROUP_FLAG_ROUTE_AUDIO))
+            continue;
+
+        for (c = 0;  c < PA_ELEMENTSOF(classes);  c++) {
+            /* the last matching decision wins */
+            generic = specific = -1;
+
+            for (i = 0;  i < count;  i++) {
+                d = decisions + i;
+
+                if (d->class != classes[c] || targets[i].any == NULL)
+                    continue;
+
+                if (!d->group)
+                    generic = i;
+                else if (targets[i].group == grp->name)
+                    specific = i;
+            }
+
+            if (specific >= 0)
+                t = targets + specific;
+            else if (generic >= 0)
+                t = targets + generic;
+            else {
+                current.class = classes[c];
+                current.mode  = "";
+                current.hwid  = "";
+
+                if (classes[c] == pa_policy_route_to_sink)
+                    current.sink = grp->sink;
+                else
+                    current.source = grp->source;
+
+                if (current.any == NULL)
+                    continue;
+
+                t = &current;
+            }
+
+            if (move_group(u, grp, t) < 0)
+                ret = -1;
+        }
+
+        if (grp->num_moving == 0)
+            attached++;
+    }
+
+    /* mode, hwid and the stream route are global, so decisions for
+     * a specific group don't broadcast */
+    for (i = 0;  i < count;  i++) {
+        if (decisions[i].class == pa_policy_route_to_sink &&
+            !decisions[i].group && targets[i].sink)
+            broadcast_sink_route(u, decisions[i].target, targets + i);
+    }
+
+    pa_xfree(targets);
+
+    return ret < 0 ? -1 : attached;
+}
+
+static void resolve_target(struct userdata *u, enum pa_policy_route_class class,
+                           const char *type, const char *mode, const char *hwid,
+                           struct target *target)
+{
+    target->class = class;
+    target->mode  = mode ? mode : "";
+    target->hwid  = hwid ? hwid : "";
+    target->any   = NULL;
+    target->group = NULL;
+
+    switch (class) {
+
+    case pa_policy_route_to_sink:
+        target->sink = find_sink_by_type(u, type);
+        break;
+
+    case pa_policy_route_to_source:
+        target->source = find_source_by_type(u, type);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void broadcast_sink_route(struct userdata *u, const char *type,
+                                 struct target *target)
+{
+    pa_assert(target->class == pa_policy_route_to_sink);
+    pa_assert(target->sink);
+
+    /* For sink target update audio mode and accessory hwid. The proplist
+     * change is posted and the hook fired only if either of them changed. */
+    update_sink_mode(target->sink, target->mode, target->hwid);
+
+    /* Forward shared info. First HWID then MODE, so that when checking MODE value HWID already
+     * is stored. */
+    pa_policy_forward_sets(u, PA_PROP_MAEMO_ACCESSORY_HWID, target->hwid);
+    pa_policy_forward_sets_always(u, PA_PROP_MAEMO_AUDIO_MODE, target->mode);
+
+    /* Update active sink for streams */
+    pa_classify_update_stream_route(u, type);
+}
+
+static void update_sink_mode(struct pa_sink *sink, const char *mode,
+                             const char *hwid)
+{
+    pa_proplist *pl;
+
+    pa_assert(sink);
+    pa_assert(mode);
+    pa_assert(hwid);
+
+    if (pa_safe_streq(pa_proplist_gets(sink->proplist, PA_PROP_MAEMO_AUDIO_MODE), mode) &&
+        pa_safe_streq(pa_proplist_gets(sink->proplist, PA_PROP_MAEMO_ACCESSORY_HWID), hwid))
+    {
+        pa_log_debug("mode '%s' of sink '%s' unchanged", mode, sink->name);
+        return;
+    }
+
+    pa_log_info("Broadcast mode '%s' to sink '%s'", mode, sink->name);
+
+    pl = pa_proplist_new();
+    pa_proplist_sets(pl, PA_PROP_MAEMO_AUDIO_MODE    , mode);
+    pa_proplist_sets(pl, PA_PROP_MAEMO_ACCESSORY_HWID, hwid);
+
+    /* posts the change event and fires PA_CORE_HOOK_SINK_PROPLIST_CHANGED */
+    pa_sink_update_proplist(sink, PA_UPDATE_REPLACE, pl);
+
+    pa_proplist_free(pl);
 }
 
 static int start_move_group(struct pa_policy_group *group)
@@ -1016,13 +1216,53 @@ int pa_policy_group_cork(struct userdata *u, const char *name, int corked)
     else {
         if (!(grp->flags & PA_POLICY_GROUP_FLAG_CORK_STREAM))
             ret = 0;
+        else if (u->groups->cork_batch) {
+            cork_queue(u, grp, corked);
+            ret = 0;
+        }
         else
-            ret = cork_group(u, grp, corked);
+            ret = cork_schedule(u, grp, corked);
     }
 
     return ret;
 }
 
+/*
+ * Between begin and commit the cork changes are only collected, the last
+ * one per group winning, and commit applies what is left of them in one
+ * pass. A cork/uncork pair within the batch thus never reaches the
+ * streams. A route change within the batch applies the corks collected
+ * so far first, see pa_policy_group_cork_flush().
+ */
+void pa_policy_group_cork_begin(struct userdata *u)
+{
+    pa_assert(u);
+    pa_assert(u->groups);
+
+    u->groups->cork_batch = true;
+}
+
+/* Streams are to be corked before they are moved, the uncorks wait for
+ * the commit when the streams are at their new place. */
+void pa_policy_group_cork_flush(struct userdata *u)
+{
+    pa_assert(u);
+    pa_assert(u->groups);
+
+    if (u->groups->cork_batch)
+        cork_apply_queued(u, true);
+}
+
+void pa_policy_group_cork_commit(struct userdata *u)
+{
+    pa_assert(u);
+    pa_assert(u->groups);
+
+    u->groups->cork_batch = false;
+
+    cork_apply_queued(u, false);
+}
+
 
 int pa_policy_group_volume_limit(struct userdata *u, const char *name,
                                  uint32_t percent)
@@ -1051,6 +1291,18 @@ int pa_policy_group_volume_limit(struct userdata *u, const char *name,
 
         if (!(group->flags & PA_POLICY_GROUP_FLAG_LIMIT_VOLUME))
             ret = 0;
+        else if (group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_FACTOR) {
+            mute = percent > 0 ? false : true;
+            ret  = mute_group_by_factor(u, group, mute);
+
+            /* source outputs have no volume factors */
+            if ((group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE) &&
+                mute_sources_by_route(u, group, mute) < 0)
+                ret = -1;
+
+            if (!mute)
+                volset_group(u, group, percent);
+        }
         else {
             if (!(group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE))
                 ret = volset_group(u, group, percent);
@@ -1096,7 +1348,8 @@ static struct pa_policy_group *group_scan(struct pa_policy_groupset *gset,
 }
 
 
-static int move_group(struct pa_policy_group *group, struct target *target)
+static int move_group(struct userdata *u, struct pa_policy_group *group,
+                      struct target *target)
 {
     struct pa_sink               *sink;
     struct pa_source             *source;
@@ -1146,7 +1399,7 @@ static int move_group(struct pa_policy_group *group, struct target *target)
                                          pa_sink_input_ext_get_name(sinp),
                                          sinkname);
                         }
-                    } else if (pa_sink_input_move_to(sinp, sink, true) < 0) {
+                    } else if (move_sink_input(u, sinp, sink) < 0) {
                         ret = -1;
                         pa_log_error("Failed to move %s to %s",
                                      pa_sink_input_ext_get_name(sinp),
@@ -1207,7 +1460,7 @@ static int move_group(struct pa_policy_group *group, struct target *target)
                                          pa_source_output_ext_get_name(sout),
                                          pa_source_ext_get_name(source));
                         }
-                    } else if (pa_source_output_move_to(sout, source, true) < 0) {
+                    } else if (move_source_output(u, sout, source) < 0) {
                         ret = -1;
                         pa_log_error("Failed to move %s to %s",
                                      pa_source_output_ext_get_name(sout),
@@ -1293,7 +1546,8 @@ static int volset_group(struct userdata        *u,
 }
 
 
-bool pa_policy_group_sink(struct pa_policy_group *group, pa_sink *sink)
+bool pa_policy_group_sink(struct userdata *u, struct pa_policy_group *group,
+                          pa_sink *sink)
 {
     pa_assert(group);
     pa_assert(sink);
@@ -1304,11 +1558,12 @@ bool pa_policy_group_sink(struct pa_policy_group *group, pa_sink *sink)
     if (!group->sink_match)
         return false;
 
-    return pa_policy_match(group->sink_match, sink);
+    return pa_policy_match(u, group->sink_match, sink);
 }
 
 
-bool pa_policy_group_source(struct pa_policy_group *group, pa_source *source)
+bool pa_policy_group_source(struct userdata *u, struct pa_policy_group *group,
+                            pa_source *source)
 {
     pa_assert(group);
     pa_assert(source);
@@ -1319,7 +1574,7 @@ bool pa_policy_group_source(struct pa_policy_group *group, pa_source *source)
     if (!group->src_match)
         return false;
 
-    return pa_policy_match(group->src_match, source);
+    return pa_policy_match(u, group->src_match, source);
 }
 
 
@@ -1332,7 +1587,7 @@ pa_sink *pa_policy_group_find_sink(struct userdata *u, struct pa_policy_group *g
         return NULL;
 
     PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
-        if (pa_policy_match(group->sink_match, sink))
+        if (pa_policy_match(u, group->sink_match, sink))
             return sink;
     }
 
@@ -1348,14 +1603,9 @@ static int mute_group_by_route(struct userdata        *u,
     struct pa_sink_input *sinp;
     struct pa_sink *sink;
     const char *sink_name;
-    struct pa_source_output_list *soutls;
-    struct pa_source_output *sout;
-    struct pa_source *source;
-    const char *source_name;
     int ret = 0;
 
     sink = mute ? u->nullsink->sink : group->sink;
-    source = mute ? u->nullsource->source : group->source;
 
     if (sink == NULL) {
         if ((group->flags & PA_POLICY_GROUP_FLAG_DYNAMIC_SINK) && !mute) {
@@ -1389,13 +1639,31 @@ static int mute_group_by_route(struct userdata        *u,
                                  "mute-by-route",
                                  pa_sink_input_ext_get_name(sinp), sink_name);
 
-                    if (pa_sink_input_move_to(sinp, sink, true) < 0)
+                    if (move_sink_input(u, sinp, sink) < 0)
                         ret = -1;
                 }
             }
         }
     }
 
+    if (mute_sources_by_route(u, group, mute) < 0)
+        ret = -1;
+
+    return ret;
+}
+
+static int mute_sources_by_route(struct userdata        *u,
+                                 struct pa_policy_group *group,
+                                 int                     mute)
+{
+    struct pa_source_output_list *soutls;
+    struct pa_source_output *sout;
+    struct pa_source *source;
+    const char *source_name;
+    int ret = 0;
+
+    source = mute ? u->nullsource->source : group->source;
+
     if (source) {
         source_name = pa_source_ext_get_name(source);
 
@@ -1419,7 +1687,7 @@ static int mute_group_by_route(struct userdata        *u,
                                  "mute-by-route",
                                  pa_source_output_ext_get_name(sout), source_name);
 
-                    if (pa_source_output_move_to(sout, source, true) < 0)
+                    if (move_source_output(u, sout, source) < 0)
                         ret = -1;
                 }
             }
@@ -1429,6 +1697,59 @@ static int mute_group_by_route(struct userdata        *u,
     return ret;
 }
 
+static int mute_group_by_factor(struct userdata        *u,
+                                struct pa_policy_group *group,
+                                int                     mute)
+{
+    struct pa_sink_input_list *sl;
+    struct pa_sink_input *sinp;
+    int ret = 0;
+
+    if ((mute && group->mutebyfc) || (!mute && !group->mutebyfc)) {
+        pa_log_debug("group '%s' is already %smuted by factor",
+                     group->name, mute ? "" : "un");
+        return 0;
+    }
+
+    pa_log_debug("group '%s' mute-by-factor muting is %s",
+                 group->name, mute ? "on" : "off");
+
+    group->mutebyfc = mute;
+
+    /* the local policy owns the factors while the group is muted locally */
+    if (!group->locmute) {
+        for (sl = group->sinpls;   sl != NULL;   sl = sl->next) {
+            sinp = sl->sink_input;
+
+            if (pa_sink_input_ext_set_mute_factor(u, sinp, mute) < 0) {
+                pa_log("failed to %smute sink input '%s' by factor",
+                       mute ? "" : "un", pa_sink_input_ext_get_name(sinp));
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/* the factor a stream joining the group gets, see mute_group_locally() */
+static bool group_mute_factor(struct userdata        *u,
+                              struct pa_policy_group *group,
+                              struct pa_sink_input   *sinp,
+                              uint32_t                flags)
+{
+    struct pa_sink_input_ext *ext;
+
+    if (group->locmute && (group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_FACTOR)) {
+        ext = pa_sink_input_ext_lookup(u, sinp);
+
+        if (!ext || !ext->local.mute)
+            return true;
+    }
+
+    return group->mutebyfc && !(flags & PA_POLICY_LOCAL_ROUTE);
+}
+
 static int mute_group_locally(struct userdata        *u,
                               struct pa_policy_group *group,
                               int                     locmute)
@@ -1441,6 +1762,7 @@ static int mute_group_locally(struct userdata        *u,
     const char *sinp_name;
     pa_volume_t volume;
     int mutebyrt;
+    int mutebyfc;
     int mark;
     int mute;
     int percent;
@@ -1452,9 +1774,11 @@ static int mute_group_locally(struct userdata        *u,
     if (locmute != group->locmute) {
         group->locmute = locmute;
 
-        mutebyrt = group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE;
+        mutebyfc = group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_FACTOR;
+        mutebyrt = !mutebyfc && (group->flags & PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE);
         prefix   = locmute  ? "" : "un";
-        method   = mutebyrt ? " using mute-by-route" : "";
+        method   = mutebyrt ? " using mute-by-route" :
+                   mutebyfc ? " using mute-by-factor" : "";
 
         pa_log_debug("group '%s' locally %smuted%s",group->name,prefix,method);
 
@@ -1469,7 +1793,7 @@ static int mute_group_locally(struct userdata        *u,
             sink_name = sink ? pa_sink_ext_get_name(sink) : "<unknown sink>";
             sinp_name = pa_sink_input_ext_get_name(sinp);
 
-            if (mutebyrt)
+            if (mutebyrt || mutebyfc)
                 volume = group->limit;
             else
                 volume = mute ? 0 : (mark ? PA_VOLUME_NORM : group->limit);
@@ -1483,7 +1807,7 @@ static int mute_group_locally(struct userdata        *u,
                              group->name, sinp_name, sink_name);
 
                 if (sinp->sink) {
-                    if (pa_sink_input_move_to(sinp, sink, true) < 0)
+                    if (move_sink_input(u, sinp, sink) < 0)
                         ret = -1;
                 } else {
                     pa_log_debug("stream '%s'/'%s' is currently moving. finishing move",
@@ -1504,6 +1828,14 @@ static int mute_group_locally(struct userdata        *u,
                             group->name, sinp_name, sink_name);
             }
 
+            if (mutebyfc &&
+                pa_sink_input_ext_set_mute_factor(u, sinp, mute || group->mutebyfc) < 0)
+            {
+                pa_log_error("failed to set mute factor of stream '%s'/'%s'",
+                             group->name, sinp_name);
+                ret = -1;
+            }
+
             pa_log_debug("set volume limit %d for sink input '%s'/'%s'",
                          percent, group->name, sinp_name);
 
@@ -1520,6 +1852,40 @@ static int mute_group_locally(struct userdata        *u,
 }
 
 
+static int move_sink_input(struct userdata *u, struct pa_sink_input *sinp,
+                           struct pa_sink *sink)
+{
+    int ret;
+
+    pa_policy_stats_count(u, pa_policy_stat_stream_move);
+
+    PA_POLICY_PROBE3(move_sink_input_begin, sinp->index,
+                     sink->index, sink->name);
+
+    ret = pa_sink_input_move_to(sinp, sink, true);
+
+    PA_POLICY_PROBE3(move_sink_input_end, sinp->index, sink->index, ret);
+
+    return ret;
+}
+
+static int move_source_output(struct userdata *u, struct pa_source_output *sout,
+                              struct pa_source *source)
+{
+    int ret;
+
+    pa_policy_stats_count(u, pa_policy_stat_stream_move);
+
+    PA_POLICY_PROBE3(move_source_output_begin, sout->index,
+                     source->index, source->name);
+
+    ret = pa_source_output_move_to(sout, source, true);
+
+    PA_POLICY_PROBE3(move_source_output_end, sout->index, source->index, ret);
+
+    return ret;
+}
+
 static int cork_group(struct userdata *u, struct pa_policy_group *group, int corked)
 {
     struct pa_sink_input_list *sl;
@@ -1549,20 +1915,201 @@ static int cork_group(struct userdata *u, struct pa_policy_group *group, int cor
     return 0;
 }
 
+static void cork_queue(struct userdata *u, struct pa_policy_group *group,
+                       int corked)
+{
+    struct pa_policy_cork_sched *cs = &group->cork;
+
+    if (cs->queued && cs->target != corked) {
+        cs->suppressed++;
+        pa_policy_stats_count(u, pa_policy_stat_cork_suppressed);
+
+        pa_log_debug("group '%s' %scork dropped within the batch",
+                     group->name, cs->target ? "" : "un");
+    }
+
+    cs->queued = true;
+    cs->target = corked;
+}
+
+static void cork_apply_queued(struct userdata *u, bool corks_only)
+{
+    struct pa_policy_group *grp;
+    struct cursor           cursor = { .idx = 0, .grp = NULL, };
+
+    while ((grp = group_scan(u->groups, &cursor)) != NULL) {
+        if (grp->cork.queued && (grp->cork.target || !corks_only)) {
+            grp->cork.queued = false;
+            cork_schedule(u, grp, grp->cork.target);
+        }
+    }
+}
+
+/*
+ * Corking is done right away. With a grace period configured for the
+ * group uncorking is held back for that long and dropped if the group
+ * gets corked again meanwhile, e.g. when a notification interrupts the
+ * music twice in a row.
+ */
+static int cork_schedule(struct userdata *u, struct pa_policy_group *group,
+                         int corked)
+{
+    struct pa_policy_cork_sched *cs = &group->cork;
+
+    if (corked) {
+        if (cs->timer) {
+            u->core->mainloop->time_free(cs->timer);
+            cs->timer = NULL;
+            cs->suppressed++;
+            pa_policy_stats_count(u, pa_policy_stat_cork_suppressed);
+
+            pa_log_debug("group '%s' uncork/cork suppressed (%u so far)",
+                         group->name, cs->suppressed);
+            return 0;
+        }
+    }
+    else if (group->uncork_grace > 0 && group->corked) {
+        if (!cs->timer) {
+            cs->timer = pa_core_rttime_new(u->core, pa_rtclock_now() +
+                                           group->uncork_grace * PA_USEC_PER_MSEC,
+                                           uncork_cb, cs);
+        }
+        return 0;
+    }
+
+    return cork_group(u, group, corked);
+}
+
+static void uncork_cb(pa_mainloop_api *api, pa_time_event *e,
+                      const struct timeval *tv, void *userdata)
+{
+    struct pa_policy_cork_sched *cs = userdata;
+
+    pa_assert(cs);
+    pa_assert(cs->group);
+    pa_assert(cs->timer == e);
+
+    api->time_free(cs->timer);
+    cs->timer = NULL;
+
+    cork_group(cs->userdata, cs->group, 0);
+}
+
+static void cork_cancel(struct pa_policy_group *group)
+{
+    struct pa_policy_cork_sched *cs = &group->cork;
+
+    if (cs->timer) {
+        cs->userdata->core->mainloop->time_free(cs->timer);
+        cs->timer = NULL;
+    }
+
+    if (cs->suppressed) {
+        pa_log_info("group '%s': %u transient cork transitions suppressed",
+                    group->name, cs->suppressed);
+    }
+}
+
+/*
+ * 'active' is sent right away. With a hysteresis configured for the group
+ * 'inactive' is held back for that long and dropped if the group becomes
+ * active again meanwhile, so that players reopening their streams between
+ * tracks do not make the policy daemon re-evaluate everything twice.
+ */
+static void media_notify(struct userdata *u, struct pa_policy_group *group,
+                         enum pa_policy_media media, int active)
+{
+    struct pa_policy_media_notify *mn = group->media + media;
+
+    if (active) {
+        if (mn->timer) {
+            u->core->mainloop->time_free(mn->timer);
+            mn->timer = NULL;
+            mn->suppressed++;
+
+            pa_log_debug("media notification: group '%s' media '%s' "
+                         "inactive/active suppressed (%u so far)",
+                         group->name, media_names[media], mn->suppressed);
+            return;
+        }
+    }
+    else if (group->media_hysteresis > 0) {
+        if (!mn->timer) {
+            mn->timer = pa_core_rttime_new(u->core, pa_rtclock_now() +
+                                           group->media_hysteresis * PA_USEC_PER_MSEC,
+                                           media_notify_cb, mn);
+        }
+        return;
+    }
+
+    media_send(u, group, media, active);
+}
+
+static void media_send(struct userdata *u, struct pa_policy_group *group,
+                       enum pa_policy_media media, int active)
+{
+    pa_log_debug("media notification: group '%s' media '%s' "
+                 "state '%s'", group->name, media_names[media],
+                 active ? "active" : "inactive");
+
+    pa_policy_dbusif_send_media_status(u, media_names[media], group->name,
+                                       active);
+}
+
+static void media_notify_cb(pa_mainloop_api *api, pa_time_event *e,
+                            const struct timeval *tv, void *userdata)
+{
+    struct pa_policy_media_notify *mn = userdata;
+    struct pa_policy_group        *group;
+
+    pa_assert(mn);
+    pa_assert_se((group = mn->group));
+    pa_assert(mn->timer == e);
+
+    api->time_free(mn->timer);
+    mn->timer = NULL;
+
+    media_send(mn->userdata, group, mn - group->media, 0);
+}
+
+static void media_notify_cancel(struct pa_policy_group *group)
+{
+    struct pa_policy_media_notify *mn;
+    int                            i;
+
+    for (i = 0;  i < pa_policy_media_max;  i++) {
+        mn = group->media + i;
+
+        if (mn->timer) {
+            mn->userdata->core->mainloop->time_free(mn->timer);
+            mn->timer = NULL;
+        }
+
+        if (mn->suppressed) {
+            pa_log_info("group '%s': %u transient media inactive/active "
+                        "notifications suppressed", group->name, mn->suppressed);
+        }
+    }
+}
+
 
 static struct pa_policy_group *find_group_by_name(struct pa_policy_groupset *gset,
                                                   const char *name, uint32_t *ridx)
 {
     struct pa_policy_group *group = NULL;
     uint32_t                idx   = hash_value(name);
+    const char             *iname;
     
     pa_assert(gset);
     pa_assert(name);
 
-    for (group = gset->hash_tbl[idx];   group != NULL;  group = group->next) {
-        if (!strcmp(name, group->name))
-            break;
-    }    
+    /* the group names are interned, a name not in the pool is no group */
+    if ((iname = pa_policy_intern_lookup(name)) != NULL) {
+        for (group = gset->hash_tbl[idx];  group != NULL;  group = group->next) {
+            if (iname == group->name)
+                break;
+        }
+    }
 
     if (ridx != NULL)
         *ridx = idx;
@@ -1573,40 +2120,22 @@ static struct pa_policy_group *find_group_by_name(struct pa_policy_groupset *gse
 
 static struct pa_sink *find_sink_by_type(struct userdata *u, const char *type)
 {
-    void            *state = NULL;
-    pa_idxset       *idxset;
-    struct pa_sink  *sink;
+    struct pa_route_plan *plan;
 
     pa_assert(u);
     pa_assert(type);
-    pa_assert(u->core);
-    pa_assert_se((idxset = u->core->sinks));
 
-    while ((sink = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
-        if (pa_classify_is_sink_typeof(u, sink, type, NULL))
-            break;
-    }
-
-    return sink;
+    return (plan = pa_policy_route_plan_get(u, type)) ? plan->sink : NULL;
 }
 
 static struct pa_source *find_source_by_type(struct userdata *u, const char *type)
 {
-    void              *state = NULL;
-    pa_idxset         *idxset;
-    struct pa_source  *source;
+    struct pa_route_plan *plan;
 
     pa_assert(u);
     pa_assert(type);
-    pa_assert(u->core);
-    pa_assert_se((idxset = u->core->sources));
-
-    while ((source = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
-        if (pa_classify_is_source_typeof(u, source, type, NULL))
-            break;
-    }
 
-    return source;
+    return (plan = pa_policy_route_plan_get(u, type)) ? plan->source : NULL;
 }
 
 static uint32_t hash_value(const char *s)
@@ -22,6 +22,7 @@
 #define PA_POLICY_GROUP_FLAG_MEDIA_NOTIFY  PA_POLICY_GROUP_BIT(5)
 #define PA_POLICY_GROUP_FLAG_MUTE_BY_ROUTE PA_POLICY_GROUP_BIT(6)
 #define PA_POLICY_GROUP_FLAG_DYNAMIC_SINK  PA_POLICY_GROUP_BIT(7)
+#define PA_POLICY_GROUP_FLAG_MUTE_BY_FACTOR PA_POLICY_GROUP_BIT(8)
 
 #define PA_POLICY_GROUP_FLAGS_CLIENT      (PA_POLICY_GROUP_FLAG_LIMIT_VOLUME |\
                                            PA_POLICY_GROUP_FLAG_CORK_STREAM  )
@@ -40,10 +41,32 @@ struct pa_source_output_list {
     struct pa_source_output      *source_output;
 };
 
+enum pa_policy_media {
+    pa_policy_media_playback = 0,
+    pa_policy_media_recording,
+    pa_policy_media_max
+};
+
+struct pa_policy_media_notify {
+    struct userdata              *userdata;
+    struct pa_policy_group       *group;
+    pa_time_event                *timer;    /* pending 'inactive' signal */
+    uint32_t                      suppressed; /* inactive/active pairs not sent */
+};
+
+struct pa_policy_cork_sched {
+    struct userdata              *userdata;
+    struct pa_policy_group       *group;
+    pa_time_event                *timer;    /* pending uncork */
+    bool                          queued;   /* batched cork state in 'target' */
+    int                           target;
+    uint32_t                      suppressed; /* transitions not applied */
+};
+
 struct pa_policy_group {
     struct pa_policy_group       *next;     /* hash link*/
     uint32_t                      flags;    /* or'ed PA_POLICY_GROUP_FLAG_x's*/
-    char                         *name;     /* name of the policy group */
+    const char                   *name;     /* name of the policy group */
     char                         *sinkname; /* name of the default sink */
     char                         *portname; /* name of the default port */
     struct pa_sink               *sink;     /* default sink for the group */
@@ -58,17 +81,23 @@ struct pa_policy_group {
     int                           corked;
     int                           mutebyrt_sink;    /* muted by routing to null sink */
     int                           mutebyrt_source;  /* muted by routing to null source */
+    int                           mutebyfc; /* muted by zero volume factor */
     struct pa_sink_input_list    *sinpls;   /* sink input list */
     struct pa_source_output_list *soutls;   /* source output list */
     int                           sinpcnt;  /* sink input counter */
     int                           soutcnt;  /* source output counter */
     int                           num_moving;   /* Number of moving streams */
     pa_proplist                  *properties;   /* properties to set for each sink input*/
+    uint32_t                      media_hysteresis; /* ms to hold back 'inactive' */
+    struct pa_policy_media_notify media[pa_policy_media_max];
+    uint32_t                      uncork_grace; /* ms to hold back uncorking */
+    struct pa_policy_cork_sched   cork;
 };
 
 struct pa_policy_groupset {
     struct pa_policy_group    *dflt;     /*  default group */
     struct pa_policy_group    *hash_tbl[PA_POLICY_GROUP_HASH_DIM];
+    bool                       cork_batch; /* collecting cork changes */
 };
 
 enum pa_policy_route_class {
@@ -78,6 +107,14 @@ enum pa_policy_route_class {
     pa_policy_route_max
 };
 
+struct pa_policy_route_decision {
+    enum pa_policy_route_class    class;
+    const char                   *group;    /* NULL means all routed groups */
+    const char                   *target;   /* device type */
+    const char                   *mode;
+    const char                   *hwid;
+};
+
 
 struct pa_policy_groupset *pa_policy_groupset_new(struct userdata *);
 void pa_policy_groupset_free(struct pa_policy_groupset *);
@@ -118,14 +155,25 @@ void pa_policy_group_remove_source_output(struct userdata *, uint32_t);
 int  pa_policy_group_move_to(struct userdata *, const char *,
                              enum pa_policy_route_class, const char *,
                              const char *, const char *);
+/* Attach every routed group once according to the decisions; a group
+ * specific decision overrides one for all groups. Groups without a
+ * decision are re-attached where they were. Return the number of routed
+ * groups with no detached streams left, or -1 on failure. */
+int  pa_policy_group_move_all_to(struct userdata *,
+                                 const struct pa_policy_route_decision *, int);
 int  pa_policy_group_start_move_all(struct userdata *u);
 void pa_policy_group_assert_moving(struct userdata *u);
 int  pa_policy_group_cork(struct userdata *u, const char *, int);
+void pa_policy_group_cork_begin(struct userdata *u);
+void pa_policy_group_cork_flush(struct userdata *u);
+void pa_policy_group_cork_commit(struct userdata *u);
 int  pa_policy_group_volume_limit(struct userdata *, const char *, uint32_t);
 
 pa_sink *pa_policy_group_find_sink(struct userdata *u, struct pa_policy_group *group);
-bool pa_policy_group_sink(struct pa_policy_group *group, pa_sink *sink);
-bool pa_policy_group_source(struct pa_policy_group *group, pa_source *source);
+bool pa_policy_group_sink(struct userdata *u, struct pa_policy_group *group,
+                          pa_sink *sink);
+bool pa_policy_group_source(struct userdata *u, struct pa_policy_group *group,
+                            pa_source *source);
 
 #endif
 
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
@@ -7,6 +8,8 @@
 #include <config.h>
 #endif
 
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/log.h>
 
 #include "policy.h"
@@ -14,6 +17,12 @@
 #include "classify.h"
 #include "log.h"
 
+static char *device_state_key(const char *, uint32_t);
+static void device_state_put(pa_hashmap *, const char *, uint32_t,
+                             struct pa_classify_result *);
+static void device_state_send(struct userdata *, pa_hashmap *, const char *,
+                              uint32_t, struct pa_classify_result *);
+
 void pa_policy_send_device_state(struct userdata *u, const char *state,
                                  const struct pa_classify_result *list)
 {
@@ -86,3 +95,143 @@ void pa_policy_send_device_state_full(struct userdata *u)
         pa_xfree(r);
     }
 }
+
+pa_hashmap *pa_policy_device_state_save(struct userdata *u)
+{
+    void             *state;
+    pa_idxset        *idxset;
+    pa_hashmap       *saved;
+    struct pa_card   *card;
+    struct pa_sink   *sink;
+    struct pa_source *source;
+    struct pa_classify_result *r;
+
+    pa_assert(u);
+    pa_assert(u->core);
+
+    saved = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                pa_idxset_string_compare_func,
+                                pa_xfree, pa_xfree);
+
+    pa_assert_se((idxset = u->core->cards));
+    state = NULL;
+
+    while ((card = pa_idxset_iterate(idxset, &state, NULL))) {
+        pa_classify_card(u, card, PA_POLICY_DISABLE_NOTIFY, 0, true, &r);
+        device_state_put(saved, "card", card->index, r);
+    }
+
+    pa_assert_se((idxset = u->core->sinks));
+    state = NULL;
+
+    while ((sink = pa_idxset_iterate(idxset, &state, NULL))) {
+        pa_classify_sink(u, sink, PA_POLICY_DISABLE_NOTIFY, 0, &r);
+        device_state_put(saved, "sink", sink->index, r);
+    }
+
+    pa_assert_se((idxset = u->core->sources));
+    state = NULL;
+
+    while ((source = pa_idxset_iterate(idxset, &state, NULL))) {
+        pa_classify_source(u, source, PA_POLICY_DISABLE_NOTIFY, 0, &r);
+        device_state_put(saved, "source", source->index, r);
+    }
+
+    return saved;
+}
+
+void pa_policy_send_device_state_changes(struct userdata *u, pa_hashmap *saved)
+{
+    void             *state;
+    pa_idxset        *idxset;
+    struct pa_card   *card;
+    struct pa_sink   *sink;
+    struct pa_source *source;
+    struct pa_classify_result *r;
+
+    pa_assert(u);
+    pa_assert(u->core);
+    pa_assert(saved);
+
+    pa_assert_se((idxset = u->core->cards));
+    state = NULL;
+
+    while ((card = pa_idxset_iterate(idxset, &state, NULL))) {
+        pa_classify_card(u, card, PA_POLICY_DISABLE_NOTIFY, 0, true, &r);
+        device_state_send(u, saved, "card", card->index, r);
+    }
+
+    pa_assert_se((idxset = u->core->sinks));
+    state = NULL;
+
+    while ((sink = pa_idxset_iterate(idxset, &state, NULL))) {
+        pa_classify_sink(u, sink, PA_POLICY_DISABLE_NOTIFY, 0, &r);
+        device_state_send(u, saved, "sink", sink->index, r);
+    }
+
+    pa_assert_se((idxset = u->core->sources));
+    state = NULL;
+
+    while ((source = pa_idxset_iterate(idxset, &state, NULL))) {
+        pa_classify_source(u, source, PA_POLICY_DISABLE_NOTIFY, 0, &r);
+        device_state_send(u, saved, "source", source->index, r);
+    }
+}
+
+static char *device_state_key(const char *kind, uint32_t index)
+{
+    return pa_sprintf_malloc("%s:%u", kind, index);
+}
+
+static void device_state_put(pa_hashmap *saved, const char *kind, uint32_t index,
+                             struct pa_classify_result *r)
+{
+    /* the type names are owned by the classifier, which may get reset */
+    pa_hashmap_put(saved, device_state_key(kind, index),
+                   pa_policy_log_concat(r->types, r->count));
+    pa_xfree(r);
+}
+
+static void device_state_send(struct userdata *u, pa_hashmap *saved,
+                              const char *kind, uint32_t index,
+                              struct pa_classify_result *r)
+{
+    struct pa_classify_result *old;
+    const char *types;
+    char       *key;
+    char       *current;
+    char       *buf;
+    char       *type;
+    char       *save;
+    uint32_t    count;
+
+    key     = device_state_key(kind, index);
+    types   = pa_hashmap_get(saved, key);
+    current = pa_policy_log_concat(r->types, r->count);
+
+    if (types && !pa_streq(types, current)) {
+        buf = pa_xstrdup(types);
+
+        for (count = 1, type = buf;  *type;  type++)
+            count += (*type == ' ');
+
+        old = pa_xmalloc(sizeof(*old) + sizeof(char *) * count);
+        old->count = 0;
+
+        for (type = strtok_r(buf, " ", &save);  type;  type = strtok_r(NULL, " ", &save))
+            old->types[old->count++] = type;
+
+        pa_log_debug("%s %u changes type from '%s' to '%s'", kind, index,
+                     types, current);
+
+        pa_policy_dbusif_send_device_state(u, PA_POLICY_DISCONNECTED, old);
+        pa_policy_dbusif_send_device_state(u, PA_POLICY_CONNECTED, r);
+
+        pa_xfree(old);
+        pa_xfree(buf);
+    }
+
+    pa_xfree(current);
+    pa_xfree(key);
+    pa_xfree(r);
+}
@@ -1,6 +1,8 @@
 #ifndef foopolicyfoo
 #define foopolicyfoo
 
+#include <pulsecore/hashmap.h>
+
 #include "userdata.h"
 #include "classify.h"
 
@@ -10,6 +12,10 @@
 void pa_policy_send_device_state(struct userdata *u, const char *state,
                                  const struct pa_classify_result *list);
 void pa_policy_send_device_state_full(struct userdata *u);
+/* Remember the device types of all cards, sinks and sources, so that
+ * only the changes get announced after the classification has changed. */
+pa_hashmap *pa_policy_device_state_save(struct userdata *u);
+void pa_policy_send_device_state_changes(struct userdata *u, pa_hashmap *saved);
 void pa_policy_send_card_state(struct userdata *u, const struct pa_classify_result *list,
                                const char *profile);
 
@@ -0,0 +1,43 @@
+#ifndef foopolicyprobesfoo
+#define foopolicyprobesfoo
+
+/*
+ * Static (SystemTap style) probes at the hot paths of the policy. They
+ * are compiled in only when the module was configured with the 'sdt'
+ * option. Otherwise the macros expand to nothing and the arguments are
+ * not evaluated at all. The provider of the probes is 'pa_policy', eg.
+ *
+ *   stap -e 'probe process("module-policy-enforcement.so")
+ *            .provider("pa_policy").mark("move_sink_input_begin") { ... }'
+ *
+ * String arguments are passed as pointers and need to be read with
+ * user_string() or an equivalent in the tracing tool.
+ */
+
+#ifdef HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define PA_POLICY_PROBE(n)                   DTRACE_PROBE(pa_policy, n)
+#define PA_POLICY_PROBE1(n, a)               DTRACE_PROBE1(pa_policy, n, a)
+#define PA_POLICY_PROBE2(n, a, b)            DTRACE_PROBE2(pa_policy, n, a, b)
+#define PA_POLICY_PROBE3(n, a, b, c)         DTRACE_PROBE3(pa_policy, n, a, b, c)
+
+#else  /* !HAVE_SDT */
+
+#define PA_POLICY_PROBE(n)                   do {} while (0)
+#define PA_POLICY_PROBE1(n, a)               do {} while (0)
+#define PA_POLICY_PROBE2(n, a, b)            do {} while (0)
+#define PA_POLICY_PROBE3(n, a, b, c)         do {} while (0)
+
+#endif /* !HAVE_SDT */
+
+#endif /* foopolicyprobesfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
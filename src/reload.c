@@ -0,0 +1,286 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/inotify.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "reload.h"
+#include "config-file.h"
+#include "classify.h"
+#include "sink-input-ext.h"
+#include "policy.h"
+#include "route-plan.h"
+#include "arena.h"
+
+#define RELOAD_DELAY_USEC  (300 * PA_USEC_PER_MSEC) /* editors write in bursts */
+
+struct pa_policy_reload {
+    struct userdata  *userdata;
+    int               fd;       /* inotify */
+    pa_io_event      *io;
+    pa_time_event    *timer;    /* debounces the file events */
+};
+
+static int  watch_dir(struct pa_policy_reload *, const char *);
+static bool is_config_file(const char *);
+static void inotify_cb(pa_mainloop_api *, pa_io_event *, int,
+                       pa_io_event_flags_t, void *);
+static void reload_cb(pa_mainloop_api *, pa_time_event *,
+                      const struct timeval *, void *);
+static void reload_config(struct userdata *);
+
+
+struct pa_policy_reload *pa_policy_reload_new(struct userdata *u)
+{
+    struct pa_policy_reload *reload;
+    const char              *cfgfile;
+    const char              *cfgdir;
+    char                    *dir;
+    int                      nwatch;
+
+    pa_assert(u);
+    pa_assert(u->core);
+    pa_assert(u->config);
+
+    reload = pa_xnew0(struct pa_policy_reload, 1);
+    reload->userdata = u;
+
+    if ((reload->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        pa_log("can't watch policy config files: %s", strerror(errno));
+        pa_xfree(reload);
+        return NULL;
+    }
+
+    pa_policy_config_get_paths(u->config, &cfgfile, &cfgdir);
+
+    nwatch = 0;
+
+    if (cfgfile) {
+        dir = pa_parent_dir(cfgfile);
+        nwatch += watch_dir(reload, dir);
+        pa_xfree(dir);
+    }
+
+    nwatch += watch_dir(reload, cfgdir);
+
+    if (!nwatch) {
+        pa_policy_reload_free(reload);
+        return NULL;
+    }
+
+    reload->io = u->core->mainloop->io_new(u->core->mainloop, reload->fd,
+                                           PA_IO_EVENT_INPUT, inotify_cb,
+                                           reload);
+
+    return reload;
+}
+
+void pa_policy_reload_free(struct pa_policy_reload *reload)
+{
+    pa_mainloop_api *api;
+
+    if (reload) {
+        api = reload->userdata->core->mainloop;
+
+        if (reload->timer)
+            api->time_free(reload->timer);
+
+        if (reload->io)
+            api->io_free(reload->io);
+
+        if (reload->fd >= 0)
+            close(reload->fd);
+
+        pa_xfree(reload);
+    }
+}
+
+
+static int watch_dir(struct pa_policy_reload *reload, const char *dir)
+{
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+
+    if (!dir)
+        return 0;
+
+    if (inotify_add_watch(reload->fd, dir, mask) < 0) {
+        pa_log_info("can't watch policy config directory '%s': %s",
+                    dir, strerror(errno));
+        return 0;
+    }
+
+    pa_log_info("watching policy config directory '%s'", dir);
+
+    return 1;
+}
+
+static bool is_config_file(const char *name)
+{
+    return pa_endswith(name, ".conf") || pa_endswith(name, ".conf.override");
+}
+
+static void inotify_cb(pa_mainloop_api *api, pa_io_event *e, int fd,
+                       pa_io_event_flags_t events, void *userdata)
+{
+    struct pa_policy_reload    *reload = userdata;
+    const struct inotify_event *ev;
+    char                        buf[4096]
+                                __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t                     len;
+    char                       *p;
+    bool                        changed = false;
+
+    pa_assert(reload);
+    pa_assert(reload->io == e);
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (p = buf;  p < buf + len;  p += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event *)p;
+
+            if (ev->len > 0 && is_config_file(ev->name))
+                changed = true;
+        }
+    }
+
+    if (len < 0 && errno != EAGAIN && errno != EINTR) {
+        pa_log("policy config watch failed: %s", strerror(errno));
+        api->io_free(reload->io);
+        reload->io = NULL;
+        return;
+    }
+
+    if (changed) {
+        if (reload->timer)
+            pa_core_rttime_restart(reload->userdata->core, reload->timer,
+                                   pa_rtclock_now() + RELOAD_DELAY_USEC);
+        else
+            reload->timer = pa_core_rttime_new(reload->userdata->core,
+                                               pa_rtclock_now() + RELOAD_DELAY_USEC,
+                                               reload_cb, reload);
+    }
+}
+
+static void reload_cb(pa_mainloop_api *api, pa_time_event *e,
+                      const struct timeval *t, void *userdata)
+{
+    struct pa_policy_reload *reload = userdata;
+
+    pa_assert(reload);
+    pa_assert(reload->timer == e);
+
+    api->time_free(reload->timer);
+    reload->timer = NULL;
+
+    reload_config(reload->userdata);
+}
+
+static void reload_config(struct userdata *u)
+{
+    static const struct {
+        uint32_t    flag;
+        const char *name;
+    } need_module_reload[] = {
+        { PA_POLICY_CONFIG_VARIABLE, "variable" },
+        { PA_POLICY_CONFIG_GROUP,    "group"    },
+        { PA_POLICY_CONFIG_CONTEXT,  "context-rule" },
+        { PA_POLICY_CONFIG_ACTIVITY, "activity" },
+    };
+
+    struct pa_classify_stream_diff *streams = NULL;
+    pa_hashmap *devstates = NULL;
+    pa_usec_t   start;
+    uint32_t    changed;
+    uint32_t    live;
+    unsigned    i;
+    int         nread;
+    bool        reject = false;
+
+    start = pa_rtclock_now();
+
+    if ((nread = pa_policy_config_scan(u, &changed)) < 0) {
+        pa_log("policy config reload failed");
+        return;
+    }
+
+    for (i = 0;  i < PA_ELEMENTSOF(need_module_reload);  i++) {
+        if (changed & need_module_reload[i].flag) {
+            pa_log_warn("[%s] sections changed; they can't be applied live",
+                        need_module_reload[i].name);
+            reject = true;
+        }
+    }
+
+    /* Applying only a part of the new config would leave the module with
+     * one that is neither the old nor the new one. The snapshot is kept
+     * as it was, so the next reload sees the same changes again. */
+    if (reject) {
+        pa_policy_config_discard(u->config);
+        pa_log_warn("policy config not reloaded; reload the module to apply it");
+        return;
+    }
+
+    pa_policy_config_commit(u->config);
+
+    live = changed & (PA_POLICY_CONFIG_STREAM | PA_POLICY_CONFIG_DEVICE |
+                      PA_POLICY_CONFIG_CARD);
+
+    if (!live) {
+        pa_log_debug("no live policy config changes (%d file(s) read)", nread);
+        return;
+    }
+
+    /* remember the old outcome of the device classification; the old
+     * stream definitions are kept to be compared with the new ones */
+    if (live & (PA_POLICY_CONFIG_DEVICE | PA_POLICY_CONFIG_CARD))
+        devstates = pa_policy_device_state_save(u);
+
+    if (live & PA_POLICY_CONFIG_STREAM)
+        streams = pa_classify_reset_streams(u);
+    if (live & PA_POLICY_CONFIG_DEVICE)
+        pa_classify_reset_devices(u);
+    if (live & PA_POLICY_CONFIG_CARD)
+        pa_classify_reset_cards(u);
+
+    /* the plans point to the definitions that are gone now */
+    pa_policy_route_plans_invalidate(u);
+
+    if (!pa_policy_config_apply(u, live))
+        pa_log("policy config reloaded with errors");
+
+    if (streams) {
+        pa_sink_input_ext_reclassify(u, streams);
+        pa_classify_stream_diff_free(streams);
+    }
+
+    if (devstates) {
+        pa_policy_send_device_state_changes(u, devstates);
+        pa_hashmap_free(devstates);
+    }
+
+    if (live & PA_POLICY_CONFIG_DEVICE)
+        pa_classify_preload_modules(u);
+
+    pa_log_info("policy config reloaded in %llu usec (%d file(s) read)",
+                (unsigned long long)(pa_rtclock_now() - start), nread);
+
+    pa_policy_arena_log_usage();
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,26 @@
+#ifndef fooreloadfoo
+#define fooreloadfoo
+
+#include "userdata.h"
+
+/*
+ * Watches the policy config files and applies the changes of the stream,
+ * device and card definitions to the running module. A change of any
+ * other section can't be applied in place and rejects the whole reload;
+ * such changes take effect when the module is reloaded.
+ */
+
+struct pa_policy_reload;
+
+struct pa_policy_reload *pa_policy_reload_new(struct userdata *);
+void pa_policy_reload_free(struct pa_policy_reload *);
+
+#endif /* fooreloadfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
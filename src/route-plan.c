@@ -0,0 +1,618 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/source.h>
+#include <pulsecore/card.h>
+
+#include "route-plan.h"
+#include "classify.h"
+
+struct match_props {
+    uint32_t         index;           /* to detect reuse of the address */
+    char            *values;          /* see pa_classify_match_props() */
+};
+
+struct pa_policy_route_plans {
+    struct userdata *userdata;
+    pa_hashmap      *plans;           /* device type -> pa_route_plan */
+    pa_hashmap      *props;           /* device or card -> match_props */
+    pa_hook_slot    *sink_proplist;
+    pa_hook_slot    *source_proplist;
+    pa_hook_slot    *card_proplist;
+    pa_hook_slot    *card_profile;
+};
+
+static struct pa_route_plan *plan_new(struct userdata *, const char *);
+static void plan_free(void *);
+
+static void plan_add_card(struct userdata *, struct pa_route_plan *,
+                          struct pa_card *);
+static void plan_add_sink(struct userdata *, struct pa_route_plan *,
+                          struct pa_sink *);
+static void plan_remove_sink(struct userdata *, struct pa_route_plan *,
+                             struct pa_sink *);
+static void plan_add_source(struct userdata *, struct pa_route_plan *,
+                            struct pa_source *);
+static void plan_remove_source(struct userdata *, struct pa_route_plan *,
+                               struct pa_source *);
+
+static void port_list_insert(struct pa_route_plan_port **, uint32_t, void *,
+                             struct pa_classify_device_data *, const char *);
+static bool port_list_remove(struct pa_route_plan_port **, void *);
+
+static bool props_changed(struct userdata *, enum pa_policy_object_type,
+                          void *, uint32_t, pa_proplist *);
+static void props_free(void *);
+
+static pa_hook_result_t sink_proplist_changed(void *, void *, void *);
+static pa_hook_result_t source_proplist_changed(void *, void *, void *);
+static pa_hook_result_t card_proplist_changed(void *, void *, void *);
+static pa_hook_result_t card_profile_changed(void *, void *, void *);
+static void replan_sink(struct userdata *, struct pa_sink *);
+static void replan_source(struct userdata *, struct pa_source *);
+
+
+struct pa_policy_route_plans *pa_policy_route_plans_new(struct userdata *u)
+{
+    struct pa_policy_route_plans *rp;
+    pa_hook *hooks;
+
+    pa_assert(u);
+    pa_assert(u->core);
+
+    hooks = u->core->hooks;
+
+    rp = pa_xnew0(struct pa_policy_route_plans, 1);
+    rp->userdata = u;
+    rp->plans    = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                       pa_idxset_string_compare_func,
+                                       NULL, plan_free);
+    rp->props    = pa_hashmap_new_full(pa_idxset_trivial_hash_func,
+                                       pa_idxset_trivial_compare_func,
+                                       NULL, props_free);
+
+    /* definitions may match on properties */
+    rp->sink_proplist   = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_PROPLIST_CHANGED,
+                                          PA_HOOK_LATE, sink_proplist_changed, u);
+    rp->source_proplist = pa_hook_connect(hooks + PA_CORE_HOOK_SOURCE_PROPLIST_CHANGED,
+                                          PA_HOOK_LATE, source_proplist_changed, u);
+    rp->card_proplist   = pa_hook_connect(hooks + PA_CORE_HOOK_CARD_PROPLIST_CHANGED,
+                                          PA_HOOK_LATE, card_proplist_changed, u);
+
+    /* the sinks and sources of a card come and go with its profile */
+    rp->card_profile    = pa_hook_connect(hooks + PA_CORE_HOOK_CARD_PROFILE_CHANGED,
+                                          PA_HOOK_LATE, card_profile_changed, u);
+
+    return rp;
+}
+
+void pa_policy_route_plans_free(struct pa_policy_route_plans *rp)
+{
+    if (rp) {
+        pa_hook_slot_free(rp->sink_proplist);
+        pa_hook_slot_free(rp->source_proplist);
+        pa_hook_slot_free(rp->card_proplist);
+        pa_hook_slot_free(rp->card_profile);
+        pa_hashmap_free(rp->plans);
+        pa_hashmap_free(rp->props);
+        pa_xfree(rp);
+    }
+}
+
+void pa_policy_route_plans_invalidate(struct userdata *u)
+{
+    pa_assert(u);
+    pa_assert(u->plans);
+
+    pa_hashmap_remove_all(u->plans->plans);
+
+    /* the definitions may match on other properties now */
+    pa_hashmap_remove_all(u->plans->props);
+}
+
+struct pa_route_plan *pa_policy_route_plan_get(struct userdata *u,
+                                               const char *type)
+{
+    struct pa_route_plan *plan;
+
+    pa_assert(u);
+    pa_assert(u->plans);
+    pa_assert(type);
+
+    if (!(plan = pa_hashmap_get(u->plans->plans, type))) {
+        /* don't let arbitrary types from policy messages pile up */
+        if (!pa_classify_has_type(u, type))
+            return NULL;
+
+        plan = plan_new(u, type);
+        pa_hashmap_put(u->plans->plans, plan->type, plan);
+    }
+
+    return plan;
+}
+
+uint32_t pa_policy_route_plan_copy_ports(struct pa_route_plan_port *ports,
+                                         struct pa_route_plan_step **ret_steps)
+{
+    struct pa_route_plan_port *port;
+    struct pa_route_plan_step *steps;
+    uint32_t                   n = 0;
+
+    pa_assert(ret_steps);
+
+    PA_LLIST_FOREACH(port, ports)
+        n++;
+
+    steps = n ? pa_xnew(struct pa_route_plan_step, n) : NULL;
+    n = 0;
+
+    PA_LLIST_FOREACH(port, ports) {
+        steps[n].index     = port->index;
+        steps[n].data      = port->data;
+        steps[n].port_name = port->port_name;
+        n++;
+    }
+
+    *ret_steps = steps;
+
+    return n;
+}
+
+void pa_policy_route_plan_add_card(struct userdata *u, struct pa_card *card)
+{
+    struct pa_route_plan *plan;
+    void *state;
+
+    pa_assert(u);
+    pa_assert(u->plans);
+    pa_assert(card);
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state)
+        plan_add_card(u, plan, card);
+
+    props_changed(u, pa_policy_object_card, card, card->index, card->proplist);
+}
+
+void pa_policy_route_plan_remove_card(struct userdata *u, struct pa_card *card)
+{
+    struct pa_route_plan *plan;
+    struct pa_card *c;
+    void *state;
+    uint32_t idx;
+    int i;
+    bool rescan;
+
+    pa_assert(u);
+    pa_assert(u->plans);
+    pa_assert(card);
+
+    pa_hashmap_remove_and_free(u->plans->props, card);
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state) {
+        rescan = false;
+
+        for (i = 0;  i < PA_POLICY_CARD_MAX_DEFS;  i++) {
+            if (plan->cards[i] == card) {
+                plan->cards[i] = NULL;
+                plan->card_data[i] = NULL;
+                rescan = true;
+            }
+        }
+
+        if (rescan) {
+            PA_IDXSET_FOREACH(c, u->core->cards, idx) {
+                if (c != card)
+                    plan_add_card(u, plan, c);
+            }
+        }
+    }
+}
+
+void pa_policy_route_plan_add_sink(struct userdata *u, struct pa_sink *sink)
+{
+    struct pa_route_plan *plan;
+    void *state;
+
+    pa_assert(u);
+    pa_assert(u->plans);
+    pa_assert(sink);
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state)
+        plan_add_sink(u, plan, sink);
+
+    props_changed(u, pa_policy_object_sink, sink, sink->index, sink->proplist);
+}
+
+void pa_policy_route_plan_remove_sink(struct userdata *u, struct pa_sink *sink)
+{
+    struct pa_route_plan *plan;
+    void *state;
+
+    pa_assert(u);
+    pa_assert(u->plans);
+    pa_assert(sink);
+
+    pa_hashmap_remove_and_free(u->plans->props, sink);
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state)
+        plan_remove_sink(u, plan, sink);
+}
+
+void pa_policy_route_plan_add_source(struct userdata *u,
+                                     struct pa_source *source)
+{
+    struct pa_route_plan *plan;
+    void *state;
+
+    pa_assert(u);
+    pa_assert(u->plans);
+    pa_assert(source);
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state)
+        plan_add_source(u, plan, source);
+
+    props_changed(u, pa_policy_object_source, source, source->index,
+                  source->proplist);
+}
+
+void pa_policy_route_plan_remove_source(struct userdata *u,
+                                        struct pa_source *source)
+{
+    struct pa_route_plan *plan;
+    void *state;
+
+    pa_assert(u);
+    pa_assert(u->plans);
+    pa_assert(source);
+
+    pa_hashmap_remove_and_free(u->plans->props, source);
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state)
+        plan_remove_source(u, plan, source);
+}
+
+
+static struct pa_route_plan *plan_new(struct userdata *u, const char *type)
+{
+    struct pa_route_plan *plan;
+    struct pa_card       *card;
+    struct pa_sink       *sink;
+    struct pa_source     *source;
+    uint32_t              idx;
+
+    plan = pa_xnew0(struct pa_route_plan, 1);
+    plan->type = pa_xstrdup(type);
+    PA_LLIST_HEAD_INIT(struct pa_route_plan_port, plan->sink_ports);
+    PA_LLIST_HEAD_INIT(struct pa_route_plan_port, plan->source_ports);
+
+    PA_IDXSET_FOREACH(card, u->core->cards, idx)
+        plan_add_card(u, plan, card);
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx)
+        plan_add_sink(u, plan, sink);
+
+    PA_IDXSET_FOREACH(source, u->core->sources, idx)
+        plan_add_source(u, plan, source);
+
+    pa_log_debug("route plan for '%s' built (card:%s/%s sink:%s source:%s)", type,
+                 plan->cards[0] ? plan->cards[0]->name : "-",
+                 plan->cards[1] ? plan->cards[1]->name : "-",
+                 plan->sink ? plan->sink->name : "-",
+                 plan->source ? plan->source->name : "-");
+
+    return plan;
+}
+
+static void plan_free(void *data)
+{
+    struct pa_route_plan *plan = data;
+    struct pa_route_plan_port *port;
+
+    if (plan) {
+        while ((port = plan->sink_ports)) {
+            PA_LLIST_REMOVE(struct pa_route_plan_port, plan->sink_ports, port);
+            pa_xfree(port);
+        }
+
+        while ((port = plan->source_ports)) {
+            PA_LLIST_REMOVE(struct pa_route_plan_port, plan->source_ports, port);
+            pa_xfree(port);
+        }
+
+        pa_xfree(plan->type);
+        pa_xfree(plan);
+    }
+}
+
+static void plan_add_card(struct userdata *u, struct pa_route_plan *plan,
+                          struct pa_card *card)
+{
+    struct pa_classify_card_data *data;
+    int priority;
+
+    /* Like a full scan of the cards, the last matching card wins. */
+    if (pa_classify_is_card_typeof(u, card, plan->type, &data, &priority)) {
+        pa_assert(priority >= 0 && priority < PA_POLICY_CARD_MAX_DEFS);
+
+        if (!plan->cards[priority] || plan->cards[priority]->index <= card->index) {
+            plan->cards[priority] = card;
+            plan->card_data[priority] = data;
+        }
+    }
+}
+
+static void plan_add_sink(struct userdata *u, struct pa_route_plan *plan,
+                          struct pa_sink *sink)
+{
+    struct pa_classify_device_data *data;
+    struct pa_classify_port_entry  *entry;
+
+    /* not yet or no longer usable as a target */
+    if (!PA_SINK_IS_LINKED(sink->state))
+        return;
+
+    if (pa_classify_is_sink_typeof(u, sink, plan->type, NULL)) {
+        if (!plan->sink || sink->index < plan->sink->index)
+            plan->sink = sink;
+    }
+
+    if (pa_classify_is_port_sink_typeof(u, sink, plan->type, &data)) {
+        pa_assert_se((entry = pa_classify_get_port_entry(u, data, pa_policy_object_sink, sink)));
+        port_list_insert(&plan->sink_ports, sink->index, sink, data, entry->port_name);
+    }
+}
+
+static void plan_remove_sink(struct userdata *u, struct pa_route_plan *plan,
+                             struct pa_sink *sink)
+{
+    struct pa_sink *s;
+    uint32_t idx;
+
+    port_list_remove(&plan->sink_ports, sink);
+
+    if (plan->sink == sink) {
+        plan->sink = NULL;
+
+        /* called at SINK_UNLINK_POST, when the sink has left the core's
+         * idxset already, and when its type changes, when it has not */
+        PA_IDXSET_FOREACH(s, u->core->sinks, idx) {
+            if (s != sink && PA_SINK_IS_LINKED(s->state) &&
+                pa_classify_is_sink_typeof(u, s, plan->type, NULL)) {
+                plan->sink = s;
+                break;
+            }
+        }
+    }
+}
+
+static void plan_add_source(struct userdata *u, struct pa_route_plan *plan,
+                            struct pa_source *source)
+{
+    struct pa_classify_device_data *data;
+    struct pa_classify_port_entry  *entry;
+
+    if (!PA_SOURCE_IS_LINKED(source->state))
+        return;
+
+    if (pa_classify_is_source_typeof(u, source, plan->type, NULL)) {
+        if (!plan->source || source->index < plan->source->index)
+            plan->source = source;
+    }
+
+    if (pa_classify_is_port_source_typeof(u, source, plan->type, &data)) {
+        pa_assert_se((entry = pa_classify_get_port_entry(u, data, pa_policy_object_source, source)));
+        port_list_insert(&plan->source_ports, source->index, source, data, entry->port_name);
+    }
+}
+
+static void plan_remove_source(struct userdata *u, struct pa_route_plan *plan,
+                               struct pa_source *source)
+{
+    struct pa_source *s;
+    uint32_t idx;
+
+    port_list_remove(&plan->source_ports, source);
+
+    if (plan->source == source) {
+        plan->source = NULL;
+
+        /* called at SOURCE_UNLINK, before the source leaves the core's
+         * idxset, and when its type changes, so skip it explicitly */
+        PA_IDXSET_FOREACH(s, u->core->sources, idx) {
+            if (s != source && PA_SOURCE_IS_LINKED(s->state) &&
+                pa_classify_is_source_typeof(u, s, plan->type, NULL)) {
+                plan->source = s;
+                break;
+            }
+        }
+    }
+}
+
+static void port_list_insert(struct pa_route_plan_port **list, uint32_t index,
+                             void *device, struct pa_classify_device_data *data,
+                             const char *port_name)
+{
+    struct pa_route_plan_port *port;
+    struct pa_route_plan_port *after = NULL;
+
+    /* keep the list in index order, i.e. in the order of a full scan */
+    for (port = *list;  port;  port = port->next) {
+        if (port->device == device) {
+            port->data = data;
+            port->port_name = port_name;
+            return;
+        }
+
+        if (port->index < index)
+            after = port;
+    }
+
+    port = pa_xnew0(struct pa_route_plan_port, 1);
+    PA_LLIST_INIT(struct pa_route_plan_port, port);
+    port->index     = index;
+    port->device    = device;
+    port->data      = data;
+    port->port_name = port_name;
+
+    if (after)
+        PA_LLIST_INSERT_AFTER(struct pa_route_plan_port, *list, after, port);
+    else
+        PA_LLIST_PREPEND(struct pa_route_plan_port, *list, port);
+}
+
+static bool port_list_remove(struct pa_route_plan_port **list, void *device)
+{
+    struct pa_route_plan_port *port;
+
+    for (port = *list;  port;  port = port->next) {
+        if (port->device == device) {
+            PA_LLIST_REMOVE(struct pa_route_plan_port, *list, port);
+            pa_xfree(port);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Remembers the values of the properties that matter for classification
+ * and tells whether they differ from the remembered ones. Proplists also
+ * change for reasons of no interest here, e.g. the mode and hwid written
+ * on every route switch, and those need no replanning.
+ */
+static bool props_changed(struct userdata *u, enum pa_policy_object_type type,
+                          void *object, uint32_t index, pa_proplist *proplist)
+{
+    struct match_props *mp;
+    char               *values;
+
+    values = pa_classify_match_props(u, type, proplist);
+
+    if ((mp = pa_hashmap_get(u->plans->props, object)) && mp->index == index) {
+        if (pa_streq(mp->values, values)) {
+            pa_xfree(values);
+            return false;
+        }
+
+        pa_xfree(mp->values);
+    }
+    else {
+        if (mp)
+            pa_hashmap_remove_and_free(u->plans->props, object);
+
+        mp = pa_xnew0(struct match_props, 1);
+        mp->index = index;
+        pa_hashmap_put(u->plans->props, object, mp);
+    }
+
+    mp->values = values;
+
+    return true;
+}
+
+static void props_free(void *data)
+{
+    struct match_props *mp = data;
+
+    if (mp) {
+        pa_xfree(mp->values);
+        pa_xfree(mp);
+    }
+}
+
+static void replan_sink(struct userdata *u, struct pa_sink *sink)
+{
+    struct pa_route_plan *plan;
+    void *state;
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state) {
+        plan_remove_sink(u, plan, sink);
+        plan_add_sink(u, plan, sink);
+    }
+}
+
+static void replan_source(struct userdata *u, struct pa_source *source)
+{
+    struct pa_route_plan *plan;
+    void *state;
+
+    PA_HASHMAP_FOREACH(plan, u->plans->plans, state) {
+        plan_remove_source(u, plan, source);
+        plan_add_source(u, plan, source);
+    }
+}
+
+static pa_hook_result_t sink_proplist_changed(void *hook_data, void *call_data,
+                                              void *slot_data)
+{
+    struct pa_sink  *sink = (struct pa_sink *)call_data;
+    struct userdata *u    = (struct userdata *)slot_data;
+
+    if (props_changed(u, pa_policy_object_sink, sink, sink->index, sink->proplist))
+        replan_sink(u, sink);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_proplist_changed(void *hook_data, void *call_data,
+                                                void *slot_data)
+{
+    struct pa_source *source = (struct pa_source *)call_data;
+    struct userdata  *u      = (struct userdata *)slot_data;
+
+    if (props_changed(u, pa_policy_object_source, source, source->index,
+                      source->proplist))
+        replan_source(u, source);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t card_proplist_changed(void *hook_data, void *call_data,
+                                              void *slot_data)
+{
+    struct pa_card  *card = (struct pa_card *)call_data;
+    struct userdata *u    = (struct userdata *)slot_data;
+
+    if (props_changed(u, pa_policy_object_card, card, card->index, card->proplist)) {
+        pa_policy_route_plan_remove_card(u, card);
+        pa_policy_route_plan_add_card(u, card);
+    }
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t card_profile_changed(void *hook_data, void *call_data,
+                                             void *slot_data)
+{
+    struct pa_card   *card = (struct pa_card *)call_data;
+    struct userdata  *u    = (struct userdata *)slot_data;
+    struct pa_sink   *sink;
+    struct pa_source *source;
+    uint32_t          idx;
+
+    /* new sinks and sources are planned when they are put, the ones that
+     * stay may have got other ports */
+    PA_IDXSET_FOREACH(sink, card->sinks, idx)
+        replan_sink(u, sink);
+
+    PA_IDXSET_FOREACH(source, card->sources, idx)
+        replan_source(u, source);
+
+    return PA_HOOK_OK;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
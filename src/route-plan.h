@@ -0,0 +1,73 @@
+#ifndef fooroutplanfoo
+#define fooroutplanfoo
+
+#include <pulsecore/llist.h>
+
+#include "userdata.h"
+#include "classify.h"
+
+/*
+ * Route plans cache the outcome of device classification per device
+ * type: which cards get which profile, which sinks and sources get which
+ * port and which sink/source streams are moved to. Plans are built on
+ * first use and kept up to date as cards, sinks and sources come and go,
+ * so that executing an audio_route decision needs no classification.
+ * Plans exist only for the types of the device and card definitions;
+ * pa_policy_route_plan_get() returns NULL for any other type.
+ */
+
+struct pa_card;
+struct pa_sink;
+struct pa_source;
+
+struct pa_route_plan_port {
+    PA_LLIST_FIELDS(struct pa_route_plan_port);
+    uint32_t                        index;     /* sink or source index */
+    void                           *device;    /* pa_sink or pa_source */
+    struct pa_classify_device_data *data;      /* device definition data */
+    const char                     *port_name; /* owned by classify */
+};
+
+/* A port list entry copied out of the plan. Setting ports and loading
+ * modules may add and remove devices, and with them entries of the plan,
+ * so the lists are walked over copies. */
+struct pa_route_plan_step {
+    uint32_t                        index;     /* sink or source index */
+    struct pa_classify_device_data *data;
+    const char                     *port_name;
+};
+
+struct pa_route_plan {
+    char                          *type;
+    struct pa_card                *cards[PA_POLICY_CARD_MAX_DEFS];
+    struct pa_classify_card_data  *card_data[PA_POLICY_CARD_MAX_DEFS];
+    struct pa_sink                *sink;      /* first sink of this type */
+    struct pa_source              *source;    /* first source of this type */
+    PA_LLIST_HEAD(struct pa_route_plan_port, sink_ports);
+    PA_LLIST_HEAD(struct pa_route_plan_port, source_ports);
+};
+
+struct pa_policy_route_plans *pa_policy_route_plans_new(struct userdata *);
+void pa_policy_route_plans_free(struct pa_policy_route_plans *);
+void pa_policy_route_plans_invalidate(struct userdata *);
+
+struct pa_route_plan *pa_policy_route_plan_get(struct userdata *, const char *);
+uint32_t pa_policy_route_plan_copy_ports(struct pa_route_plan_port *,
+                                         struct pa_route_plan_step **);
+
+void pa_policy_route_plan_add_card(struct userdata *, struct pa_card *);
+void pa_policy_route_plan_remove_card(struct userdata *, struct pa_card *);
+void pa_policy_route_plan_add_sink(struct userdata *, struct pa_sink *);
+void pa_policy_route_plan_remove_sink(struct userdata *, struct pa_sink *);
+void pa_policy_route_plan_add_source(struct userdata *, struct pa_source *);
+void pa_policy_route_plan_remove_source(struct userdata *, struct pa_source *);
+
+#endif /* fooroutplanfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
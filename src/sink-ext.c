@@ -12,6 +12,7 @@
 #include <pulse/timeval.h>
 
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/namereg.h>
 
@@ -22,20 +23,28 @@
 #include "policy-group.h"
 #include "dbusif.h"
 #include "policy.h"
+#include "module-pool.h"
+#include "route-plan.h"
+#include "trace.h"
 #include "log.h"
+#include "stats.h"
+#include "probes.h"
 
 struct delayed_port_change {
-    struct userdata *userdata;
-    char *sink_name;
+    char *sink_name;            /* key in pa_sink_ext_data.changes */
     char *port_name;
     bool refresh;
-    pa_time_event *event;
-    PA_LLIST_FIELDS(struct delayed_port_change);
+    pa_usec_t deadline;
+    unsigned heap_idx;          /* position in pa_sink_ext_data.heap */
 };
 
 struct pa_sink_ext_data {
     struct userdata *userdata;
-    PA_LLIST_HEAD(struct delayed_port_change, change_list);
+    struct delayed_port_change **heap;  /* min-heap ordered by deadline */
+    unsigned nheap;
+    unsigned aheap;
+    pa_hashmap *changes;        /* sink name -> delayed_port_change */
+    pa_time_event *timer;       /* fires at the earliest deadline */
     int32_t pending;
     pa_sink_ext_pending_cb pending_cb;
 };
@@ -46,29 +55,37 @@ static pa_hook_result_t sink_unlink(void *, void *, void *);
 
 static void handle_new_sink(struct userdata *, struct pa_sink *);
 static void handle_removed_sink(struct userdata *, struct pa_sink *);
+static bool sink_hidden(struct userdata *, struct pa_sink *);
 
 static void delayed_port_change_free(struct delayed_port_change *c);
 
-struct pa_sink_ext_data *pa_sink_ext_new()
+struct pa_sink_ext_data *pa_sink_ext_new(struct userdata *u)
 {
     struct pa_sink_ext_data *ext;
 
+    pa_assert(u);
+
     ext = pa_xnew0 (struct pa_sink_ext_data, 1);
-    PA_LLIST_HEAD_INIT(struct delayed_port_change, ext->change_list);
+    ext->userdata = u;
+    ext->changes = pa_hashmap_new(pa_idxset_string_hash_func,
+                                  pa_idxset_string_compare_func);
 
     return ext;
 }
 
 void pa_sink_ext_free(struct pa_sink_ext_data *ext)
 {
+    unsigned i;
+
     if (ext) {
-        struct delayed_port_change *change;
+        if (ext->timer)
+            ext->userdata->core->mainloop->time_free(ext->timer);
 
-        while (ext->change_list) {
-            change = ext->change_list;
-            PA_LLIST_REMOVE(struct delayed_port_change, ext->change_list, change);
-            delayed_port_change_free(change);
-        }
+        for (i = 0;  i < ext->nheap;  i++)
+            delayed_port_change_free(ext->heap[i]);
+
+        pa_hashmap_free(ext->changes);
+        pa_xfree(ext->heap);
         pa_xfree(ext);
     }
 }
@@ -166,13 +183,91 @@ const char *pa_sink_ext_get_name(struct pa_sink *sink)
 static int set_port(pa_sink *sink, const char *port, bool refresh);
 
 static void delayed_port_change_free(struct delayed_port_change *c) {
-    if (c->event)
-        c->userdata->core->mainloop->time_free(c->event);
     pa_xfree(c->sink_name);
     pa_xfree(c->port_name);
     pa_xfree(c);
 }
 
+static void heap_set(struct pa_sink_ext_data *ext, unsigned i,
+                     struct delayed_port_change *c)
+{
+    ext->heap[i] = c;
+    c->heap_idx = i;
+}
+
+static void heap_fix(struct pa_sink_ext_data *ext, unsigned i)
+{
+    struct delayed_port_change *c = ext->heap[i];
+    unsigned parent, child;
+
+    /* sift up */
+    while (i > 0) {
+        parent = (i - 1) / 2;
+
+        if (ext->heap[parent]->deadline <= c->deadline)
+            break;
+
+        heap_set(ext, i, ext->heap[parent]);
+        i = parent;
+    }
+
+    /* sift down */
+    while ((child = 2 * i + 1) < ext->nheap) {
+        if (child + 1 < ext->nheap &&
+            ext->heap[child + 1]->deadline < ext->heap[child]->deadline)
+            child++;
+
+        if (c->deadline <= ext->heap[child]->deadline)
+            break;
+
+        heap_set(ext, i, ext->heap[child]);
+        i = child;
+    }
+
+    heap_set(ext, i, c);
+}
+
+static void heap_insert(struct pa_sink_ext_data *ext,
+                        struct delayed_port_change *c)
+{
+    if (ext->nheap >= ext->aheap) {
+        ext->aheap = ext->aheap ? ext->aheap * 2 : 4;
+        ext->heap  = pa_xrenew(struct delayed_port_change *, ext->heap,
+                               ext->aheap);
+    }
+
+    heap_set(ext, ext->nheap++, c);
+    heap_fix(ext, c->heap_idx);
+}
+
+static void heap_remove(struct pa_sink_ext_data *ext,
+                        struct delayed_port_change *c)
+{
+    unsigned i = c->heap_idx;
+
+    pa_assert(i < ext->nheap && ext->heap[i] == c);
+
+    if (i != --ext->nheap) {
+        heap_set(ext, i, ext->heap[ext->nheap]);
+        heap_fix(ext, i);
+    }
+}
+
+static void delay_cb(pa_mainloop_api *, pa_time_event *, const struct timeval *, void *);
+
+static void timer_update(struct pa_sink_ext_data *ext)
+{
+    pa_core  *core = ext->userdata->core;
+    pa_usec_t deadline;
+
+    deadline = ext->nheap ? ext->heap[0]->deadline : PA_USEC_INVALID;
+
+    if (ext->timer)
+        pa_core_rttime_restart(core, ext->timer, deadline);
+    else if (deadline != PA_USEC_INVALID)
+        ext->timer = pa_core_rttime_new(core, deadline, delay_cb, ext);
+}
+
 static void sink_ext_pending(struct userdata *u, int32_t change)
 {
     u->sinkext->pending += change;
@@ -183,6 +278,15 @@ static void sink_ext_pending(struct userdata *u, int32_t change)
     }
 }
 
+static void drop_change(struct userdata *u, struct delayed_port_change *port_change)
+{
+    struct pa_sink_ext_data *ext = u->sinkext;
+
+    heap_remove(ext, port_change);
+    pa_hashmap_remove(ext->changes, port_change->sink_name);
+    delayed_port_change_free(port_change);
+}
+
 static void execute_change(struct userdata *u, struct delayed_port_change *port_change)
 {
     pa_sink *sink;
@@ -193,23 +297,50 @@ static void execute_change(struct userdata *u, struct delayed_port_change *port_
     if ((sink = pa_namereg_get(u->core, port_change->sink_name, PA_NAMEREG_SINK)))
         set_port(sink, port_change->port_name, port_change->refresh);
 
-    PA_LLIST_REMOVE(struct delayed_port_change, u->sinkext->change_list, port_change);
-    delayed_port_change_free(port_change);
+    pa_policy_stats_count(u, pa_policy_stat_port_executed);
+
+    drop_change(u, port_change);
     sink_ext_pending(u, -1);
 }
 
+static void cancel_change(struct userdata *u, const char *sink_name)
+{
+    struct delayed_port_change *port_change;
+
+    if ((port_change = pa_hashmap_get(u->sinkext->changes, sink_name))) {
+        pa_log_info("cancel delayed port change (%s:%s).",
+                    port_change->sink_name, port_change->port_name);
+
+        pa_policy_stats_count(u, pa_policy_stat_port_elided);
+
+        drop_change(u, port_change);
+        timer_update(u->sinkext);
+        sink_ext_pending(u, -1);
+    }
+}
+
 static void delay_cb(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata)
 {
-    struct delayed_port_change *port_change = userdata;
-    struct userdata *u = port_change->userdata;
+    struct pa_sink_ext_data *ext = userdata;
+    struct delayed_port_change *port_change;
+    struct userdata *u = ext->userdata;
+    pa_usec_t now;
 
     pa_assert(u);
-    pa_assert(port_change->event == e);
+    pa_assert(ext->timer == e);
 
-    pa_log_info("start delayed port change (%s:%s).",
-                port_change->sink_name, port_change->port_name);
+    now = pa_rtclock_now();
 
-    execute_change(u, port_change);
+    while (ext->nheap > 0 && ext->heap[0]->deadline <= now) {
+        port_change = ext->heap[0];
+
+        pa_log_info("start delayed port change (%s:%s).",
+                    port_change->sink_name, port_change->port_name);
+
+        execute_change(u, port_change);
+    }
+
+    timer_update(ext);
 }
 
 static int set_port(pa_sink *sink, const char *port, bool refresh) {
@@ -222,6 +353,8 @@ static int set_port(pa_sink *sink, const char *port, bool refresh) {
             sink->set_port(sink, sink->active_port);
         }
     } else {
+        PA_POLICY_PROBE3(sink_set_port, sink->index, sink->name, port);
+
         if (pa_sink_set_port(sink, port, false) < 0) {
             ret = -1;
             pa_log("failed to set sink '%s' port to '%s'",
@@ -236,48 +369,47 @@ static int set_port(pa_sink *sink, const char *port, bool refresh) {
     return ret;
 }
 
-static struct delayed_port_change *llist_append(struct delayed_port_change *list,
-                                                struct delayed_port_change *item)
-{
-    struct delayed_port_change *i;
-
-    if (list) {
-        for (i = list; i->next; i = i->next) {};
-        i->next = item;
-        item->prev = i;
-        item->next = NULL;
-    } else {
-        item->prev = item->next = NULL;
-        list = item;
-    }
-
-    return list;
-}
-
 static int set_port_add(struct userdata *u, pa_sink *sink, const char *port,
                         const struct pa_classify_device_data *device, bool refresh) {
+    struct pa_sink_ext_data *ext;
     struct delayed_port_change *change;
-    int ret = 0;
 
     pa_assert(u);
+    pa_assert_se((ext = u->sinkext));
     pa_assert(sink);
     pa_assert(port);
 
     if (device->flags & PA_POLICY_DELAYED_PORT_CHANGE && device->port_change_delay > 0) {
-        change = pa_xnew0(struct delayed_port_change, 1);
-        PA_LLIST_INIT(struct delayed_port_change, change);
-        u->sinkext->change_list = llist_append(u->sinkext->change_list, change);
-        change->userdata = u;
-        change->sink_name = pa_xstrdup(sink->name);
+        if ((change = pa_hashmap_get(ext->changes, sink->name))) {
+            /* the last change to the same sink wins */
+            pa_log_info("replace delayed port change (%s:%s) with (%s:%s)",
+                        change->sink_name, change->port_name, sink->name, port);
+            pa_xfree(change->port_name);
+            pa_policy_stats_count(u, pa_policy_stat_port_elided);
+        }
+        else {
+            change = pa_xnew0(struct delayed_port_change, 1);
+            change->sink_name = pa_xstrdup(sink->name);
+            heap_insert(ext, change);
+            pa_hashmap_put(ext->changes, change->sink_name, change);
+            sink_ext_pending(u, 1);
+        }
+
         change->port_name = pa_xstrdup(port);
         change->refresh = refresh;
-        change->event = pa_core_rttime_new(u->core, pa_rtclock_now() + device->port_change_delay, delay_cb, change);
+        change->deadline = pa_rtclock_now() + device->port_change_delay;
+        heap_fix(ext, change->heap_idx);
+        timer_update(ext);
+
+        pa_policy_stats_count(u, pa_policy_stat_port_queued);
         pa_log_info("queue delayed port change in %u us (%s:%s)", device->port_change_delay, sink->name, port);
-        sink_ext_pending(u, 1);
 
-        return ret;
+        return 0;
     }
 
+    /* an immediate change supersedes any delayed one */
+    cancel_change(u, sink->name);
+
     return set_port(sink, port, refresh);
 }
 
@@ -285,72 +417,90 @@ int pa_sink_ext_set_ports(struct userdata *u, const char *type)
 {
     int ret = 0;
     pa_sink *sink;
+    struct pa_route_plan *plan;
+    struct pa_route_plan_step *steps;
     struct pa_classify_device_data *data;
-    struct pa_classify_port_entry *port_entry;
-    char *port;
+    const char *port;
     struct pa_sink_ext *ext;
-    uint32_t idx;
+    uint32_t i, n;
 
     pa_assert(u);
     pa_assert(u->core);
 
     pa_classify_update_modules(u, PA_POLICY_MODULE_FOR_SINK, type);
 
-    PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
-        /* Check whether the port of this sink should be changed. */
-        if (pa_classify_is_port_sink_typeof(u, sink, type, &data)) {
+    /* The plan lists the sinks of which port should be changed. */
+    plan = pa_policy_route_plan_get(u, type);
+    n = pa_policy_route_plan_copy_ports(plan ? plan->sink_ports : NULL, &steps);
 
-            pa_assert_se(port_entry = pa_classify_get_port_entry(data,
-                                                                 pa_policy_object_sink,
-                                                                 sink));
-            pa_assert_se(port = port_entry->port_name);
+    /* modules first, as they may bring or take away sinks */
+    for (i = 0;  i < n;  i++)
+        pa_classify_update_module(u, PA_POLICY_MODULE_FOR_SINK, steps[i].data);
 
-            ext  = pa_sink_ext_lookup(u, sink);
-            if (!ext)
-                continue;
+    for (i = 0;  i < n;  i++) {
+        sink = pa_idxset_get_by_index(u->core->sinks, steps[i].index);
+        data = steps[i].data;
+        pa_assert_se(port = steps[i].port_name);
 
-            pa_classify_update_module(u, PA_POLICY_MODULE_FOR_SINK, data);
+        if (!sink || !PA_SINK_IS_LINKED(sink->state))
+            continue;
 
-            if (ext->overridden_port) {
-                pa_xfree(ext->overridden_port);
-                ext->overridden_port = pa_xstrdup(port);
-                continue;
-            }
+        ext  = pa_sink_ext_lookup(u, sink);
+        if (!ext)
+            continue;
 
-            if (!sink->active_port || !pa_streq(port,sink->active_port->name)){
-                if (!ext->overridden_port) {
-                    ret = set_port_add(u, sink, port, data, false);
-                }
-                continue;
-            }
+        if (ext->overridden_port) {
+            pa_xfree(ext->overridden_port);
+            ext->overridden_port = pa_xstrdup(port);
+            continue;
+        }
 
-            if ((data->flags & PA_POLICY_REFRESH_PORT_ALWAYS) && !ext->overridden_port) {
-                ret = set_port_add(u, sink, port, data, true);
-                continue;
+        if (!sink->active_port || !pa_streq(port,sink->active_port->name)){
+            if (!ext->overridden_port) {
+                ret = set_port_add(u, sink, port, data, false);
             }
+            continue;
         }
-    } /* for */
+
+        if ((data->flags & PA_POLICY_REFRESH_PORT_ALWAYS) && !ext->overridden_port) {
+            ret = set_port_add(u, sink, port, data, true);
+            continue;
+        }
+
+        /* the sink is already on the right port, so a change queued
+         * by an earlier route would only switch it away */
+        cancel_change(u, sink->name);
+    }
+
+    pa_xfree(steps);
 
     return ret;
 }
 
 void pa_sink_ext_pending_start(struct userdata *u)
 {
-    struct delayed_port_change *change;
-    void *tmp;
+    struct pa_sink_ext_data *ext;
 
-    if (u->sinkext->pending != 0) {
-        pa_log_info("execute and clear %d pending port change(s).", u->sinkext->pending);
-        /* execute all previously pending changes before starting */
-        PA_LLIST_FOREACH_SAFE(change, tmp, u->sinkext->change_list) {
+    pa_assert(u);
+    pa_assert_se((ext = u->sinkext));
+
+    /* execute all previously pending changes before starting, in the
+     * order of their deadlines; the last one reports the previous
+     * route done */
+    if (ext->pending != 0) {
+        pa_log_info("execute and clear %d pending port change(s).", ext->pending);
+
+        while (ext->nheap > 0) {
             pa_log_info("execute pending port change (%s:%s).",
-                        change->sink_name, change->port_name);
-            execute_change(u, change);
+                        ext->heap[0]->sink_name, ext->heap[0]->port_name);
+            execute_change(u, ext->heap[0]);
         }
+
+        timer_update(ext);
     }
 
-    pa_assert(u->sinkext->pending == 0);
-    pa_assert(u->sinkext->pending_cb == NULL);
+    pa_assert(ext->pending == 0);
+    pa_assert(ext->pending_cb == NULL);
 }
 
 void pa_sink_ext_pending_run(struct userdata *u, pa_sink_ext_pending_cb cb)
@@ -471,8 +621,11 @@ static pa_hook_result_t sink_put(void *hook_data, void *call_data,
 {
     struct pa_sink  *sink = (struct pa_sink *)call_data;
     struct userdata *u    = (struct userdata *)slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_new_sink(u, sink);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_sink_put, start);
 
     return PA_HOOK_OK;
 }
@@ -483,8 +636,11 @@ static pa_hook_result_t sink_unlink(void *hook_data, void *call_data,
 {
     struct pa_sink  *sink = (struct pa_sink *)call_data;
     struct userdata *u    = (struct userdata *)slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_removed_sink(u, sink);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_sink_unlink, start);
 
     return PA_HOOK_OK;
 }
@@ -500,11 +656,13 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
     struct pa_sink_ext  *ext;
     struct pa_classify_result *r;
 
-    if (sink && u) {
+    if (sink && u && !sink_hidden(u, sink)) {
         name = pa_sink_ext_get_name(sink);
         idx  = sink->index;
         ns   = u->nullsink;
 
+        pa_policy_trace_event(u, pa_policy_trace_sink_put, name);
+
         if (!strcmp(name, ns->name)) {
             ns->sink = sink;
             pa_log_debug("new sink '%s' (idx=%d) will be used to "
@@ -514,7 +672,7 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
         pa_policy_context_register(u, pa_policy_object_sink, name, sink);
         pa_policy_activity_register(u, pa_policy_object_sink, name, sink);
 
-        if (pa_policy_log_level_debug()) {
+        if (pa_policy_log_enabled(u, pa_policy_log_device)) {
             pa_classify_sink(u, sink, 0, 0, &r);
             buf = pa_policy_log_concat(r->types, r->count);
             ret = pa_proplist_sets(sink->proplist,
@@ -535,6 +693,7 @@ static void handle_new_sink(struct userdata *u, struct pa_sink *sink)
 
         pa_policy_groupset_update_default_sink(u, PA_IDXSET_INVALID);
         pa_policy_groupset_register_sink(u, sink);
+        pa_policy_route_plan_add_sink(u, sink);
 
         pa_classify_sink(u, sink, PA_POLICY_DISABLE_NOTIFY, 0, &r);
         pa_policy_send_device_state(u, PA_POLICY_CONNECTED, r);
@@ -551,11 +710,13 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
     struct pa_sink_ext  *ext;
     struct pa_classify_result *r;
 
-    if (sink && u) {
+    if (sink && u && !sink_hidden(u, sink)) {
         name = pa_sink_ext_get_name(sink);
         idx  = sink->index;
         ns   = u->nullsink;
 
+        pa_policy_trace_event(u, pa_policy_trace_sink_unlink, name);
+
         if (ns->sink == sink) {
             pa_log_debug("cease to use sink '%s' (idx=%u) to mute-by-route",
                          name, idx);
@@ -569,7 +730,7 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
         pa_policy_context_unregister(u, pa_policy_object_sink, name, sink,idx);
         pa_policy_activity_unregister(u, pa_policy_object_sink, name, sink,idx);
 
-        if (pa_policy_log_level_debug()) {
+        if (pa_policy_log_enabled(u, pa_policy_log_device)) {
             pa_classify_sink(u, sink, 0, 0, &r);
             buf = pa_policy_log_concat(r->types, r->count);
             pa_log_debug("remove sink '%s' (idx=%d%s%s)",
@@ -580,6 +741,10 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
 
         pa_policy_groupset_update_default_sink(u, idx);
         pa_policy_groupset_unregister_sink(u, idx);
+        pa_policy_route_plan_remove_sink(u, sink);
+
+        if (sink->name)
+            cancel_change(u, sink->name);
 
         if ((ext = pa_index_hash_remove(u->hsnk, idx)) == NULL)
             pa_log("no extension found for sink '%s' (idx=%u)",name, idx);
@@ -597,6 +762,23 @@ static void handle_removed_sink(struct userdata *u, struct pa_sink *sink)
 }
 
 
+/* A device of a module parked in the module pool is taken for gone. */
+void pa_sink_ext_hide(struct userdata *u, struct pa_sink *sink)
+{
+    handle_removed_sink(u, sink);
+}
+
+void pa_sink_ext_show(struct userdata *u, struct pa_sink *sink)
+{
+    handle_new_sink(u, sink);
+}
+
+static bool sink_hidden(struct userdata *u, struct pa_sink *sink)
+{
+    return u->modpool && pa_policy_module_pool_hides(u->modpool, sink);
+}
+
+
 /*
  * Local Variables:
  * c-basic-offset: 4
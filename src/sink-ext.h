@@ -1,6 +1,8 @@
 #ifndef foosinkextfoo
 #define foosinkextfoo
 
+#include <stdint.h>
+
 #include "userdata.h"
 
 struct pa_sink;
@@ -22,13 +24,15 @@ struct pa_sink_ext {
 
 typedef void (*pa_sink_ext_pending_cb)(struct userdata *u);
 
-struct pa_sink_ext_data *pa_sink_ext_new();
+struct pa_sink_ext_data *pa_sink_ext_new(struct userdata *);
 void pa_sink_ext_free(struct pa_sink_ext_data *ext);
 struct pa_null_sink *pa_sink_ext_init_null_sink(const char *);
 void pa_sink_ext_null_sink_free(struct pa_null_sink *);
 struct pa_sink_evsubscr *pa_sink_ext_subscription(struct userdata *);
 void  pa_sink_ext_subscription_free(struct pa_sink_evsubscr *);
 void  pa_sink_ext_discover(struct userdata *);
+void  pa_sink_ext_hide(struct userdata *, struct pa_sink *);
+void  pa_sink_ext_show(struct userdata *, struct pa_sink *);
 struct pa_sink_ext *pa_sink_ext_lookup(struct userdata *, struct pa_sink *);
 const char *pa_sink_ext_get_name(struct pa_sink *);
 int pa_sink_ext_set_ports(struct userdata *, const char *);
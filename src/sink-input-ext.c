@@ -21,14 +21,17 @@
 #include "sink-ext.h"
 #include "classify.h"
 #include "context.h"
+#include "stats.h"
 
 #define VOLUME_LIMIT_FACTOR_KEY "x-policy.volume.factor"
+#define MUTE_FACTOR_KEY         "x-policy.mute.factor"
 
 /* hooks */
 static pa_hook_result_t sink_input_neew(void *, void *, void *);
 static pa_hook_result_t sink_input_fixate(void *, void *, void *);
 static pa_hook_result_t sink_input_put(void *, void *, void *);
 static pa_hook_result_t sink_input_unlink(void *, void *, void *);
+static pa_hook_result_t sink_input_move_finish(void *, void *, void *);
 static pa_hook_result_t sink_input_state_changed(pa_core *c, pa_sink_input *si, struct userdata *u);
 #if (PULSEAUDIO_VERSION >= 6)
 static pa_hook_result_t sink_input_mute_changed(pa_core *c, pa_sink_input *si, struct userdata *u);
@@ -41,6 +44,8 @@ static void handle_new_sink_input(struct userdata *u, struct pa_sink_input *si,
 static void handle_sink_input_fixate(struct userdata *u, pa_sink_input_new_data *sinp_data);
 static void handle_removed_sink_input(struct userdata *,
                                       struct pa_sink_input *);
+static void reclassify_sink_input(struct userdata *, struct pa_sink_input *);
+static void mute_factor_apply(struct userdata *, struct pa_sink_input *, bool);
 static uint32_t update_state_flag(uint32_t flags, enum pa_sink_input_ext_state flag, bool set);
 
 struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
@@ -52,6 +57,7 @@ struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
     pa_hook_slot            *fixate;
     pa_hook_slot            *put;
     pa_hook_slot            *unlink;
+    pa_hook_slot            *move_finish;
 
     pa_assert(u);
     pa_assert_se((core = u->core));
@@ -67,7 +73,8 @@ struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
                              PA_HOOK_LATE, sink_input_put, (void *)u);
     unlink = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_INPUT_UNLINK,
                              PA_HOOK_LATE, sink_input_unlink, (void *)u);
-
+    move_finish = pa_hook_connect(hooks + PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH,
+                                  PA_HOOK_LATE, sink_input_move_finish, (void *)u);
 
     subscr = pa_xnew0(struct pa_sinp_evsubscr, 1);
     
@@ -75,6 +82,7 @@ struct pa_sinp_evsubscr *pa_sink_input_ext_subscription(struct userdata *u)
     subscr->fixate = fixate;
     subscr->put    = put;
     subscr->unlink = unlink;
+    subscr->move_finish = move_finish;
     /* cork and mute state hooks are dynamically set when corking or muting
      * is done for the first time. This way if corking or muting is never
      * used, we don't need to set up the state hooks. */
@@ -91,6 +99,7 @@ void  pa_sink_input_ext_subscription_free(struct pa_sinp_evsubscr *subscr)
         pa_hook_slot_free(subscr->fixate);
         pa_hook_slot_free(subscr->put);
         pa_hook_slot_free(subscr->unlink);
+        pa_hook_slot_free(subscr->move_finish);
         if (subscr->cork_state)
             pa_hook_slot_free(subscr->cork_state);
         if (subscr->mute_state)
@@ -119,11 +128,7 @@ void  pa_sink_input_ext_rediscover(struct userdata *u)
     void                 *state = NULL;
     pa_idxset            *idxset;
     struct pa_sink_input *sinp;
-    struct pa_sink_input_ext *ext;
-    uint32_t              old_corked_state;
-    uint32_t              old_muted_state;
     const char           *group_name;
-    const char           *clear[3] = { PA_PROP_POLICY_GROUP, PA_PROP_POLICY_STREAM_FLAGS, NULL };
 
     pa_assert(u);
     pa_assert(u->core);
@@ -137,16 +142,63 @@ void  pa_sink_input_ext_rediscover(struct userdata *u)
             continue;
 
         pa_log_debug("rediscover sink-input \"%s\"", pa_sink_input_ext_get_name(sinp));
-        pa_assert_se((ext = pa_sink_input_ext_lookup(u, sinp)));
-        old_corked_state = ext->local.cork_state;
-        old_muted_state = ext->local.mute_state;
-        /* First remove sink input and then re-classify. */
-        handle_removed_sink_input(u, sinp);
-        pa_proplist_unset_many(sinp->proplist, clear);
-        handle_new_sink_input(u, sinp, &old_corked_state, &old_muted_state);
+        reclassify_sink_input(u, sinp);
     }
 }
 
+void pa_sink_input_ext_reclassify(struct userdata *u,
+                                  struct pa_classify_stream_diff *diff)
+{
+    void                 *state = NULL;
+    pa_idxset            *idxset;
+    struct pa_sink_input *sinp;
+    pa_proplist          *proplist;
+    const char           *group_name;
+    const char           *old_group;
+    const char           *new_group;
+    const char           *clear[3] = { PA_PROP_POLICY_GROUP, PA_PROP_POLICY_STREAM_FLAGS, NULL };
+    bool                  changed;
+    unsigned              n = 0;
+
+    pa_assert(u);
+    pa_assert(u->core);
+    pa_assert(diff);
+    pa_assert_se((idxset = u->core->sink_inputs));
+
+    while ((sinp = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
+        if (!(group_name = pa_proplist_gets(sinp->proplist, PA_PROP_POLICY_GROUP)))
+            continue;
+
+        if (!pa_sink_input_ext_lookup(u, sinp))
+            continue;           /* not put yet */
+
+        /* classification merges the stream properties of the definition
+         * into the proplist, so work on a copy */
+        proplist = pa_proplist_copy(sinp->proplist);
+        pa_proplist_unset_many(proplist, clear);
+
+        changed = pa_classify_stream_diff_check(u, diff, sinp->client, proplist,
+                                                &old_group, &new_group);
+        pa_proplist_free(proplist);
+
+        /* Leave alone the streams that were put to their group by other
+         * means than the stream definitions, e.g. by a context rule. */
+        if (!changed || !old_group || !pa_streq(group_name, old_group))
+            continue;
+
+        /* The stream is re-classified also when its group stays, as the
+         * flags or the properties of its definition may have changed. The
+         * context rule objects are registered again on the way. */
+        pa_log_debug("reclassify sink-input \"%s\" (%s => %s)",
+                     pa_sink_input_ext_get_name(sinp), old_group,
+                     pa_strnull(new_group));
+        reclassify_sink_input(u, sinp);
+        n++;
+    }
+
+    pa_log_debug("%u sink-input(s) reclassified", n);
+}
+
 struct pa_sink_input_ext *pa_sink_input_ext_lookup(struct userdata      *u,
                                                    struct pa_sink_input *sinp)
 {
@@ -233,6 +285,8 @@ int pa_sink_input_ext_set_volume_limit(struct userdata *u,
     pa_assert(u);
     pa_assert(sinp);
 
+    pa_policy_stats_count(u, pa_policy_stat_volume_limit);
+
     retval = 0;
 
     if (limit == 0)
@@ -268,6 +322,57 @@ void  pa_sink_input_ext_unset_volume_limit(struct userdata *u, struct pa_sink_in
     sink_input_ext_unset_volume_limit(ext, si);
 }
 
+/* Mute by a zero volume factor. Unlike a move to the null sink this
+ * leaves the stream where it is, so there is no rewind, no resampler
+ * rebuild and no IO thread round-trip but the one of the soft volume.
+ * The soft volume of a moving stream can't be set, so its factor is
+ * set when the move finishes. */
+int pa_sink_input_ext_set_mute_factor(struct userdata *u,
+                                      struct pa_sink_input *sinp,
+                                      bool mute)
+{
+    struct pa_sink_input_ext *ext;
+
+    pa_assert(u);
+    pa_assert(sinp);
+
+    if (!(ext = pa_sink_input_ext_lookup(u, sinp)))
+        return -1;
+
+    if (ext->local.mute_factor == mute)
+        return 0;
+
+    ext->local.mute_factor = mute;
+
+    if (!sinp->sink) {
+        ext->local.mute_factor_moving = true;
+        return 0;
+    }
+
+    mute_factor_apply(u, sinp, mute);
+
+    return 0;
+}
+
+static void mute_factor_apply(struct userdata *u, struct pa_sink_input *sinp,
+                              bool mute)
+{
+    pa_cvolume volume;
+
+    /* the stream may have left it as it was before the move */
+    if (!!pa_hashmap_get(sinp->volume_factor_items, MUTE_FACTOR_KEY) == mute)
+        return;
+
+    pa_policy_stats_count(u, pa_policy_stat_mute);
+
+    if (mute) {
+        pa_cvolume_mute(&volume, sinp->sample_spec.channels);
+        pa_sink_input_add_volume_factor(sinp, MUTE_FACTOR_KEY, &volume);
+    }
+    else
+        pa_sink_input_remove_volume_factor(sinp, MUTE_FACTOR_KEY);
+}
+
 static pa_hook_result_t sink_input_neew(void *hook_data, void *call_data,
                                        void *slot_data)
 {
@@ -286,10 +391,13 @@ static pa_hook_result_t sink_input_neew(void *hook_data, void *call_data,
     int                     local_route;
     int                     local_volume;
     struct pa_policy_group *group;
+    pa_usec_t               start;
 
     pa_assert(u);
     pa_assert(data);
 
+    start = pa_policy_stats_start();
+
     if ((group_name = pa_classify_sink_input_by_data(u,data,&flags)) != NULL &&
         (group      = pa_policy_group_find(u, group_name)          ) != NULL ){
 
@@ -363,6 +471,7 @@ static pa_hook_result_t sink_input_neew(void *hook_data, void *call_data,
 
     }
 
+    pa_policy_stats_stop(u, pa_policy_stat_hook_sink_input_new, start);
 
     return PA_HOOK_OK;
 }
@@ -373,8 +482,11 @@ static pa_hook_result_t sink_input_put(void *hook_data, void *call_data,
 {
     struct pa_sink_input *sinp = (struct pa_sink_input *)call_data;
     struct userdata      *u    = (struct userdata *)slot_data;
+    pa_usec_t             start;
 
+    start = pa_policy_stats_start();
     handle_new_sink_input(u, sinp, NULL, NULL);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_sink_input_put, start);
 
     return PA_HOOK_OK;
 }
@@ -384,11 +496,14 @@ static pa_hook_result_t sink_input_fixate(void *hook_data, void *call_data,
 {
     pa_sink_input_new_data  *sinp_data = (pa_sink_input_new_data *) call_data;
     struct userdata         *u         = (struct userdata *) slot_data;
+    pa_usec_t                start;
 
     pa_assert(sinp_data);
     pa_assert(u);
 
+    start = pa_policy_stats_start();
     handle_sink_input_fixate(u, sinp_data);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_sink_input_fixate, start);
 
     return PA_HOOK_OK;
 }
@@ -398,8 +513,26 @@ static pa_hook_result_t sink_input_unlink(void *hook_data, void *call_data,
 {
     struct pa_sink_input *sinp = (struct pa_sink_input *)call_data;
     struct userdata      *u    = (struct userdata *)slot_data;
+    pa_usec_t             start;
 
+    start = pa_policy_stats_start();
     handle_removed_sink_input(u, sinp);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_sink_input_unlink, start);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_move_finish(void *hook_data, void *call_data,
+                                               void *slot_data)
+{
+    struct pa_sink_input     *sinp = (struct pa_sink_input *)call_data;
+    struct userdata          *u    = (struct userdata *)slot_data;
+    struct pa_sink_input_ext *ext;
+
+    if ((ext = pa_sink_input_ext_lookup(u, sinp)) && ext->local.mute_factor_moving) {
+        ext->local.mute_factor_moving = false;
+        mute_factor_apply(u, sinp, ext->local.mute_factor);
+    }
 
     return PA_HOOK_OK;
 }
@@ -479,6 +612,8 @@ static void handle_new_sink_input(struct userdata      *u,
 
         if (pa_hashmap_get(sinp->volume_factor_items, VOLUME_LIMIT_FACTOR_KEY))
             ext->local.volume_limit_enabled = true;
+        if (pa_hashmap_get(sinp->volume_factor_items, MUTE_FACTOR_KEY))
+            ext->local.mute_factor = true;
 
         idx  = sinp->index;
         sinp_name = sink_input_ext_get_name(sinp->proplist);
@@ -533,6 +668,8 @@ bool pa_sink_input_ext_cork(struct userdata *u, pa_sink_input *si, bool cork)
 
     pa_assert(!ext->local.ignore_cork_state_change);
 
+    pa_policy_stats_count(u, pa_policy_stat_cork);
+
     sink_input_corked = si->state == PA_SINK_INPUT_CORKED;
 
     pa_log_debug("sink input cork state before: user: %d policy: %d, request %scork",
@@ -602,6 +739,8 @@ bool pa_sink_input_ext_mute(struct userdata *u, pa_sink_input *si, bool mute)
     pa_assert(u);
     pa_assert(si);
 
+    pa_policy_stats_count(u, pa_policy_stat_mute);
+
     pa_sink_input_set_mute(si, mute, true);
 
 #elif (PULSEAUDIO_VERSION >= 6)
@@ -618,6 +757,8 @@ bool pa_sink_input_ext_mute(struct userdata *u, pa_sink_input *si, bool mute)
 
     pa_assert(!ext->local.ignore_mute_state_change);
 
+    pa_policy_stats_count(u, pa_policy_stat_mute);
+
     pa_log_debug("sink input mute state before: user: %d policy: %d, request %smute",
                  ext->local.mute_state & PA_SINK_INPUT_EXT_STATE_USER ? 1 : 0,
                  ext->local.mute_state & PA_SINK_INPUT_EXT_STATE_POLICY ? 1 : 0,
@@ -715,6 +856,15 @@ static void handle_sink_input_fixate(struct userdata *u,
          * and update our internal data structure. */
         pa_sink_input_new_data_add_volume_factor(sinp_data, VOLUME_LIMIT_FACTOR_KEY, &group_limit);
     }
+
+    /* join a group muted by factor already muted, not to let a burst out
+     * before the stream is put to the group */
+    if (group->mutebyfc && !(flags & PA_POLICY_LOCAL_ROUTE)) {
+        pa_log_debug("set stream '%s'/'%s' mute factor", group->name, sinp_name);
+
+        pa_cvolume_mute(&group_limit, sinp_data->channel_map.channels);
+        pa_sink_input_new_data_add_volume_factor(sinp_data, MUTE_FACTOR_KEY, &group_limit);
+    }
 }
 
 static void handle_removed_sink_input(struct userdata      *u,
@@ -754,6 +904,22 @@ static void handle_removed_sink_input(struct userdata      *u,
     }
 }
 
+static void reclassify_sink_input(struct userdata *u, struct pa_sink_input *sinp)
+{
+    struct pa_sink_input_ext *ext;
+    uint32_t              old_corked_state;
+    uint32_t              old_muted_state;
+    const char           *clear[3] = { PA_PROP_POLICY_GROUP, PA_PROP_POLICY_STREAM_FLAGS, NULL };
+
+    pa_assert_se((ext = pa_sink_input_ext_lookup(u, sinp)));
+    old_corked_state = ext->local.cork_state;
+    old_muted_state = ext->local.mute_state;
+    /* First remove sink input and then re-classify. */
+    handle_removed_sink_input(u, sinp);
+    pa_proplist_unset_many(sinp->proplist, clear);
+    handle_new_sink_input(u, sinp, &old_corked_state, &old_muted_state);
+}
+
 static uint32_t update_state_flag(uint32_t flags, enum pa_sink_input_ext_state flag, bool set)
 {
     if (set)
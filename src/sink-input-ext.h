@@ -8,15 +8,19 @@
 #include <pulsecore/sink-input.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/hashmap.h>
 
 
 #include "userdata.h"
 
+struct pa_classify_stream_diff;
+
 struct pa_sinp_evsubscr {
     pa_hook_slot    *neew;
     pa_hook_slot    *fixate;
     pa_hook_slot    *put;
     pa_hook_slot    *unlink;
+    pa_hook_slot    *move_finish;
     pa_hook_slot    *cork_state;
     pa_hook_slot    *mute_state;
 };
@@ -36,6 +40,8 @@ struct pa_sink_input_ext {
         uint32_t mute_state;
         bool ignore_mute_state_change;
         bool volume_limit_enabled;
+        bool mute_factor;       /* muted by a zero volume factor */
+        bool mute_factor_moving; /* to set mute_factor at move finish */
     }                local;     /* local policies */
 };
 
@@ -44,6 +50,9 @@ void  pa_sink_input_ext_subscription_free(struct pa_sinp_evsubscr *);
 void  pa_sink_input_ext_discover(struct userdata *);
 /* Go through all othermedia streams and re-classify them. */
 void  pa_sink_input_ext_rediscover(struct userdata *u);
+/* Re-classify the streams the reloaded stream definitions classify differently. */
+void  pa_sink_input_ext_reclassify(struct userdata *u,
+                                   struct pa_classify_stream_diff *diff);
 struct pa_sink_input_ext *pa_sink_input_ext_lookup(struct userdata *,
                                                    struct pa_sink_input *);
 int   pa_sink_input_ext_set_policy_group(struct pa_sink_input *, const char *);
@@ -51,6 +60,7 @@ const char *pa_sink_input_ext_get_policy_group(struct pa_sink_input *);
 const char *pa_sink_input_ext_get_name(struct pa_sink_input *);
 int   pa_sink_input_ext_set_volume_limit(struct userdata *u, struct pa_sink_input *, pa_volume_t);
 void  pa_sink_input_ext_unset_volume_limit(struct userdata *u, struct pa_sink_input *si);
+int   pa_sink_input_ext_set_mute_factor(struct userdata *u, struct pa_sink_input *, bool);
 bool pa_sink_input_ext_cork(struct userdata *u, pa_sink_input *si, bool cork);
 bool pa_sink_input_ext_mute(struct userdata *u, pa_sink_input *si, bool mute);
 
@@ -0,0 +1,669 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "sockif.h"
+#include "dbusif.h"
+#include "policy-group.h"
+#include "sink-ext.h"
+#include "source-ext.h"
+#include "context.h"
+#include "trace.h"
+
+#define FRAME_MAX   (64 * 1024)
+#define FRAME_BURST 8           /* frames handled per wakeup of a client */
+#define SOCKET_MODE 0600
+
+struct client {
+    PA_LLIST_FIELDS(struct client);
+    struct pa_policy_sockif *sockif;
+    int                      fd;
+    pa_io_event             *io;
+    pa_defer_event          *defer;     /* handles the frames left over */
+    char                    *buf;       /* length prefix and frame */
+    size_t                   len;       /* bytes in buf */
+    size_t                   size;      /* allocated */
+};
+
+struct pa_policy_sockif {
+    struct userdata         *userdata;
+    char                    *path;
+    int                      fd;
+    pa_io_event             *io;
+    PA_LLIST_HEAD(struct client, clients);
+};
+
+struct frame {                          /* decoding position in a frame */
+    const uint8_t           *p;
+    const uint8_t           *end;
+};
+
+struct action {
+    /* checks one entry of the action */
+    bool (*check)(struct frame *);
+    /* executes count entries, checked already; returns the status */
+    int  (*execute)(struct userdata *, struct frame *, unsigned);
+};
+
+static void accept_cb(pa_mainloop_api *, pa_io_event *, int,
+                      pa_io_event_flags_t, void *);
+static void client_cb(pa_mainloop_api *, pa_io_event *, int,
+                      pa_io_event_flags_t, void *);
+static void client_defer_cb(pa_mainloop_api *, pa_defer_event *, void *);
+static void client_free(struct client *);
+static bool peer_allowed(int);
+static int  client_frames(struct client *);
+static bool client_frame_ready(struct client *);
+static int  handle_frame(struct client *, const uint8_t *, uint32_t);
+static bool route_entry(struct frame *, struct pa_policy_route_decision *);
+static bool value_entry(struct frame *, const char **, uint8_t *, uint8_t);
+static bool pair_entry(struct frame *, const char **, const char **);
+static bool route_check(struct frame *);
+static bool volume_limit_check(struct frame *);
+static bool flag_check(struct frame *);
+static bool context_check(struct frame *);
+static int  route_action(struct userdata *, struct frame *, unsigned);
+static int  volume_limit_action(struct userdata *, struct frame *, unsigned);
+static int  cork_action(struct userdata *, struct frame *, unsigned);
+static int  mute_action(struct userdata *, struct frame *, unsigned);
+static int  context_action(struct userdata *, struct frame *, unsigned);
+static bool get_u8(struct frame *, uint8_t *);
+static bool get_u32(struct frame *, uint32_t *);
+static bool get_str(struct frame *, const char **);
+static void put_u32(uint8_t *, uint32_t);
+
+static const struct action actions[] = {
+    [pa_policy_sockif_route]        = { route_check,        route_action        },
+    [pa_policy_sockif_volume_limit] = { volume_limit_check, volume_limit_action },
+    [pa_policy_sockif_cork]         = { flag_check,         cork_action         },
+    [pa_policy_sockif_mute]         = { flag_check,         mute_action         },
+    [pa_policy_sockif_context]      = { context_check,      context_action      },
+};
+
+
+struct pa_policy_sockif *pa_policy_sockif_new(struct userdata *u,
+                                              const char *path)
+{
+    struct pa_policy_sockif *sockif;
+    struct sockaddr_un       addr;
+    struct stat              st;
+    int                      fd;
+
+    pa_assert(u);
+    pa_assert(path);
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        pa_log("policy socket path '%s' is too long", path);
+        return NULL;
+    }
+
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            pa_log("'%s' exists and is not a socket", path);
+            return NULL;
+        }
+
+        /* a previous instance may have left its socket behind */
+        unlink(path);
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        pa_log("can't create policy socket: %s", strerror(errno));
+        return NULL;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        pa_log("can't bind policy socket '%s': %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    /* nobody can connect before listen(), so the mode is set in time */
+    if (chmod(path, SOCKET_MODE) < 0 || listen(fd, 4) < 0) {
+        pa_log("can't listen on policy socket '%s': %s", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    sockif = pa_xnew0(struct pa_policy_sockif, 1);
+    sockif->userdata = u;
+    sockif->path     = pa_xstrdup(path);
+    sockif->fd       = fd;
+    sockif->io       = u->core->mainloop->io_new(u->core->mainloop, fd,
+                                                 PA_IO_EVENT_INPUT,
+                                                 accept_cb, sockif);
+    PA_LLIST_HEAD_INIT(struct client, sockif->clients);
+
+    pa_log_info("policy actions accepted on '%s'", path);
+
+    return sockif;
+}
+
+void pa_policy_sockif_free(struct pa_policy_sockif *sockif)
+{
+    if (sockif) {
+        while (sockif->clients)
+            client_free(sockif->clients);
+
+        if (sockif->io)
+            sockif->userdata->core->mainloop->io_free(sockif->io);
+
+        close(sockif->fd);
+        unlink(sockif->path);
+
+        pa_xfree(sockif->path);
+        pa_xfree(sockif);
+    }
+}
+
+
+static void accept_cb(pa_mainloop_api *api, pa_io_event *e, int fd,
+                      pa_io_event_flags_t events, void *userdata)
+{
+    struct pa_policy_sockif *sockif = userdata;
+    struct client           *client;
+    int                      cfd;
+
+    pa_assert(sockif);
+    pa_assert(sockif->io == e);
+
+    if ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            pa_log("can't accept policy client: %s", strerror(errno));
+        return;
+    }
+
+    if (!peer_allowed(cfd)) {
+        close(cfd);
+        return;
+    }
+
+    client = pa_xnew0(struct client, 1);
+    client->sockif = sockif;
+    client->fd     = cfd;
+    client->io     = api->io_new(api, cfd, PA_IO_EVENT_INPUT, client_cb, client);
+    client->defer  = api->defer_new(api, client_defer_cb, client);
+    api->defer_enable(client->defer, 0);
+
+    PA_LLIST_PREPEND(struct client, sockif->clients, client);
+
+    pa_log_debug("policy client connected");
+}
+
+/* One read per wakeup; client_frames() stops reading while frames are
+ * left over, so a busy client can't hold up the mainloop. */
+static void client_cb(pa_mainloop_api *api, pa_io_event *e, int fd,
+                      pa_io_event_flags_t events, void *userdata)
+{
+    struct client *client = userdata;
+    ssize_t        n;
+
+    pa_assert(client);
+    pa_assert(client->io == e);
+
+    if (client->size - client->len < 4096) {
+        client->size = client->size ? client->size * 2 : 8192;
+        client->buf  = pa_xrealloc(client->buf, client->size);
+    }
+
+    n = read(fd, client->buf + client->len, client->size - client->len);
+
+    if (n > 0) {
+        client->len += n;
+
+        if (client_frames(client) < 0)
+            client_free(client);
+
+        return;
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    if (n < 0)
+        pa_log("policy client read failed: %s", strerror(errno));
+    else
+        pa_log_debug("policy client disconnected");
+
+    client_free(client);
+}
+
+static void client_defer_cb(pa_mainloop_api *api, pa_defer_event *e,
+                            void *userdata)
+{
+    struct client *client = userdata;
+
+    pa_assert(client);
+    pa_assert(client->defer == e);
+
+    if (client_frames(client) < 0)
+        client_free(client);
+}
+
+/* The mode of the socket keeps others out already; this also covers a
+ * socket placed in a directory with looser permissions. */
+static bool peer_allowed(int fd)
+{
+    struct ucred cred;
+    socklen_t    len = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        pa_log("can't get the credentials of policy client: %s",
+               strerror(errno));
+        return false;
+    }
+
+    if (cred.uid != 0 && cred.uid != getuid()) {
+        pa_log("policy client of uid %u (pid %d) refused",
+               (unsigned)cred.uid, (int)cred.pid);
+        return false;
+    }
+
+    return true;
+}
+
+static void client_free(struct client *client)
+{
+    struct pa_policy_sockif *sockif = client->sockif;
+
+    PA_LLIST_REMOVE(struct client, sockif->clients, client);
+
+    if (client->io)
+        sockif->userdata->core->mainloop->io_free(client->io);
+
+    if (client->defer)
+        sockif->userdata->core->mainloop->defer_free(client->defer);
+
+    close(client->fd);
+    pa_xfree(client->buf);
+    pa_xfree(client);
+}
+
+/* Handle the complete frames in the buffer, at most FRAME_BURST of them.
+ * With more left the client is not read until the next mainloop
+ * iteration has handled them. Returns -1 if the client should be
+ * dropped. */
+static int client_frames(struct client *client)
+{
+    pa_mainloop_api *api = client->sockif->userdata->core->mainloop;
+    struct frame     prefix;
+    uint32_t         len;
+    size_t           offs = 0;
+    unsigned         n;
+    bool             more;
+
+    for (n = 0;  n < FRAME_BURST;  n++) {
+        if (client->len - offs < sizeof(len))
+            break;
+
+        prefix.p   = (const uint8_t *)client->buf + offs;
+        prefix.end = prefix.p + sizeof(len);
+        get_u32(&prefix, &len);
+
+        if (len == 0 || len > FRAME_MAX) {
+            pa_log("invalid frame from policy client (%u bytes)", len);
+            return -1;
+        }
+
+        if (client->len - offs - sizeof(len) < len)
+            break;
+
+        if (handle_frame(client, (const uint8_t *)client->buf + offs + sizeof(len),
+                         len) < 0)
+            return -1;
+
+        offs += sizeof(len) + len;
+    }
+
+    if (offs > 0) {
+        memmove(client->buf, client->buf + offs, client->len - offs);
+        client->len -= offs;
+    }
+
+    more = client_frame_ready(client);
+
+    api->defer_enable(client->defer, more);
+    api->io_enable(client->io, more ? PA_IO_EVENT_NULL : PA_IO_EVENT_INPUT);
+
+    return 0;
+}
+
+static bool client_frame_ready(struct client *client)
+{
+    struct frame prefix;
+    uint32_t     len;
+
+    if (client->len < sizeof(len))
+        return false;
+
+    prefix.p   = (const uint8_t *)client->buf;
+    prefix.end = prefix.p + sizeof(len);
+    get_u32(&prefix, &len);
+
+    /* an invalid length is reported when the frame is taken */
+    return len == 0 || len > FRAME_MAX || client->len - sizeof(len) >= len;
+}
+
+static int handle_frame(struct client *client, const uint8_t *frame,
+                        uint32_t len)
+{
+    struct userdata *u = client->sockif->userdata;
+    uint8_t          reply[8];
+    uint32_t         txid;
+    int              status;
+    pa_usec_t        start;
+
+    pa_policy_trace_write(u->trace, pa_policy_trace_frame, frame, len);
+
+    start  = pa_rtclock_now();
+    status = pa_policy_sockif_process_frame(u, frame, len, &txid);
+
+    pa_log_debug("policy actions from socket handled in %llu usec",
+                 (unsigned long long)(pa_rtclock_now() - start));
+
+    /* the framing is intact, so only the transaction fails */
+    if (status < 0) {
+        pa_log("malformed actions from policy client (txid:%u)", txid);
+        status = false;
+    }
+
+    if (txid == 0)
+        return 0;
+
+    put_u32(reply, txid);
+    put_u32(reply + 4, status);
+
+    if (send(client->fd, reply, sizeof(reply), MSG_NOSIGNAL | MSG_DONTWAIT) != sizeof(reply)) {
+        pa_log("can't reply to policy client: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int pa_policy_sockif_decode_frame(const uint8_t *data, uint32_t len,
+                                  uint32_t *txid_ret)
+{
+    struct frame frame = { .p = data, .end = data + len, };
+    uint8_t      code;
+    uint8_t      count;
+    int          ncmd = 0;
+
+    pa_assert(txid_ret);
+
+    if (!get_u32(&frame, txid_ret)) {
+        *txid_ret = 0;
+        return -1;
+    }
+
+    while (frame.p < frame.end) {
+        if (!get_u8(&frame, &code) || !get_u8(&frame, &count) || !count ||
+            code >= PA_ELEMENTSOF(actions) || !actions[code].check)
+            return -1;
+
+        for (ncmd += count;  count > 0;  count--) {
+            if (!actions[code].check(&frame))
+                return -1;
+        }
+    }
+
+    return ncmd;
+}
+
+int pa_policy_sockif_process_frame(struct userdata *u, const uint8_t *data,
+                                   uint32_t len, uint32_t *txid_ret)
+{
+    struct frame frame = { .p = data, .end = data + len, };
+    uint8_t      code;
+    uint8_t      count;
+    int          status = true;
+
+    pa_assert(u);
+    pa_assert(txid_ret);
+
+    /* nothing is executed of a frame that is malformed anywhere */
+    if (pa_policy_sockif_decode_frame(data, len, txid_ret) < 0)
+        return -1;
+
+    pa_log_debug("got actions from socket (txid:%u)", *txid_ret);
+
+    frame.p += sizeof(*txid_ret);
+
+    pa_policy_dbusif_actions_begin(u);
+
+    while (frame.p < frame.end) {
+        get_u8(&frame, &code);
+        get_u8(&frame, &count);
+
+        status &= actions[code].execute(u, &frame, count);
+    }
+
+    pa_policy_dbusif_actions_end(u);
+
+    return status;
+}
+
+
+/* The entries are decoded by the same functions when the frame is
+ * checked and when it is executed. */
+static bool route_entry(struct frame *frame, struct pa_policy_route_decision *d)
+{
+    const char *group;
+    uint8_t     class;
+
+    if (!get_u8(frame, &class) || class > 1 ||
+        !get_str(frame, &d->target) || !d->target[0] ||
+        !get_str(frame, &d->mode) ||
+        !get_str(frame, &d->hwid) ||
+        !get_str(frame, &group))
+        return false;
+
+    d->class = class ? pa_policy_route_to_source : pa_policy_route_to_sink;
+    d->group = group[0] ? group : NULL;
+
+    return true;
+}
+
+static bool value_entry(struct frame *frame, const char **name, uint8_t *value,
+                        uint8_t max)
+{
+    return get_str(frame, name) && get_u8(frame, value) && *value <= max;
+}
+
+static bool pair_entry(struct frame *frame, const char **a, const char **b)
+{
+    return get_str(frame, a) && get_str(frame, b);
+}
+
+static bool route_check(struct frame *frame)
+{
+    struct pa_policy_route_decision d;
+
+    return route_entry(frame, &d);
+}
+
+static bool volume_limit_check(struct frame *frame)
+{
+    const char *group;
+    uint8_t     limit;
+
+    return value_entry(frame, &group, &limit, 100);
+}
+
+static bool flag_check(struct frame *frame)
+{
+    const char *name;
+    uint8_t     flag;
+
+    return value_entry(frame, &name, &flag, 1);
+}
+
+static bool context_check(struct frame *frame)
+{
+    const char *variable;
+    const char *value;
+
+    return pair_entry(frame, &variable, &value);
+}
+
+
+static int route_action(struct userdata *u, struct frame *frame,
+                        unsigned count)
+{
+    struct pa_policy_route_decision *decisions;
+    unsigned                         i;
+    int                              result;
+
+    decisions = pa_xnew(struct pa_policy_route_decision, count);
+
+    for (i = 0;  i < count;  i++)
+        route_entry(frame, decisions + i);
+
+    result = pa_policy_dbusif_route(u, decisions, count);
+
+    pa_xfree(decisions);
+
+    return result;
+}
+
+static int volume_limit_action(struct userdata *u, struct frame *frame,
+                               unsigned count)
+{
+    const char *group;
+    uint8_t     limit;
+
+    while (count--) {
+        value_entry(frame, &group, &limit, 100);
+
+        pa_log_debug("volume limit (%s|%u)", group, limit);
+        pa_policy_group_volume_limit(u, group, limit);
+    }
+
+    pa_sink_ext_set_volumes(u);
+
+    return true;
+}
+
+static int cork_action(struct userdata *u, struct frame *frame, unsigned count)
+{
+    const char *group;
+    uint8_t     corked;
+
+    while (count--) {
+        value_entry(frame, &group, &corked, 1);
+
+        pa_log_debug("cork stream (%s|%u)", group, corked);
+        pa_policy_group_cork(u, group, corked);
+    }
+
+    return true;
+}
+
+static int mute_action(struct userdata *u, struct frame *frame, unsigned count)
+{
+    const char *device;
+    uint8_t     muted;
+
+    while (count--) {
+        value_entry(frame, &device, &muted, 1);
+
+        pa_log_debug("mute device (%s|%u)", device, muted);
+        pa_source_ext_set_mute(u, device, muted);
+    }
+
+    return true;
+}
+
+static int context_action(struct userdata *u, struct frame *frame,
+                          unsigned count)
+{
+    const char *variable;
+    const char *value;
+
+    while (count--) {
+        pair_entry(frame, &variable, &value);
+
+        pa_log_debug("context (%s|%s)", variable, value);
+        pa_policy_context_variable_changed(u, variable, value);
+    }
+
+    return true;
+}
+
+
+static bool get_u8(struct frame *frame, uint8_t *v)
+{
+    if (frame->end - frame->p < 1)
+        return false;
+
+    *v = *frame->p++;
+
+    return true;
+}
+
+static bool get_u32(struct frame *frame, uint32_t *v)
+{
+    const uint8_t *p = frame->p;
+
+    if (frame->end - p < 4)
+        return false;
+
+    *v = (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+         (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    frame->p += 4;
+
+    return true;
+}
+
+/* Strings are used in place; the encoding carries their terminator. */
+static bool get_str(struct frame *frame, const char **s)
+{
+    uint8_t len;
+
+    if (!get_u8(frame, &len) || frame->end - frame->p < len + 1 ||
+        frame->p[len] != '\0')
+        return false;
+
+    *s = (const char *)frame->p;
+    frame->p += len + 1;
+
+    return true;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,61 @@
+#ifndef foosockiffoo
+#define foosockiffoo
+
+#include <stdint.h>
+
+#include "userdata.h"
+
+/*
+ * Local Unix socket endpoint for policy actions. Only processes of the
+ * same user or root may connect. A client sends frames of a 32-bit
+ * length followed by the frame:
+ *
+ *   frame   = txid:u32 action...
+ *   action  = code:u8 count:u8 entry{count}
+ *   str     = len:u8 byte{len} '\0'
+ *
+ * with the entries of the actions by code:
+ *
+ *   1 route          class:u8 (0 sink, 1 source) device mode hwid group
+ *   2 volume_limit   group:str limit:u8 (0 - 100)
+ *   3 cork           group:str corked:u8
+ *   4 mute           device:str muted:u8
+ *   5 context        variable:str value:str
+ *
+ * The route arguments besides the class are strings; an empty mode or
+ * hwid is not applicable, an empty group means all groups. Integers are
+ * little endian. Each frame is answered with the transaction id and the
+ * status, two 32-bit words, unless the transaction id is 0. A frame is
+ * checked as a whole before any of its actions is executed; a malformed
+ * one is answered with status 0 and executes nothing.
+ */
+
+enum pa_policy_sockif_action {
+    pa_policy_sockif_route = 1,
+    pa_policy_sockif_volume_limit,
+    pa_policy_sockif_cork,
+    pa_policy_sockif_mute,
+    pa_policy_sockif_context,
+};
+
+struct pa_policy_sockif;
+
+struct pa_policy_sockif *pa_policy_sockif_new(struct userdata *, const char *);
+void pa_policy_sockif_free(struct pa_policy_sockif *);
+/* Executes the actions of a frame. Returns the status to report for the
+ * transaction, or -1 if the frame is malformed. */
+int  pa_policy_sockif_process_frame(struct userdata *, const uint8_t *,
+                                    uint32_t, uint32_t *);
+/* Checks a frame without executing it. Returns the number of commands,
+ * or -1 if the frame is malformed. */
+int  pa_policy_sockif_decode_frame(const uint8_t *, uint32_t, uint32_t *);
+
+#endif /* foosockiffoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
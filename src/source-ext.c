@@ -18,7 +18,11 @@
 #include "policy-group.h"
 #include "dbusif.h"
 #include "policy.h"
+#include "module-pool.h"
+#include "route-plan.h"
 #include "log.h"
+#include "stats.h"
+#include "probes.h"
 
 /* hooks */
 static pa_hook_result_t source_put(void *, void *, void *);
@@ -26,6 +30,7 @@ static pa_hook_result_t source_unlink(void *, void *, void *);
 
 static void handle_new_source(struct userdata *, struct pa_source *);
 static void handle_removed_source(struct userdata *, struct pa_source *);
+static bool source_hidden(struct userdata *, struct pa_source *);
 
 
 
@@ -88,8 +93,7 @@ const char *pa_source_ext_get_name(struct pa_source *source)
 
 int pa_source_ext_set_mute(struct userdata *u, const char *type, int mute)
 {
-    void              *state = NULL;
-    pa_idxset         *idxset;
+    struct pa_route_plan *plan;
     struct pa_source  *source;
     const char        *name;
     bool          current_mute;
@@ -97,26 +101,26 @@ int pa_source_ext_set_mute(struct userdata *u, const char *type, int mute)
     pa_assert(u);
     pa_assert(type);
     pa_assert(u->core);
-    pa_assert_se((idxset = u->core->sources));
 
-    while ((source = pa_idxset_iterate(idxset, &state, NULL)) != NULL) {
-        if (pa_classify_is_source_typeof(u, source, type, NULL)) {
-            name = pa_source_ext_get_name(source);
-            current_mute = pa_source_get_mute(source, 0);
+    pa_policy_stats_count(u, pa_policy_stat_mute);
 
-            if ((current_mute && mute) || (!current_mute && !mute)) {
-                pa_log_debug("%s() source '%s' type '%s' is already %smuted",
-                             __FUNCTION__, name, type, mute ? "" : "un");
-            }
-            else {
-                pa_log_debug("%s() %smute source '%s' type '%s'",
-                             __FUNCTION__, mute ? "" : "un", name, type);
+    if ((plan = pa_policy_route_plan_get(u, type)) &&
+        (source = plan->source) != NULL) {
+        name = pa_source_ext_get_name(source);
+        current_mute = pa_source_get_mute(source, 0);
 
-                pa_source_set_mute(source, mute, true);
-            }
+        if ((current_mute && mute) || (!current_mute && !mute)) {
+            pa_log_debug("%s() source '%s' type '%s' is already %smuted",
+                         __FUNCTION__, name, type, mute ? "" : "un");
+        }
+        else {
+            pa_log_debug("%s() %smute source '%s' type '%s'",
+                         __FUNCTION__, mute ? "" : "un", name, type);
 
-            return 0;
+            pa_source_set_mute(source, mute, true);
         }
+
+        return 0;
     }
 
 
@@ -127,53 +131,63 @@ int pa_source_ext_set_ports(struct userdata *u, const char *type)
 {
     int ret = 0;
     pa_source *source;
+    struct pa_route_plan *plan;
+    struct pa_route_plan_step *steps;
     struct pa_classify_device_data *data;
-    uint32_t idx;
+    const char *port;
+    uint32_t i, n;
 
     pa_assert(u);
     pa_assert(u->core);
 
     pa_classify_update_modules(u, PA_POLICY_MODULE_FOR_SOURCE, type);
 
-    PA_IDXSET_FOREACH(source, u->core->sources, idx) {
-        /* Check whether the port of this source should be changed. */
-        if (pa_classify_is_port_source_typeof(u, source, type, &data)) {
-            struct pa_classify_port_entry *port_entry;
-
-            pa_assert_se(port_entry = pa_classify_get_port_entry(data,
-                                                                 pa_policy_object_source,
-                                                                 source));
-
-            pa_classify_update_module(u, PA_POLICY_MODULE_FOR_SOURCE, data);
-
-            if (!source->active_port ||
-                    !pa_streq(port_entry->port_name,
-                              source->active_port->name)) {
-
-                if (pa_source_set_port(source, port_entry->port_name,
-                                       false) < 0) {
-                    ret = -1;
-                    pa_log("failed to set source '%s' port to '%s'",
-                           source->name, port_entry->port_name);
-                }
-                else {
-                    pa_log_debug("changed source '%s' port to '%s'",
-                                 source->name, port_entry->port_name);
-                }
-                continue;
+    /* The plan lists the sources of which port should be changed. */
+    plan = pa_policy_route_plan_get(u, type);
+    n = pa_policy_route_plan_copy_ports(plan ? plan->source_ports : NULL, &steps);
+
+    /* modules first, as they may bring or take away sources */
+    for (i = 0;  i < n;  i++)
+        pa_classify_update_module(u, PA_POLICY_MODULE_FOR_SOURCE, steps[i].data);
+
+    for (i = 0;  i < n;  i++) {
+        source = pa_idxset_get_by_index(u->core->sources, steps[i].index);
+        data   = steps[i].data;
+        port   = steps[i].port_name;
+
+        if (!source || !PA_SOURCE_IS_LINKED(source->state))
+            continue;
+
+        if (!source->active_port ||
+                !pa_streq(port, source->active_port->name)) {
+
+            PA_POLICY_PROBE3(source_set_port, source->index, source->name,
+                             port);
+
+            if (pa_source_set_port(source, port, false) < 0) {
+                ret = -1;
+                pa_log("failed to set source '%s' port to '%s'",
+                       source->name, port);
+            }
+            else {
+                pa_log_debug("changed source '%s' port to '%s'",
+                             source->name, port);
             }
+            continue;
+        }
 
-            if (data->flags & PA_POLICY_REFRESH_PORT_ALWAYS) {
-                if (source->set_port) {
-                    pa_log_debug("refresh source '%s' port to '%s'",
-                            source->name, port_entry->port_name);
-                    source->set_port(source, source->active_port);
-                }
-                continue;
+        if (data->flags & PA_POLICY_REFRESH_PORT_ALWAYS) {
+            if (source->set_port) {
+                pa_log_debug("refresh source '%s' port to '%s'",
+                        source->name, port);
+                source->set_port(source, source->active_port);
             }
+            continue;
         }
     }
 
+    pa_xfree(steps);
+
     return ret;
 }
 
@@ -182,8 +196,11 @@ static pa_hook_result_t source_put(void *hook_data, void *call_data,
 {
     struct pa_source  *source = (struct pa_source *)call_data;
     struct userdata *u    = (struct userdata *)slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_new_source(u, source);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_source_put, start);
 
     return PA_HOOK_OK;
 }
@@ -194,8 +211,11 @@ static pa_hook_result_t source_unlink(void *hook_data, void *call_data,
 {
     struct pa_source  *source = (struct pa_source *)call_data;
     struct userdata *u = (struct userdata *)slot_data;
+    pa_usec_t        start;
 
+    start = pa_policy_stats_start();
     handle_removed_source(u, source);
+    pa_policy_stats_stop(u, pa_policy_stat_hook_source_unlink, start);
 
     return PA_HOOK_OK;
 }
@@ -208,7 +228,7 @@ static void handle_new_source(struct userdata *u, struct pa_source *source)
     int              ret;
     struct pa_classify_result *r;
 
-    if (source && u) {
+    if (source && u && !source_hidden(u, source)) {
         name = pa_source_ext_get_name(source);
         idx  = source->index;
 
@@ -218,7 +238,7 @@ static void handle_new_source(struct userdata *u, struct pa_source *source)
                          "mute-by-route", name, idx);
         }
 
-        if (pa_policy_log_level_debug()) {
+        if (pa_policy_log_enabled(u, pa_policy_log_device)) {
             pa_classify_source(u, source, 0, 0, &r);
             buf = pa_policy_log_concat(r->types, r->count);
             ret = pa_proplist_sets(source->proplist,
@@ -239,6 +259,7 @@ static void handle_new_source(struct userdata *u, struct pa_source *source)
         pa_policy_groupset_update_default_source(u, PA_IDXSET_INVALID);
 #endif
         pa_policy_groupset_register_source(u, source);
+        pa_policy_route_plan_add_source(u, source);
 
         pa_classify_source(u, source, PA_POLICY_DISABLE_NOTIFY, 0, &r);
         pa_policy_send_device_state(u, PA_POLICY_CONNECTED, r);
@@ -256,7 +277,7 @@ static void handle_removed_source(struct userdata *u, struct pa_source *source)
     struct pa_null_source     *ns;
     struct pa_classify_result *r;
 
-    if (source && u) {
+    if (source && u && !source_hidden(u, source)) {
         name = pa_source_ext_get_name(source);
         idx  = source->index;
         ns   = u->nullsource;
@@ -270,7 +291,7 @@ static void handle_removed_source(struct userdata *u, struct pa_source *source)
         pa_policy_context_unregister(u, pa_policy_object_source,
                                      name, source, idx);
 
-        if (pa_policy_log_level_debug()) {
+        if (pa_policy_log_enabled(u, pa_policy_log_device)) {
             pa_classify_source(u, source, 0, 0, &r);
             buf = pa_policy_log_concat(r->types, r->count);
             pa_log_debug("remove source '%s' (idx=%d%s%s)",
@@ -283,6 +304,7 @@ static void handle_removed_source(struct userdata *u, struct pa_source *source)
         pa_policy_groupset_update_default_source(u, idx);
 #endif
         pa_policy_groupset_unregister_source(u, idx);
+        pa_policy_route_plan_remove_source(u, source);
 
         pa_classify_source(u, source, PA_POLICY_DISABLE_NOTIFY, 0, &r);
         pa_policy_send_device_state(u, PA_POLICY_DISCONNECTED, r);
@@ -312,6 +334,23 @@ void pa_source_ext_null_source_free(struct pa_null_source *null_source)
 
 
 
+/* A device of a module parked in the module pool is taken for gone. */
+void pa_source_ext_hide(struct userdata *u, struct pa_source *source)
+{
+    handle_removed_source(u, source);
+}
+
+void pa_source_ext_show(struct userdata *u, struct pa_source *source)
+{
+    handle_new_source(u, source);
+}
+
+static bool source_hidden(struct userdata *u, struct pa_source *source)
+{
+    return u->modpool && pa_policy_module_pool_hides(u->modpool, source);
+}
+
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -18,6 +18,8 @@ struct pa_source_evsubscr {
 struct pa_source_evsubscr *pa_source_ext_subscription(struct userdata *);
 void  pa_source_ext_subscription_free(struct pa_source_evsubscr *);
 void  pa_source_ext_discover(struct userdata *);
+void  pa_source_ext_hide(struct userdata *, struct pa_source *);
+void  pa_source_ext_show(struct userdata *, struct pa_source *);
 const char *pa_source_ext_get_name(struct pa_source *);
 int   pa_source_ext_set_mute(struct userdata *, const char *, int);
 int   pa_source_ext_set_ports(struct userdata *, const char *);
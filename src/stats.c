@@ -0,0 +1,244 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#if (PULSEAUDIO_VERSION >= 15)
+#include <pulse/def.h>
+#include <pulsecore/json.h>
+#include <pulsecore/message-handler.h>
+#endif
+
+#include "stats.h"
+#include "intern.h"
+
+#define STATS_OBJECT_PATH   "/modules/policy-enforcement"
+
+struct pa_policy_stats {
+    struct userdata    *userdata;
+    struct pa_policy_stat_value values[pa_policy_stat_max];
+};
+
+static const char *names[pa_policy_stat_max] = {
+    [pa_policy_stat_hook_sink_input_new]        = "hook.sink_input_new",
+    [pa_policy_stat_hook_sink_input_fixate]     = "hook.sink_input_fixate",
+    [pa_policy_stat_hook_sink_input_put]        = "hook.sink_input_put",
+    [pa_policy_stat_hook_sink_input_unlink]     = "hook.sink_input_unlink",
+    [pa_policy_stat_hook_sink_put]              = "hook.sink_put",
+    [pa_policy_stat_hook_sink_unlink]           = "hook.sink_unlink",
+    [pa_policy_stat_hook_source_put]            = "hook.source_put",
+    [pa_policy_stat_hook_source_unlink]         = "hook.source_unlink",
+    [pa_policy_stat_hook_card_put]              = "hook.card_put",
+    [pa_policy_stat_hook_card_unlink]           = "hook.card_unlink",
+    [pa_policy_stat_hook_card_profile_available]= "hook.card_profile_available",
+    [pa_policy_stat_hook_card_profile_changed]  = "hook.card_profile_changed",
+    [pa_policy_stat_classify]                   = "classify",
+    [pa_policy_stat_match]                      = "match",
+    [pa_policy_stat_stream_move]                = "stream.move",
+    [pa_policy_stat_cork]                       = "stream.cork",
+    [pa_policy_stat_cork_suppressed]            = "stream.cork_suppressed",
+    [pa_policy_stat_mute]                       = "stream.mute",
+    [pa_policy_stat_volume_limit]               = "stream.volume_limit",
+    [pa_policy_stat_dbus_in]                    = "dbus.in",
+    [pa_policy_stat_dbus_out]                   = "dbus.out",
+    [pa_policy_stat_shared_written]             = "shared.written",
+    [pa_policy_stat_shared_suppressed]          = "shared.suppressed",
+    [pa_policy_stat_port_queued]                = "port.queued",
+    [pa_policy_stat_port_executed]              = "port.executed",
+    [pa_policy_stat_port_elided]                = "port.elided",
+    [pa_policy_stat_module_pool]                = "module.pool_saved",
+    [pa_policy_stat_intern_strings]             = "intern.strings",
+    [pa_policy_stat_intern_bytes]               = "intern.bytes",
+};
+
+#if (PULSEAUDIO_VERSION >= 15)
+static int message_cb(const char *, const char *, const pa_json_object *,
+                      char **, void *);
+#endif
+
+
+struct pa_policy_stats *pa_policy_stats_new(struct userdata *u)
+{
+    struct pa_policy_stats *stats;
+
+    pa_assert(u);
+
+    stats = pa_xnew0(struct pa_policy_stats, 1);
+    stats->userdata = u;
+
+#if (PULSEAUDIO_VERSION >= 15)
+    pa_message_handler_register(u->core, STATS_OBJECT_PATH,
+                                "Policy enforcement statistics",
+                                message_cb, stats);
+#endif
+
+    return stats;
+}
+
+void pa_policy_stats_free(struct pa_policy_stats *stats)
+{
+    if (stats) {
+#if (PULSEAUDIO_VERSION >= 15)
+        pa_message_handler_unregister(stats->userdata->core, STATS_OBJECT_PATH);
+#endif
+        pa_xfree(stats);
+    }
+}
+
+void pa_policy_stats_count(struct userdata *u, enum pa_policy_stat stat)
+{
+    pa_assert(u);
+    pa_assert(stat < pa_policy_stat_max);
+
+    if (u->stats)
+        u->stats->values[stat].calls++;
+}
+
+pa_usec_t pa_policy_stats_start(void)
+{
+    return pa_rtclock_now();
+}
+
+void pa_policy_stats_stop(struct userdata *u, enum pa_policy_stat stat,
+                          pa_usec_t start)
+{
+    pa_policy_stats_add(u, stat, pa_rtclock_now() - start);
+}
+
+void pa_policy_stats_add(struct userdata *u, enum pa_policy_stat stat,
+                         pa_usec_t spent)
+{
+    struct pa_policy_stat_value *v;
+    unsigned                     bucket;
+
+    pa_assert(u);
+    pa_assert(stat < pa_policy_stat_max);
+
+    if (!u->stats)
+        return;
+
+    v     = u->stats->values + stat;
+
+    for (bucket = 0;  bucket < PA_POLICY_STATS_BUCKETS - 1;  bucket++) {
+        if (spent < (1ULL << bucket))
+            break;
+    }
+
+    v->calls++;
+    v->total += spent;
+    v->hist[bucket]++;
+
+    if (spent > v->max)
+        v->max = spent;
+}
+
+void pa_policy_stats_reset(struct userdata *u)
+{
+    pa_assert(u);
+    pa_assert(u->stats);
+
+    memset(u->stats->values, 0, sizeof(u->stats->values));
+
+    pa_log_info("statistics reset");
+}
+
+const char *pa_policy_stats_name(enum pa_policy_stat stat)
+{
+    pa_assert(stat < pa_policy_stat_max);
+
+    return names[stat];
+}
+
+const struct pa_policy_stat_value *pa_policy_stats_value(struct userdata *u,
+                                                         enum pa_policy_stat stat)
+{
+    struct pa_policy_stat_value *values;
+
+    pa_assert(u);
+    pa_assert(u->stats);
+    pa_assert(stat < pa_policy_stat_max);
+
+    values = u->stats->values;
+
+    if (stat == pa_policy_stat_intern_strings)
+        values[stat].value = pa_policy_intern_count();
+    else if (stat == pa_policy_stat_intern_bytes)
+        values[stat].value = pa_policy_intern_size();
+
+    return values + stat;
+}
+
+
+#if (PULSEAUDIO_VERSION >= 15)
+/*
+ * 'get-stats' returns an array of objects with the name, calls, total,
+ * max, histogram and gauge value of each entry; 'reset-stats' clears
+ * all the counters.
+ */
+static int message_cb(const char *path, const char *message,
+                      const pa_json_object *parameters, char **response,
+                      void *userdata)
+{
+    struct pa_policy_stats            *stats = userdata;
+    struct userdata                   *u;
+    const struct pa_policy_stat_value *v;
+    pa_json_encoder                   *encoder;
+    unsigned                           i, j;
+
+    pa_assert(stats);
+    pa_assert_se((u = stats->userdata));
+    pa_assert(message);
+    pa_assert(response);
+
+    if (pa_streq(message, "reset-stats")) {
+        pa_policy_stats_reset(u);
+        return PA_OK;
+    }
+
+    if (!pa_streq(message, "get-stats"))
+        return -PA_ERR_NOTIMPLEMENTED;
+
+    encoder = pa_json_encoder_new();
+    pa_json_encoder_begin_element_array(encoder);
+
+    for (i = 0;  i < pa_policy_stat_max;  i++) {
+        v = pa_policy_stats_value(u, i);
+
+        pa_json_encoder_begin_element_object(encoder);
+        pa_json_encoder_add_member_string(encoder, "name", names[i]);
+        pa_json_encoder_add_member_int(encoder, "calls", v->calls);
+        pa_json_encoder_add_member_int(encoder, "total", v->total);
+        pa_json_encoder_add_member_int(encoder, "max", v->max);
+
+        pa_json_encoder_begin_member_array(encoder, "histogram");
+        for (j = 0;  j < PA_POLICY_STATS_BUCKETS;  j++)
+            pa_json_encoder_add_element_int(encoder, v->hist[j]);
+        pa_json_encoder_end_array(encoder);
+
+        pa_json_encoder_add_member_int(encoder, "value", v->value);
+        pa_json_encoder_end_object(encoder);
+    }
+
+    pa_json_encoder_end_array(encoder);
+
+    *response = pa_json_encoder_to_string_free(encoder);
+
+    return PA_OK;
+}
+#endif
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
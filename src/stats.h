@@ -0,0 +1,88 @@
+#ifndef foopolicystatsfoo
+#define foopolicystatsfoo
+
+#include <stdint.h>
+
+#include <pulse/sample.h>
+
+#include "userdata.h"
+
+/*
+ * Counters of what the module does: hook invocations with the time spent
+ * in them, classifications, matcher evaluations, stream operations,
+ * D-Bus traffic and shared data writes. Timed counters keep a histogram
+ * of the durations with power of two buckets in microseconds. The
+ * counters are always on and can be read and reset over D-Bus and the
+ * PulseAudio message API.
+ * 'module.pool_saved' times the module loads saved by the module pool.
+ * The 'intern.*' entries are not counters but gauges of the string intern
+ * pool; their current value is in 'value' and the other fields are 0.
+ */
+
+#define PA_POLICY_STATS_BUCKETS 12  /* < 1us, < 2us, ... >= 1024us */
+
+enum pa_policy_stat {
+    pa_policy_stat_hook_sink_input_new = 0,
+    pa_policy_stat_hook_sink_input_fixate,
+    pa_policy_stat_hook_sink_input_put,
+    pa_policy_stat_hook_sink_input_unlink,
+    pa_policy_stat_hook_sink_put,
+    pa_policy_stat_hook_sink_unlink,
+    pa_policy_stat_hook_source_put,
+    pa_policy_stat_hook_source_unlink,
+    pa_policy_stat_hook_card_put,
+    pa_policy_stat_hook_card_unlink,
+    pa_policy_stat_hook_card_profile_available,
+    pa_policy_stat_hook_card_profile_changed,
+    pa_policy_stat_classify,
+    pa_policy_stat_match,
+    pa_policy_stat_stream_move,
+    pa_policy_stat_cork,
+    pa_policy_stat_cork_suppressed,
+    pa_policy_stat_mute,
+    pa_policy_stat_volume_limit,
+    pa_policy_stat_dbus_in,
+    pa_policy_stat_dbus_out,
+    pa_policy_stat_shared_written,  /* shared data writes passed on */
+    pa_policy_stat_shared_suppressed, /* identical writes dropped */
+    pa_policy_stat_port_queued,     /* delayed port changes requested */
+    pa_policy_stat_port_executed,   /* delayed port changes applied */
+    pa_policy_stat_port_elided,     /* replaced or cancelled before applied */
+    pa_policy_stat_module_pool,
+    pa_policy_stat_intern_strings,  /* gauge: strings in the intern pool */
+    pa_policy_stat_intern_bytes,    /* gauge: their size */
+    pa_policy_stat_max
+};
+
+struct pa_policy_stat_value {
+    uint64_t            calls;
+    uint64_t            total;      /* usec, timed counters only */
+    uint64_t            max;
+    uint64_t            hist[PA_POLICY_STATS_BUCKETS];
+    uint64_t            value;      /* gauges only */
+};
+
+struct pa_policy_stats;
+
+struct pa_policy_stats *pa_policy_stats_new(struct userdata *);
+void pa_policy_stats_free(struct pa_policy_stats *);
+
+void pa_policy_stats_count(struct userdata *, enum pa_policy_stat);
+pa_usec_t pa_policy_stats_start(void);
+void pa_policy_stats_stop(struct userdata *, enum pa_policy_stat, pa_usec_t);
+void pa_policy_stats_add(struct userdata *, enum pa_policy_stat, pa_usec_t);
+void pa_policy_stats_reset(struct userdata *);
+
+const char *pa_policy_stats_name(enum pa_policy_stat);
+const struct pa_policy_stat_value *pa_policy_stats_value(struct userdata *,
+                                                         enum pa_policy_stat);
+
+#endif /* foopolicystatsfoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,246 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "trace.h"
+
+/*
+ * The file starts with the magic and the version, every record with its
+ * time (64 bits), type and data length (32 bits each) followed by the
+ * data. All integers are little endian, so that a trace recorded on the
+ * device can be replayed anywhere.
+ */
+#define TRACE_MAGIC     "PAPT"
+#define TRACE_VERSION   2
+#define TRACE_HDR_LEN   8
+#define TRACE_REC_LEN   16
+#define TRACE_DATA_MAX  (1024 * 1024)  /* sanity limit for loading */
+#define TRACE_BUFSIZ    (64 * 1024)    /* records are written in chunks */
+
+struct pa_policy_trace {
+    char      *path;
+    FILE      *f;
+    char      *buf;                    /* stdio buffer of f */
+    pa_usec_t  start;
+    unsigned   nrecord;
+};
+
+static void put_u32(uint8_t *, uint32_t);
+static void put_u64(uint8_t *, uint64_t);
+static uint32_t get_u32(const uint8_t *);
+static uint64_t get_u64(const uint8_t *);
+
+
+struct pa_policy_trace *pa_policy_trace_open(const char *path)
+{
+    struct pa_policy_trace *trace;
+    uint8_t                 hdr[TRACE_HDR_LEN];
+    char                   *buf;
+    FILE                   *f;
+
+    pa_assert(path);
+
+    if ((f = fopen(path, "we")) == NULL) {
+        pa_log_error("can't create policy trace '%s': %s", path, strerror(errno));
+        return NULL;
+    }
+
+    buf = pa_xmalloc(TRACE_BUFSIZ);
+    setvbuf(f, buf, _IOFBF, TRACE_BUFSIZ);
+
+    memcpy(hdr, TRACE_MAGIC, 4);
+    put_u32(hdr + 4, TRACE_VERSION);
+
+    if (fwrite(hdr, sizeof(hdr), 1, f) != 1 || fflush(f) != 0) {
+        pa_log_error("can't write policy trace '%s': %s", path, strerror(errno));
+        fclose(f);
+        pa_xfree(buf);
+        return NULL;
+    }
+
+    trace = pa_xnew0(struct pa_policy_trace, 1);
+    trace->path  = pa_xstrdup(path);
+    trace->f     = f;
+    trace->buf   = buf;
+    trace->start = pa_rtclock_now();
+
+    pa_log_info("recording policy trace to '%s'", path);
+
+    return trace;
+}
+
+void pa_policy_trace_close(struct pa_policy_trace *trace)
+{
+    if (trace) {
+        if (trace->f) {
+            if (fclose(trace->f) != 0)
+                pa_log("can't write policy trace '%s': %s",
+                       trace->path, strerror(errno));
+            else
+                pa_log_info("policy trace '%s' closed (%u records)",
+                            trace->path, trace->nrecord);
+        }
+
+        pa_xfree(trace->buf);
+        pa_xfree(trace->path);
+        pa_xfree(trace);
+    }
+}
+
+void pa_policy_trace_write(struct pa_policy_trace *trace,
+                           enum pa_policy_trace_type type,
+                           const void *data, uint32_t len)
+{
+    uint8_t rec[TRACE_REC_LEN];
+
+    if (!trace || !trace->f)
+        return;
+
+    put_u64(rec, pa_rtclock_now() - trace->start);
+    put_u32(rec + 8, type);
+    put_u32(rec + 12, len);
+
+    /* the records reach the file when the buffer fills up and at close */
+    if (fwrite(rec, sizeof(rec), 1, trace->f) != 1 ||
+        (len && fwrite(data, len, 1, trace->f) != 1))
+    {
+        /* a truncated trace is still usable up to the failure */
+        pa_log("can't write policy trace '%s': %s; recording stopped",
+               trace->path, strerror(errno));
+        fclose(trace->f);
+        trace->f = NULL;
+        return;
+    }
+
+    trace->nrecord++;
+}
+
+void pa_policy_trace_event(struct userdata *u, enum pa_policy_trace_type type,
+                           const char *name)
+{
+    pa_assert(u);
+
+    if (u->trace && name)
+        pa_policy_trace_write(u->trace, type, name, strlen(name) + 1);
+}
+
+int pa_policy_trace_load(const char *path,
+                         struct pa_policy_trace_record **records_ret,
+                         unsigned *nrecord_ret)
+{
+    struct pa_policy_trace_record *records = NULL;
+    uint8_t                        hdr[TRACE_HDR_LEN];
+    uint8_t                        rec[TRACE_REC_LEN];
+    uint32_t                       len;
+    unsigned                       nrecord = 0;
+    unsigned                       arecord = 0;
+    FILE                          *f;
+
+    pa_assert(path);
+    pa_assert(records_ret);
+    pa_assert(nrecord_ret);
+
+    if ((f = fopen(path, "re")) == NULL) {
+        pa_log("can't open policy trace '%s': %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr, TRACE_MAGIC, 4) ||
+        get_u32(hdr + 4) != TRACE_VERSION)
+    {
+        pa_log("'%s' is not a policy trace of version %u", path, TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+
+    while (fread(rec, sizeof(rec), 1, f) == 1) {
+        len = get_u32(rec + 12);
+
+        if (len > TRACE_DATA_MAX) {
+            pa_log("policy trace '%s' is corrupted", path);
+            break;
+        }
+
+        if (nrecord >= arecord) {
+            arecord = arecord ? arecord * 2 : 64;
+            records = pa_xrenew(struct pa_policy_trace_record, records, arecord);
+        }
+
+        records[nrecord].time = get_u64(rec);
+        records[nrecord].type = get_u32(rec + 8);
+        records[nrecord].len  = len;
+        records[nrecord].data = pa_xmalloc(len + 1);
+        records[nrecord].data[len] = '\0';
+
+        if (len && fread(records[nrecord].data, len, 1, f) != 1) {
+            pa_log_info("policy trace '%s' is truncated", path);
+            pa_xfree(records[nrecord].data);
+            break;
+        }
+
+        nrecord++;
+    }
+
+    fclose(f);
+
+    *records_ret = records;
+    *nrecord_ret = nrecord;
+
+    return 0;
+}
+
+void pa_policy_trace_records_free(struct pa_policy_trace_record *records,
+                                  unsigned nrecord)
+{
+    unsigned i;
+
+    for (i = 0;  i < nrecord;  i++)
+        pa_xfree(records[i].data);
+
+    pa_xfree(records);
+}
+
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
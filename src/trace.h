@@ -0,0 +1,52 @@
+#ifndef footracefoo
+#define footracefoo
+
+#include <stdint.h>
+
+#include "userdata.h"
+
+/*
+ * Trace of the policy input of the module: the D-Bus messages of the
+ * policy daemon, the frames of the policy socket and the appearance and removal of sinks and cards, with
+ * the time they arrived. A trace can be replayed to another instance
+ * of the module to reproduce what happened.
+ */
+
+enum pa_policy_trace_type {
+    pa_policy_trace_message = 1,   /* marshalled D-Bus message */
+    pa_policy_trace_sink_put,      /* name of the sink */
+    pa_policy_trace_sink_unlink,
+    pa_policy_trace_card_put,      /* name of the card */
+    pa_policy_trace_card_unlink,
+    pa_policy_trace_frame,         /* frame of the policy socket */
+};
+
+struct pa_policy_trace_record {
+    pa_usec_t                   time;   /* since the start of the trace */
+    enum pa_policy_trace_type   type;
+    uint32_t                    len;
+    char                       *data;
+};
+
+struct pa_policy_trace;
+
+struct pa_policy_trace *pa_policy_trace_open(const char *);
+void pa_policy_trace_close(struct pa_policy_trace *);
+void pa_policy_trace_write(struct pa_policy_trace *, enum pa_policy_trace_type,
+                           const void *, uint32_t);
+void pa_policy_trace_event(struct userdata *, enum pa_policy_trace_type,
+                           const char *);
+
+int  pa_policy_trace_load(const char *, struct pa_policy_trace_record **,
+                          unsigned *);
+void pa_policy_trace_records_free(struct pa_policy_trace_record *, unsigned);
+
+#endif /* footracefoo */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -30,6 +30,13 @@ struct pa_policy_context;
 struct pa_policy_dbusif;
 struct pa_policy_variable;
 struct pa_sink_ext_data;
+struct pa_policy_route_plans;
+struct pa_policy_config;
+struct pa_policy_reload;
+struct pa_policy_trace;
+struct pa_policy_sockif;
+struct pa_policy_stats;
+struct pa_policy_module_pool;
 
 struct userdata {
     pa_core                   *core;
@@ -51,7 +58,15 @@ struct userdata {
     struct pa_policy_dbusif   *dbusif;
     struct pa_policy_variable *vars;
     struct pa_sink_ext_data   *sinkext;
-    pa_shared_data            *shared;   /* for forwarding context etc properties */
+    pa_shared_data            *shared;   /* context etc properties, see forward.h */
+    struct pa_policy_route_plans *plans; /* precomputed routes per device type */
+    struct pa_policy_config   *config;   /* loaded config, if kept for reload */
+    struct pa_policy_reload   *reload;   /* config file watch */
+    struct pa_policy_trace    *trace;    /* recording of the policy input */
+    struct pa_policy_sockif   *sockif;   /* local socket for policy actions */
+    struct pa_policy_stats    *stats;    /* counters readable by clients */
+    struct pa_policy_module_pool *modpool; /* warm device modules, if any */
+    uint32_t                   logcats;  /* enabled debug log categories */
 };
 
 
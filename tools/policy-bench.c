@@ -0,0 +1,929 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <pulse/proplist.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/card.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/log.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+
+#include "policy-host.h"
+#include "config-file.h"
+#include "classify.h"
+#include "policy-group.h"
+#include "dbusif.h"
+#include "sockif.h"
+#include "trace.h"
+#include "log.h"
+
+/*
+ * Microbenchmarks of the policy hot paths, run on the policy host of
+ * the tools with a generated configuration. The sinks, cards and sink
+ * inputs are stand-ins that carry what the classification and the
+ * groups look at: an index, a name, a proplist and the card profiles.
+ * The churn rounds unlink the sinks and cards through the core hooks,
+ * so every round classifies them cold first and cached then. With a
+ * recorded policy trace the decoding of its audio_actions messages is
+ * measured as well.
+ *
+ * The same policy transaction is decoded from an audio_actions message
+ * and from a frame of the policy socket, to compare the two interfaces.
+ * The bus daemon hop and the socket I/O are not part of it, as they need
+ * a running bus and a peer.
+ *
+ * The app id updates run with all the debug log categories off and on.
+ * The log level is error either way, so the messages are dropped and
+ * the difference is what building them costs.
+ *
+ * Every benchmark reports the time and the number of heap allocations
+ * per operation. The allocations are counted by wrapping malloc() and
+ * friends, which needs glibc.
+ */
+
+#define BENCH_GROUPS      8
+
+#define DEFAULT_RULES     100
+#define DEFAULT_STREAMS   64
+#define DEFAULT_CHURN     100
+
+struct bench {
+    struct userdata        *u;
+    uint32_t                nrule;
+    uint32_t                nstream;
+    uint32_t                nchurn;
+    pa_sink               **sinks;
+    pa_card               **cards;
+    pa_sink_input_new_data *data;
+    pa_sink_input         **sinps;
+    const char            **groups;  /* classification of the sink inputs */
+};
+
+struct measure {
+    const char *name;
+    uint64_t    ops;
+    uint64_t    nsec;
+    uint64_t    allocs;
+    uint64_t    start;
+    uint64_t    start_allocs;
+};
+
+static uint64_t nalloc;
+
+static uint64_t now_ns(void);
+static void measure_init(struct measure *, const char *);
+static void measure_begin(struct measure *);
+static void measure_end(struct measure *, uint64_t);
+static void measure_print(struct measure *);
+
+static int  config_write(const char *, uint32_t);
+static void objects_create(struct bench *);
+static void objects_destroy(struct bench *);
+static pa_card_profile *profile_new(const char *);
+static void profile_free(void *);
+
+static void bench_streams(struct bench *);
+static void bench_sinks(struct bench *);
+static void bench_cards(struct bench *);
+static void bench_groups(struct bench *);
+static void bench_log(struct bench *);
+static void bench_app_ids(struct bench *, uint32_t, const char *);
+static int  bench_decode(struct bench *, const char *);
+static void bench_transport(struct bench *);
+static DBusMessage *transaction_message(void);
+static uint8_t *transaction_frame(uint32_t *);
+
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&nalloc, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __atomic_add_fetch(&nalloc, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&nalloc, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-r rules] [-s streams] [-c churn] [-t trace]\n"
+            "  -r n   stream, device and card rules in the config "
+            "(default %u)\n"
+            "  -s n   sinks, cards and sink inputs (default %u)\n"
+            "  -c n   rounds over all of them (default %u)\n"
+            "  -t f   decode the policy actions recorded in trace f\n",
+            prog, DEFAULT_RULES, DEFAULT_STREAMS, DEFAULT_CHURN);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench bench;
+    char         dir[] = "/tmp/policy-bench.XXXXXX";
+    char        *cfgfile;
+    const char  *tracefile = NULL;
+    int          opt;
+    int          ret = 1;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.nrule   = DEFAULT_RULES;
+    bench.nstream = DEFAULT_STREAMS;
+    bench.nchurn  = DEFAULT_CHURN;
+
+    while ((opt = getopt(argc, argv, "r:s:c:t:h")) != -1) {
+        switch (opt) {
+        case 'r':  bench.nrule   = strtoul(optarg, NULL, 10);  break;
+        case 's':  bench.nstream = strtoul(optarg, NULL, 10);  break;
+        case 'c':  bench.nchurn  = strtoul(optarg, NULL, 10);  break;
+        case 't':  tracefile     = optarg;                     break;
+        default:   usage(argv[0]);                             return 2;
+        }
+    }
+
+    if (optind != argc || !bench.nrule || !bench.nstream || !bench.nchurn) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    pa_log_set_ident("policy-bench");
+    pa_log_set_target(pa_log_target_new(PA_LOG_STDERR, NULL));
+    pa_log_set_level(PA_LOG_ERROR);
+
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "can't create a directory for the config: %s\n",
+                strerror(errno));
+        return 1;
+    }
+
+    /* the name must not end in .conf, as the directory is scanned too */
+    cfgfile = pa_sprintf_malloc("%s/bench.policy", dir);
+
+    if (config_write(cfgfile, bench.nrule) < 0)
+        goto out;
+
+    if (!(bench.u = pa_policy_host_new(0))) {
+        fprintf(stderr, "failed to set up the policy\n");
+        goto out;
+    }
+
+    if (!pa_policy_parse_config_files(bench.u, cfgfile, dir, NULL, false))
+        goto out;
+
+    if (!pa_policy_group_find(bench.u, PA_POLICY_DEFAULT_GROUP_NAME))
+        pa_policy_groupset_create_default_group(bench.u, NULL);
+
+    printf("%u rules, %u streams, %u rounds\n",
+           bench.nrule, bench.nstream, bench.nchurn);
+
+    objects_create(&bench);
+
+    bench_streams(&bench);
+    bench_sinks(&bench);
+    bench_cards(&bench);
+    bench_groups(&bench);
+    bench_log(&bench);
+
+    objects_destroy(&bench);
+
+    bench_transport(&bench);
+
+    if (tracefile && bench_decode(&bench, tracefile) < 0)
+        goto out;
+
+    ret = 0;
+
+ out:
+    pa_policy_host_free(bench.u);
+    unlink(cfgfile);
+    rmdir(dir);
+    pa_xfree(cfgfile);
+
+    return ret;
+}
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void measure_init(struct measure *m, const char *name)
+{
+    memset(m, 0, sizeof(*m));
+    m->name = name;
+}
+
+static void measure_begin(struct measure *m)
+{
+    m->start_allocs = __atomic_load_n(&nalloc, __ATOMIC_RELAXED);
+    m->start = now_ns();
+}
+
+static void measure_end(struct measure *m, uint64_t ops)
+{
+    m->nsec   += now_ns() - m->start;
+    m->allocs += __atomic_load_n(&nalloc, __ATOMIC_RELAXED) - m->start_allocs;
+    m->ops    += ops;
+}
+
+static void measure_print(struct measure *m)
+{
+    if (!m->ops)
+        return;
+
+#ifdef __GLIBC__
+    printf("%-24s %10llu ops %10.1f ns/op %8.2f allocs/op\n", m->name,
+           (unsigned long long)m->ops, (double)m->nsec / m->ops,
+           (double)m->allocs / m->ops);
+#else
+    printf("%-24s %10llu ops %10.1f ns/op\n", m->name,
+           (unsigned long long)m->ops, (double)m->nsec / m->ops);
+#endif
+}
+
+
+/* Rule i matches the objects named or with the media name ending in i,
+ * so an object with a higher number goes through more rules. */
+static int config_write(const char *path, uint32_t nrule)
+{
+    FILE     *f;
+    uint32_t  i;
+
+    if (!(f = fopen(path, "w"))) {
+        fprintf(stderr, "can't create '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    for (i = 0;  i < BENCH_GROUPS;  i++)
+        fprintf(f, "[group]\nname = group%u\nflags = client\n\n", i);
+
+    for (i = 0;  i < nrule;  i++) {
+        fprintf(f, "[device]\ntype = type%u\nsink = equals:bench.sink%u\n\n",
+                i, i);
+        fprintf(f, "[card]\ntype = type%u\nname = equals:bench.card%u\n"
+                "profile = profile%u\n\n", i, i, i);
+        fprintf(f, "[stream]\nproperty = " PA_PROP_MEDIA_NAME
+                "@equals:bench.stream%u\ngroup = group%u\n\n",
+                i, i % BENCH_GROUPS);
+    }
+
+    if (fclose(f) != 0) {
+        fprintf(stderr, "can't write '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void objects_create(struct bench *b)
+{
+    pa_card_profile *prof;
+    uint32_t         i;
+    uint32_t         n;
+
+    b->sinks  = pa_xnew0(pa_sink *, b->nstream);
+    b->cards  = pa_xnew0(pa_card *, b->nstream);
+    b->data   = pa_xnew0(pa_sink_input_new_data, b->nstream);
+    b->sinps  = pa_xnew0(pa_sink_input *, b->nstream);
+    b->groups = pa_xnew0(const char *, b->nstream);
+
+    for (i = 0;  i < b->nstream;  i++) {
+        n = i % b->nrule;
+
+        b->sinks[i] = pa_xnew0(pa_sink, 1);
+        b->sinks[i]->index = i;
+        b->sinks[i]->name = pa_sprintf_malloc("bench.sink%u", n);
+        b->sinks[i]->proplist = pa_proplist_new();
+
+        b->cards[i] = pa_xnew0(pa_card, 1);
+        b->cards[i]->index = i;
+        b->cards[i]->name = pa_sprintf_malloc("bench.card%u", n);
+        b->cards[i]->proplist = pa_proplist_new();
+        b->cards[i]->profiles = pa_hashmap_new_full(pa_idxset_string_hash_func,
+                                                    pa_idxset_string_compare_func,
+                                                    NULL, profile_free);
+        prof = profile_new(pa_sprintf_malloc("profile%u", n));
+        pa_hashmap_put(b->cards[i]->profiles, prof->name, prof);
+
+        b->data[i].proplist = pa_proplist_new();
+        pa_proplist_setf(b->data[i].proplist, PA_PROP_MEDIA_NAME,
+                         "bench.stream%u", n);
+
+        b->sinps[i] = pa_xnew0(pa_sink_input, 1);
+        b->sinps[i]->index = i;
+        b->sinps[i]->proplist = pa_proplist_copy(b->data[i].proplist);
+    }
+}
+
+static void objects_destroy(struct bench *b)
+{
+    pa_core  *core = b->u->core;
+    uint32_t  i;
+
+    for (i = 0;  i < b->nstream;  i++) {
+        pa_hook_fire(&core->hooks[PA_CORE_HOOK_SINK_UNLINK_POST], b->sinks[i]);
+        pa_proplist_free(b->sinks[i]->proplist);
+        pa_xfree(b->sinks[i]->name);
+        pa_xfree(b->sinks[i]);
+
+        pa_hook_fire(&core->hooks[PA_CORE_HOOK_CARD_UNLINK], b->cards[i]);
+        pa_hashmap_free(b->cards[i]->profiles);
+        pa_proplist_free(b->cards[i]->proplist);
+        pa_xfree(b->cards[i]->name);
+        pa_xfree(b->cards[i]);
+
+        pa_proplist_free(b->data[i].proplist);
+
+        pa_proplist_free(b->sinps[i]->proplist);
+        pa_xfree(b->sinps[i]);
+    }
+
+    pa_xfree(b->sinks);
+    pa_xfree(b->cards);
+    pa_xfree(b->data);
+    pa_xfree(b->sinps);
+    pa_xfree(b->groups);
+}
+
+/* takes the ownership of the name */
+static pa_card_profile *profile_new(const char *name)
+{
+    pa_card_profile *prof;
+
+    prof = pa_xnew0(pa_card_profile, 1);
+    prof->name = (char *)name;
+    prof->available = PA_AVAILABLE_UNKNOWN;
+
+    return prof;
+}
+
+static void profile_free(void *p)
+{
+    pa_card_profile *prof = p;
+
+    pa_xfree(prof->name);
+    pa_xfree(prof);
+}
+
+
+/* a policy transaction of a call setup */
+static const struct {
+    const char *type, *device, *mode, *hwid;
+} transaction_routes[] = {
+    { "sink",   "earpiece",   "na", "na" },
+    { "source", "microphone", "na", "na" },
+};
+
+static const struct {
+    const char *group;
+    int32_t     limit;
+} transaction_limits[] = {
+    { "player",    0   },
+    { "ringtone",  0   },
+    { "navigator", 50  },
+    { "call",      100 },
+};
+
+static const struct {
+    const char *group;
+    bool        corked;
+} transaction_corks[] = {
+    { "player",      true  },
+    { "videoeditor", true  },
+};
+
+static const struct {
+    const char *variable, *value;
+} transaction_contexts[] = {
+    { "call",         "active"  },
+    { "emergency",    "off"     },
+};
+
+static void bench_streams(struct bench *b)
+{
+    struct measure m;
+    uint32_t       flags;
+    uint32_t       r, i;
+
+    measure_init(&m, "classify sink input");
+
+    for (r = 0;  r < b->nchurn;  r++) {
+        measure_begin(&m);
+
+        for (i = 0;  i < b->nstream;  i++)
+            b->groups[i] = pa_classify_sink_input_by_data(b->u, b->data + i, &flags);
+
+        measure_end(&m, b->nstream);
+    }
+
+    measure_print(&m);
+}
+
+static void bench_sinks(struct bench *b)
+{
+    struct pa_classify_result *result;
+    struct measure             cold;
+    struct measure             warm;
+    pa_core                   *core = b->u->core;
+    uint32_t                   r, i;
+
+    measure_init(&cold, "classify sink (cold)");
+    measure_init(&warm, "classify sink (cached)");
+
+    for (r = 0;  r < b->nchurn;  r++) {
+        measure_begin(&cold);
+
+        for (i = 0;  i < b->nstream;  i++) {
+            pa_classify_sink(b->u, b->sinks[i], 0, 0, &result);
+            pa_xfree(result);
+        }
+
+        measure_end(&cold, b->nstream);
+        measure_begin(&warm);
+
+        for (i = 0;  i < b->nstream;  i++) {
+            pa_classify_sink(b->u, b->sinks[i], 0, 0, &result);
+            pa_xfree(result);
+        }
+
+        measure_end(&warm, b->nstream);
+
+        for (i = 0;  i < b->nstream;  i++)
+            pa_hook_fire(&core->hooks[PA_CORE_HOOK_SINK_UNLINK_POST], b->sinks[i]);
+    }
+
+    measure_print(&cold);
+    measure_print(&warm);
+}
+
+static void bench_cards(struct bench *b)
+{
+    struct pa_classify_result *result;
+    struct measure             cold;
+    struct measure             warm;
+    pa_core                   *core = b->u->core;
+    uint32_t                   r, i;
+
+    measure_init(&cold, "classify card (cold)");
+    measure_init(&warm, "classify card (cached)");
+
+    for (r = 0;  r < b->nchurn;  r++) {
+        measure_begin(&cold);
+
+        for (i = 0;  i < b->nstream;  i++) {
+            pa_classify_card(b->u, b->cards[i], 0, 0, false, &result);
+            pa_xfree(result);
+        }
+
+        measure_end(&cold, b->nstream);
+        measure_begin(&warm);
+
+        for (i = 0;  i < b->nstream;  i++) {
+            pa_classify_card(b->u, b->cards[i], 0, 0, false, &result);
+            pa_xfree(result);
+        }
+
+        measure_end(&warm, b->nstream);
+
+        for (i = 0;  i < b->nstream;  i++)
+            pa_hook_fire(&core->hooks[PA_CORE_HOOK_CARD_UNLINK], b->cards[i]);
+    }
+
+    measure_print(&cold);
+    measure_print(&warm);
+}
+
+/* the sink inputs are removed in the order they were inserted, which
+ * is the longest walk of the member lists */
+static void bench_groups(struct bench *b)
+{
+    struct measure ins;
+    struct measure rem;
+    uint32_t       r, i;
+
+    measure_init(&ins, "group insert sink input");
+    measure_init(&rem, "group remove sink input");
+
+    for (r = 0;  r < b->nchurn;  r++) {
+        measure_begin(&ins);
+
+        for (i = 0;  i < b->nstream;  i++)
+            pa_policy_group_insert_sink_input(b->u, b->groups[i], b->sinps[i], 0);
+
+        measure_end(&ins, b->nstream);
+        measure_begin(&rem);
+
+        for (i = 0;  i < b->nstream;  i++)
+            pa_policy_group_remove_sink_input(b->u, b->sinps[i]->index);
+
+        measure_end(&rem, b->nstream);
+    }
+
+    measure_print(&ins);
+    measure_print(&rem);
+}
+
+static void bench_log(struct bench *b)
+{
+    uint32_t logcats = b->u->logcats;
+
+    bench_app_ids(b, 0, "app id update (log off)");
+    bench_app_ids(b, PA_POLICY_LOG_ALL, "app id update (log all)");
+
+    b->u->logcats = logcats;
+}
+
+/* every round moves the app ids to another group */
+static void bench_app_ids(struct bench *b, uint32_t logcats, const char *name)
+{
+    struct measure   m;
+    char           **app_ids;
+    char            *groups[BENCH_GROUPS];
+    uint32_t         r, i;
+
+    b->u->logcats = logcats;
+
+    app_ids = pa_xnew0(char *, b->nstream);
+
+    for (i = 0;  i < b->nstream;  i++)
+        app_ids[i] = pa_sprintf_malloc("bench.app%u", i);
+
+    for (i = 0;  i < BENCH_GROUPS;  i++)
+        groups[i] = pa_sprintf_malloc("group%u", i);
+
+    /* the first registration adds the app ids, the rounds update them */
+    for (i = 0;  i < b->nstream;  i++) {
+        pa_classify_register_app_id(b->u, app_ids[i], PA_PROP_MEDIA_ROLE,
+                                    pa_method_equals, "music", groups[0]);
+    }
+
+    measure_init(&m, name);
+
+    for (r = 0;  r < b->nchurn;  r++) {
+        measure_begin(&m);
+
+        for (i = 0;  i < b->nstream;  i++) {
+            pa_classify_register_app_id(b->u, app_ids[i], PA_PROP_MEDIA_ROLE,
+                                        pa_method_equals, "music",
+                                        groups[(r + 1) % BENCH_GROUPS]);
+        }
+
+        measure_end(&m, b->nstream);
+    }
+
+    measure_print(&m);
+
+    for (i = 0;  i < b->nstream;  i++) {
+        pa_classify_unregister_app_id(b->u, app_ids[i], PA_PROP_MEDIA_ROLE,
+                                      pa_method_equals, "music");
+        pa_xfree(app_ids[i]);
+    }
+
+    for (i = 0;  i < BENCH_GROUPS;  i++)
+        pa_xfree(groups[i]);
+
+    pa_xfree(app_ids);
+}
+
+/* The messages are demarshalled from the trace for every round, as the
+ * module gets them from the bus, and then walked through without being
+ * executed. */
+static int bench_decode(struct bench *b, const char *path)
+{
+    struct pa_policy_trace_record  *recs;
+    struct pa_policy_trace_record **acts;
+    DBusMessage                   **msgs;
+    DBusMessage                    *msg;
+    DBusError                       error;
+    struct measure                  demarshal;
+    struct measure                  decode;
+    unsigned                        nrec;
+    unsigned                        nact = 0;
+    uint64_t                        ncmd = 0;
+    unsigned                        i;
+    uint32_t                        r;
+    int                             n;
+
+    if (pa_policy_trace_load(path, &recs, &nrec) < 0)
+        return -1;
+
+    acts = pa_xnew0(struct pa_policy_trace_record *, nrec);
+    msgs = pa_xnew0(DBusMessage *, nrec);
+
+    dbus_error_init(&error);
+
+    for (i = 0;  i < nrec;  i++) {
+        if (recs[i].type != pa_policy_trace_message)
+            continue;
+
+        if (!(msg = dbus_message_demarshal(recs[i].data, recs[i].len, &error))) {
+            fprintf(stderr, "invalid message in '%s': %s\n", path, error.message);
+            dbus_error_free(&error);
+            continue;
+        }
+
+        if ((n = pa_policy_dbusif_decode_actions(msg)) >= 0) {
+            acts[nact++] = recs + i;
+            ncmd += n;
+        }
+
+        dbus_message_unref(msg);
+    }
+
+    printf("%u of %u trace records are policy actions with %llu commands\n",
+           nact, nrec, (unsigned long long)ncmd);
+
+    measure_init(&demarshal, "demarshal actions");
+    measure_init(&decode, "decode actions");
+
+    for (r = 0;  nact && r < b->nchurn;  r++) {
+        measure_begin(&demarshal);
+
+        for (i = 0;  i < nact;  i++)
+            msgs[i] = dbus_message_demarshal(acts[i]->data, acts[i]->len, NULL);
+
+        measure_end(&demarshal, nact);
+        measure_begin(&decode);
+
+        for (i = 0;  i < nact;  i++)
+            pa_policy_dbusif_decode_actions(msgs[i]);
+
+        measure_end(&decode, nact);
+
+        for (i = 0;  i < nact;  i++)
+            dbus_message_unref(msgs[i]);
+    }
+
+    measure_print(&demarshal);
+    measure_print(&decode);
+
+    pa_xfree(msgs);
+    pa_xfree(acts);
+    pa_policy_trace_records_free(recs, nrec);
+
+    return 0;
+}
+
+/* The message is demarshalled for every round, as the module gets it
+ * from the bus; the frame is used in place. */
+static void bench_transport(struct bench *b)
+{
+    DBusMessage   *msg;
+    DBusMessage   *copy;
+    char          *marshalled;
+    int            msglen;
+    uint8_t       *frame;
+    uint32_t       framelen;
+    uint32_t       txid;
+    struct measure dbus;
+    struct measure sock;
+    uint32_t       r;
+    unsigned       i;
+
+    msg   = transaction_message();
+    frame = transaction_frame(&framelen);
+
+    if (!dbus_message_marshal(msg, &marshalled, &msglen)) {
+        fprintf(stderr, "can't marshal the policy actions\n");
+        goto out;
+    }
+
+    printf("transaction of %d commands: %d bytes on D-Bus, %u on the socket\n",
+           pa_policy_dbusif_decode_actions(msg), msglen, framelen);
+
+    measure_init(&dbus, "decode D-Bus actions");
+    measure_init(&sock, "decode socket frame");
+
+    for (r = 0;  r < b->nchurn;  r++) {
+        measure_begin(&dbus);
+
+        for (i = 0;  i < b->nstream;  i++) {
+            copy = dbus_message_demarshal(marshalled, msglen, NULL);
+            pa_policy_dbusif_decode_actions(copy);
+            dbus_message_unref(copy);
+        }
+
+        measure_end(&dbus, b->nstream);
+        measure_begin(&sock);
+
+        for (i = 0;  i < b->nstream;  i++)
+            pa_policy_sockif_decode_frame(frame, framelen, &txid);
+
+        measure_end(&sock, b->nstream);
+    }
+
+    measure_print(&dbus);
+    measure_print(&sock);
+
+    dbus_free(marshalled);
+
+ out:
+    dbus_message_unref(msg);
+    pa_xfree(frame);
+}
+
+static void message_action_open(DBusMessageIter *arr, DBusMessageIter *ent,
+                                DBusMessageIter *cmds, const char *name)
+{
+    dbus_message_iter_open_container(arr, DBUS_TYPE_DICT_ENTRY, NULL, ent);
+    dbus_message_iter_append_basic(ent, DBUS_TYPE_STRING, &name);
+    dbus_message_iter_open_container(ent, DBUS_TYPE_ARRAY, "a(sv)", cmds);
+}
+
+static void message_action_close(DBusMessageIter *arr, DBusMessageIter *ent,
+                                 DBusMessageIter *cmds)
+{
+    dbus_message_iter_close_container(ent, cmds);
+    dbus_message_iter_close_container(arr, ent);
+}
+
+static void message_arg(DBusMessageIter *cmd, const char *name, int type,
+                        const void *value)
+{
+    DBusMessageIter st;
+    DBusMessageIter var;
+    char            sig[2] = { (char)type, '\0' };
+
+    dbus_message_iter_open_container(cmd, DBUS_TYPE_STRUCT, NULL, &st);
+    dbus_message_iter_append_basic(&st, DBUS_TYPE_STRING, &name);
+    dbus_message_iter_open_container(&st, DBUS_TYPE_VARIANT, sig, &var);
+    dbus_message_iter_append_basic(&var, type, value);
+    dbus_message_iter_close_container(&st, &var);
+    dbus_message_iter_close_container(cmd, &st);
+}
+
+static DBusMessage *transaction_message(void)
+{
+    DBusMessage     *msg;
+    DBusMessageIter  it, arr, ent, cmds, cmd;
+    dbus_uint32_t    txid = 1;
+    const char      *s;
+    unsigned         i;
+
+    msg = dbus_message_new_signal("/com/nokia/policy/decision",
+                                  "com.nokia.policy", "audio_actions");
+
+    dbus_message_iter_init_append(msg, &it);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &txid);
+    dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "{saa(sv)}", &arr);
+
+    message_action_open(&arr, &ent, &cmds, "com.nokia.policy.audio_route");
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_routes);  i++) {
+        dbus_message_iter_open_container(&cmds, DBUS_TYPE_ARRAY, "(sv)", &cmd);
+        message_arg(&cmd, "type",   DBUS_TYPE_STRING, &transaction_routes[i].type);
+        message_arg(&cmd, "device", DBUS_TYPE_STRING, &transaction_routes[i].device);
+        message_arg(&cmd, "mode",   DBUS_TYPE_STRING, &transaction_routes[i].mode);
+        message_arg(&cmd, "hwid",   DBUS_TYPE_STRING, &transaction_routes[i].hwid);
+        dbus_message_iter_close_container(&cmds, &cmd);
+    }
+    message_action_close(&arr, &ent, &cmds);
+
+    message_action_open(&arr, &ent, &cmds, "com.nokia.policy.volume_limit");
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_limits);  i++) {
+        dbus_message_iter_open_container(&cmds, DBUS_TYPE_ARRAY, "(sv)", &cmd);
+        message_arg(&cmd, "group", DBUS_TYPE_STRING, &transaction_limits[i].group);
+        message_arg(&cmd, "limit", DBUS_TYPE_INT32,  &transaction_limits[i].limit);
+        dbus_message_iter_close_container(&cmds, &cmd);
+    }
+    message_action_close(&arr, &ent, &cmds);
+
+    message_action_open(&arr, &ent, &cmds, "com.nokia.policy.audio_cork");
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_corks);  i++) {
+        s = transaction_corks[i].corked ? "corked" : "uncorked";
+        dbus_message_iter_open_container(&cmds, DBUS_TYPE_ARRAY, "(sv)", &cmd);
+        message_arg(&cmd, "group", DBUS_TYPE_STRING, &transaction_corks[i].group);
+        message_arg(&cmd, "cork",  DBUS_TYPE_STRING, &s);
+        dbus_message_iter_close_container(&cmds, &cmd);
+    }
+    message_action_close(&arr, &ent, &cmds);
+
+    message_action_open(&arr, &ent, &cmds, "com.nokia.policy.context");
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_contexts);  i++) {
+        dbus_message_iter_open_container(&cmds, DBUS_TYPE_ARRAY, "(sv)", &cmd);
+        message_arg(&cmd, "variable", DBUS_TYPE_STRING, &transaction_contexts[i].variable);
+        message_arg(&cmd, "value",    DBUS_TYPE_STRING, &transaction_contexts[i].value);
+        dbus_message_iter_close_container(&cmds, &cmd);
+    }
+    message_action_close(&arr, &ent, &cmds);
+
+    dbus_message_iter_close_container(&it, &arr);
+
+    return msg;
+}
+
+struct frame_buf {
+    uint8_t *data;
+    uint32_t len;
+    uint32_t size;
+};
+
+static void frame_put(struct frame_buf *buf, const void *data, uint32_t len)
+{
+    if (buf->len + len > buf->size) {
+        buf->size = (buf->len + len) * 2;
+        buf->data = pa_xrealloc(buf->data, buf->size);
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void frame_u8(struct frame_buf *buf, uint8_t v)
+{
+    frame_put(buf, &v, 1);
+}
+
+static void frame_str(struct frame_buf *buf, const char *s)
+{
+    /* "na" of the D-Bus encoding is an empty string on the socket */
+    if (pa_streq(s, "na"))
+        s = "";
+
+    frame_u8(buf, strlen(s));
+    frame_put(buf, s, strlen(s) + 1);
+}
+
+/* The frame carries the same transaction as transaction_message(). */
+static uint8_t *transaction_frame(uint32_t *len)
+{
+    static const uint8_t txid[4] = { 1, 0, 0, 0 };
+    struct frame_buf buf = { NULL, 0, 0 };
+    unsigned         i;
+
+    frame_put(&buf, txid, sizeof(txid));
+
+    frame_u8(&buf, pa_policy_sockif_route);
+    frame_u8(&buf, PA_ELEMENTSOF(transaction_routes));
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_routes);  i++) {
+        frame_u8(&buf, pa_streq(transaction_routes[i].type, "source"));
+        frame_str(&buf, transaction_routes[i].device);
+        frame_str(&buf, transaction_routes[i].mode);
+        frame_str(&buf, transaction_routes[i].hwid);
+        frame_str(&buf, "");
+    }
+
+    frame_u8(&buf, pa_policy_sockif_volume_limit);
+    frame_u8(&buf, PA_ELEMENTSOF(transaction_limits));
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_limits);  i++) {
+        frame_str(&buf, transaction_limits[i].group);
+        frame_u8(&buf, transaction_limits[i].limit);
+    }
+
+    frame_u8(&buf, pa_policy_sockif_cork);
+    frame_u8(&buf, PA_ELEMENTSOF(transaction_corks));
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_corks);  i++) {
+        frame_str(&buf, transaction_corks[i].group);
+        frame_u8(&buf, transaction_corks[i].corked);
+    }
+
+    frame_u8(&buf, pa_policy_sockif_context);
+    frame_u8(&buf, PA_ELEMENTSOF(transaction_contexts));
+    for (i = 0;  i < PA_ELEMENTSOF(transaction_contexts);  i++) {
+        frame_str(&buf, transaction_contexts[i].variable);
+        frame_str(&buf, transaction_contexts[i].value);
+    }
+
+    *len = buf.len;
+
+    return buf.data;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
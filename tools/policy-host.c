@@ -0,0 +1,133 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/mainloop.h>
+#include <pulse/proplist.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/module.h>
+#include <meego/shared-data.h>
+
+#include "policy-host.h"
+#include "index-hash.h"
+#include "policy-group.h"
+#include "classify.h"
+#include "context.h"
+#include "sink-ext.h"
+#include "source-ext.h"
+#include "variable.h"
+#include "route-plan.h"
+#include "config-file.h"
+#include "intern.h"
+
+static pa_mainloop *mainloop;
+
+
+struct userdata *pa_policy_host_new(uint32_t logcats)
+{
+    struct userdata *u;
+    pa_core         *core;
+    pa_module       *m;
+
+    pa_assert(!mainloop);
+
+    if (!(mainloop = pa_mainloop_new()))
+        return NULL;
+
+    if (!(core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0))) {
+        pa_mainloop_free(mainloop);
+        mainloop = NULL;
+        return NULL;
+    }
+
+    m = pa_xnew0(pa_module, 1);
+    m->core     = core;
+    m->name     = pa_xstrdup("module-policy-enforcement");
+    m->index    = PA_IDXSET_INVALID;
+    m->proplist = pa_proplist_new();
+
+    u = pa_xnew0(struct userdata, 1);
+    m->userdata = u;
+
+    pa_policy_intern_init();
+
+    u->core     = core;
+    u->module   = m;
+    u->logcats  = logcats;
+    u->nullsink = pa_sink_ext_init_null_sink(NULL);
+    u->nullsource= pa_source_ext_init_null_source(NULL);
+    u->hsnk     = pa_index_hash_init(8);
+    u->hsi      = pa_index_hash_init(10);
+    u->groups   = pa_policy_groupset_new(u);
+    u->classify = pa_classify_new(u);
+    u->context  = pa_policy_context_new(u);
+    u->vars     = pa_policy_var_init();
+    u->sinkext  = pa_sink_ext_new(u);
+    u->shared   = pa_shared_data_get(core);
+    u->plans    = pa_policy_route_plans_new(u);
+
+    if (u->groups == NULL || u->classify == NULL || u->context == NULL ||
+        u->shared == NULL) {
+        pa_policy_host_free(u);
+        return NULL;
+    }
+
+    pa_policy_groupset_update_default_sink(u, PA_IDXSET_INVALID);
+
+    return u;
+}
+
+void pa_policy_host_free(struct userdata *u)
+{
+    pa_module *m;
+    pa_core   *core;
+
+    if (!u)
+        return;
+
+    m    = u->module;
+    core = u->core;
+
+    pa_policy_config_free(u->config);
+    pa_policy_var_done(u->vars);
+    pa_sink_ext_free(u->sinkext);
+    pa_policy_route_plans_free(u->plans);
+
+    if (u->groups)
+        pa_policy_groupset_free(u->groups);
+
+    pa_classify_free(u);
+    pa_policy_context_free(u->context);
+    pa_index_hash_free(u->hsnk);
+    pa_index_hash_free(u->hsi);
+    pa_sink_ext_null_sink_free(u->nullsink);
+    pa_source_ext_null_source_free(u->nullsource);
+
+    if (u->shared)
+        pa_shared_data_unref(u->shared);
+
+    pa_policy_intern_done();
+
+    pa_xfree(u);
+
+    pa_proplist_free(m->proplist);
+    pa_xfree(m->name);
+    pa_xfree(m);
+
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,33 @@
+#ifndef foopolicyhostfoo
+#define foopolicyhostfoo
+
+#include <stdint.h>
+
+#include "userdata.h"
+
+/*
+ * A policy userdata outside of the daemon, for the offline tools. The
+ * core is a real pa_core on its own mainloop, without any devices or
+ * clients, and the module is a stand-in. Only the parts of the policy
+ * that work without the daemon are set up: there are no event
+ * subscriptions, no D-Bus interface, no socket and no config reload.
+ *
+ * The tools link the installed libpulsecore rather than stubs of it. The
+ * policy code uses hashmaps, idxsets, proplists, hooks, time events and
+ * the module API, so stubs would cover most of pulsecore and drift from
+ * the version the module is built for. A build host that can build the
+ * module already has the library.
+ */
+
+struct userdata *pa_policy_host_new(uint32_t logcats);
+void pa_policy_host_free(struct userdata *);
+
+#endif
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,89 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+
+#include "policy-host.h"
+#include "config-file.h"
+#include "lint.h"
+
+/*
+ * Checks a policy configuration offline, with the parser and the checks
+ * of the module. Exits with 0 if the configuration loads cleanly, 1 if
+ * it loads with lint warnings and 2 if it does not load at all.
+ */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-v] [-d configdir] config_file\n"
+            "  -d dir   directory of the additional config files "
+            "(default: as the module)\n"
+            "  -v       log the debug messages of the parser\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct userdata *u;
+    char            *cfgfile;
+    const char      *cfgdir = NULL;
+    bool             verbose = false;
+    int              opt;
+    int              nwarn;
+
+    while ((opt = getopt(argc, argv, "d:vh")) != -1) {
+        switch (opt) {
+        case 'd':  cfgdir  = optarg;  break;
+        case 'v':  verbose = true;    break;
+        default:   usage(argv[0]);    return 2;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    pa_log_set_ident("policy-lint");
+    pa_log_set_target(pa_log_target_new(PA_LOG_STDERR, NULL));
+    pa_log_set_level(verbose ? PA_LOG_DEBUG : PA_LOG_INFO);
+
+    if (!(u = pa_policy_host_new(0))) {
+        fprintf(stderr, "failed to set up the policy\n");
+        return 2;
+    }
+
+    /* the module looks for a relative path in the config directory
+     * of the daemon, here it is relative to the working directory */
+    cfgfile = pa_make_path_absolute(argv[optind]);
+
+    if (!pa_policy_parse_config_files(u, cfgfile, cfgdir, NULL, false))
+        nwarn = -1;
+    else
+        nwarn = pa_policy_lint(u);
+
+    pa_policy_host_free(u);
+    pa_xfree(cfgfile);
+
+    if (nwarn < 0)
+        return 2;
+
+    return nwarn ? 1 : 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */